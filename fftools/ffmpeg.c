@@ -69,6 +69,7 @@
 #endif
 
 #include "libavutil/bprint.h"
+#include "libavutil/buffer.h"
 #include "libavutil/dict.h"
 #include "libavutil/mem.h"
 #include "libavutil/time.h"
@@ -140,6 +141,9 @@ static atomic_int transcode_init_done = 0;
 static volatile int ffmpeg_exited = 0;
 static int64_t copy_ts_first_pts = AV_NOPTS_VALUE;
 
+/* FrameData is attached to every packet and frame, so recycle it */
+static AVBufferPool *frame_data_pool;
+
 static void
 sigterm_handler(int sig)
 {
@@ -334,15 +338,19 @@ static void ffmpeg_cleanup(int ret)
                    av_err2str(AVERROR(errno)));
     }
     av_freep(&vstats_filename);
+    av_freep(&sched_stats_filename);
     of_enc_stats_close();
 
     hw_device_free_all();
 
     av_freep(&filter_nbthreads);
+    av_freep(&filter_complex_affinity);
 
     av_freep(&input_files);
     av_freep(&output_files);
 
+    av_buffer_pool_uninit(&frame_data_pool);
+
     uninit_opts();
 
     avformat_network_deinit();
@@ -398,6 +406,22 @@ static void frame_data_free(void *opaque, uint8_t *data)
     av_free(data);
 }
 
+static AVBufferRef *frame_data_alloc(void *opaque, size_t size)
+{
+    AVBufferRef *buf;
+    FrameData *fd;
+
+    fd = av_mallocz(size);
+    if (!fd)
+        return NULL;
+
+    buf = av_buffer_create((uint8_t *)fd, size, frame_data_free, NULL, 0);
+    if (!buf)
+        av_freep(&fd);
+
+    return buf;
+}
+
 static int frame_data_ensure(AVBufferRef **dst, int writable)
 {
     AVBufferRef *src = *dst;
@@ -405,17 +429,16 @@ static int frame_data_ensure(AVBufferRef **dst, int writable)
     if (!src || (writable && !av_buffer_is_writable(src))) {
         FrameData *fd;
 
-        fd = av_mallocz(sizeof(*fd));
-        if (!fd)
-            return AVERROR(ENOMEM);
-
-        *dst = av_buffer_create((uint8_t *)fd, sizeof(*fd),
-                                frame_data_free, NULL, 0);
+        *dst = av_buffer_pool_get(frame_data_pool);
         if (!*dst) {
             av_buffer_unref(&src);
-            av_freep(&fd);
             return AVERROR(ENOMEM);
         }
+        fd = (FrameData *)(*dst)->data;
+
+        // a recycled FrameData may still carry its previous user's parameters
+        avcodec_parameters_free(&fd->par_enc);
+        memset(fd, 0, sizeof(*fd));
 
         if (src) {
             const FrameData *fd_src = (const FrameData *)src->data;
@@ -545,7 +568,8 @@ void update_benchmark(const char *fmt, ...)
     }
 }
 
-static void print_report(int is_last_report, int64_t timer_start, int64_t cur_time, int64_t pts)
+static void print_report(Scheduler *sch, int is_last_report,
+                         int64_t timer_start, int64_t cur_time, int64_t pts)
 {
     AVBPrint buf, buf_script;
     int64_t total_size = of_filesize(output_files[0]);
@@ -681,6 +705,8 @@ static void print_report(int is_last_report, int64_t timer_start, int64_t cur_ti
     av_bprint_finalize(&buf, NULL);
 
     if (progress_avio) {
+        if (sched_stats_filename)
+            sch_stats_print(sch, &buf_script, SCH_STATS_PROGRESS);
         av_bprintf(&buf_script, "progress=%s\n",
                    is_last_report ? "end" : "continue");
         avio_write(progress_avio, buf_script.str,
@@ -849,6 +875,33 @@ static int check_keyboard_interaction(int64_t cur_time)
     return 0;
 }
 
+static void write_sched_stats(Scheduler *sch)
+{
+    AVIOContext *pb;
+    AVBPrint bp;
+    int ret;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    sch_stats_print(sch, &bp, SCH_STATS_JSON);
+    if (!av_bprint_is_complete(&bp)) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    ret = avio_open2(&pb, sched_stats_filename, AVIO_FLAG_WRITE, &int_cb, NULL);
+    if (ret < 0)
+        goto fail;
+
+    avio_write(pb, bp.str, bp.len);
+    ret = avio_closep(&pb);
+
+fail:
+    if (ret < 0)
+        av_log(NULL, AV_LOG_ERROR, "Error writing scheduling statistics to '%s': %s\n",
+               sched_stats_filename, av_err2str(ret));
+    av_bprint_finalize(&bp, NULL);
+}
+
 /*
  * The following code is the main loop of the file converter
  */
@@ -880,7 +933,7 @@ static int transcode(Scheduler *sch)
                 break;
 
         /* dump report by using the output first video and audio streams */
-        print_report(0, timer_start, cur_time, transcode_ts);
+        print_report(sch, 0, timer_start, cur_time, transcode_ts);
     }
 
     ret = sch_stop(sch, &transcode_ts);
@@ -894,7 +947,10 @@ static int transcode(Scheduler *sch)
     term_exit();
 
     /* dump report by using the first video and audio streams */
-    print_report(1, timer_start, av_gettime_relative(), transcode_ts);
+    print_report(sch, 1, timer_start, av_gettime_relative(), transcode_ts);
+
+    if (sched_stats_filename)
+        write_sched_stats(sch);
 
     return ret;
 }
@@ -965,7 +1021,9 @@ int main(int argc, char **argv)
     show_banner(argc, argv, options);
 
     sch = sch_alloc();
-    if (!sch) {
+    frame_data_pool = av_buffer_pool_init2(sizeof(FrameData), NULL,
+                                           frame_data_alloc, NULL);
+    if (!sch || !frame_data_pool) {
         ret = AVERROR(ENOMEM);
         goto finish;
     }
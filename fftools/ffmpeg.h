@@ -148,6 +148,7 @@ typedef struct OptionsContext {
     int64_t start_time_eof;
     int seek_timestamp;
     const char *format;
+    const char *affinity;
 
     SpecifierOptList codec_names;
     SpecifierOptList audio_ch_layouts;
@@ -317,6 +318,8 @@ typedef struct OutputFilterOptions {
     AVDictionary       *swr_opts;
 
     const char         *nb_threads;
+    // for simple filtergraphs only, CPUs to run the filtergraph on
+    const char         *affinity;
 
     // A combination of OFilterFlags.
     unsigned            flags;
@@ -415,6 +418,9 @@ typedef struct DecoderOpts {
     // Either forced (when DECODER_FLAG_FRAMERATE_FORCED is set) or
     // estimated (otherwise) video framerate.
     AVRational                  framerate;
+
+    // CPUs to run the decoder and its worker threads on, may be NULL
+    const char                 *affinity;
 } DecoderOpts;
 
 typedef struct Decoder {
@@ -689,6 +695,7 @@ extern Decoder     **decoders;
 extern int        nb_decoders;
 
 extern char *vstats_filename;
+extern char *sched_stats_filename;
 
 extern float dts_delta_threshold;
 extern float dts_error_threshold;
@@ -713,6 +720,8 @@ extern float max_error_rate;
 
 extern char *filter_nbthreads;
 extern int filter_complex_nbthreads;
+extern char *filter_complex_affinity;
+extern int64_t sched_latency;
 extern int vstats_version;
 extern int auto_conversion_filters;
 
@@ -35,6 +35,7 @@
 #include "libavcodec/codec.h"
 
 #include "ffmpeg.h"
+#include "thread_affinity.h"
 
 typedef struct DecoderPriv {
     Decoder             dec;
@@ -1616,7 +1617,7 @@ static int dec_open(DecoderPriv *dp, AVDictionary **dec_opts,
         // called after avcodec_open2() because the user-set value of
         // extra_hw_frames becomes valid in there, and we need to add
         // this on top of it.
-        int extra_frames = DEFAULT_FRAME_THREAD_QUEUE_SIZE;
+        int extra_frames = sch_frame_queue_size(dp->sch);
         if (dp->dec_ctx->extra_hw_frames >= 0)
             dp->dec_ctx->extra_hw_frames += extra_frames;
         else
@@ -1659,6 +1660,7 @@ int dec_init(Decoder **pdec, Scheduler *sch,
              AVFrame *param_out)
 {
     DecoderPriv *dp;
+    ThreadAffinity *prev;
     int ret;
 
     *pdec = NULL;
@@ -1669,7 +1671,16 @@ int dec_init(Decoder **pdec, Scheduler *sch,
 
     multiview_check_manual(dp, *dec_opts);
 
+    if (o->affinity) {
+        ret = sch_set_affinity(sch, SCH_DEC_IN(dp->sch_idx), o->affinity);
+        if (ret < 0)
+            goto fail;
+    }
+
+    // worker threads created by avcodec_open2() inherit the affinity
+    sch_affinity_enter(sch, SCH_DEC_IN(dp->sch_idx), &prev);
     ret = dec_open(dp, dec_opts, o, param_out);
+    sch_affinity_leave(sch, &prev);
     if (ret < 0)
         goto fail;
 
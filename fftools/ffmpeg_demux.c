@@ -130,6 +130,9 @@ typedef struct Demuxer {
 
     Scheduler            *sch;
 
+    // CPUs to run the demuxer and decoders on, may be NULL
+    char                 *affinity;
+
     AVPacket             *pkt_heartbeat;
 
     int                   read_started;
@@ -870,6 +873,8 @@ void ifile_close(InputFile **pf)
 
     av_packet_free(&d->pkt_heartbeat);
 
+    av_freep(&d->affinity);
+
     av_freep(pf);
 }
 
@@ -942,6 +947,7 @@ int ist_use(InputStream *ist, int decoding_needed,
         ds->dec_opts.par   = ist->par;
 
         ds->dec_opts.log_parent = ist;
+        ds->dec_opts.affinity   = d->affinity;
 
         ds->decoded_params = av_frame_alloc();
         if (!ds->decoded_params)
@@ -1405,6 +1411,13 @@ static int ist_add(const OptionsContext *o, Demuxer *d, AVStream *st, AVDictiona
     if (ist->st->disposition & AV_DISPOSITION_ATTACHED_PIC)
         av_dict_set(&ds->decoder_opts, "thread_type", "-frame", 0);
 
+    /* Frame threading delays output by one frame per thread, which the
+     * latency-bounded mode cannot afford. AV_CODEC_FLAG_LOW_DELAY is not
+     * forced, as it breaks streams with reordering in some decoders; it can
+     * still be set with -flags low_delay. */
+    if (sched_latency && !av_dict_get(ds->decoder_opts, "thread_type", NULL, 0))
+        av_dict_set(&ds->decoder_opts, "thread_type", "slice", 0);
+
     switch (par->codec_type) {
     case AVMEDIA_TYPE_VIDEO:
         opt_match_per_stream_str(ist, &o->frame_rates, ic, st, &framerate);
@@ -1616,6 +1629,16 @@ int ifile_open(const OptionsContext *o, const char *filename, Scheduler *sch)
         return ret;
     d->sch = sch;
 
+    if (o->affinity) {
+        ret = sch_set_affinity(sch, SCH_DSTREAM(ret, 0), o->affinity);
+        if (ret < 0)
+            return ret;
+
+        d->affinity = av_strdup(o->affinity);
+        if (!d->affinity)
+            return AVERROR(ENOMEM);
+    }
+
     if (stop_time != INT64_MAX && recording_time != INT64_MAX) {
         stop_time = INT64_MAX;
         av_log(d, AV_LOG_WARNING, "-t and -to cannot be used together; using -t.\n");
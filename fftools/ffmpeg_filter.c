@@ -1190,6 +1190,13 @@ int fg_create(FilterGraph **pfg, char *graph_desc, Scheduler *sch)
         goto fail;
     fgp->sch_idx = ret;
 
+    if (!pfg && filter_complex_affinity) {
+        ret = sch_set_affinity(sch, SCH_FILTER_IN(fgp->sch_idx, 0),
+                               filter_complex_affinity);
+        if (ret < 0)
+            goto fail;
+    }
+
 fail:
     avfilter_inout_free(&inputs);
     avfilter_inout_free(&outputs);
@@ -1254,6 +1261,13 @@ int fg_create_simple(FilterGraph **pfg,
             return AVERROR(ENOMEM);
     }
 
+    if (opts->affinity) {
+        ret = sch_set_affinity(fgp->sch, SCH_FILTER_IN(fgp->sch_idx, 0),
+                               opts->affinity);
+        if (ret < 0)
+            return ret;
+    }
+
     return 0;
 }
 
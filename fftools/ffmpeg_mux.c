@@ -206,6 +206,31 @@ static int mux_fixup_ts(Muxer *mux, MuxStream *ms, AVPacket *pkt)
     return 0;
 }
 
+static void mux_update_latency(MuxStream *ms, const AVPacket *pkt)
+{
+    const FrameData *fd;
+    int64_t latency;
+
+    if (!pkt->opaque_ref)
+        return;
+    fd = (const FrameData*)pkt->opaque_ref->data;
+
+    for (unsigned i = 0; i < FF_ARRAY_ELEMS(fd->wallclock); i++) {
+        if (fd->wallclock[i] == INT64_MIN)
+            continue;
+
+        latency = av_gettime_relative() - fd->wallclock[i];
+
+        if (!ms->latency_nb || latency < ms->latency_min)
+            ms->latency_min = latency;
+        if (!ms->latency_nb || latency > ms->latency_max)
+            ms->latency_max = latency;
+        ms->latency_sum += latency;
+        ms->latency_nb++;
+        return;
+    }
+}
+
 static int write_packet(Muxer *mux, OutputStream *ost, AVPacket *pkt)
 {
     MuxStream *ms = ms_from_ost(ost);
@@ -228,6 +253,9 @@ static int write_packet(Muxer *mux, OutputStream *ost, AVPacket *pkt)
     ms->data_size_mux += pkt->size;
     frame_num = atomic_fetch_add(&ost->packets_written, 1);
 
+    if (sched_latency)
+        mux_update_latency(ms, pkt);
+
     pkt->stream_index = ost->index;
 
     if (ms->stats.io)
@@ -694,6 +722,8 @@ static void mux_final_stats(Muxer *mux)
     uint64_t total_packets = 0, total_size = 0;
     uint64_t video_size = 0, audio_size = 0, subtitle_size = 0,
              extra_size = 0, other_size = 0;
+    int64_t latency_min = INT64_MAX, latency_max = 0, latency_sum = 0;
+    uint64_t latency_nb = 0;
 
     uint8_t overhead[16] = "unknown";
     int64_t file_size = of_filesize(of);
@@ -732,6 +762,18 @@ static void mux_final_stats(Muxer *mux)
         av_log(of, AV_LOG_VERBOSE, "%"PRIu64" packets muxed (%"PRIu64" bytes); ",
                atomic_load(&ost->packets_written), s);
 
+        if (ms->latency_nb) {
+            av_log(of, AV_LOG_VERBOSE, "latency min %.1fms avg %.1fms max %.1fms; ",
+                   ms->latency_min / 1e3,
+                   ms->latency_sum / 1e3 / ms->latency_nb,
+                   ms->latency_max / 1e3);
+
+            latency_min  = FFMIN(latency_min, ms->latency_min);
+            latency_max  = FFMAX(latency_max, ms->latency_max);
+            latency_sum += ms->latency_sum;
+            latency_nb  += ms->latency_nb;
+        }
+
         av_log(of, AV_LOG_VERBOSE, "\n");
     }
 
@@ -752,6 +794,10 @@ static void mux_final_stats(Muxer *mux)
            other_size    / 1024.0,
            extra_size    / 1024.0,
            overhead);
+
+    if (latency_nb)
+        av_log(of, AV_LOG_INFO, "pipeline latency: min %.1fms avg %.1fms max %.1fms\n",
+               latency_min / 1e3, latency_sum / 1e3 / latency_nb, latency_max / 1e3);
 }
 
 int of_write_trailer(OutputFile *of)
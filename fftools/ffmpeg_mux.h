@@ -78,6 +78,13 @@ typedef struct MuxStream {
     // combined size of all the packets sent to the muxer
     uint64_t        data_size_mux;
 
+    /* wallclock time packets took from their earliest latency probe to the
+     * muxer, in microseconds; only gathered with -sched_latency */
+    int64_t         latency_min;
+    int64_t         latency_max;
+    int64_t         latency_sum;
+    uint64_t        latency_nb;
+
     int             copy_initial_nonkeyframes;
     int             copy_prior_start;
     int             streamcopy_started;
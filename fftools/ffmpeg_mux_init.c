@@ -987,6 +987,8 @@ ost_bind_filter(const Muxer *mux, MuxStream *ms, OutputFilter *ofilter,
             return ret;
     }
 
+    opts.affinity = o->affinity;
+
     ret = ost_get_filters(o, mux->fc, ost, &filters);
     if (ret < 0)
         return ret;
@@ -1262,6 +1264,12 @@ static int ost_add(Muxer *mux, const OptionsContext *o, enum AVMediaType type,
             return ret;
         ms->sch_idx_enc = ret;
 
+        if (o->affinity) {
+            ret = sch_set_affinity(mux->sch, SCH_ENC(ms->sch_idx_enc), o->affinity);
+            if (ret < 0)
+                return ret;
+        }
+
         ret = enc_alloc(&ost->enc, enc, mux->sch, ms->sch_idx_enc, ost);
         if (ret < 0)
             return ret;
@@ -1411,6 +1419,15 @@ static int ost_add(Muxer *mux, const OptionsContext *o, enum AVMediaType type,
 
         threads_manual = !!av_dict_get(encoder_opts, "threads", NULL, 0);
 
+        // in latency-bounded mode, avoid the delay of B-frame reordering
+        // and frame threading unless asked for
+        if (sched_latency && type == AVMEDIA_TYPE_VIDEO) {
+            if (!av_dict_get(encoder_opts, "bf", NULL, 0))
+                av_dict_set(&encoder_opts, "bf", "0", 0);
+            if (!av_dict_get(encoder_opts, "thread_type", NULL, 0))
+                av_dict_set(&encoder_opts, "thread_type", "slice", 0);
+        }
+
         ret = av_opt_set_dict2(ost->enc->enc_ctx, &encoder_opts, AV_OPT_SEARCH_CHILDREN);
         if (ret < 0) {
             av_log(ost, AV_LOG_ERROR, "Error applying encoder options: %s\n",
@@ -3331,6 +3348,12 @@ int of_open(const OptionsContext *o, const char *filename, Scheduler *sch)
     mux->sch     = sch;
     mux->sch_idx = err;
 
+    if (o->affinity) {
+        err = sch_set_affinity(sch, SCH_MSTREAM(mux->sch_idx, 0), o->affinity);
+        if (err < 0)
+            return err;
+    }
+
     /* create all output streams for this file */
     err = create_streams(mux, o);
     if (err < 0)
@@ -42,6 +42,7 @@
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/avutil.h"
+#include "libavutil/buffer.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
@@ -51,6 +52,7 @@
 HWDevice *filter_hw_device;
 
 char *vstats_filename;
+char *sched_stats_filename;
 
 float dts_delta_threshold   = 10;
 float dts_error_threshold   = 3600*30;
@@ -74,6 +76,8 @@ int stdin_interaction = 1;
 float max_error_rate  = 2.0/3;
 char *filter_nbthreads;
 int filter_complex_nbthreads = 0;
+char *filter_complex_affinity;
+int64_t sched_latency = 0;
 int vstats_version = 2;
 int auto_conversion_filters = 1;
 int64_t stats_period = 500000;
@@ -422,6 +426,75 @@ static int opt_filter_threads(void *optctx, const char *opt, const char *arg)
     return 0;
 }
 
+static int opt_filter_complex_affinity(void *optctx, const char *opt, const char *arg)
+{
+    av_free(filter_complex_affinity);
+    filter_complex_affinity = av_strdup(arg);
+    return filter_complex_affinity ? 0 : AVERROR(ENOMEM);
+}
+
+static int opt_slice_thread_pool(void *optctx, const char *opt, const char *arg)
+{
+    GlobalOptionsContext *go = optctx;
+    double num;
+    int ret;
+
+    ret = parse_number(opt, arg, OPT_TYPE_INT, 0, INT_MAX, &num);
+    if (ret < 0)
+        return ret;
+
+    return sch_slice_thread_pool(go->sch, num);
+}
+
+static int opt_sched_batch(void *optctx, const char *opt, const char *arg)
+{
+    GlobalOptionsContext *go = optctx;
+    int64_t max_delay = 10000;
+    char *end;
+    long nb_items;
+
+    nb_items = strtol(arg, &end, 10);
+    if (end == arg || nb_items < 0 || nb_items > INT_MAX ||
+        (*end && *end != ':'))
+        goto fail;
+
+    if (*end == ':' &&
+        (av_parse_time(&max_delay, end + 1, 1) < 0 || max_delay <= 0))
+        goto fail;
+
+    return sch_batch(go->sch, nb_items, max_delay);
+fail:
+    av_log(NULL, AV_LOG_ERROR, "Invalid %s value: '%s'\n", opt, arg);
+    return AVERROR(EINVAL);
+}
+
+static int opt_sched_latency(void *optctx, const char *opt, const char *arg)
+{
+    GlobalOptionsContext *go = optctx;
+    int64_t max_delay;
+
+    if (av_parse_time(&max_delay, arg, 1) < 0 || max_delay <= 0) {
+        av_log(NULL, AV_LOG_ERROR, "Invalid %s value: '%s'\n", opt, arg);
+        return AVERROR(EINVAL);
+    }
+
+    sched_latency = max_delay;
+    return sch_latency(go->sch, max_delay);
+}
+
+static int opt_huge_pages(void *optctx, const char *opt, const char *arg)
+{
+    double min_size;
+    int ret;
+
+    ret = parse_number(opt, arg, OPT_TYPE_INT64, 0, INT64_MAX, &min_size);
+    if (ret < 0)
+        return ret;
+
+    av_buffer_pool_set_huge_page_threshold(min_size);
+    return 0;
+}
+
 static int opt_abort_on(void *optctx, const char *opt, const char *arg)
 {
     static const AVOption opts[] = {
@@ -955,6 +1028,19 @@ static int opt_vstats_file(void *optctx, const char *opt, const char *arg)
     return 0;
 }
 
+static int opt_sched_stats(void *optctx, const char *opt, const char *arg)
+{
+    GlobalOptionsContext *go = optctx;
+
+    av_free(sched_stats_filename);
+    sched_stats_filename = av_strdup(arg);
+    if (!sched_stats_filename)
+        return AVERROR(ENOMEM);
+
+    sch_stats_enable(go->sch);
+    return 0;
+}
+
 static int opt_vstats(void *optctx, const char *opt, const char *arg)
 {
     char filename[40];
@@ -1618,6 +1704,9 @@ const OptionDef options[] = {
     { "progress",               OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
         { .func_arg = opt_progress },
       "write program-readable progress information", "url" },
+    { "sched_stats",            OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_sched_stats },
+      "write per-component scheduling statistics", "url" },
     { "stdin",                  OPT_TYPE_BOOL, OPT_EXPERT,
         { &stdin_interaction },
       "enable or disable interaction on standard input" },
@@ -1708,6 +1797,18 @@ const OptionDef options[] = {
     { "filter_threads",         OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
         { .func_arg = opt_filter_threads },
         "number of non-complex filter threads" },
+    { "slice_thread_pool",      OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_slice_thread_pool },
+        "run the slice threading of all codecs, filters and scalers on one pool of workers", "nb_threads" },
+    { "sched_batch",            OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_sched_batch },
+        "hand frames and packets between threads in batches", "nb_items[:max_delay]" },
+    { "sched_latency",          OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_sched_latency },
+        "bound the latency added by queueing and codec delay", "max_delay" },
+    { "huge_pages",             OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_huge_pages },
+        "allocate frame buffers of at least min_size bytes from huge pages", "min_size" },
 #if FFMPEG_OPT_FILTER_SCRIPT
     { "filter_script",          OPT_TYPE_STRING, OPT_PERSTREAM | OPT_EXPERT | OPT_OUTPUT,
         { .off = OFFSET(filter_scripts) },
@@ -1722,6 +1823,9 @@ const OptionDef options[] = {
     { "filter_complex_threads", OPT_TYPE_INT, OPT_EXPERT,
         { &filter_complex_nbthreads },
         "number of threads for -filter_complex" },
+    { "filter_complex_affinity", OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
+        { .func_arg = opt_filter_complex_affinity },
+        "run -filter_complex graphs on the given CPUs", "cpus" },
     { "lavfi",               OPT_TYPE_FUNC, OPT_FUNC_ARG | OPT_EXPERT,
         { .func_arg = opt_filter_complex },
         "create a complex filtergraph", "graph_description" },
@@ -1762,6 +1866,9 @@ const OptionDef options[] = {
     { "thread_queue_size",   OPT_TYPE_INT,  OPT_OFFSET | OPT_EXPERT | OPT_INPUT | OPT_OUTPUT,
         { .off = OFFSET(thread_queue_size) },
         "set the maximum number of queued packets from the demuxer" },
+    { "affinity",            OPT_TYPE_STRING, OPT_OFFSET | OPT_EXPERT | OPT_INPUT | OPT_OUTPUT,
+        { .off = OFFSET(affinity) },
+        "run the threads processing this file on the given CPUs", "cpus" },
     { "find_stream_info",    OPT_TYPE_BOOL, OPT_INPUT | OPT_EXPERT | OPT_OFFSET,
         { .off = OFFSET(find_stream_info) },
         "read and decode the streams to fill missing information with heuristics" },
@@ -27,17 +27,20 @@
 #include "ffmpeg_sched.h"
 #include "ffmpeg_utils.h"
 #include "sync_queue.h"
+#include "thread_affinity.h"
 #include "thread_queue.h"
 
 #include "libavcodec/packet.h"
 
 #include "libavutil/avassert.h"
+#include "libavutil/bprint.h"
 #include "libavutil/error.h"
 #include "libavutil/fifo.h"
 #include "libavutil/frame.h"
 #include "libavutil/mem.h"
 #include "libavutil/thread.h"
 #include "libavutil/threadmessage.h"
+#include "libavutil/threadpool.h"
 #include "libavutil/time.h"
 
 // 100 ms
@@ -60,6 +63,28 @@ typedef struct SchWaiter {
     int                 choked_next;
 } SchWaiter;
 
+typedef struct SchTaskStats {
+    // all times in microseconds, from av_gettime_relative()
+    int64_t               start;
+    atomic_int_least64_t  end;
+
+    // time spent in sch_*_receive(), i.e. waiting for input
+    atomic_int_least64_t  recv_wait;
+    // time spent in sch_*_send(), i.e. waiting for downstream to accept
+    // the output or for the scheduler to unchoke this task
+    atomic_int_least64_t  send_wait;
+
+    atomic_uint_least64_t nb_received;
+    atomic_uint_least64_t nb_sent;
+
+    // number of times the task was choked by schedule_update_locked()
+    atomic_uint           nb_choked;
+
+    // only accessed by sch_stats_print() for computing the current rate
+    uint64_t              report_count;
+    int64_t               report_time;
+} SchTaskStats;
+
 typedef struct SchTask {
     Scheduler          *parent;
     SchedulerNode       node;
@@ -69,8 +94,25 @@ typedef struct SchTask {
 
     pthread_t           thread;
     int                 thread_running;
+
+    // CPUs the task thread is restricted to, NULL for no restriction
+    ThreadAffinity     *affinity;
+
+    SchTaskStats        stats;
 } SchTask;
 
+// items received from a queue with tq_receive_batch(), see sch_batch()
+typedef struct SchBatch {
+    void              **items;
+    int                *stream_idx;
+    // allocated size, 0 when batching is disabled
+    unsigned            size;
+    // items[pos..nb-1] have not been returned yet
+    unsigned            pos;
+    unsigned            nb;
+    int                 frames;
+} SchBatch;
+
 typedef struct SchDecOutput {
     SchedulerNode      *dst;
     uint8_t            *dst_finished;
@@ -88,6 +130,7 @@ typedef struct SchDec {
     SchTask             task;
     // Queue for receiving input packets, one stream.
     ThreadQueue        *queue;
+    SchBatch            batch;
 
     // Queue for sending post-flush end timestamps back to the source
     AVThreadMessageQueue *queue_end_ts;
@@ -140,6 +183,7 @@ typedef struct SchEnc {
     SchTask             task;
     // Queue for receiving input frames, one stream.
     ThreadQueue        *queue;
+    SchBatch            batch;
     // tq_send() to queue returned EOF
     int                 in_finished;
 
@@ -259,6 +303,7 @@ typedef struct SchFilterGraph {
     // input queue, nb_inputs+1 streams
     // last stream is control
     ThreadQueue        *queue;
+    SchBatch            batch;
     SchWaiter           waiter;
 
     // protected by schedule_lock
@@ -305,9 +350,27 @@ struct Scheduler {
     char               *sdp_filename;
     int                 sdp_auto;
 
+    int                 shared_pool;
+
+    // collect the per-task statistics printed by sch_stats_print()
+    int                 stats;
+
+    // number of items handed to decoders, filtergraphs and encoders per
+    // wakeup, and the longest they may be held back for that
+    unsigned            batch_size;
+    int64_t             batch_delay;
+
+    // maximum duration of media held in each queue in latency-bounded mode,
+    // 0 otherwise; see sch_latency()
+    int64_t             max_latency;
+    // how far ahead of the trailing output stream sources may run
+    int64_t             schedule_tolerance;
+
     enum SchedulerState state;
     atomic_int          terminate;
 
+    int64_t             start_time;
+
     pthread_mutex_t     schedule_lock;
 
     atomic_int_least64_t last_dts;
@@ -411,6 +474,8 @@ static int task_start(SchTask *task)
 
     av_assert0(!task->thread_running);
 
+    task->stats.start = av_gettime_relative();
+
     ret = pthread_create(&task->thread, NULL, task_wrapper, task);
     if (ret) {
         av_log(task->func_arg, AV_LOG_ERROR, "pthread_create() failed: %s\n",
@@ -432,6 +497,45 @@ static void task_init(Scheduler *sch, SchTask *task, enum SchedulerNodeType type
 
     task->func      = func;
     task->func_arg  = func_arg;
+
+    atomic_init(&task->stats.end,         0);
+    atomic_init(&task->stats.recv_wait,   0);
+    atomic_init(&task->stats.send_wait,   0);
+    atomic_init(&task->stats.nb_received, 0);
+    atomic_init(&task->stats.nb_sent,     0);
+    atomic_init(&task->stats.nb_choked,   0);
+}
+
+// timestamps are only taken when the statistics are collected
+static int64_t stats_time(const Scheduler *sch)
+{
+    return sch->stats ? av_gettime_relative() : 0;
+}
+
+static void task_stats_recv(SchTask *task, int64_t start, int received)
+{
+    SchTaskStats *s = &task->stats;
+
+    if (!task->parent->stats)
+        return;
+
+    atomic_fetch_add_explicit(&s->recv_wait, av_gettime_relative() - start,
+                              memory_order_relaxed);
+    if (received)
+        atomic_fetch_add_explicit(&s->nb_received, 1, memory_order_relaxed);
+}
+
+static void task_stats_send(SchTask *task, int64_t start, int sent)
+{
+    SchTaskStats *s = &task->stats;
+
+    if (!task->parent->stats)
+        return;
+
+    atomic_fetch_add_explicit(&s->send_wait, av_gettime_relative() - start,
+                              memory_order_relaxed);
+    if (sent)
+        atomic_fetch_add_explicit(&s->nb_sent, 1, memory_order_relaxed);
 }
 
 static int64_t trailing_dts(const Scheduler *sch, int count_finished)
@@ -456,6 +560,87 @@ static int64_t trailing_dts(const Scheduler *sch, int count_finished)
     return min_dts == INT64_MAX ? AV_NOPTS_VALUE : min_dts;
 }
 
+static int batch_alloc(SchBatch *b, unsigned size, int frames)
+{
+    b->items      = av_calloc(size, sizeof(*b->items));
+    b->stream_idx = av_calloc(size, sizeof(*b->stream_idx));
+    if (!b->items || !b->stream_idx)
+        return AVERROR(ENOMEM);
+
+    b->frames = frames;
+    for (unsigned i = 0; i < size; i++) {
+        b->items[i] = frames ? (void*)av_frame_alloc() : (void*)av_packet_alloc();
+        if (!b->items[i])
+            return AVERROR(ENOMEM);
+        b->size++;
+    }
+
+    return 0;
+}
+
+static void batch_free(SchBatch *b)
+{
+    for (unsigned i = 0; b->items && i < b->size; i++) {
+        if (b->frames)
+            av_frame_free((AVFrame**)&b->items[i]);
+        else
+            av_packet_free((AVPacket**)&b->items[i]);
+    }
+    av_freep(&b->items);
+    av_freep(&b->stream_idx);
+    b->size = 0;
+}
+
+/**
+ * Drop the items received for the given stream, or all of them when
+ * stream_idx is negative.
+ */
+static void batch_discard(SchBatch *b, int stream_idx)
+{
+    for (unsigned i = b->pos; i < b->nb; i++) {
+        if (stream_idx >= 0 && b->stream_idx[i] != stream_idx)
+            continue;
+
+        if (b->frames)
+            av_frame_unref(b->items[i]);
+        else
+            av_packet_unref(b->items[i]);
+        b->stream_idx[i] = -1;
+    }
+}
+
+/**
+ * tq_receive(), but fetching up to a whole batch from the queue at once when
+ * batching is enabled.
+ */
+static int batch_receive(ThreadQueue *tq, SchBatch *b, int *stream_idx, void *data)
+{
+    if (!b->size)
+        return tq_receive(tq, stream_idx, data);
+
+    while (1) {
+        if (b->pos == b->nb) {
+            int ret = tq_receive_batch(tq, b->stream_idx, b->items, b->size);
+            if (ret < 0) {
+                *stream_idx = b->stream_idx[0];
+                return ret;
+            }
+
+            b->pos = 0;
+            b->nb  = ret;
+        }
+
+        *stream_idx = b->stream_idx[b->pos];
+        if (b->frames)
+            av_frame_move_ref(data, b->items[b->pos++]);
+        else
+            av_packet_move_ref(data, b->items[b->pos++]);
+
+        if (*stream_idx >= 0)
+            return 0;
+    }
+}
+
 void sch_free(Scheduler **psch)
 {
     Scheduler *sch = *psch;
@@ -478,6 +663,8 @@ void sch_free(Scheduler **psch)
         av_packet_free(&d->send_pkt);
 
         waiter_uninit(&d->waiter);
+
+        thread_affinity_free(&d->task.affinity);
     }
     av_freep(&sch->demux);
 
@@ -501,6 +688,8 @@ void sch_free(Scheduler **psch)
         av_packet_free(&mux->sub_heartbeat_pkt);
 
         tq_free(&mux->queue);
+
+        thread_affinity_free(&mux->task.affinity);
     }
     av_freep(&sch->mux);
 
@@ -508,6 +697,7 @@ void sch_free(Scheduler **psch)
         SchDec *dec = &sch->dec[i];
 
         tq_free(&dec->queue);
+        batch_free(&dec->batch);
 
         av_thread_message_queue_free(&dec->queue_end_ts);
 
@@ -521,6 +711,8 @@ void sch_free(Scheduler **psch)
         av_freep(&dec->outputs);
 
         av_frame_free(&dec->send_frame);
+
+        thread_affinity_free(&dec->task.affinity);
     }
     av_freep(&sch->dec);
 
@@ -528,11 +720,14 @@ void sch_free(Scheduler **psch)
         SchEnc *enc = &sch->enc[i];
 
         tq_free(&enc->queue);
+        batch_free(&enc->batch);
 
         av_packet_free(&enc->send_pkt);
 
         av_freep(&enc->dst);
         av_freep(&enc->dst_finished);
+
+        thread_affinity_free(&enc->task.affinity);
     }
     av_freep(&sch->enc);
 
@@ -549,16 +744,22 @@ void sch_free(Scheduler **psch)
         SchFilterGraph *fg = &sch->filters[i];
 
         tq_free(&fg->queue);
+        batch_free(&fg->batch);
 
         av_freep(&fg->inputs);
         av_freep(&fg->outputs);
 
         waiter_uninit(&fg->waiter);
+
+        thread_affinity_free(&fg->task.affinity);
     }
     av_freep(&sch->filters);
 
     av_freep(&sch->sdp_filename);
 
+    if (sch->shared_pool)
+        av_thread_pool_free_global();
+
     pthread_mutex_destroy(&sch->schedule_lock);
 
     pthread_mutex_destroy(&sch->mux_ready_lock);
@@ -586,6 +787,8 @@ Scheduler *sch_alloc(void)
     sch->class    = &scheduler_class;
     sch->sdp_auto = 1;
 
+    sch->schedule_tolerance = SCHEDULE_TOLERANCE;
+
     ret = pthread_mutex_init(&sch->schedule_lock, NULL);
     if (ret)
         goto fail;
@@ -615,6 +818,133 @@ int sch_sdp_filename(Scheduler *sch, const char *sdp_filename)
     return sch->sdp_filename ? 0 : AVERROR(ENOMEM);
 }
 
+int sch_slice_thread_pool(Scheduler *sch, int nb_threads)
+{
+    int ret = av_thread_pool_set_global(nb_threads);
+    if (ret < 0) {
+        av_log(sch, AV_LOG_ERROR, "Could not create the shared thread pool: %s\n",
+               av_err2str(ret));
+        return ret;
+    }
+
+    av_log(sch, AV_LOG_VERBOSE, "Using a shared pool of %d worker threads\n", ret);
+    sch->shared_pool = 1;
+
+    return 0;
+}
+
+int sch_batch(Scheduler *sch, unsigned nb_items, int64_t max_delay)
+{
+    av_assert0(sch->state == SCH_STATE_UNINIT);
+
+    if (max_delay <= 0)
+        return AVERROR(EINVAL);
+
+    sch->batch_size  = nb_items;
+    sch->batch_delay = max_delay;
+
+    return 0;
+}
+
+unsigned sch_frame_queue_size(const Scheduler *sch)
+{
+    // a receiver may hold a whole batch on top of a full queue
+    return DEFAULT_FRAME_THREAD_QUEUE_SIZE +
+           (sch->batch_size > 1 ? FFMIN(sch->batch_size, DEFAULT_FRAME_THREAD_QUEUE_SIZE) : 0);
+}
+
+void sch_stats_enable(Scheduler *sch)
+{
+    av_assert0(sch->state == SCH_STATE_UNINIT);
+
+    sch->stats = 1;
+}
+
+int sch_latency(Scheduler *sch, int64_t max_delay)
+{
+    av_assert0(sch->state == SCH_STATE_UNINIT);
+
+    if (max_delay <= 0)
+        return AVERROR(EINVAL);
+
+    sch->max_latency        = max_delay;
+    sch->schedule_tolerance = FFMIN(max_delay, SCHEDULE_TOLERANCE);
+
+    return 0;
+}
+
+static SchTask *task_get(Scheduler *sch, SchedulerNode node)
+{
+    switch (node.type) {
+    case SCH_NODE_TYPE_DEMUX:
+        av_assert0(node.idx < sch->nb_demux);
+        return &sch->demux[node.idx].task;
+    case SCH_NODE_TYPE_MUX:
+        av_assert0(node.idx < sch->nb_mux);
+        return &sch->mux[node.idx].task;
+    case SCH_NODE_TYPE_DEC:
+        av_assert0(node.idx < sch->nb_dec);
+        return &sch->dec[node.idx].task;
+    case SCH_NODE_TYPE_ENC:
+        av_assert0(node.idx < sch->nb_enc);
+        return &sch->enc[node.idx].task;
+    case SCH_NODE_TYPE_FILTER_IN:
+    case SCH_NODE_TYPE_FILTER_OUT:
+        av_assert0(node.idx < sch->nb_filters);
+        return &sch->filters[node.idx].task;
+    default: av_assert0(0);
+    }
+}
+
+int sch_set_affinity(Scheduler *sch, SchedulerNode node, const char *cpus)
+{
+    SchTask *task = task_get(sch, node);
+    ThreadAffinity *ta;
+    int ret;
+
+    av_assert0(sch->state == SCH_STATE_UNINIT);
+
+    ret = thread_affinity_parse(&ta, cpus);
+    if (ret < 0) {
+        av_log(sch, AV_LOG_ERROR, "Invalid CPU list '%s': %s\n", cpus,
+               ret == AVERROR(ENOSYS) ? "thread affinity is not supported "
+                                        "on this platform" : av_err2str(ret));
+        return ret;
+    }
+
+    thread_affinity_free(&task->affinity);
+    task->affinity = ta;
+
+    return 0;
+}
+
+void sch_affinity_enter(Scheduler *sch, SchedulerNode node, ThreadAffinity **prev)
+{
+    SchTask *task = task_get(sch, node);
+    int ret;
+
+    *prev = NULL;
+
+    if (!task->affinity)
+        return;
+
+    ret = thread_affinity_apply(task->affinity, prev);
+    if (ret < 0)
+        av_log(sch, AV_LOG_WARNING,
+               "Could not set thread affinity: %s\n", av_err2str(ret));
+}
+
+void sch_affinity_leave(Scheduler *sch, ThreadAffinity **prev)
+{
+    if (*prev) {
+        int ret = thread_affinity_apply(*prev, NULL);
+        if (ret < 0)
+            av_log(sch, AV_LOG_WARNING, "Could not restore thread affinity: %s\n",
+                   av_err2str(ret));
+    }
+    thread_affinity_free(prev);
+}
+
 static const AVClass sch_mux_class = {
     .class_name                = "SchMux",
     .version                   = LIBAVUTIL_VERSION_INT,
@@ -1094,8 +1424,48 @@ int sch_connect(Scheduler *sch, SchedulerNode src, SchedulerNode dst)
     return 0;
 }
 
+/**
+ * Send packets taken from the pre-muxing queues to the muxer with as few
+ * queue operations as possible, skipping streams the muxer no longer wants.
+ * Frees the packets.
+ */
+static int mux_send_pending(SchMux *mux, unsigned *stream_idx,
+                            AVPacket **pkts, unsigned nb_pkts)
+{
+    unsigned nb_sent = 0;
+    int ret = 0;
+
+    while (nb_sent < nb_pkts) {
+        SchMuxStream *ms = &mux->streams[stream_idx[nb_sent]];
+
+        if (ms->init_eof) {
+            nb_sent++;
+            continue;
+        }
+
+        ret = tq_send_batch(mux->queue, stream_idx + nb_sent,
+                            (void**)(pkts + nb_sent), nb_pkts - nb_sent);
+        if (ret == AVERROR_EOF) {
+            ms->init_eof = 1;
+            nb_sent++;
+            ret = 0;
+        } else if (ret < 0)
+            break;
+        else
+            nb_sent += ret;
+    }
+
+    for (unsigned i = 0; i < nb_pkts; i++)
+        av_packet_free(&pkts[i]);
+
+    return FFMIN(ret, 0);
+}
+
 static int mux_task_start(SchMux *mux)
 {
+    AVPacket *pending[32];
+    unsigned  pending_stream[FF_ARRAY_ELEMS(pending)];
+    unsigned  nb_pending = 0;
     int ret = 0;
 
     ret = task_start(&mux->task);
@@ -1135,14 +1505,19 @@ static int mux_task_start(SchMux *mux)
             av_assert0(ret >= 0);
 
             if (pkt) {
-                if (!ms->init_eof)
-                    ret = tq_send(mux->queue, min_stream, pkt);
-                av_packet_free(&pkt);
-                if (ret == AVERROR_EOF)
-                    ms->init_eof = 1;
-                else if (ret < 0)
-                    return ret;
-            } else
+                pending_stream[nb_pending] = min_stream;
+                pending[nb_pending++]      = pkt;
+                if (nb_pending < FF_ARRAY_ELEMS(pending))
+                    continue;
+            }
+
+            // the stream must not be finished before its packets are sent
+            ret = mux_send_pending(mux, pending_stream, pending, nb_pending);
+            nb_pending = 0;
+            if (ret < 0)
+                return ret;
+
+            if (!pkt)
                 tq_send_finish(mux->queue, min_stream);
 
             continue;
@@ -1151,6 +1526,10 @@ static int mux_task_start(SchMux *mux)
         break;
     }
 
+    ret = mux_send_pending(mux, pending_stream, pending, nb_pending);
+    if (ret < 0)
+        return ret;
+
     atomic_store(&mux->mux_started, 1);
 
     return 0;
@@ -1324,7 +1703,7 @@ static void schedule_update_locked(Scheduler *sch)
                 continue;
             if (dts == AV_NOPTS_VALUE && ms->last_dts != AV_NOPTS_VALUE)
                 continue;
-            if (dts != AV_NOPTS_VALUE && ms->last_dts - dts >= SCHEDULE_TOLERANCE)
+            if (dts != AV_NOPTS_VALUE && ms->last_dts - dts >= sch->schedule_tolerance)
                 continue;
 
             // resolve the source to unchoke
@@ -1349,8 +1728,12 @@ static void schedule_update_locked(Scheduler *sch)
     for (unsigned type = 0; type < 2; type++)
         for (unsigned i = 0; i < (type ? sch->nb_filters : sch->nb_demux); i++) {
             SchWaiter *w = type ? &sch->filters[i].waiter : &sch->demux[i].waiter;
-            if (w->choked_prev != w->choked_next)
+            SchTask   *t = type ? &sch->filters[i].task   : &sch->demux[i].task;
+            if (w->choked_prev != w->choked_next) {
                 waiter_set(w, w->choked_next);
+                if (w->choked_next)
+                    atomic_fetch_add_explicit(&t->stats.nb_choked, 1, memory_order_relaxed);
+            }
         }
 
 }
@@ -1443,6 +1826,59 @@ fail:
     return ret;
 }
 
+/**
+ * Switch the queues that have exactly one sending and one receiving thread to
+ * the lock-free mode.
+ */
+static int queues_set_spsc(Scheduler *sch)
+{
+    int ret;
+
+    for (unsigned i = 0; i < sch->nb_dec; i++) {
+        int nb_senders = 1;
+
+        // subtitle heartbeats are sent from the muxer threads
+        for (unsigned j = 0; j < sch->nb_mux; j++) {
+            SchMux *mux = &sch->mux[j];
+
+            for (unsigned k = 0; k < mux->nb_streams; k++) {
+                SchMuxStream *ms = &mux->streams[k];
+
+                for (unsigned l = 0; l < ms->nb_sub_heartbeat_dst; l++)
+                    nb_senders += ms->sub_heartbeat_dst[l] == i;
+            }
+        }
+
+        if (nb_senders == 1) {
+            ret = tq_set_spsc(sch->dec[i].queue);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    // frames going through a sync queue are sent from whichever thread
+    // happens to unblock it
+    for (unsigned i = 0; i < sch->nb_enc; i++) {
+        if (sch->enc[i].sq_idx[0] < 0) {
+            ret = tq_set_spsc(sch->enc[i].queue);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    for (unsigned i = 0; i < sch->nb_mux; i++) {
+        if (sch->mux[i].nb_streams == 1) {
+            ret = tq_set_spsc(sch->mux[i].queue);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    // filtergraph queues also receive commands from the main thread
+
+    return 0;
+}
+
 static int start_prepare(Scheduler *sch)
 {
     int ret;
@@ -1585,7 +2021,54 @@ static int start_prepare(Scheduler *sch)
     if (ret < 0)
         return ret;
 
-    return 0;
+    if (sch->batch_size > 1) {
+        unsigned size_pkt   = FFMIN(sch->batch_size, DEFAULT_PACKET_THREAD_QUEUE_SIZE);
+        unsigned size_frame = FFMIN(sch->batch_size, DEFAULT_FRAME_THREAD_QUEUE_SIZE);
+
+        for (unsigned i = 0; i < sch->nb_dec; i++) {
+            tq_set_batch(sch->dec[i].queue, sch->batch_size, sch->batch_delay);
+            ret = batch_alloc(&sch->dec[i].batch, size_pkt, 0);
+            if (ret < 0)
+                return ret;
+        }
+        for (unsigned i = 0; i < sch->nb_filters; i++) {
+            tq_set_batch(sch->filters[i].queue, sch->batch_size, sch->batch_delay);
+            ret = batch_alloc(&sch->filters[i].batch, size_frame, 1);
+            if (ret < 0)
+                return ret;
+        }
+        for (unsigned i = 0; i < sch->nb_enc; i++) {
+            tq_set_batch(sch->enc[i].queue, sch->batch_size, sch->batch_delay);
+            ret = batch_alloc(&sch->enc[i].batch, size_frame, 1);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    if (sch->max_latency) {
+        for (unsigned i = 0; i < sch->nb_dec; i++) {
+            ret = tq_set_max_duration(sch->dec[i].queue, sch->max_latency);
+            if (ret < 0)
+                return ret;
+        }
+        for (unsigned i = 0; i < sch->nb_filters; i++) {
+            ret = tq_set_max_duration(sch->filters[i].queue, sch->max_latency);
+            if (ret < 0)
+                return ret;
+        }
+        for (unsigned i = 0; i < sch->nb_enc; i++) {
+            ret = tq_set_max_duration(sch->enc[i].queue, sch->max_latency);
+            if (ret < 0)
+                return ret;
+        }
+        for (unsigned i = 0; i < sch->nb_mux; i++) {
+            ret = tq_set_max_duration(sch->mux[i].queue, sch->max_latency);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
+    return queues_set_spsc(sch);
 }
 
 int sch_start(Scheduler *sch)
@@ -1597,7 +2080,8 @@ int sch_start(Scheduler *sch)
         return ret;
 
     av_assert0(sch->state == SCH_STATE_UNINIT);
-    sch->state = SCH_STATE_STARTED;
+    sch->state      = SCH_STATE_STARTED;
+    sch->start_time = av_gettime_relative();
 
     for (unsigned i = 0; i < sch->nb_mux; i++) {
         SchMux *mux = &sch->mux[i];
@@ -1679,11 +2163,110 @@ int sch_wait(Scheduler *sch, uint64_t timeout_us, int64_t *transcode_ts)
     return ret;
 }
 
+static void task_stats_print(SchTask *task, ThreadQueue *queue, int64_t now,
+                             AVBPrint *bp, enum SchStatsFormat fmt, int first)
+{
+    static const char * const type_names[] = {
+        [SCH_NODE_TYPE_DEMUX]     = "demux",
+        [SCH_NODE_TYPE_MUX]       = "mux",
+        [SCH_NODE_TYPE_DEC]       = "dec",
+        [SCH_NODE_TYPE_ENC]       = "enc",
+        [SCH_NODE_TYPE_FILTER_IN] = "filter",
+    };
+    SchTaskStats  *s = &task->stats;
+    const char *type = type_names[task->node.type];
+    unsigned     idx = task->node.idx;
+    ThreadQueueStats qs = { 0 };
+
+    int64_t  end       = atomic_load_explicit(&s->end,       memory_order_relaxed);
+    int64_t  recv_wait = atomic_load_explicit(&s->recv_wait, memory_order_relaxed);
+    int64_t  send_wait = atomic_load_explicit(&s->send_wait, memory_order_relaxed);
+    uint64_t nb_recv   = atomic_load_explicit(&s->nb_received, memory_order_relaxed);
+    uint64_t nb_sent   = atomic_load_explicit(&s->nb_sent,     memory_order_relaxed);
+    unsigned nb_choked = atomic_load_explicit(&s->nb_choked,   memory_order_relaxed);
+
+    int64_t  elapsed   = s->start ? (end ? end : now) - s->start : 0;
+    int64_t  busy      = FFMAX(elapsed - recv_wait - send_wait, 0);
+    // demuxers only produce, everything else is rated by what it consumes
+    uint64_t nb_items  = task->node.type == SCH_NODE_TYPE_DEMUX ? nb_sent : nb_recv;
+    double   rate      = elapsed > 0 ? nb_items * 1e6 / elapsed : 0.0;
+
+    if (queue)
+        tq_get_stats(queue, &qs);
+
+    if (fmt == SCH_STATS_JSON) {
+        av_bprintf(bp, "%s\n        {\n", first ? "" : ",");
+        av_bprintf(bp, "            \"node\": \"%s%u\",\n", type, idx);
+        av_bprintf(bp, "            \"type\": \"%s\",\n", type);
+        av_bprintf(bp, "            \"index\": %u,\n", idx);
+        av_bprintf(bp, "            \"elapsed_us\": %"PRId64",\n", elapsed);
+        av_bprintf(bp, "            \"busy_us\": %"PRId64",\n", busy);
+        av_bprintf(bp, "            \"recv_wait_us\": %"PRId64",\n", recv_wait);
+        av_bprintf(bp, "            \"send_wait_us\": %"PRId64",\n", send_wait);
+        av_bprintf(bp, "            \"received\": %"PRIu64",\n", nb_recv);
+        av_bprintf(bp, "            \"sent\": %"PRIu64",\n", nb_sent);
+        av_bprintf(bp, "            \"rate\": %.3f,\n", rate);
+        av_bprintf(bp, "            \"choke_events\": %u", nb_choked);
+        if (queue)
+            av_bprintf(bp, ",\n            \"queue\": { \"capacity\": %zu, "
+                       "\"max_items\": %zu }", qs.capacity, qs.max_items);
+        av_bprintf(bp, "\n        }");
+        return;
+    }
+
+    // report the rate since the previous report
+    if (s->report_time && now > s->report_time)
+        rate = (nb_items - s->report_count) * 1e6 / (now - s->report_time);
+    s->report_count = nb_items;
+    s->report_time  = now;
+
+#define PCT(x) (elapsed > 0 ? 100.0 * (x) / elapsed : 0.0)
+    av_bprintf(bp, "sched_%s%u_busy=%.1f\n",      type, idx, PCT(busy));
+    av_bprintf(bp, "sched_%s%u_recv_wait=%.1f\n", type, idx, PCT(recv_wait));
+    av_bprintf(bp, "sched_%s%u_send_wait=%.1f\n", type, idx, PCT(send_wait));
+    av_bprintf(bp, "sched_%s%u_rate=%.2f\n",      type, idx, rate);
+    av_bprintf(bp, "sched_%s%u_choked=%u\n",      type, idx, nb_choked);
+    if (queue) {
+        av_bprintf(bp, "sched_%s%u_queue=%zu\n",     type, idx, qs.nb_items);
+        av_bprintf(bp, "sched_%s%u_queue_max=%zu\n", type, idx, qs.max_items);
+    }
+#undef PCT
+}
+
+void sch_stats_print(Scheduler *sch, AVBPrint *bp, enum SchStatsFormat fmt)
+{
+    int64_t now = av_gettime_relative();
+    int first = 1;
+
+    if (fmt == SCH_STATS_JSON)
+        av_bprintf(bp, "{\n    \"elapsed_us\": %"PRId64",\n    \"nodes\": [",
+                   sch->start_time ? now - sch->start_time : 0);
+
+    for (unsigned i = 0; i < sch->nb_demux; i++, first = 0)
+        task_stats_print(&sch->demux[i].task, NULL, now, bp, fmt, first);
+    for (unsigned i = 0; i < sch->nb_dec; i++, first = 0)
+        task_stats_print(&sch->dec[i].task, sch->dec[i].queue, now, bp, fmt, first);
+    for (unsigned i = 0; i < sch->nb_filters; i++, first = 0)
+        task_stats_print(&sch->filters[i].task, sch->filters[i].queue, now, bp, fmt, first);
+    for (unsigned i = 0; i < sch->nb_enc; i++, first = 0)
+        task_stats_print(&sch->enc[i].task, sch->enc[i].queue, now, bp, fmt, first);
+    for (unsigned i = 0; i < sch->nb_mux; i++, first = 0)
+        task_stats_print(&sch->mux[i].task, sch->mux[i].queue, now, bp, fmt, first);
+
+    if (fmt == SCH_STATS_JSON)
+        av_bprintf(bp, "\n    ]\n}\n");
+}
+
 static int enc_open(Scheduler *sch, SchEnc *enc, const AVFrame *frame)
 {
+    ThreadAffinity *prev;
     int ret;
 
+    // the encoder may be opened from the thread feeding it, make sure the
+    // worker threads it creates run on the CPUs assigned to the encoder
+    sch_affinity_enter(sch, SCH_ENC(enc - sch->enc), &prev);
     ret = enc->open_cb(enc->task.func_arg, frame);
+    sch_affinity_leave(sch, &prev);
     if (ret < 0)
         return ret;
 
@@ -2029,23 +2612,27 @@ static int demux_flush(Scheduler *sch, SchDemux *d, AVPacket *pkt)
 int sch_demux_send(Scheduler *sch, unsigned demux_idx, AVPacket *pkt,
                    unsigned flags)
 {
+    int64_t start = stats_time(sch);
     SchDemux *d;
-    int terminate;
+    int ret, sent = 0;
 
     av_assert0(demux_idx < sch->nb_demux);
     d = &sch->demux[demux_idx];
 
-    terminate = waiter_wait(sch, &d->waiter);
-    if (terminate)
-        return AVERROR_EXIT;
-
-    // flush the downstreams after seek
-    if (pkt->stream_index == -1)
-        return demux_flush(sch, d, pkt);
+    if (waiter_wait(sch, &d->waiter)) {
+        ret = AVERROR_EXIT;
+    } else if (pkt->stream_index == -1) {
+        // flush the downstreams after seek
+        ret = demux_flush(sch, d, pkt);
+    } else {
+        av_assert0(pkt->stream_index < d->nb_streams);
 
-    av_assert0(pkt->stream_index < d->nb_streams);
+        ret  = demux_send_for_stream(sch, d, &d->streams[pkt->stream_index], pkt, flags);
+        sent = ret >= 0;
+    }
 
-    return demux_send_for_stream(sch, d, &d->streams[pkt->stream_index], pkt, flags);
+    task_stats_send(&d->task, start, sent);
+    return ret;
 }
 
 static int demux_done(Scheduler *sch, unsigned demux_idx)
@@ -2075,11 +2662,15 @@ int sch_mux_receive(Scheduler *sch, unsigned mux_idx, AVPacket *pkt)
     SchMux *mux;
     int ret, stream_idx;
 
+    int64_t start = stats_time(sch);
+
     av_assert0(mux_idx < sch->nb_mux);
     mux = &sch->mux[mux_idx];
 
     ret = tq_receive(mux->queue, &stream_idx, pkt);
     pkt->stream_index = stream_idx;
+
+    task_stats_recv(&mux->task, start, ret >= 0);
     return ret;
 }
 
@@ -2158,6 +2749,7 @@ int sch_dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
 {
     SchDec *dec;
     int ret, dummy;
+    int64_t start;
 
     av_assert0(dec_idx < sch->nb_dec);
     dec = &sch->dec[dec_idx];
@@ -2172,8 +2764,10 @@ int sch_dec_receive(Scheduler *sch, unsigned dec_idx, AVPacket *pkt)
         dec->expect_end_ts = 0;
     }
 
-    ret = tq_receive(dec->queue, &dummy, pkt);
+    start = stats_time(sch);
+    ret   = batch_receive(dec->queue, &dec->batch, &dummy, pkt);
     av_assert0(dummy <= 0);
+    task_stats_recv(&dec->task, start, ret >= 0);
 
     // got a flush packet, on the next call to this function the decoder
     // will give us post-flush end timestamp
@@ -2230,17 +2824,13 @@ finish:
     return AVERROR_EOF;
 }
 
-int sch_dec_send(Scheduler *sch, unsigned dec_idx,
-                 unsigned out_idx, AVFrame *frame)
+static int dec_send(Scheduler *sch, SchDec *dec,
+                    unsigned out_idx, AVFrame *frame)
 {
-    SchDec *dec;
     SchDecOutput *o;
     int ret;
     unsigned nb_done = 0;
 
-    av_assert0(dec_idx < sch->nb_dec);
-    dec = &sch->dec[dec_idx];
-
     av_assert0(out_idx < dec->nb_outputs);
     o = &dec->outputs[out_idx];
 
@@ -2274,12 +2864,29 @@ int sch_dec_send(Scheduler *sch, unsigned dec_idx,
     return (nb_done == o->nb_dst) ? AVERROR_EOF : 0;
 }
 
+int sch_dec_send(Scheduler *sch, unsigned dec_idx,
+                 unsigned out_idx, AVFrame *frame)
+{
+    int64_t start = stats_time(sch);
+    SchDec *dec;
+    int ret;
+
+    av_assert0(dec_idx < sch->nb_dec);
+    dec = &sch->dec[dec_idx];
+
+    ret = dec_send(sch, dec, out_idx, frame);
+
+    task_stats_send(&dec->task, start, ret >= 0);
+    return ret;
+}
+
 static int dec_done(Scheduler *sch, unsigned dec_idx)
 {
     SchDec *dec = &sch->dec[dec_idx];
     int ret = 0;
 
     tq_receive_finish(dec->queue, 0);
+    batch_discard(&dec->batch, -1);
 
     // make sure our source does not get stuck waiting for end timestamps
     // that will never arrive
@@ -2303,13 +2910,16 @@ int sch_enc_receive(Scheduler *sch, unsigned enc_idx, AVFrame *frame)
 {
     SchEnc *enc;
     int ret, dummy;
+    int64_t start = stats_time(sch);
 
     av_assert0(enc_idx < sch->nb_enc);
     enc = &sch->enc[enc_idx];
 
-    ret = tq_receive(enc->queue, &dummy, frame);
+    ret = batch_receive(enc->queue, &enc->batch, &dummy, frame);
     av_assert0(dummy <= 0);
 
+    task_stats_recv(&enc->task, start, ret >= 0);
+
     return ret;
 }
 
@@ -2343,14 +2953,10 @@ finish:
     return AVERROR_EOF;
 }
 
-int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
+static int enc_send(Scheduler *sch, SchEnc *enc, AVPacket *pkt)
 {
-    SchEnc *enc;
     int ret;
 
-    av_assert0(enc_idx < sch->nb_enc);
-    enc = &sch->enc[enc_idx];
-
     for (unsigned i = 0; i < enc->nb_dst; i++) {
         uint8_t *finished = &enc->dst_finished[i];
         AVPacket *to_send = pkt;
@@ -2376,12 +2982,28 @@ int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
     return 0;
 }
 
+int sch_enc_send(Scheduler *sch, unsigned enc_idx, AVPacket *pkt)
+{
+    int64_t start = stats_time(sch);
+    SchEnc *enc;
+    int ret;
+
+    av_assert0(enc_idx < sch->nb_enc);
+    enc = &sch->enc[enc_idx];
+
+    ret = enc_send(sch, enc, pkt);
+
+    task_stats_send(&enc->task, start, ret >= 0);
+    return ret;
+}
+
 static int enc_done(Scheduler *sch, unsigned enc_idx)
 {
     SchEnc *enc = &sch->enc[enc_idx];
     int ret = 0;
 
     tq_receive_finish(enc->queue, 0);
+    batch_discard(&enc->batch, -1);
 
     for (unsigned i = 0; i < enc->nb_dst; i++) {
         int err = enc_send_to_dst(sch, enc->dst[i], &enc->dst_finished[i], NULL);
@@ -2392,14 +3014,9 @@ static int enc_done(Scheduler *sch, unsigned enc_idx)
     return ret;
 }
 
-int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
-                       unsigned *in_idx, AVFrame *frame)
+static int filter_receive(Scheduler *sch, SchFilterGraph *fg,
+                          unsigned *in_idx, AVFrame *frame)
 {
-    SchFilterGraph *fg;
-
-    av_assert0(fg_idx < sch->nb_filters);
-    fg = &sch->filters[fg_idx];
-
     av_assert0(*in_idx <= fg->nb_inputs);
 
     // update scheduling to account for desired input stream, if it changed
@@ -2423,7 +3040,7 @@ int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
     while (1) {
         int ret, idx;
 
-        ret = tq_receive(fg->queue, &idx, frame);
+        ret = batch_receive(fg->queue, &fg->batch, &idx, frame);
         if (idx < 0)
             return AVERROR_EOF;
         else if (ret >= 0) {
@@ -2436,6 +3053,22 @@ int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
     }
 }
 
+int sch_filter_receive(Scheduler *sch, unsigned fg_idx,
+                       unsigned *in_idx, AVFrame *frame)
+{
+    int64_t start = stats_time(sch);
+    SchFilterGraph *fg;
+    int ret;
+
+    av_assert0(fg_idx < sch->nb_filters);
+    fg = &sch->filters[fg_idx];
+
+    ret = filter_receive(sch, fg, in_idx, frame);
+
+    task_stats_recv(&fg->task, start, ret >= 0);
+    return ret;
+}
+
 void sch_filter_receive_finish(Scheduler *sch, unsigned fg_idx, unsigned in_idx)
 {
     SchFilterGraph *fg;
@@ -2450,6 +3083,7 @@ void sch_filter_receive_finish(Scheduler *sch, unsigned fg_idx, unsigned in_idx)
     if (!fi->receive_finished) {
         fi->receive_finished = 1;
         tq_receive_finish(fg->queue, in_idx);
+        batch_discard(&fg->batch, in_idx);
 
         // close the control stream when all actual inputs are done
         if (++fg->nb_inputs_finished_receive == fg->nb_inputs)
@@ -2459,8 +3093,10 @@ void sch_filter_receive_finish(Scheduler *sch, unsigned fg_idx, unsigned in_idx)
 
 int sch_filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *frame)
 {
+    int64_t start = stats_time(sch);
     SchFilterGraph *fg;
     SchedulerNode  dst;
+    int ret;
 
     av_assert0(fg_idx < sch->nb_filters);
     fg = &sch->filters[fg_idx];
@@ -2468,9 +3104,12 @@ int sch_filter_send(Scheduler *sch, unsigned fg_idx, unsigned out_idx, AVFrame *
     av_assert0(out_idx < fg->nb_outputs);
     dst = fg->outputs[out_idx].dst;
 
-    return (dst.type == SCH_NODE_TYPE_ENC)                                    ?
-           send_to_enc   (sch, &sch->enc[dst.idx],                     frame) :
-           send_to_filter(sch, &sch->filters[dst.idx], dst.idx_stream, frame);
+    ret = (dst.type == SCH_NODE_TYPE_ENC)                                    ?
+          send_to_enc   (sch, &sch->enc[dst.idx],                     frame) :
+          send_to_filter(sch, &sch->filters[dst.idx], dst.idx_stream, frame);
+
+    task_stats_send(&fg->task, start, frame && ret >= 0);
+    return ret;
 }
 
 static int filter_done(Scheduler *sch, unsigned fg_idx)
@@ -2480,6 +3119,7 @@ static int filter_done(Scheduler *sch, unsigned fg_idx)
 
     for (unsigned i = 0; i <= fg->nb_inputs; i++)
         tq_receive_finish(fg->queue, i);
+    batch_discard(&fg->batch, -1);
 
     for (unsigned i = 0; i < fg->nb_outputs; i++) {
         SchedulerNode dst = fg->outputs[i].dst;
@@ -2531,6 +3171,13 @@ static void *task_wrapper(void *arg)
     int ret;
     int err = 0;
 
+    if (task->affinity) {
+        ret = thread_affinity_apply(task->affinity, NULL);
+        if (ret < 0)
+            av_log(task->func_arg, AV_LOG_WARNING,
+                   "Could not set thread affinity: %s\n", av_err2str(ret));
+    }
+
     ret = task->func(task->func_arg);
     if (ret < 0)
         av_log(task->func_arg, AV_LOG_ERROR,
@@ -2539,6 +3186,9 @@ static void *task_wrapper(void *arg)
     err = task_cleanup(sch, task->node);
     ret = err_merge(ret, err);
 
+    atomic_store_explicit(&task->stats.end, av_gettime_relative(),
+                          memory_order_relaxed);
+
     // EOF is considered normal termination
     if (ret == AVERROR_EOF)
         ret = 0;
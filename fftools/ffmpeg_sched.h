@@ -85,8 +85,10 @@
  * knowledge about the whole transcoding pipeline.
  */
 
+struct AVBPrint;
 struct AVFrame;
 struct AVPacket;
+struct ThreadAffinity;
 
 typedef struct Scheduler Scheduler;
 
@@ -149,6 +151,36 @@ int sch_stop(Scheduler *sch, int64_t *finish_ts);
  */
 int sch_wait(Scheduler *sch, uint64_t timeout_us, int64_t *transcode_ts);
 
+enum SchStatsFormat {
+    /**
+     * "key=value" lines, as used by the -progress output; rates are computed
+     * over the interval since the previous call with this format.
+     */
+    SCH_STATS_PROGRESS,
+    /**
+     * A JSON document with the totals since the scheduler was started.
+     */
+    SCH_STATS_JSON,
+};
+
+/**
+ * Collect the statistics printed by sch_stats_print(). Without this, no
+ * timestamps are taken when items are sent or received.
+ *
+ * Must be called before sch_start().
+ */
+void sch_stats_enable(Scheduler *sch);
+
+/**
+ * Append per-node statistics to bp: the time each component spent working and
+ * waiting for input/output, the number of items it processed and its rate,
+ * how often it was choked by the scheduler and the high-water mark of its
+ * input queue.
+ *
+ * May be called while the transcoding is running, from the main thread.
+ */
+void sch_stats_print(Scheduler *sch, struct AVBPrint *bp, enum SchStatsFormat fmt);
+
 /**
  * Add a demuxer to the scheduler.
  *
@@ -298,6 +330,63 @@ int sch_mux_stream_ready(Scheduler *sch, unsigned mux_idx, unsigned stream_idx);
  */
 int sch_sdp_filename(Scheduler *sch, const char *sdp_filename);
 
+/**
+ * Run the slice threading jobs of all the components created from now on on
+ * a single pool of nb_threads workers (0 for one per CPU), which lives until
+ * the scheduler is freed. Frame threading, external libraries and the
+ * scheduler's own threads are not affected.
+ */
+int sch_slice_thread_pool(Scheduler *sch, int nb_threads);
+
+/**
+ * Hand frames and packets to decoders, filtergraphs and encoders in batches of
+ * up to nb_items (at most the queue size), rather than waking the receiving
+ * thread for each one; the receiver then takes everything queued with a single
+ * tq_receive_batch() call. An item is held back for at most max_delay
+ * microseconds waiting for its batch to fill.
+ *
+ * Must be called before sch_start().
+ */
+int sch_batch(Scheduler *sch, unsigned nb_items, int64_t max_delay);
+
+/**
+ * Maximum number of frames that may be in flight between a decoder and a
+ * filtergraph, or a filtergraph and an encoder: the queue size, plus a batch
+ * already taken from the queue by the receiver when batching is enabled.
+ */
+unsigned sch_frame_queue_size(const Scheduler *sch);
+
+/**
+ * Bound the latency added by the scheduler: size the queues feeding decoders,
+ * filtergraphs, encoders and muxers to hold at most max_delay microseconds
+ * worth of media each, rather than a fixed number of items, and keep sources
+ * at most max_delay ahead of the trailing output stream.
+ *
+ * Must be called before sch_start().
+ */
+int sch_latency(Scheduler *sch, int64_t max_delay);
+
+/**
+ * Restrict the thread running the given node to the CPUs listed in cpus,
+ * e.g. "0-7,16-23". Threads it creates, such as codec or filter workers,
+ * inherit the restriction.
+ *
+ * Must be called before sch_start().
+ */
+int sch_set_affinity(Scheduler *sch, SchedulerNode node, const char *cpus);
+
+/**
+ * Temporarily restrict the calling thread to the CPUs assigned to node with
+ * sch_set_affinity(), so that threads created meanwhile (e.g. by
+ * avcodec_open2()) inherit them. Must be paired with sch_affinity_leave().
+ *
+ * @param prev the previous affinity of the calling thread is stored here,
+ *             or NULL if node has no affinity assigned
+ */
+void sch_affinity_enter(Scheduler *sch, SchedulerNode node,
+                        struct ThreadAffinity **prev);
+void sch_affinity_leave(Scheduler *sch, struct ThreadAffinity **prev);
+
 /**
  * Add an encoder to the scheduler.
  *
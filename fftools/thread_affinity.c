@@ -0,0 +1,137 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+
+#if HAVE_SCHED_SETAFFINITY
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+#include <sched.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+
+#include "thread_affinity.h"
+
+#if HAVE_SCHED_SETAFFINITY
+
+struct ThreadAffinity {
+    cpu_set_t set;
+};
+
+int thread_affinity_parse(ThreadAffinity **pta, const char *str)
+{
+    ThreadAffinity *ta;
+    const char *p = str;
+
+    ta = av_mallocz(sizeof(*ta));
+    if (!ta)
+        return AVERROR(ENOMEM);
+
+    CPU_ZERO(&ta->set);
+
+    while (*p) {
+        char *end;
+        long first, last;
+
+        first = last = strtol(p, &end, 10);
+        if (end == p)
+            goto fail;
+        p = end;
+
+        if (*p == '-') {
+            last = strtol(++p, &end, 10);
+            if (end == p)
+                goto fail;
+            p = end;
+        }
+
+        if (first < 0 || last < first || last >= CPU_SETSIZE)
+            goto fail;
+
+        for (long i = first; i <= last; i++)
+            CPU_SET(i, &ta->set);
+
+        if (*p == ',')
+            p++;
+        else if (*p)
+            goto fail;
+    }
+
+    if (!CPU_COUNT(&ta->set))
+        goto fail;
+
+    *pta = ta;
+    return 0;
+fail:
+    av_freep(&ta);
+    return AVERROR(EINVAL);
+}
+
+int thread_affinity_apply(const ThreadAffinity *ta, ThreadAffinity **prev)
+{
+    ThreadAffinity *old = NULL;
+
+    if (prev) {
+        old = av_mallocz(sizeof(*old));
+        if (!old)
+            return AVERROR(ENOMEM);
+
+        if (sched_getaffinity(0, sizeof(old->set), &old->set) < 0) {
+            int ret = AVERROR(errno);
+            av_freep(&old);
+            return ret;
+        }
+    }
+
+    // on Linux, pid 0 refers to the calling thread rather than the process
+    if (sched_setaffinity(0, sizeof(ta->set), &ta->set) < 0) {
+        int ret = AVERROR(errno);
+        av_freep(&old);
+        return ret;
+    }
+
+    if (prev)
+        *prev = old;
+
+    return 0;
+}
+
+#else
+
+int thread_affinity_parse(ThreadAffinity **pta, const char *str)
+{
+    return AVERROR(ENOSYS);
+}
+
+int thread_affinity_apply(const ThreadAffinity *ta, ThreadAffinity **prev)
+{
+    return AVERROR(ENOSYS);
+}
+
+#endif
+
+void thread_affinity_free(ThreadAffinity **pta)
+{
+    av_freep(pta);
+}
@@ -0,0 +1,46 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef FFTOOLS_THREAD_AFFINITY_H
+#define FFTOOLS_THREAD_AFFINITY_H
+
+/**
+ * A set of CPUs a thread may run on.
+ */
+typedef struct ThreadAffinity ThreadAffinity;
+
+/**
+ * Parse a list of CPU indices and ranges, e.g. "0-7,16-23".
+ *
+ * @return 0 on success, AVERROR(EINVAL) on malformed input,
+ *         AVERROR(ENOSYS) when thread affinity is not supported
+ */
+int  thread_affinity_parse(ThreadAffinity **pta, const char *str);
+void thread_affinity_free(ThreadAffinity **pta);
+
+/**
+ * Restrict the calling thread to the CPUs in ta. Threads created by the
+ * calling thread afterwards inherit the restriction.
+ *
+ * @param prev if non-NULL, the affinity the thread had before this call is
+ *             stored here, so that it can be restored later by passing it
+ *             to this function; the caller must free it
+ */
+int  thread_affinity_apply(const ThreadAffinity *ta, ThreadAffinity **prev);
+
+#endif // FFTOOLS_THREAD_AFFINITY_H
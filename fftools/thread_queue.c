@@ -16,6 +16,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -25,8 +26,11 @@
 #include "libavutil/fifo.h"
 #include "libavutil/frame.h"
 #include "libavutil/intreadwrite.h"
+#include "libavutil/macros.h"
+#include "libavutil/mathematics.h"
 #include "libavutil/mem.h"
 #include "libavutil/thread.h"
+#include "libavutil/time.h"
 
 #include "libavcodec/packet.h"
 
@@ -38,16 +42,43 @@ enum {
 };
 
 struct ThreadQueue {
-    int              *finished;
+    atomic_int       *finished;
     unsigned int    nb_streams;
 
     enum ThreadQueueType type;
 
     AVContainerFifo *fifo;
     AVFifo          *fifo_stream_index;
+    size_t          queue_size;
+
+    atomic_size_t   max_items;
+
+    // see tq_set_batch(); batch_size is 1 when batching is disabled
+    size_t          batch_size;
+    int64_t         batch_delay;
+
+    /* see tq_set_max_duration(); limit is the number of items the queue may
+     * hold, recomputed by the sender from the durations in stream_duration
+     * (in AV_TIME_BASE units) */
+    int64_t         max_duration;
+    int64_t        *stream_duration;
+    atomic_size_t   limit;
 
     pthread_mutex_t lock;
     pthread_cond_t  cond;
+
+    /* Single-producer/single-consumer mode, see tq_set_spsc().
+     * items/items_stream are a ring of queue_size entries; head is only
+     * written by the sender, tail only by the receiver. The mutex and
+     * condition are only used for sleeping, a thread going to sleep sets its
+     * *_waiting flag and the other side only wakes it when that is set. */
+    int             spsc;
+    void          **items;
+    unsigned       *items_stream;
+    atomic_size_t   head;
+    atomic_size_t   tail;
+    atomic_int      send_waiting;
+    atomic_int      recv_waiting;
 };
 
 void tq_free(ThreadQueue **ptq)
@@ -60,7 +91,17 @@ void tq_free(ThreadQueue **ptq)
     av_container_fifo_free(&tq->fifo);
     av_fifo_freep2(&tq->fifo_stream_index);
 
+    for (size_t i = 0; tq->items && i < tq->queue_size; i++) {
+        if (tq->type == THREAD_QUEUE_FRAMES)
+            av_frame_free((AVFrame**)&tq->items[i]);
+        else
+            av_packet_free((AVPacket**)&tq->items[i]);
+    }
+    av_freep(&tq->items);
+    av_freep(&tq->items_stream);
+
     av_freep(&tq->finished);
+    av_freep(&tq->stream_duration);
 
     pthread_cond_destroy(&tq->cond);
     pthread_mutex_destroy(&tq->lock);
@@ -95,6 +136,17 @@ ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
     if (!tq->finished)
         goto fail;
     tq->nb_streams = nb_streams;
+    for (unsigned int i = 0; i < nb_streams; i++)
+        atomic_init(&tq->finished[i], 0);
+
+    tq->queue_size = queue_size;
+    tq->batch_size = 1;
+    atomic_init(&tq->max_items,    0);
+    atomic_init(&tq->limit,        queue_size);
+    atomic_init(&tq->head,         0);
+    atomic_init(&tq->tail,         0);
+    atomic_init(&tq->send_waiting, 0);
+    atomic_init(&tq->recv_waiting, 0);
 
     tq->type = type;
 
@@ -113,51 +165,289 @@ fail:
     return NULL;
 }
 
-int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
+int tq_set_spsc(ThreadQueue *tq)
 {
-    int *finished;
-    int ret;
+    av_assert0(!atomic_load(&tq->head) && !av_container_fifo_can_read(tq->fifo));
 
-    av_assert0(stream_idx < tq->nb_streams);
-    finished = &tq->finished[stream_idx];
+    if (tq->spsc)
+        return 0;
 
-    pthread_mutex_lock(&tq->lock);
+    tq->items        = av_calloc(tq->queue_size, sizeof(*tq->items));
+    tq->items_stream = av_calloc(tq->queue_size, sizeof(*tq->items_stream));
+    if (!tq->items || !tq->items_stream)
+        goto fail;
 
-    if (*finished & FINISHED_SEND) {
-        ret = AVERROR(EINVAL);
-        goto finish;
+    for (size_t i = 0; i < tq->queue_size; i++) {
+        tq->items[i] = (tq->type == THREAD_QUEUE_FRAMES) ?
+                       (void*)av_frame_alloc() : (void*)av_packet_alloc();
+        if (!tq->items[i])
+            goto fail;
     }
 
-    while (!(*finished & FINISHED_RECV) && !av_fifo_can_write(tq->fifo_stream_index))
-        pthread_cond_wait(&tq->cond, &tq->lock);
+    tq->spsc = 1;
+
+    return 0;
+fail:
+    for (size_t i = 0; tq->items && i < tq->queue_size; i++) {
+        if (tq->type == THREAD_QUEUE_FRAMES)
+            av_frame_free((AVFrame**)&tq->items[i]);
+        else
+            av_packet_free((AVPacket**)&tq->items[i]);
+    }
+    av_freep(&tq->items);
+    av_freep(&tq->items_stream);
+    return AVERROR(ENOMEM);
+}
 
-    if (*finished & FINISHED_RECV) {
-        ret = AVERROR_EOF;
-        *finished |= FINISHED_SEND;
+void tq_set_batch(ThreadQueue *tq, size_t batch_size, int64_t max_delay)
+{
+    tq->batch_size  = FFMIN(FFMAX(batch_size, 1), tq->queue_size);
+    tq->batch_delay = max_delay;
+}
+
+int tq_set_max_duration(ThreadQueue *tq, int64_t max_duration)
+{
+    av_assert0(max_duration > 0);
+
+    if (!tq->stream_duration) {
+        tq->stream_duration = av_calloc(tq->nb_streams, sizeof(*tq->stream_duration));
+        if (!tq->stream_duration)
+            return AVERROR(ENOMEM);
+    }
+    tq->max_duration = max_duration;
+
+    return 0;
+}
+
+/**
+ * Recompute the item limit from the duration of the item about to be sent.
+ * Every stream is granted as many items as fit into max_duration, at least
+ * one; streams whose item duration is not known yet get one.
+ */
+static void update_limit(ThreadQueue *tq, unsigned int stream_idx, const void *data)
+{
+    AVRational tb;
+    int64_t duration;
+    size_t limit = 0;
+
+    if (!tq->max_duration)
+        return;
+
+    if (tq->type == THREAD_QUEUE_FRAMES) {
+        const AVFrame *frame = data;
+        duration = frame->duration;
+        tb       = frame->time_base;
     } else {
-        ret = av_fifo_write(tq->fifo_stream_index, &stream_idx, 1);
+        const AVPacket *pkt = data;
+        duration = pkt->duration;
+        tb       = pkt->time_base;
+    }
+
+    if (duration > 0 && tb.num > 0 && tb.den > 0)
+        tq->stream_duration[stream_idx] = av_rescale_q(duration, tb, AV_TIME_BASE_Q);
+
+    for (unsigned int i = 0; i < tq->nb_streams; i++) {
+        int64_t d = tq->stream_duration[i];
+        limit += d > 0 ? FFMAX(tq->max_duration / d, 1) : 1;
+    }
+
+    atomic_store_explicit(&tq->limit, FFMIN(limit, tq->queue_size),
+                          memory_order_relaxed);
+}
+
+/**
+ * Whether a sender waiting for space should be woken up with nb_items queued:
+ * with batching, only once there is room for a whole batch.
+ */
+static int room_for_batch(ThreadQueue *tq, size_t nb_items)
+{
+    size_t limit = atomic_load_explicit(&tq->limit, memory_order_relaxed);
+
+    return nb_items < limit && limit - nb_items >= FFMIN(tq->batch_size, limit);
+}
+
+/**
+ * Wait on the queue condition; when batching, the other side may not signal
+ * us until a whole batch is ready, so wake up after batch_delay to bound the
+ * latency.
+ */
+static void cond_wait(ThreadQueue *tq)
+{
+    if (tq->batch_size > 1) {
+        int64_t t = av_gettime() + tq->batch_delay;
+        struct timespec tv = { .tv_sec  =  t / 1000000,
+                               .tv_nsec = (t % 1000000) * 1000 };
+        pthread_cond_timedwait(&tq->cond, &tq->lock, &tv);
+    } else
+        pthread_cond_wait(&tq->cond, &tq->lock);
+}
+
+static void spsc_wake(ThreadQueue *tq)
+{
+    pthread_mutex_lock(&tq->lock);
+    pthread_cond_broadcast(&tq->cond);
+    pthread_mutex_unlock(&tq->lock);
+}
+
+static int spsc_full(ThreadQueue *tq, size_t head)
+{
+    return head - atomic_load(&tq->tail) >=
+           atomic_load_explicit(&tq->limit, memory_order_relaxed);
+}
+
+/**
+ * Make the items written up to head visible to the receiver, waking it up if
+ * it is waiting and enough items are queued.
+ */
+static void spsc_publish(ThreadQueue *tq, size_t head)
+{
+    size_t nb_items;
+
+    if (head == atomic_load_explicit(&tq->head, memory_order_relaxed))
+        return;
+
+    atomic_store(&tq->head, head);
+
+    nb_items = head - atomic_load_explicit(&tq->tail, memory_order_relaxed);
+    if (nb_items > atomic_load_explicit(&tq->max_items, memory_order_relaxed))
+        atomic_store_explicit(&tq->max_items, nb_items, memory_order_relaxed);
+
+    // only wake the receiver if it actually went to sleep
+    if (nb_items >= FFMIN(tq->batch_size, atomic_load_explicit(&tq->limit, memory_order_relaxed)) &&
+        atomic_load(&tq->recv_waiting))
+        spsc_wake(tq);
+}
+
+static int spsc_send(ThreadQueue *tq, const unsigned int *stream_idx,
+                     void **data, size_t nb_items)
+{
+    size_t head = atomic_load_explicit(&tq->head, memory_order_relaxed);
+    size_t nb_sent;
+    int ret = 0;
+
+    for (nb_sent = 0; nb_sent < nb_items; nb_sent++) {
+        atomic_int *finished = &tq->finished[stream_idx[nb_sent]];
+        size_t slot;
+
+        if (atomic_load(finished) & FINISHED_SEND) {
+            ret = AVERROR(EINVAL);
+            break;
+        }
+
+        update_limit(tq, stream_idx[nb_sent], data[nb_sent]);
+
+        if (!(atomic_load(finished) & FINISHED_RECV) && spsc_full(tq, head)) {
+            // the receiver cannot make room before it sees what we queued
+            spsc_publish(tq, head);
+
+            pthread_mutex_lock(&tq->lock);
+            // announce we are about to sleep, then check again; the receiver
+            // does the converse, so at least one of us sees the other
+            atomic_store(&tq->send_waiting, 1);
+            while (!(atomic_load(finished) & FINISHED_RECV) && spsc_full(tq, head))
+                cond_wait(tq);
+            atomic_store(&tq->send_waiting, 0);
+            pthread_mutex_unlock(&tq->lock);
+        }
+
+        if (atomic_load(finished) & FINISHED_RECV) {
+            atomic_fetch_or(finished, FINISHED_SEND);
+            ret = AVERROR_EOF;
+            break;
+        }
+
+        slot = head++ % tq->queue_size;
+        if (tq->type == THREAD_QUEUE_FRAMES)
+            av_frame_move_ref(tq->items[slot], data[nb_sent]);
+        else
+            av_packet_move_ref(tq->items[slot], data[nb_sent]);
+        tq->items_stream[slot] = stream_idx[nb_sent];
+    }
+
+    spsc_publish(tq, head);
+
+    return nb_sent ? nb_sent : ret;
+}
+
+int tq_send_batch(ThreadQueue *tq, const unsigned int *stream_idx,
+                  void **data, size_t nb_items)
+{
+    size_t nb_sent;
+    int ret = 0;
+
+    for (size_t i = 0; i < nb_items; i++)
+        av_assert0(stream_idx[i] < tq->nb_streams);
+
+    if (tq->spsc)
+        return spsc_send(tq, stream_idx, data, nb_items);
+
+    pthread_mutex_lock(&tq->lock);
+
+    for (nb_sent = 0; nb_sent < nb_items; nb_sent++) {
+        atomic_int *finished = &tq->finished[stream_idx[nb_sent]];
+
+        if (*finished & FINISHED_SEND) {
+            ret = AVERROR(EINVAL);
+            break;
+        }
+
+        update_limit(tq, stream_idx[nb_sent], data[nb_sent]);
+
+        while (!(*finished & FINISHED_RECV) &&
+               av_fifo_can_read(tq->fifo_stream_index) >= atomic_load(&tq->limit)) {
+            // the receiver may be waiting for what we queued so far
+            if (nb_sent)
+                pthread_cond_broadcast(&tq->cond);
+            cond_wait(tq);
+        }
+
+        if (*finished & FINISHED_RECV) {
+            ret = AVERROR_EOF;
+            *finished |= FINISHED_SEND;
+            break;
+        }
+
+        ret = av_fifo_write(tq->fifo_stream_index, &stream_idx[nb_sent], 1);
         if (ret < 0)
-            goto finish;
+            break;
 
-        ret = av_container_fifo_write(tq->fifo, data, 0);
+        ret = av_container_fifo_write(tq->fifo, data[nb_sent], 0);
         if (ret < 0)
-            goto finish;
+            break;
 
-        pthread_cond_broadcast(&tq->cond);
+        if (av_fifo_can_read(tq->fifo_stream_index) > atomic_load(&tq->max_items))
+            atomic_store(&tq->max_items, av_fifo_can_read(tq->fifo_stream_index));
     }
 
-finish:
+    if (nb_sent && av_fifo_can_read(tq->fifo_stream_index) >=
+                   FFMIN(tq->batch_size, atomic_load(&tq->limit)))
+        pthread_cond_broadcast(&tq->cond);
+
     pthread_mutex_unlock(&tq->lock);
 
-    return ret;
+    return nb_sent ? nb_sent : ret;
+}
+
+int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
+{
+    int ret = tq_send_batch(tq, &stream_idx, &data, 1);
+    return FFMIN(ret, 0);
 }
 
+/**
+ * Non-blocking receive of up to nb_items items with the lock held.
+ *
+ * @return number of items received, or AVERROR_EOF with stream_idx[0] set to
+ *         a stream that just finished (-1 if all have), or AVERROR(EAGAIN)
+ */
 static int receive_locked(ThreadQueue *tq, int *stream_idx,
-                          void *data)
+                          void **data, size_t nb_items)
 {
     unsigned int nb_finished = 0;
+    size_t nb_received = 0;
 
-    while (av_container_fifo_read(tq->fifo, data, 0) >= 0) {
+    while (nb_received < nb_items &&
+           av_container_fifo_read(tq->fifo, data[nb_received], 0) >= 0) {
         unsigned idx;
         int ret;
 
@@ -165,14 +455,16 @@ static int receive_locked(ThreadQueue *tq, int *stream_idx,
         av_assert0(ret >= 0);
         if (tq->finished[idx] & FINISHED_RECV) {
             (tq->type == THREAD_QUEUE_FRAMES) ?
-            av_frame_unref(data) : av_packet_unref(data);
+            av_frame_unref(data[nb_received]) : av_packet_unref(data[nb_received]);
             continue;
         }
 
-        *stream_idx = idx;
-        return 0;
+        stream_idx[nb_received++] = idx;
     }
 
+    if (nb_received)
+        return nb_received;
+
     for (unsigned int i = 0; i < tq->nb_streams; i++) {
         if (!tq->finished[i])
             continue;
@@ -180,7 +472,7 @@ static int receive_locked(ThreadQueue *tq, int *stream_idx,
         /* return EOF to the consumer at most once for each stream */
         if (!(tq->finished[i] & FINISHED_RECV)) {
             tq->finished[i] |= FINISHED_RECV;
-            *stream_idx   = i;
+            stream_idx[0] = i;
             return AVERROR_EOF;
         }
 
@@ -190,25 +482,148 @@ static int receive_locked(ThreadQueue *tq, int *stream_idx,
     return nb_finished == tq->nb_streams ? AVERROR_EOF : AVERROR(EAGAIN);
 }
 
-int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
+/**
+ * Non-blocking receive in SPSC mode, same return values as receive_locked().
+ * *consumed is set when an item was removed from the ring.
+ */
+static int spsc_receive(ThreadQueue *tq, int *stream_idx, void **data,
+                        size_t nb_items, int *consumed)
+{
+    unsigned int nb_finished = 0;
+    size_t nb_received = 0;
+    size_t tail = atomic_load_explicit(&tq->tail, memory_order_relaxed);
+    size_t head = atomic_load(&tq->head);
+
+    while (nb_received < nb_items && tail != head) {
+        size_t   slot = tail++ % tq->queue_size;
+        unsigned  idx = tq->items_stream[slot];
+
+        if (tq->type == THREAD_QUEUE_FRAMES)
+            av_frame_move_ref(data[nb_received], tq->items[slot]);
+        else
+            av_packet_move_ref(data[nb_received], tq->items[slot]);
+
+        if (atomic_load(&tq->finished[idx]) & FINISHED_RECV) {
+            (tq->type == THREAD_QUEUE_FRAMES) ?
+            av_frame_unref(data[nb_received]) : av_packet_unref(data[nb_received]);
+            continue;
+        }
+
+        stream_idx[nb_received++] = idx;
+    }
+
+    // hand all the slots back at once
+    if (tail != atomic_load_explicit(&tq->tail, memory_order_relaxed)) {
+        atomic_store(&tq->tail, tail);
+        *consumed = 1;
+    }
+
+    if (nb_received)
+        return nb_received;
+
+    for (unsigned int i = 0; i < tq->nb_streams; i++) {
+        int finished = atomic_load(&tq->finished[i]);
+
+        if (!finished)
+            continue;
+
+        if (!(finished & FINISHED_RECV)) {
+            // the sender publishes all its items before marking the stream
+            // finished, so they may have arrived since we checked
+            if (tail != atomic_load(&tq->head))
+                return AVERROR(EAGAIN);
+
+            atomic_fetch_or(&tq->finished[i], FINISHED_RECV);
+            stream_idx[0] = i;
+            return AVERROR_EOF;
+        }
+
+        nb_finished++;
+    }
+
+    return nb_finished == tq->nb_streams ? AVERROR_EOF : AVERROR(EAGAIN);
+}
+
+static int tq_receive_spsc(ThreadQueue *tq, int *stream_idx, void **data,
+                           size_t nb_items)
+{
+    int consumed = 0;
+    int ret;
+
+    while ((ret = spsc_receive(tq, stream_idx, data, nb_items, &consumed)) == AVERROR(EAGAIN)) {
+        size_t tail = atomic_load_explicit(&tq->tail, memory_order_relaxed);
+
+        if (tail != atomic_load(&tq->head))
+            continue;
+
+        pthread_mutex_lock(&tq->lock);
+
+        atomic_store(&tq->recv_waiting, 1);
+
+        // the sender may be waiting for the space we freed by discarding
+        if (consumed && atomic_load(&tq->send_waiting))
+            pthread_cond_broadcast(&tq->cond);
+        consumed = 0;
+
+        while (tail == atomic_load(&tq->head)) {
+            int event = 0;
+
+            // finishing a stream always wakes us, check for that as well
+            for (unsigned int i = 0; i < tq->nb_streams; i++) {
+                int finished = atomic_load(&tq->finished[i]);
+                if (finished && !(finished & FINISHED_RECV))
+                    event = 1;
+            }
+            if (event)
+                break;
+
+            cond_wait(tq);
+        }
+
+        atomic_store(&tq->recv_waiting, 0);
+
+        pthread_mutex_unlock(&tq->lock);
+    }
+
+    if (consumed && atomic_load(&tq->send_waiting)) {
+        size_t nb_queued = atomic_load(&tq->head) -
+                           atomic_load_explicit(&tq->tail, memory_order_relaxed);
+
+        // with batching, let the sender sleep until there is room for a batch
+        if (room_for_batch(tq, nb_queued))
+            spsc_wake(tq);
+    }
+
+    return ret;
+}
+
+int tq_receive_batch(ThreadQueue *tq, int *stream_idx, void **data,
+                     size_t nb_items)
 {
     int ret;
 
-    *stream_idx = -1;
+    av_assert0(nb_items > 0);
+
+    stream_idx[0] = -1;
+
+    if (tq->spsc)
+        return tq_receive_spsc(tq, stream_idx, data, nb_items);
 
     pthread_mutex_lock(&tq->lock);
 
     while (1) {
         size_t can_read = av_container_fifo_can_read(tq->fifo);
 
-        ret = receive_locked(tq, stream_idx, data);
+        ret = receive_locked(tq, stream_idx, data, nb_items);
 
-        // signal other threads if the fifo state changed
-        if (can_read != av_container_fifo_can_read(tq->fifo))
+        // signal other threads if the fifo state changed; with batching,
+        // only once a sender would be able to queue a whole batch
+        if (can_read != av_container_fifo_can_read(tq->fifo) &&
+            room_for_batch(tq, av_fifo_can_read(tq->fifo_stream_index)))
             pthread_cond_broadcast(&tq->cond);
 
         if (ret == AVERROR(EAGAIN)) {
-            pthread_cond_wait(&tq->cond, &tq->lock);
+            cond_wait(tq);
             continue;
         }
 
@@ -220,6 +635,12 @@ int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
     return ret;
 }
 
+int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
+{
+    int ret = tq_receive_batch(tq, stream_idx, &data, 1);
+    return FFMIN(ret, 0);
+}
+
 void tq_send_finish(ThreadQueue *tq, unsigned int stream_idx)
 {
     av_assert0(stream_idx < tq->nb_streams);
@@ -249,3 +670,19 @@ void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx)
 
     pthread_mutex_unlock(&tq->lock);
 }
+
+void tq_get_stats(ThreadQueue *tq, ThreadQueueStats *stats)
+{
+    stats->capacity  = atomic_load(&tq->limit);
+    stats->max_items = atomic_load(&tq->max_items);
+
+    if (tq->spsc) {
+        size_t tail = atomic_load(&tq->tail);
+        stats->nb_items = atomic_load(&tq->head) - tail;
+        return;
+    }
+
+    pthread_mutex_lock(&tq->lock);
+    stats->nb_items = av_fifo_can_read(tq->fifo_stream_index);
+    pthread_mutex_unlock(&tq->lock);
+}
@@ -19,6 +19,7 @@
 #ifndef FFTOOLS_THREAD_QUEUE_H
 #define FFTOOLS_THREAD_QUEUE_H
 
+#include <stdint.h>
 #include <string.h>
 
 enum ThreadQueueType {
@@ -28,6 +29,16 @@ enum ThreadQueueType {
 
 typedef struct ThreadQueue ThreadQueue;
 
+typedef struct ThreadQueueStats {
+    // number of items currently in the queue
+    size_t          nb_items;
+    // largest number of items that were in the queue at once
+    size_t          max_items;
+    // number of items that can currently be stored in the queue without
+    // blocking
+    size_t          capacity;
+} ThreadQueueStats;
+
 /**
  * Allocate a queue for sending data between threads.
  *
@@ -40,6 +51,43 @@ ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
                       enum ThreadQueueType type);
 void         tq_free(ThreadQueue **tq);
 
+/**
+ * Switch the queue to a lock-free single-producer/single-consumer ring.
+ *
+ * In this mode sending and receiving do not take any lock unless the queue is
+ * full or empty, and the other side is only woken up when it actually went to
+ * sleep. Must be called before any item is sent. Afterwards all sending
+ * functions must be called from a single thread and all receiving functions
+ * from a single (other) thread; the role may move to a different thread only
+ * if there is a proper synchronization point between the two.
+ */
+int          tq_set_spsc(ThreadQueue *tq);
+
+/**
+ * Hand items over in batches: a receiver waiting for data is only woken up
+ * once batch_size items are queued, a sender waiting for space once there is
+ * room for batch_size items. Either side waits at most max_delay microseconds
+ * before re-checking the queue, which bounds the added latency.
+ *
+ * Must be called before any item is sent.
+ *
+ * @param batch_size number of items per wakeup, clipped to the queue size;
+ *                   values of 0 or 1 disable batching
+ */
+void         tq_set_batch(ThreadQueue *tq, size_t batch_size, int64_t max_delay);
+
+/**
+ * Bound the queue by media duration rather than by item count: each stream
+ * may only hold as many items as fit into max_duration, judging by the
+ * duration of the last item sent for it, and at least one. The total stays
+ * capped by the queue size.
+ *
+ * Must be called before any item is sent.
+ *
+ * @param max_duration duration in AV_TIME_BASE units
+ */
+int          tq_set_max_duration(ThreadQueue *tq, int64_t max_duration);
+
 /**
  * Send an item for the given stream to the queue.
  *
@@ -53,6 +101,20 @@ void         tq_free(ThreadQueue **tq);
  * - AVERROR_EOF the receiving side has marked the given stream as finished
  */
 int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data);
+/**
+ * Send several items at once, taking the queue lock (or publishing them to
+ * the receiver in SPSC mode) once for the whole batch rather than per item.
+ * The items are queued in order until one of them cannot be sent.
+ *
+ * @param stream_idx array of nb_items stream indices, one for each item
+ * @param data array of nb_items items, moved as in tq_send()
+ * @return the number of items sent, counted from the start of the arrays.
+ *         When it is smaller than nb_items, the next item failed and was
+ *         left untouched; when no item could be sent, the error tq_send()
+ *         would have returned for the first one.
+ */
+int tq_send_batch(ThreadQueue *tq, const unsigned int *stream_idx,
+                  void **data, size_t nb_items);
 /**
  * Mark the given stream finished from the sending side.
  */
@@ -73,9 +135,30 @@ void tq_send_finish(ThreadQueue *tq, unsigned int stream_idx);
  *   for each stream. When *stream_idx is -1, all streams are done.
  */
 int tq_receive(ThreadQueue *tq, int *stream_idx, void *data);
+/**
+ * Read up to nb_items items from the queue at once, taking the queue lock (or
+ * handing their slots back to the sender in SPSC mode) once for the whole
+ * batch. Blocks until at least one item is available, but returns whatever
+ * is queued at that point rather than waiting for nb_items.
+ *
+ * @param stream_idx array of nb_items entries; the stream index of each item
+ *                   read is written here, on EOF stream_idx[0] is set as in
+ *                   tq_receive()
+ * @param data array of nb_items items to write the data to
+ * @return the number of items read (at least 1), or AVERROR_EOF as in
+ *         tq_receive(); a stream EOF is only returned once all items queued
+ *         before it have been read
+ */
+int tq_receive_batch(ThreadQueue *tq, int *stream_idx, void **data,
+                     size_t nb_items);
 /**
  * Mark the given stream finished from the receiving side.
  */
 void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx);
 
+/**
+ * Get the fill state of the queue. May be called from any thread.
+ */
+void tq_get_stats(ThreadQueue *tq, ThreadQueueStats *stats);
+
 #endif // FFTOOLS_THREAD_QUEUE_H
@@ -826,6 +826,34 @@ static void copy_input_samples(AACEncContext *s, const AVFrame *frame)
     }
 }
 
+typedef struct AACEncSearchJob {
+    SingleChannelElement *sce;
+    enum RawDataBlockType type;
+    int channel;
+    int bitres_alloc;                            ///< psy allocation of the channel element
+    int cutoff;                                  ///< psy cutoff set by the search
+} AACEncSearchJob;
+
+/* Search the quantizers of one channel in the context of the calling thread,
+ * refreshed from the main one. */
+static int search_for_quantizers_job(AVCodecContext *avctx, void *arg,
+                                     int jobnr, int threadnr)
+{
+    AACEncContext *s0 = avctx->priv_data, *s = s0->thread_ctx[threadnr];
+    AACEncSearchJob *job = (AACEncSearchJob *)arg + jobnr;
+
+    memcpy(s, s0, offsetof(AACEncContext, qcoefs));
+    s->cur_type         = job->type;
+    s->cur_channel      = job->channel;
+    s->psy.bitres.alloc = job->bitres_alloc;
+    if (s->options.pns && s->coder->mark_pns)
+        s->coder->mark_pns(s, avctx, job->sce);
+    s->coder->search_for_quantizers(avctx, s, job->sce, s->lambda);
+    job->cutoff = s->psy.cutoff;
+
+    return 0;
+}
+
 static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                             const AVFrame *frame, int *got_packet_ptr)
 {
@@ -839,6 +867,9 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
     int ms_mode = 0, is_mode = 0, tns_mode = 0, pred_mode = 0;
     int chan_el_counter[4];
     FFPsyWindowInfo windows[AAC_MAX_CHANNELS];
+    AACEncSearchJob jobs[AAC_MAX_CHANNELS];
+    int bitres_alloc[AAC_MAX_CHANNELS];
+    int parallel;
 
     /* add current frame to queue */
     if (frame) {
@@ -959,11 +990,15 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
 
         if ((avctx->frame_num & 0xFF)==1 && !(avctx->flags & AV_CODEC_FLAG_BITEXACT))
             put_bitstream_info(s, LIBAVCODEC_IDENT);
+        /* The psy model carries state from one channel element to the next,
+         * including the cutoff set by the quantizer search, so it runs first
+         * for all elements. The quantizer searches then only depend on its
+         * results and, once the cutoff is known, run for all channels
+         * concurrently. */
+        parallel = s->thread_ctx && s->cutoff_known;
         start_ch = 0;
         target_bits = 0;
-        memset(chan_el_counter, 0, sizeof(chan_el_counter));
         for (i = 0; i < s->chan_map[0]; i++) {
-            FFPsyWindowInfo* wi = windows + start_ch;
             const float *coeffs[2];
             tag      = s->chan_map[i+1];
             chans    = tag == TYPE_CPE ? 2 : 1;
@@ -971,8 +1006,6 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
             cpe->common_window = 0;
             memset(cpe->is_mask, 0, sizeof(cpe->is_mask));
             memset(cpe->ms_mask, 0, sizeof(cpe->ms_mask));
-            put_bits(&s->pb, 3, tag);
-            put_bits(&s->pb, 4, chan_el_counter[tag]++);
             for (ch = 0; ch < chans; ch++) {
                 sce = &cpe->ch[ch];
                 coeffs[ch] = sce->coeffs;
@@ -987,20 +1020,50 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
             }
             s->psy.bitres.alloc = -1;
             s->psy.bitres.bits = s->last_frame_pb_count / s->channels;
-            s->psy.model->analyze(&s->psy, start_ch, coeffs, wi);
+            s->psy.model->analyze(&s->psy, start_ch, coeffs, windows + start_ch);
             if (s->psy.bitres.alloc > 0) {
                 /* Lambda unused here on purpose, we need to take psy's unscaled allocation */
                 target_bits += s->psy.bitres.alloc
                     * (s->lambda / (avctx->global_quality ? avctx->global_quality : 120));
                 s->psy.bitres.alloc /= chans;
             }
+            bitres_alloc[i] = s->psy.bitres.alloc;
             s->cur_type = tag;
             for (ch = 0; ch < chans; ch++) {
+                if (parallel) {
+                    jobs[start_ch + ch] = (AACEncSearchJob) {
+                        .sce          = &cpe->ch[ch],
+                        .type         = tag,
+                        .channel      = start_ch + ch,
+                        .bitres_alloc = s->psy.bitres.alloc,
+                    };
+                    continue;
+                }
                 s->cur_channel = start_ch + ch;
                 if (s->options.pns && s->coder->mark_pns)
                     s->coder->mark_pns(s, avctx, &cpe->ch[ch]);
                 s->coder->search_for_quantizers(avctx, s, &cpe->ch[ch], s->lambda);
             }
+            start_ch += chans;
+        }
+        if (parallel) {
+            avctx->execute2(avctx, search_for_quantizers_job, jobs, NULL, s->channels);
+            for (ch = 0; ch < s->channels; ch++)
+                av_assert1(jobs[ch].cutoff == s->psy.cutoff);
+        }
+        s->cutoff_known = 1;
+
+        start_ch = 0;
+        memset(chan_el_counter, 0, sizeof(chan_el_counter));
+        for (i = 0; i < s->chan_map[0]; i++) {
+            FFPsyWindowInfo* wi = windows + start_ch;
+            tag      = s->chan_map[i+1];
+            chans    = tag == TYPE_CPE ? 2 : 1;
+            cpe      = &s->cpe[i];
+            put_bits(&s->pb, 3, tag);
+            put_bits(&s->pb, 4, chan_el_counter[tag]++);
+            s->cur_type = tag;
+            s->psy.bitres.alloc = bitres_alloc[i];
             if (chans > 1
                 && wi[0].window_type[0] == wi[1].window_type[0]
                 && wi[0].window_shape   == wi[1].window_shape) {
@@ -1198,6 +1261,10 @@ static av_cold int aac_encode_end(AVCodecContext *avctx)
     av_freep(&s->buffer.samples);
     av_freep(&s->cpe);
     av_freep(&s->fdsp);
+    if (s->thread_ctx)
+        for (int i = 0; i < avctx->thread_count; i++)
+            av_freep(&s->thread_ctx[i]);
+    av_freep(&s->thread_ctx);
     ff_af_queue_close(&s->afq);
     return 0;
 }
@@ -1386,6 +1453,17 @@ static av_cold int aac_encode_init(AVCodecContext *avctx)
 
     ff_af_queue_init(avctx, &s->afq);
 
+    if (avctx->active_thread_type & FF_THREAD_SLICE) {
+        s->thread_ctx = av_calloc(avctx->thread_count, sizeof(*s->thread_ctx));
+        if (!s->thread_ctx)
+            return AVERROR(ENOMEM);
+        for (i = 0; i < avctx->thread_count; i++) {
+            s->thread_ctx[i] = av_memdup(s, sizeof(*s));
+            if (!s->thread_ctx[i])
+                return AVERROR(ENOMEM);
+        }
+    }
+
     return 0;
 }
 
@@ -1424,7 +1502,7 @@ const FFCodec ff_aac_encoder = {
     .p.type         = AVMEDIA_TYPE_AUDIO,
     .p.id           = AV_CODEC_ID_AAC,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
-                      AV_CODEC_CAP_SMALL_LAST_FRAME,
+                      AV_CODEC_CAP_SMALL_LAST_FRAME | AV_CODEC_CAP_SLICE_THREADS,
     .priv_data_size = sizeof(AACEncContext),
     .init           = aac_encode_init,
     FF_CODEC_ENCODE_CB(aac_encode_frame),
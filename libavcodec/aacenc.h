@@ -240,8 +240,13 @@ typedef struct AACEncContext {
     float lambda_sum;                            ///< sum(lambda), for Qvg reporting
     int lambda_count;                            ///< count(lambda), for Qvg reporting
     enum RawDataBlockType cur_type;              ///< channel group type cur_channel belongs to
+    struct AACEncContext **thread_ctx;           ///< per-thread duplicate contexts for the quantizer searches
+    int cutoff_known;                            ///< the quantizer search has set the psy cutoff, see aac_encode_frame()
 
     AudioFrameQueue afq;
+
+    /* The fields below are scratch space private to each (duplicate) context,
+     * the ones above are copied to a thread context before it is used. */
     DECLARE_ALIGNED(32, int,   qcoefs)[96];      ///< quantized coefficients
     DECLARE_ALIGNED(32, float, scoefs)[1024];    ///< scaled coefficients
 
@@ -88,6 +88,12 @@
  * encoders do.
  */
 #define FF_CODEC_CAP_EOF_FLUSH              (1 << 10)
+/**
+ * The decoder supports frame threading, but it is only used when the caller
+ * asked for frame threading alone (thread_type == FF_THREAD_FRAME), as it
+ * adds delay. Slice threading is preferred otherwise.
+ */
+#define FF_CODEC_CAP_FRAME_THREADS_OPT_IN   (1 << 11)
 
 /**
  * FFCodec.codec_tags termination value
@@ -32,6 +32,8 @@
 
 #include "config_components.h"
 
+#include <stdatomic.h>
+
 #include "libavutil/display.h"
 #include "libavutil/emms.h"
 #include "libavutil/imgutils.h"
@@ -53,6 +55,7 @@
 #include "jpeglsdec.h"
 #include "profiles.h"
 #include "put_bits.h"
+#include "thread.h"
 #include "exif.h"
 #include "bytestream.h"
 #include "tiff_common.h"
@@ -757,7 +760,7 @@ int ff_mjpeg_decode_sof(MJpegDecodeContext *s)
         }
 
         av_frame_unref(s->picture_ptr);
-        if (ff_get_buffer(s->avctx, s->picture_ptr, AV_GET_BUFFER_FLAG_REF) < 0)
+        if (ff_thread_get_buffer(s->avctx, s->picture_ptr, AV_GET_BUFFER_FLAG_REF) < 0)
             return -1;
         s->picture_ptr->pict_type = AV_PICTURE_TYPE_I;
         s->picture_ptr->flags |= AV_FRAME_FLAG_KEY;
@@ -801,26 +804,27 @@ int ff_mjpeg_decode_sof(MJpegDecodeContext *s)
         memset(s->coefs_finished, 0, sizeof(s->coefs_finished));
     }
 
-    if (s->avctx->hwaccel) {
-        const FFHWAccel *hwaccel = ffhwaccel(s->avctx->hwaccel);
-        s->hwaccel_picture_private =
-            av_mallocz(hwaccel->frame_priv_data_size);
-        if (!s->hwaccel_picture_private)
-            return AVERROR(ENOMEM);
+    return 0;
+}
 
-        ret = hwaccel->start_frame(s->avctx, s->raw_image_buffer,
-                                   s->raw_image_buffer_size);
-        if (ret < 0)
-            return ret;
-    }
+static int mjpeg_hwaccel_start_frame(MJpegDecodeContext *s)
+{
+    const FFHWAccel *hwaccel = ffhwaccel(s->avctx->hwaccel);
 
-    return 0;
+    s->hwaccel_picture_private =
+        av_mallocz(hwaccel->frame_priv_data_size);
+    if (!s->hwaccel_picture_private)
+        return AVERROR(ENOMEM);
+
+    return hwaccel->start_frame(s->avctx, s->raw_image_buffer,
+                                s->raw_image_buffer_size);
 }
 
-static inline int mjpeg_decode_dc(MJpegDecodeContext *s, int dc_index)
+static inline int mjpeg_decode_dc(MJpegDecodeContext *s, GetBitContext *gb,
+                                  int dc_index)
 {
     int code;
-    code = get_vlc2(&s->gb, s->vlcs[0][dc_index].table, 9, 2);
+    code = get_vlc2(gb, s->vlcs[0][dc_index].table, 9, 2);
     if (code < 0 || code > 16) {
         av_log(s->avctx, AV_LOG_WARNING,
                "mjpeg_decode_dc: bad vlc: %d:%d (%p)\n",
@@ -829,46 +833,47 @@ static inline int mjpeg_decode_dc(MJpegDecodeContext *s, int dc_index)
     }
 
     if (code)
-        return get_xbits(&s->gb, code);
+        return get_xbits(gb, code);
     else
         return 0;
 }
 
 /* decode block and dequantize */
-static int decode_block(MJpegDecodeContext *s, int16_t *block, int component,
+static int decode_block(MJpegDecodeContext *s, GetBitContext *gb,
+                        int16_t *block, int *last_dc,
                         int dc_index, int ac_index, uint16_t *quant_matrix)
 {
     int code, i, j, level, val;
 
     /* DC coef */
-    val = mjpeg_decode_dc(s, dc_index);
+    val = mjpeg_decode_dc(s, gb, dc_index);
     if (val == 0xfffff) {
         av_log(s->avctx, AV_LOG_ERROR, "error dc\n");
         return AVERROR_INVALIDDATA;
     }
-    val = val * (unsigned)quant_matrix[0] + s->last_dc[component];
-    s->last_dc[component] = val;
+    val = val * (unsigned)quant_matrix[0] + *last_dc;
+    *last_dc = val;
     block[0] = av_clip_int16(val);
     /* AC coefs */
     i = 0;
-    {OPEN_READER(re, &s->gb);
+    {OPEN_READER(re, gb);
     do {
-        UPDATE_CACHE(re, &s->gb);
-        GET_VLC(code, re, &s->gb, s->vlcs[1][ac_index].table, 9, 2);
+        UPDATE_CACHE(re, gb);
+        GET_VLC(code, re, gb, s->vlcs[1][ac_index].table, 9, 2);
 
         i += ((unsigned)code) >> 4;
             code &= 0xf;
         if (code) {
             if (code > MIN_CACHE_BITS - 16)
-                UPDATE_CACHE(re, &s->gb);
+                UPDATE_CACHE(re, gb);
 
             {
-                int cache = GET_CACHE(re, &s->gb);
+                int cache = GET_CACHE(re, gb);
                 int sign  = (~cache) >> 31;
                 level     = (NEG_USR32(sign ^ cache,code) ^ sign) - sign;
             }
 
-            LAST_SKIP_BITS(re, &s->gb, code);
+            LAST_SKIP_BITS(re, gb, code);
 
             if (i > 63) {
                 av_log(s->avctx, AV_LOG_ERROR, "error count: %d\n", i);
@@ -878,7 +883,7 @@ static int decode_block(MJpegDecodeContext *s, int16_t *block, int component,
             block[j] = level * quant_matrix[i];
         }
     } while (i < 63);
-    CLOSE_READER(re, &s->gb);}
+    CLOSE_READER(re, gb);}
 
     return 0;
 }
@@ -889,7 +894,7 @@ static int decode_dc_progressive(MJpegDecodeContext *s, int16_t *block,
 {
     unsigned val;
     s->bdsp.clear_block(block);
-    val = mjpeg_decode_dc(s, dc_index);
+    val = mjpeg_decode_dc(s, &s->gb, dc_index);
     if (val == 0xfffff) {
         av_log(s->avctx, AV_LOG_ERROR, "error dc\n");
         return AVERROR_INVALIDDATA;
@@ -1183,7 +1188,7 @@ static int ljpeg_decode_rgb_scan(MJpegDecodeContext *s, int nb_components, int p
                 topleft[i] = top[i];
                 top[i]     = buffer[mb_x][i];
 
-                dc = mjpeg_decode_dc(s, s->dc_index[i]);
+                dc = mjpeg_decode_dc(s, &s->gb, s->dc_index[i]);
                 if(dc == 0xFFFFF)
                     return -1;
 
@@ -1317,7 +1322,7 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor,
                     for(j=0; j<n; j++) {
                         int pred, dc;
 
-                        dc = mjpeg_decode_dc(s, s->dc_index[i]);
+                        dc = mjpeg_decode_dc(s, &s->gb, s->dc_index[i]);
                         if(dc == 0xFFFFF)
                             return -1;
                         if (   h * mb_x + x >= s->width
@@ -1388,7 +1393,7 @@ static int ljpeg_decode_yuv_scan(MJpegDecodeContext *s, int predictor,
                     for (j = 0; j < n; j++) {
                         int pred;
 
-                        dc = mjpeg_decode_dc(s, s->dc_index[i]);
+                        dc = mjpeg_decode_dc(s, &s->gb, s->dc_index[i]);
                         if(dc == 0xFFFFF)
                             return -1;
                         if (   h * mb_x + x >= s->width
@@ -1457,6 +1462,95 @@ static void shift_output(MJpegDecodeContext *s, uint8_t *ptr, int linesize)
     }
 }
 
+typedef struct MJpegScanSlices {
+    int nb_components;
+    atomic_int error;
+} MJpegScanSlices;
+
+/* decode the MCUs of one restart interval of a sequential DCT scan */
+static int mjpeg_decode_scan_slice(AVCodecContext *avctx, void *arg,
+                                   int jobnr, int threadnr)
+{
+    MJpegDecodeContext *s = avctx->priv_data;
+    MJpegScanSlices *slices = arg;
+    const int nb_components   = slices->nb_components;
+    const int bytes_per_pixel = 1 + (s->bits > 8);
+    const int nb_mcus         = s->mb_width * s->mb_height;
+    const int mcu_start       = jobnr * s->restart_interval;
+    const int mcu_end         = FFMIN(mcu_start + s->restart_interval, nb_mcus);
+    const unsigned buf_size   = (s->gb.size_in_bits + 7) >> 3;
+    const unsigned start      = s->restart_offsets[jobnr];
+    const unsigned end        = jobnr + 1 < s->nb_restart_offsets ?
+                                s->restart_offsets[jobnr + 1] - 2 : buf_size;
+    int last_dc[MAX_COMPONENTS];
+    int chroma_h_shift, chroma_v_shift, chroma_width, chroma_height;
+    GetBitContext gb;
+    LOCAL_ALIGNED_32(int16_t, block, [64]);
+
+    if (start > end || end > buf_size ||
+        init_get_bits8(&gb, s->gb.buffer + start, end - start) < 0)
+        goto fail;
+
+    av_pix_fmt_get_chroma_sub_sample(avctx->pix_fmt, &chroma_h_shift,
+                                     &chroma_v_shift);
+    chroma_width  = AV_CEIL_RSHIFT(s->width,  chroma_h_shift);
+    chroma_height = AV_CEIL_RSHIFT(s->height, chroma_v_shift);
+
+    for (int i = 0; i < nb_components; i++)
+        last_dc[i] = 4 << s->bits;
+
+    for (int mcu = mcu_start; mcu < mcu_end; mcu++) {
+        const int mb_x = mcu % s->mb_width;
+        const int mb_y = mcu / s->mb_width;
+
+        if (get_bits_left(&gb) < 0) {
+            av_log(avctx, AV_LOG_ERROR, "overread %d\n", -get_bits_left(&gb));
+            goto fail;
+        }
+        for (int i = 0; i < nb_components; i++) {
+            const int c = s->comp_index[i];
+            const int h = s->h_scount[i];
+            const int v = s->v_scount[i];
+            const int linesize = s->linesize[c];
+            int x = 0, y = 0;
+
+            for (int j = 0; j < s->nb_blocks[i]; j++) {
+                int block_offset = ((linesize * (v * mb_y + y) * 8) +
+                                    (h * mb_x + x) * 8 * bytes_per_pixel) >> avctx->lowres;
+                uint8_t *ptr = NULL;
+
+                if (s->interlaced && s->bottom_field)
+                    block_offset += linesize >> 1;
+                if (   8*(h * mb_x + x) < ((c == 1) || (c == 2) ? chroma_width  : s->width)
+                    && 8*(v * mb_y + y) < ((c == 1) || (c == 2) ? chroma_height : s->height))
+                    ptr = s->picture_ptr->data[c] + block_offset;
+
+                s->bdsp.clear_block(block);
+                if (decode_block(s, &gb, block, &last_dc[i],
+                                 s->dc_index[i], s->ac_index[i],
+                                 s->quant_matrixes[s->quant_sindex[i]]) < 0) {
+                    av_log(avctx, AV_LOG_ERROR,
+                           "error y=%d x=%d\n", mb_y, mb_x);
+                    goto fail;
+                }
+                if (ptr && linesize) {
+                    s->idsp.idct_put(ptr, linesize, block);
+                    if (s->bits & 7)
+                        shift_output(s, ptr, linesize);
+                }
+                if (++x == h) {
+                    x = 0;
+                    y++;
+                }
+            }
+        }
+    }
+    return 0;
+fail:
+    atomic_store(&slices->error, 1);
+    return AVERROR_INVALIDDATA;
+}
+
 static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
                              int Al, const uint8_t *mb_bitmask,
                              int mb_bitmask_size,
@@ -1492,6 +1586,21 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
         s->coefs_finished[c] |= 1;
     }
 
+    /* Every restart interval can be decoded independently once the
+     * positions of all RSTn markers are known. */
+    if (!mb_bitmask && !s->progressive && s->restart_interval &&
+        s->nb_restart_offsets > 1 &&
+        s->nb_restart_offsets == (s->mb_width * s->mb_height - 1) / s->restart_interval + 1) {
+        MJpegScanSlices slices = { .nb_components = nb_components };
+
+        s->restart_offsets[0] = get_bits_count(&s->gb) >> 3;
+        atomic_init(&slices.error, 0);
+        s->avctx->execute2(s->avctx, mjpeg_decode_scan_slice, &slices,
+                           NULL, s->nb_restart_offsets);
+        skip_bits_long(&s->gb, get_bits_left(&s->gb));
+        return atomic_load(&slices.error) ? AVERROR_INVALIDDATA : 0;
+    }
+
     for (mb_y = 0; mb_y < s->mb_height; mb_y++) {
         for (mb_x = 0; mb_x < s->mb_width; mb_x++) {
             const int copy_mb = mb_bitmask && !get_bits1(&mb_bitmask_gb);
@@ -1533,7 +1642,7 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
 
                         } else {
                             s->bdsp.clear_block(s->block);
-                            if (decode_block(s, s->block, i,
+                            if (decode_block(s, &s->gb, s->block, &s->last_dc[i],
                                              s->dc_index[i], s->ac_index[i],
                                              s->quant_matrixes[s->quant_sindex[i]]) < 0) {
                                 av_log(s->avctx, AV_LOG_ERROR,
@@ -2237,6 +2346,71 @@ found:
     return val;
 }
 
+/**
+ * Save the quantization and Huffman tables that will be in effect at the end
+ * of the packet for the next frame thread: the current ones, updated by the
+ * DQT and DHT segments following the segment at buf_ptr.
+ */
+static void save_next_tables(MJpegDecodeContext *s,
+                             const uint8_t *buf_ptr, const uint8_t *buf_end)
+{
+    memcpy(s->next_quant_matrixes,  s->quant_matrixes,      sizeof(s->quant_matrixes));
+    memcpy(s->next_qscale,          s->qscale,              sizeof(s->qscale));
+    memcpy(s->next_huffman_lengths, s->raw_huffman_lengths, sizeof(s->raw_huffman_lengths));
+    memcpy(s->next_huffman_values,  s->raw_huffman_values,  sizeof(s->raw_huffman_values));
+
+    while (buf_end - buf_ptr >= 2) {
+        int len = AV_RB16(buf_ptr), start_code;
+        GetByteContext gb;
+
+        /* skip the marker segment, entropy coded data is scanned for markers */
+        if (len < 2 || len > buf_end - buf_ptr)
+            break;
+        buf_ptr += len;
+        do {
+            start_code = find_marker(&buf_ptr, buf_end);
+        } while (start_code == SOI || (start_code >= RST0 && start_code <= RST7) ||
+                 (start_code == EOI && s->interlaced));
+        /* the decoder stops at the EOI of a frame */
+        if (start_code < 0 || start_code == EOI || buf_end - buf_ptr < 2)
+            break;
+
+        bytestream2_init(&gb, buf_ptr + 2, FFMIN(AV_RB16(buf_ptr), buf_end - buf_ptr) - 2);
+        if (start_code == DQT) {
+            while (bytestream2_get_bytes_left(&gb) >= 65) {
+                int pr    = bytestream2_peek_byte(&gb) >> 4;
+                int index = bytestream2_get_byte(&gb) & 0xf;
+                uint16_t *matrix = s->next_quant_matrixes[index];
+
+                if (pr > 1 || index >= 4 ||
+                    bytestream2_get_bytes_left(&gb) < 64 << pr)
+                    break;
+                for (int i = 0; i < 64; i++)
+                    matrix[i] = pr ? bytestream2_get_be16u(&gb) :
+                                     bytestream2_get_byteu(&gb);
+                s->next_qscale[index] = FFMAX(matrix[1], matrix[8]) >> 1;
+            }
+        } else if (start_code == DHT) {
+            while (bytestream2_get_bytes_left(&gb) >= 17) {
+                int class = bytestream2_peek_byte(&gb) >> 4;
+                int index = bytestream2_get_byte(&gb) & 0xf;
+                uint8_t lengths[16];
+                int n = 0;
+
+                if (class >= 2 || index >= 4)
+                    break;
+                bytestream2_get_bufferu(&gb, lengths, 16);
+                for (int i = 0; i < 16; i++)
+                    n += lengths[i];
+                if (n > 256 || bytestream2_get_bytes_left(&gb) < n)
+                    break;
+                memcpy(s->next_huffman_lengths[class][index], lengths, 16);
+                bytestream2_get_bufferu(&gb, s->next_huffman_values[class][index], n);
+            }
+        }
+    }
+}
+
 int ff_mjpeg_find_marker(MJpegDecodeContext *s,
                          const uint8_t **buf_ptr, const uint8_t *buf_end,
                          const uint8_t **unescaped_buf_ptr,
@@ -2254,6 +2428,12 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
         const uint8_t *src = *buf_ptr;
         const uint8_t *ptr = src;
         uint8_t *dst = s->buffer;
+        /* slot 0 is reserved for the start of the entropy coded data */
+        const int record_rst = s->avctx->active_thread_type & FF_THREAD_SLICE;
+        /* a truncated scan is treated as ending the picture */
+        int end_marker = EOI;
+
+        s->nb_restart_offsets = 1;
 
         #define copy_data_segment(skip) do {       \
             ptrdiff_t length = (ptr - src) - (skip);  \
@@ -2290,8 +2470,22 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
 
                     if (x < RST0 || x > RST7) {
                         copy_data_segment(1);
-                        if (x)
+                        if (x) {
+                            end_marker = x;
                             break;
+                        }
+                    } else if (record_rst) {
+                        /* Any 0xFF fill bytes before the marker have been
+                         * dropped above, so everything left to copy ends
+                         * with the marker and the next restart interval
+                         * starts right after it. */
+                        unsigned *offsets = av_fast_realloc(s->restart_offsets,
+                                                            &s->restart_offsets_size,
+                                                            (s->nb_restart_offsets + 1) * sizeof(*offsets));
+                        if (!offsets)
+                            return AVERROR(ENOMEM);
+                        s->restart_offsets = offsets;
+                        offsets[s->nb_restart_offsets++] = dst - s->buffer + (ptr - src);
                     }
                 }
             }
@@ -2300,6 +2494,8 @@ int ff_mjpeg_find_marker(MJpegDecodeContext *s,
         }
         #undef copy_data_segment
 
+        s->scan_ends_picture = end_marker == EOI;
+
         *unescaped_buf_ptr  = s->buffer;
         *unescaped_buf_size = dst - s->buffer;
         memset(s->buffer + *unescaped_buf_size, 0,
@@ -2384,12 +2580,15 @@ int ff_mjpeg_decode_frame_from_buf(AVCodecContext *avctx, AVFrame *frame,
     int index;
     int ret = 0;
     int is16bit;
+    int single_scan;
     AVDictionaryEntry *e = NULL;
 
     s->force_pal8 = 0;
 
     s->buf_size = buf_size;
 
+    s->setup_finished = 0;
+
     av_dict_free(&s->exif_metadata);
     av_freep(&s->stereo3d);
     s->adobe_transform = -1;
@@ -2593,6 +2792,24 @@ eoi_parser:
                 break;
             }
 
+            /* Release the next frame thread as soon as nothing it copies
+             * from this context can change anymore. Hwaccels must not be
+             * called before that point, so they always do it here. */
+            single_scan = s->cur_scan == 1 && s->scan_ends_picture &&
+                          !s->interlaced && !s->ls;
+            if (s->got_picture && !s->setup_finished &&
+                (avctx->hwaccel || single_scan)) {
+                s->setup_final    = single_scan;
+                s->setup_finished = 1;
+                if (!s->setup_final)
+                    save_next_tables(s, buf_ptr, buf_end);
+                ff_thread_finish_setup(avctx);
+            }
+
+            if (avctx->hwaccel && s->got_picture && s->cur_scan == 1 &&
+                (ret = mjpeg_hwaccel_start_frame(s)) < 0)
+                goto fail;
+
             if ((ret = ff_mjpeg_decode_sos(s, NULL, 0, NULL)) < 0 &&
                 (avctx->err_recognition & AV_EF_EXPLODE))
                 goto fail;
@@ -2966,6 +3183,8 @@ av_cold int ff_mjpeg_decode_end(AVCodecContext *avctx)
     av_freep(&s->stereo3d);
     av_freep(&s->ljpeg_buffer);
     s->ljpeg_buffer_size = 0;
+    av_freep(&s->restart_offsets);
+    s->restart_offsets_size = 0;
 
     for (i = 0; i < 3; i++) {
         for (j = 0; j < 4; j++)
@@ -2995,6 +3214,114 @@ static void decode_flush(AVCodecContext *avctx)
 }
 
 #if CONFIG_MJPEG_DECODER
+#if HAVE_THREADS
+static int copy_huffman_table(MJpegDecodeContext *s, int class, int index,
+                              const uint8_t *lengths, const uint8_t *values)
+{
+    uint8_t bits_table[17] = { 0 };
+    int nb_codes = 0, ret;
+
+    for (int i = 0; i < 16; i++)
+        nb_codes += lengths[i];
+
+    if (!memcmp(s->raw_huffman_lengths[class][index], lengths, 16) &&
+        !memcmp(s->raw_huffman_values[class][index], values, nb_codes))
+        return 0;
+
+    memcpy(s->raw_huffman_lengths[class][index], lengths, 16);
+    memcpy(s->raw_huffman_values[class][index], values, nb_codes);
+    memcpy(bits_table + 1, lengths, 16);
+
+    ff_vlc_free(&s->vlcs[class][index]);
+    if (class > 0)
+        ff_vlc_free(&s->vlcs[2][index]);
+    if (!nb_codes)
+        return 0;
+
+    if ((ret = ff_mjpeg_build_vlc(&s->vlcs[class][index], bits_table,
+                                  values, class > 0, s->avctx)) < 0)
+        return ret;
+    if (class > 0)
+        return ff_mjpeg_build_vlc(&s->vlcs[2][index], bits_table,
+                                  values, 0, s->avctx);
+    return 0;
+}
+
+static int mjpeg_update_thread_context(AVCodecContext *dst,
+                                       const AVCodecContext *src)
+{
+    MJpegDecodeContext *s = dst->priv_data;
+    const MJpegDecodeContext *s1 = src->priv_data;
+    int ret;
+
+    if (s == s1)
+        return 0;
+
+    /* The source thread was released before it finished parsing its packet
+     * (hwaccel decoding of a multi-scan or interlaced picture), so the rest
+     * of its state may still change; only take the tables it saved for us. */
+    if (s1->setup_finished && !s1->setup_final) {
+        memcpy(s->quant_matrixes, s1->next_quant_matrixes, sizeof(s->quant_matrixes));
+        memcpy(s->qscale,         s1->next_qscale,         sizeof(s->qscale));
+
+        for (int class = 0; class < 2; class++) {
+            for (int index = 0; index < 4; index++) {
+                if ((ret = copy_huffman_table(s, class, index,
+                                              s1->next_huffman_lengths[class][index],
+                                              s1->next_huffman_values[class][index])) < 0)
+                    return ret;
+            }
+        }
+        return 0;
+    }
+
+    memcpy(s->quant_matrixes, s1->quant_matrixes, sizeof(s->quant_matrixes));
+    memcpy(s->qscale,         s1->qscale,         sizeof(s->qscale));
+
+    for (int class = 0; class < 2; class++) {
+        for (int index = 0; index < 4; index++) {
+            if ((ret = copy_huffman_table(s, class, index,
+                                          s1->raw_huffman_lengths[class][index],
+                                          s1->raw_huffman_values[class][index])) < 0)
+                return ret;
+        }
+    }
+
+    s->first_picture      = s1->first_picture;
+    s->width              = s1->width;
+    s->height             = s1->height;
+    s->bits               = s1->bits;
+    memcpy(s->h_count, s1->h_count, sizeof(s->h_count));
+    memcpy(s->v_count, s1->v_count, sizeof(s->v_count));
+    s->interlaced         = s1->interlaced;
+    s->bottom_field       = s1->bottom_field;
+    s->interlace_polarity = s1->interlace_polarity;
+    s->buggy_avid         = s1->buggy_avid;
+    s->cs_itu601          = s1->cs_itu601;
+    s->multiscope         = s1->multiscope;
+    s->flipped            = s1->flipped;
+    s->pegasus_rct        = s1->pegasus_rct;
+    s->rgb                = s1->rgb;
+    s->colr               = s1->colr;
+    s->xfrm               = s1->xfrm;
+    s->hwaccel_pix_fmt    = s1->hwaccel_pix_fmt;
+    s->hwaccel_sw_pix_fmt = s1->hwaccel_sw_pix_fmt;
+
+    /* a picture of which only the first field has been decoded so far */
+    av_frame_unref(s->picture_ptr);
+    s->got_picture = 0;
+    if (s1->interlaced && s1->got_picture) {
+        if ((ret = av_frame_ref(s->picture_ptr, s1->picture_ptr)) < 0)
+            return ret;
+        memcpy(s->linesize, s1->linesize, sizeof(s->linesize));
+        s->pix_desc    = s1->pix_desc;
+        s->got_picture = 1;
+    }
+
+    return 0;
+}
+#endif
+
 #define OFFSET(x) offsetof(MJpegDecodeContext, x)
 #define VD AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_DECODING_PARAM
 static const AVOption options[] = {
@@ -3019,8 +3346,10 @@ const FFCodec ff_mjpeg_decoder = {
     .init           = ff_mjpeg_decode_init,
     .close          = ff_mjpeg_decode_end,
     FF_CODEC_DECODE_CB(ff_mjpeg_decode_frame),
+    UPDATE_THREAD_CONTEXT(mjpeg_update_thread_context),
     .flush          = decode_flush,
-    .p.capabilities = AV_CODEC_CAP_DR1,
+    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_FRAME_THREADS |
+                      AV_CODEC_CAP_SLICE_THREADS,
     .p.max_lowres   = 3,
     .p.priv_class   = &mjpegdec_class,
     .p.profiles     = NULL_IF_CONFIG_SMALL(ff_mjpeg_profiles),
@@ -123,6 +123,9 @@ typedef struct MJpegDecodeContext {
 
     int restart_interval;
     int restart_count;
+    unsigned *restart_offsets;          ///< offsets in buffer following each RSTn of the current scan
+    unsigned int restart_offsets_size;
+    int nb_restart_offsets;
 
     int buggy_avid;
     int cs_itu601;
@@ -161,6 +164,16 @@ typedef struct MJpegDecodeContext {
     uint8_t raw_huffman_lengths[2][4][16];
     uint8_t raw_huffman_values[2][4][256];
 
+    int scan_ends_picture; ///< the last unescaped scan is followed by EOI or the end of the packet, not by another marker
+    int setup_finished; ///< frame threading: ff_thread_finish_setup() was called for the current packet
+    int setup_final;    ///< frame threading: the state read by the next thread is complete
+    /* frame threading: tables in effect at the end of the packet, saved for
+     * the next thread when setup is finished before the packet is parsed */
+    uint16_t next_quant_matrixes[4][64];
+    int next_qscale[4];
+    uint8_t next_huffman_lengths[2][4][16];
+    uint8_t next_huffman_values[2][4][256];
+
     enum AVPixelFormat hwaccel_sw_pix_fmt;
     enum AVPixelFormat hwaccel_pix_fmt;
     void *hwaccel_picture_private;
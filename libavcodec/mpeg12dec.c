@@ -791,17 +791,59 @@ static int mpeg_decode_update_thread_context(AVCodecContext *avctx,
 {
     Mpeg1Context *ctx = avctx->priv_data, *ctx_from = avctx_from->priv_data;
     MpegEncContext *s = &ctx->mpeg_enc_ctx, *s1 = &ctx_from->mpeg_enc_ctx;
-    int err;
+    int err, reinit;
 
     if (avctx == avctx_from || !s1->context_initialized)
         return 0;
 
+    /* The macroblock layout depends on more than the dimensions,
+     * start from scratch if the sequence changed. */
+    if (s->context_initialized &&
+        (s->width         != s1->width         ||
+         s->height        != s1->height        ||
+         s->mb_height     != s1->mb_height     ||
+         s->chroma_format != s1->chroma_format ||
+         s->codec_id      != s1->codec_id))
+        ff_mpv_common_end(s);
+    reinit = !s->context_initialized;
+
     err = ff_mpeg_update_thread_context(avctx, avctx_from);
     if (err)
         return err;
 
-    if (!s->context_initialized)
-        memcpy(s + 1, s1 + 1, sizeof(Mpeg1Context) - sizeof(MpegEncContext));
+    if (reinit && !avctx->lowres)
+        ff_mpv_framesize_disable(&s->sc);
+
+    avctx->codec_id = avctx_from->codec_id;
+    s->bit_rate     = s1->bit_rate;
+    memcpy(s->intra_matrix, s1->intra_matrix, sizeof(s->intra_matrix));
+    memcpy(s->chroma_intra_matrix, s1->chroma_intra_matrix, sizeof(s->chroma_intra_matrix));
+    memcpy(s->inter_matrix, s1->inter_matrix, sizeof(s->inter_matrix));
+    memcpy(s->chroma_inter_matrix, s1->chroma_inter_matrix, sizeof(s->chroma_inter_matrix));
+
+    ctx->pan_scan             = ctx_from->pan_scan;
+    ctx->aspect_ratio_info    = ctx_from->aspect_ratio_info;
+    ctx->save_aspect          = ctx_from->save_aspect;
+    ctx->save_width           = ctx_from->save_width;
+    ctx->save_height          = ctx_from->save_height;
+    ctx->save_progressive_seq = ctx_from->save_progressive_seq;
+    ctx->frame_rate_ext       = ctx_from->frame_rate_ext;
+    ctx->frame_rate_index     = ctx_from->frame_rate_index;
+    ctx->sync                 = ctx_from->sync;
+    ctx->closed_gop           = ctx_from->closed_gop;
+    ctx->tmpgexs              = ctx_from->tmpgexs;
+    ctx->extradata_decoded    = ctx_from->extradata_decoded;
+
+    /* User data and GOP headers preceding the next picture are pending
+     * until its first field is started. */
+    ctx->has_stereo3d         = ctx_from->has_stereo3d;
+    ctx->stereo3d_type        = ctx_from->stereo3d_type;
+    ctx->has_afd              = ctx_from->has_afd;
+    ctx->afd                  = ctx_from->afd;
+    ctx->timecode_frame_start = ctx_from->timecode_frame_start;
+    err = av_buffer_replace(&ctx->a53_buf_ref, ctx_from->a53_buf_ref);
+    if (err < 0)
+        return err;
 
     return 0;
 }
@@ -1250,6 +1292,33 @@ static int mpeg_decode_picture_coding_extension(Mpeg1Context *s1)
     return 0;
 }
 
+/**
+ * Give up on a first field whose second field is missing, so that frame
+ * threads using it as a reference do not wait for it forever.
+ */
+static void mpeg_drop_first_field(MpegEncContext *s)
+{
+    if (s->first_field && s->cur_pic.ptr)
+        ff_thread_progress_report(&s->cur_pic.ptr->progress, INT_MAX);
+    s->first_field = 0;
+}
+
+static int export_timecode(AVCodecContext *avctx, AVFrame *frame, int64_t tc)
+{
+    char tcbuf[AV_TIMECODE_STR_SIZE];
+    AVFrameSideData *tcside = av_frame_new_side_data(frame,
+                                                     AV_FRAME_DATA_GOP_TIMECODE,
+                                                     sizeof(int64_t));
+    if (!tcside)
+        return AVERROR(ENOMEM);
+    memcpy(tcside->data, &tc, sizeof(int64_t));
+
+    av_timecode_make_mpeg_tc_string(tcbuf, tc);
+    av_dict_set(&frame->metadata, "timecode", tcbuf, 0);
+
+    return 0;
+}
+
 static int mpeg_field_start(Mpeg1Context *s1, const uint8_t *buf, int buf_size)
 {
     MpegEncContext *s = &s1->mpeg_enc_ctx;
@@ -1333,7 +1402,20 @@ static int mpeg_field_start(Mpeg1Context *s1, const uint8_t *buf, int buf_size)
             s1->has_afd = 0;
         }
 
-        if (HAVE_THREADS && (avctx->active_thread_type & FF_THREAD_FRAME))
+        /* With frame threading, the timecode can't be held until the
+         * picture is output, as setup is finished by then. */
+        if (HAVE_THREADS && (avctx->active_thread_type & FF_THREAD_FRAME) &&
+            s1->timecode_frame_start != -1) {
+            ret = export_timecode(avctx, s->cur_pic.ptr->f, s1->timecode_frame_start);
+            if (ret < 0)
+                return ret;
+            s1->timecode_frame_start = -1;
+        }
+
+        /* The state of a field pair is only complete once its second
+         * field has been started. */
+        if (HAVE_THREADS && (avctx->active_thread_type & FF_THREAD_FRAME) &&
+            s->picture_structure == PICT_FRAME)
             ff_thread_finish_setup(avctx);
     } else { // second field
         second_field = 1;
@@ -1359,6 +1441,9 @@ static int mpeg_field_start(Mpeg1Context *s1, const uint8_t *buf, int buf_size)
                 s->cur_pic.data[i] +=
                     s->cur_pic.ptr->f->linesize[i];
         }
+
+        if (HAVE_THREADS && (avctx->active_thread_type & FF_THREAD_FRAME))
+            ff_thread_finish_setup(avctx);
     }
 
     if (avctx->hwaccel) {
@@ -1539,7 +1624,9 @@ static int mpeg_decode_slice(MpegEncContext *s, int mb_y,
             int left;
 
             ff_mpeg_draw_horiz_band(s, mb_size * (s->mb_y >> field_pic), mb_size);
-            ff_mpv_report_decode_progress(s);
+            /* rows of a first field are still missing the other field */
+            if (!s->first_field)
+                ff_mpv_report_decode_progress(s);
 
             s->mb_x  = 0;
             s->mb_y += 1 << field_pic;
@@ -1837,11 +1924,12 @@ static int mpeg1_decode_sequence(AVCodecContext *avctx,
     s->width  = width;
     s->height = height;
 
+    mpeg_drop_first_field(s);
+
     /* We set MPEG-2 parameters so that it emulates MPEG-1. */
     s->progressive_sequence = 1;
     s->progressive_frame    = 1;
     s->picture_structure    = PICT_FRAME;
-    s->first_field          = 0;
     s->frame_pred_frame_dct = 1;
     s->chroma_format        = 1;
     s->codec_id             =
@@ -2394,7 +2482,7 @@ static int decode_chunks(AVCodecContext *avctx, AVFrame *picture,
             break;
         case GOP_START_CODE:
             if (last_code == 0) {
-                s2->first_field = 0;
+                mpeg_drop_first_field(s2);
                 ret = mpeg_decode_gop(avctx, buf_ptr, input_size);
                 if (ret < 0)
                     return ret;
@@ -2427,7 +2515,7 @@ static int decode_chunks(AVCodecContext *avctx, AVFrame *picture,
                     av_log(s2->avctx, AV_LOG_WARNING, "invalid frame_pred_frame_dct\n");
 
                 if (s2->picture_structure == PICT_FRAME) {
-                    s2->first_field = 0;
+                    mpeg_drop_first_field(s2);
                     s2->v_edge_pos  = 16 * s2->mb_height;
                 } else {
                     s2->first_field ^= 1;
@@ -2615,16 +2703,9 @@ static int mpeg_decode_frame(AVCodecContext *avctx, AVFrame *picture,
         ff_mpv_unref_picture(&s2->cur_pic);
 
         if (s->timecode_frame_start != -1 && *got_output) {
-            char tcbuf[AV_TIMECODE_STR_SIZE];
-            AVFrameSideData *tcside = av_frame_new_side_data(picture,
-                                                             AV_FRAME_DATA_GOP_TIMECODE,
-                                                             sizeof(int64_t));
-            if (!tcside)
-                return AVERROR(ENOMEM);
-            memcpy(tcside->data, &s->timecode_frame_start, sizeof(int64_t));
-
-            av_timecode_make_mpeg_tc_string(tcbuf, s->timecode_frame_start);
-            av_dict_set(&picture->metadata, "timecode", tcbuf, 0);
+            ret = export_timecode(avctx, picture, s->timecode_frame_start);
+            if (ret < 0)
+                return ret;
 
             s->timecode_frame_start = -1;
         }
@@ -2662,8 +2743,10 @@ const FFCodec ff_mpeg1video_decoder = {
     .close                 = mpeg_decode_end,
     FF_CODEC_DECODE_CB(mpeg_decode_frame),
     .p.capabilities        = AV_CODEC_CAP_DRAW_HORIZ_BAND | AV_CODEC_CAP_DR1 |
-                             AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SLICE_THREADS,
-    .caps_internal         = FF_CODEC_CAP_SKIP_FRAME_FILL_PARAM,
+                             AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SLICE_THREADS |
+                             AV_CODEC_CAP_FRAME_THREADS,
+    .caps_internal         = FF_CODEC_CAP_SKIP_FRAME_FILL_PARAM |
+                             FF_CODEC_CAP_FRAME_THREADS_OPT_IN,
     .flush                 = flush,
     .p.max_lowres          = 3,
     UPDATE_THREAD_CONTEXT(mpeg_decode_update_thread_context),
@@ -2721,10 +2804,13 @@ const FFCodec ff_mpeg2video_decoder = {
     .close          = mpeg_decode_end,
     FF_CODEC_DECODE_CB(mpeg_decode_frame),
     .p.capabilities = AV_CODEC_CAP_DRAW_HORIZ_BAND | AV_CODEC_CAP_DR1 |
-                      AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SLICE_THREADS,
-    .caps_internal  = FF_CODEC_CAP_SKIP_FRAME_FILL_PARAM,
+                      AV_CODEC_CAP_DELAY | AV_CODEC_CAP_SLICE_THREADS |
+                      AV_CODEC_CAP_FRAME_THREADS,
+    .caps_internal  = FF_CODEC_CAP_SKIP_FRAME_FILL_PARAM |
+                      FF_CODEC_CAP_FRAME_THREADS_OPT_IN,
     .flush          = flush,
     .p.max_lowres   = 3,
+    UPDATE_THREAD_CONTEXT(mpeg_decode_update_thread_context),
     .p.profiles     = NULL_IF_CONFIG_SMALL(ff_mpeg2_video_profiles),
     .hw_configs     = (const AVCodecHWConfigInternal *const []) {
 #if CONFIG_MPEG2_DXVA2_HWACCEL
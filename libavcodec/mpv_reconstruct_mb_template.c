@@ -110,8 +110,7 @@ void mpv_reconstruct_mb_internal(MpegEncContext *s, int16_t block[12][64],
             /* decoding or more than one mb_type (MC was already done otherwise) */
 
 #if !IS_ENCODER
-            if (HAVE_THREADS && is_mpeg12 != DEFINITELY_MPEG12_H261 &&
-                s->avctx->active_thread_type & FF_THREAD_FRAME) {
+            if (HAVE_THREADS && s->avctx->active_thread_type & FF_THREAD_FRAME) {
                 if (s->mv_dir & MV_DIR_FORWARD) {
                     ff_thread_progress_await(&s->last_pic.ptr->progress,
                                              lowest_referenced_row(s, 0));
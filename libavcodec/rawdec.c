@@ -223,7 +223,9 @@ static int raw_decode(AVCodecContext *avctx, AVFrame *frame,
     if (context->frame_size < 0)
         return context->frame_size;
 
-    need_copy = !avpkt->buf || context->is_1_2_4_8_bpp || context->is_yuv2 || context->is_lt_16bpp;
+    need_copy = !avpkt->buf || context->is_1_2_4_8_bpp || context->is_yuv2 || context->is_lt_16bpp ||
+                // b64a is swapped in place below
+                (avctx->codec_tag == AV_RL32("b64a") && !av_buffer_is_writable(avpkt->buf));
 
     res = ff_decode_frame_props(avctx, frame);
     if (res < 0)
@@ -768,6 +768,9 @@ static int config_input(AVFilterLink *inlink)
         ff_ebur128_set_channel(s->r128_out, 0, FF_EBUR128_DUAL_MONO);
     }
 
+    ff_ebur128_set_thread_context(s->r128_in,  ctx);
+    ff_ebur128_set_thread_context(s->r128_out, ctx);
+
     s->buf_size = frame_size(inlink->sample_rate, 3000) * inlink->ch_layout.nb_channels;
     s->buf = av_malloc_array(s->buf_size, sizeof(*s->buf));
     if (!s->buf)
@@ -930,6 +933,7 @@ const FFFilter ff_af_loudnorm = {
     .p.name        = "loudnorm",
     .p.description = NULL_IF_CONFIG_SMALL("EBU R128 loudness normalization"),
     .p.priv_class  = &loudnorm_class,
+    .p.flags       = AVFILTER_FLAG_SLICE_THREADS,
     .priv_size     = sizeof(LoudNormContext),
     .init          = init,
     .activate      = activate,
@@ -227,14 +227,22 @@ int avfilter_config_links(AVFilterContext *filter)
 static void update_link_current_pts(FilterLinkInternal *li, int64_t pts)
 {
     AVFilterLink *const link = &li->l.pub;
+    int in_heap = li->l.graph && li->age_index >= 0;
+    /* sink links may be fed from several threads during a graph threading
+     * round */
+    int locked  = in_heap && fffiltergraph(li->l.graph)->activating;
 
     if (pts == AV_NOPTS_VALUE)
         return;
+    if (locked)
+        ff_avfilter_graph_lock_heap(li->l.graph);
     li->l.current_pts = pts;
     li->l.current_pts_us = av_rescale_q(pts, link->time_base, AV_TIME_BASE_Q);
     /* TODO use duration */
-    if (li->l.graph && li->age_index >= 0)
+    if (in_heap)
         ff_avfilter_graph_update_heap(li->l.graph, li);
+    if (locked)
+        ff_avfilter_graph_unlock_heap(li->l.graph);
 }
 
 void ff_filter_set_ready(AVFilterContext *filter, unsigned priority)
@@ -1685,3 +1693,9 @@ int ff_filter_execute(AVFilterContext *ctx, avfilter_action_func *func,
 {
     return fffilterctx(ctx)->execute(ctx, func, arg, ret, nb_jobs);
 }
+
+int ff_filter_execute_is_ordered(AVFilterContext *ctx)
+{
+    return fffilterctx(ctx)->execute == default_execute ||
+           fffiltergraph(ctx->graph)->thread;
+}
@@ -253,6 +253,20 @@ unsigned avfilter_filter_pad_count(const AVFilter *filter, int is_output);
  */
 #define AVFILTER_THREAD_SLICE (1 << 0)
 
+/**
+ * Activate filters from independent parts of the graph concurrently.
+ *
+ * Only meaningful in AVFilterGraph.thread_type. Filters are only activated
+ * concurrently when they share no link and no neighbouring filter, so this is
+ * mostly useful for graphs with several parallel branches.
+ *
+ * The filters are activated as the jobs of AVFilterGraph.execute, or of the
+ * internal slice threads if it is not set, with as many filters at once as
+ * AVFilterGraph.nb_threads. Filters using slice threading are always
+ * activated alone, with all the threads for their slices.
+ */
+#define AVFILTER_THREAD_GRAPH (1 << 1)
+
 /** An instance of a filter */
 typedef struct AVFilterContext {
     const AVClass *av_class;        ///< needed for av_log() and filters common options
@@ -599,6 +613,9 @@ typedef struct AVFilterGraph {
      * bit AND with AVFilterContext.thread_type to get the final mask used for
      * determining allowed threading types. I.e. a threading type needs to be
      * set in both to be allowed.
+     *
+     * AVFILTER_THREAD_GRAPH must be set before adding any filters to the
+     * filtergraph.
      */
     int thread_type;
 
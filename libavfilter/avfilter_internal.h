@@ -27,6 +27,8 @@
 
 #include <stdint.h>
 
+#include "libavutil/thread.h"
+
 #include "avfilter.h"
 #include "filters.h"
 #include "framequeue.h"
@@ -116,6 +118,12 @@ typedef struct FFFilterContext {
     double *var_values;
 
     struct AVFilterCommand *command_queue;
+
+    /**
+     * Set while the filter or one of its neighbours is selected for
+     * concurrent activation in the current round (AVFILTER_THREAD_GRAPH).
+     */
+    int claimed;
 } FFFilterContext;
 
 static inline FFFilterContext *fffilterctx(AVFilterContext *ctx)
@@ -145,6 +153,25 @@ typedef struct FFFilterGraph {
     void *thread;
     avfilter_execute_func *thread_execute;
     FFFrameQueueGlobal frame_queues;
+
+    /**
+     * Filters of the current round and their return values, NULL unless
+     * AVFILTER_THREAD_GRAPH is in use. The round is run with thread_execute,
+     * one job per filter.
+     */
+    AVFilterContext **activate_list;
+    int *activate_rets;
+    unsigned nb_activate_max;
+    /**
+     * Set while a round is running.
+     */
+    int activating;
+
+    /**
+     * Protects the sink links age heap while a round is running, it is
+     * updated by the filters feeding the sinks.
+     */
+    AVMutex heap_lock;
 } FFFilterGraph;
 
 static inline FFFilterGraph *fffiltergraph(AVFilterGraph *graph)
@@ -158,6 +185,12 @@ static inline FFFilterGraph *fffiltergraph(AVFilterGraph *graph)
 void ff_avfilter_graph_update_heap(AVFilterGraph *graph,
                                    struct FilterLinkInternal *li);
 
+/**
+ * Lock/unlock the age heap and the current pts of the links in it.
+ */
+void ff_avfilter_graph_lock_heap(AVFilterGraph *graph);
+void ff_avfilter_graph_unlock_heap(AVFilterGraph *graph);
+
 /**
  * Allocate a new filter context and return it.
  *
@@ -49,6 +49,7 @@ static const AVOption filtergraph_options[] = {
     { "thread_type", "Allowed thread types", OFFSET(thread_type), AV_OPT_TYPE_FLAGS,
         { .i64 = AVFILTER_THREAD_SLICE }, 0, INT_MAX, F|V|A, .unit = "thread_type" },
         { "slice", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_SLICE }, .flags = F|V|A, .unit = "thread_type" },
+        { "graph", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = AVFILTER_THREAD_GRAPH }, .flags = F|V|A, .unit = "thread_type" },
     { "threads",     "Maximum number of threads", OFFSET(nb_threads), AV_OPT_TYPE_INT,
         { .i64 = 0 }, 0, INT_MAX, F|V|A, .unit = "threads"},
         {"auto", "autodetect a suitable number of threads to use", 0, AV_OPT_TYPE_CONST, {.i64 = 0 }, .flags = F|V|A, .unit = "threads"},
@@ -88,6 +89,11 @@ AVFilterGraph *avfilter_graph_alloc(void)
     if (!graph)
         return NULL;
 
+    if (ff_mutex_init(&graph->heap_lock, NULL)) {
+        av_free(graph);
+        return NULL;
+    }
+
     ret = &graph->p;
     ret->av_class = &filtergraph_class;
     av_opt_set_defaults(ret);
@@ -126,6 +132,9 @@ void avfilter_graph_free(AVFilterGraph **graphp)
         avfilter_free(graph->filters[0]);
 
     ff_graph_thread_free(graphi);
+    ff_mutex_destroy(&graphi->heap_lock);
+    av_freep(&graphi->activate_list);
+    av_freep(&graphi->activate_rets);
 
     av_freep(&graphi->sink_links);
 
@@ -162,6 +171,35 @@ void avfilter_graph_set_auto_convert(AVFilterGraph *graph, unsigned flags)
     fffiltergraph(graph)->disable_auto_convert = flags;
 }
 
+/**
+ * Set up AVFILTER_THREAD_GRAPH, which runs its rounds on the threads used for
+ * slice threading. The flag is cleared if there is only one.
+ *
+ * nb_threads is the number of threads of the internal pool, set up by
+ * ff_graph_thread_init(), or what the caller set for its own execute.
+ */
+static int graph_activate_init(FFFilterGraph *graphi)
+{
+    AVFilterGraph *graph = &graphi->p;
+    int nb_threads = graph->nb_threads;
+
+    if (!graphi->thread_execute || nb_threads <= 1) {
+        graph->thread_type &= ~AVFILTER_THREAD_GRAPH;
+        return 0;
+    }
+
+    graphi->activate_list = av_calloc(nb_threads, sizeof(*graphi->activate_list));
+    graphi->activate_rets = av_calloc(nb_threads, sizeof(*graphi->activate_rets));
+    if (!graphi->activate_list || !graphi->activate_rets) {
+        av_freep(&graphi->activate_list);
+        av_freep(&graphi->activate_rets);
+        return AVERROR(ENOMEM);
+    }
+    graphi->nb_activate_max = nb_threads;
+
+    return 0;
+}
+
 AVFilterContext *avfilter_graph_alloc_filter(AVFilterGraph *graph,
                                              const AVFilter *filter,
                                              const char *name)
@@ -181,6 +219,14 @@ AVFilterContext *avfilter_graph_alloc_filter(AVFilterGraph *graph,
         }
     }
 
+    if (graph->thread_type & AVFILTER_THREAD_GRAPH && !graphi->activate_list) {
+        int ret = graph_activate_init(graphi);
+        if (ret < 0) {
+            av_log(graph, AV_LOG_ERROR, "Error initializing graph threading: %s.\n", av_err2str(ret));
+            return NULL;
+        }
+    }
+
     filters = av_realloc_array(graph->filters, graph->nb_filters + 1, sizeof(*filters));
     if (!filters)
         return NULL;
@@ -1423,6 +1469,16 @@ void ff_avfilter_graph_update_heap(AVFilterGraph *graph, FilterLinkInternal *li)
     heap_bubble_down(graphi, li, li->age_index);
 }
 
+void ff_avfilter_graph_lock_heap(AVFilterGraph *graph)
+{
+    ff_mutex_lock(&fffiltergraph(graph)->heap_lock);
+}
+
+void ff_avfilter_graph_unlock_heap(AVFilterGraph *graph)
+{
+    ff_mutex_unlock(&fffiltergraph(graph)->heap_lock);
+}
+
 int avfilter_graph_request_oldest(AVFilterGraph *graph)
 {
     FFFilterGraph *graphi = fffiltergraph(graph);
@@ -1470,8 +1526,93 @@ int avfilter_graph_request_oldest(AVFilterGraph *graph)
     return 0;
 }
 
+static int activate_job(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    AVFilterContext **filters = arg;
+    return ff_filter_activate(filters[jobnr]);
+}
+
+/**
+ * Filters that reach beyond their own links, and the ones using slice
+ * threading, which keep all the threads busy themselves, are activated alone.
+ */
+static int filter_runs_alone(AVFilterContext *ctx)
+{
+    return fffilter(ctx->filter)->flags_internal & FF_FILTER_FLAG_GRAPH_EXCLUSIVE ||
+           ctx->thread_type & AVFILTER_THREAD_SLICE;
+}
+
+static int filter_is_claimed(AVFilterContext *ctx)
+{
+    if (fffilterctx(ctx)->claimed)
+        return 1;
+    for (unsigned i = 0; i < ctx->nb_inputs; i++)
+        if (ctx->inputs[i] && fffilterctx(ctx->inputs[i]->src)->claimed)
+            return 1;
+    for (unsigned i = 0; i < ctx->nb_outputs; i++)
+        if (ctx->outputs[i] && fffilterctx(ctx->outputs[i]->dst)->claimed)
+            return 1;
+    return 0;
+}
+
+static void filter_set_claimed(AVFilterContext *ctx, int claimed)
+{
+    fffilterctx(ctx)->claimed = claimed;
+    for (unsigned i = 0; i < ctx->nb_inputs; i++)
+        if (ctx->inputs[i])
+            fffilterctx(ctx->inputs[i]->src)->claimed = claimed;
+    for (unsigned i = 0; i < ctx->nb_outputs; i++)
+        if (ctx->outputs[i])
+            fffilterctx(ctx->outputs[i]->dst)->claimed = claimed;
+}
+
+/**
+ * Activate the most urgent filter together with other ready filters whose
+ * neighbourhoods do not overlap with it or with each other.
+ *
+ * An activation only touches the filter, its links and the ready status of
+ * the filters at the other end of them, so filters selected this way never
+ * access the same state.
+ */
+static int graph_run_once_parallel(FFFilterGraph *graphi, AVFilterContext *first)
+{
+    AVFilterGraph *graph = &graphi->p;
+    unsigned nb_filters = 0;
+
+    graphi->activate_list[nb_filters++] = first;
+    filter_set_claimed(first, 1);
+
+    for (unsigned i = 0; i < graph->nb_filters &&
+                         nb_filters < graphi->nb_activate_max; i++) {
+        AVFilterContext *ctx = graph->filters[i];
+
+        if (!fffilterctx(ctx)->ready || filter_runs_alone(ctx) ||
+            filter_is_claimed(ctx))
+            continue;
+        graphi->activate_list[nb_filters++] = ctx;
+        filter_set_claimed(ctx, 1);
+    }
+
+    for (unsigned i = 0; i < nb_filters; i++)
+        filter_set_claimed(graphi->activate_list[i], 0);
+
+    if (nb_filters == 1)
+        return ff_filter_activate(first);
+
+    graphi->activating = 1;
+    graphi->thread_execute(first, activate_job, graphi->activate_list,
+                           graphi->activate_rets, nb_filters);
+    graphi->activating = 0;
+
+    for (unsigned i = 0; i < nb_filters; i++)
+        if (graphi->activate_rets[i] < 0)
+            return graphi->activate_rets[i];
+    return 0;
+}
+
 int ff_filter_graph_run_once(AVFilterGraph *graph)
 {
+    FFFilterGraph *graphi = fffiltergraph(graph);
     FFFilterContext *ctxi;
     unsigned i;
 
@@ -1486,5 +1627,7 @@ int ff_filter_graph_run_once(AVFilterGraph *graph)
 
     if (!ctxi->ready)
         return AVERROR(EAGAIN);
+    if (graphi->nb_activate_max > 1 && !filter_runs_alone(&ctxi->p))
+        return graph_run_once_parallel(graphi, &ctxi->p);
     return ff_filter_activate(&ctxi->p);
 }
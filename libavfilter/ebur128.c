@@ -53,6 +53,8 @@
 #include "libavutil/mem_internal.h"
 #include "libavutil/thread.h"
 
+#include "filters.h"
+
 #define CHECK_ERROR(condition, errorcode, goto_point)                          \
     if ((condition)) {                                                         \
         errcode = (errorcode);                                                 \
@@ -97,6 +99,8 @@ struct FFEBUR128StateInternal {
     unsigned long window;
     /** Data pointer array for interleaved data */
     void **data_ptrs;
+    /** Filter whose slice threads are used to filter the channels. */
+    struct AVFilterContext *thread_ctx;
 };
 
 static AVOnce histogram_init = AV_ONCE_INIT;
@@ -280,6 +284,7 @@ FFEBUR128State *ff_ebur128_init(unsigned int channels,
     st->d->data_ptrs = av_malloc_array(channels, sizeof(*st->d->data_ptrs));
     CHECK_ERROR(!st->d->data_ptrs, 0,
                 free_short_term_block_energy_histogram);
+    st->d->thread_ctx = NULL;
 
     return st;
 
@@ -314,53 +319,102 @@ void ff_ebur128_destroy(FFEBUR128State ** st)
     *st = NULL;
 }
 
+typedef struct EBUR128ThreadData {
+    FFEBUR128State *st;
+    const void **srcs;
+    size_t src_index;
+    size_t frames;
+    int stride;
+} EBUR128ThreadData;
+
 #define EBUR128_FILTER(type, scaling_factor)                                       \
-static void ebur128_filter_##type(FFEBUR128State* st, const type** srcs,           \
-                                  size_t src_index, size_t frames,                 \
-                                  int stride) {                                    \
+static void ebur128_filter_channel_##type(FFEBUR128State* st, const type* src,     \
+                                          size_t frames, int stride, size_t c) {   \
     double* audio_data = st->d->audio_data + st->d->audio_data_index;              \
-    size_t i, c;                                                                   \
+    double v0, v1, v2, v3, v4;                                                     \
+    double *v;                                                                     \
+    size_t i;                                                                      \
+    int ci;                                                                        \
                                                                                    \
     if ((st->mode & FF_EBUR128_MODE_SAMPLE_PEAK) == FF_EBUR128_MODE_SAMPLE_PEAK) { \
-        for (c = 0; c < st->channels; ++c) {                                       \
-            double max = 0.0;                                                      \
-            for (i = 0; i < frames; ++i) {                                         \
-                type v = srcs[c][src_index + i * stride];                          \
-                if (v > max) {                                                     \
-                    max =        v;                                                \
-                } else if (-v > max) {                                             \
-                    max = -1.0 * v;                                                \
-                }                                                                  \
+        double max = 0.0;                                                          \
+        for (i = 0; i < frames; ++i) {                                             \
+            type v = src[i * stride];                                              \
+            if (v > max) {                                                         \
+                max =        v;                                                    \
+            } else if (-v > max) {                                                 \
+                max = -1.0 * v;                                                    \
             }                                                                      \
-            max /= scaling_factor;                                                 \
-            if (max > st->d->sample_peak[c]) st->d->sample_peak[c] = max;          \
         }                                                                          \
+        max /= scaling_factor;                                                     \
+        if (max > st->d->sample_peak[c]) st->d->sample_peak[c] = max;              \
     }                                                                              \
-    for (c = 0; c < st->channels; ++c) {                                           \
-        int ci = st->d->channel_map[c] - 1;                                        \
-        if (ci < 0) continue;                                                      \
-        else if (ci == FF_EBUR128_DUAL_MONO - 1) ci = 0; /*dual mono */            \
-        for (i = 0; i < frames; ++i) {                                             \
-            st->d->v[ci][0] = (double) (srcs[c][src_index + i * stride] / scaling_factor) \
-                         - st->d->a[1] * st->d->v[ci][1]                           \
-                         - st->d->a[2] * st->d->v[ci][2]                           \
-                         - st->d->a[3] * st->d->v[ci][3]                           \
-                         - st->d->a[4] * st->d->v[ci][4];                          \
-            audio_data[i * st->channels + c] =                                     \
-                           st->d->b[0] * st->d->v[ci][0]                           \
-                         + st->d->b[1] * st->d->v[ci][1]                           \
-                         + st->d->b[2] * st->d->v[ci][2]                           \
-                         + st->d->b[3] * st->d->v[ci][3]                           \
-                         + st->d->b[4] * st->d->v[ci][4];                          \
-            st->d->v[ci][4] = st->d->v[ci][3];                                     \
-            st->d->v[ci][3] = st->d->v[ci][2];                                     \
-            st->d->v[ci][2] = st->d->v[ci][1];                                     \
-            st->d->v[ci][1] = st->d->v[ci][0];                                     \
-        }                                                                          \
-        st->d->v[ci][4] = fabs(st->d->v[ci][4]) < DBL_MIN ? 0.0 : st->d->v[ci][4]; \
-        st->d->v[ci][3] = fabs(st->d->v[ci][3]) < DBL_MIN ? 0.0 : st->d->v[ci][3]; \
-        st->d->v[ci][2] = fabs(st->d->v[ci][2]) < DBL_MIN ? 0.0 : st->d->v[ci][2]; \
-        st->d->v[ci][1] = fabs(st->d->v[ci][1]) < DBL_MIN ? 0.0 : st->d->v[ci][1]; \
+                                                                                   \
+    ci = st->d->channel_map[c] - 1;                                                \
+    if (ci < 0) return;                                                            \
+    else if (ci == FF_EBUR128_DUAL_MONO - 1) ci = 0; /*dual mono */                \
+                                                                                   \
+    /* keep the filter state in locals, it cannot alias audio_data then */         \
+    v = st->d->v[ci];                                                              \
+    v1 = v[1]; v2 = v[2]; v3 = v[3]; v4 = v[4];                                    \
+    for (i = 0; i < frames; ++i) {                                                 \
+        v0 = (double) (src[i * stride] / scaling_factor)                           \
+           - st->d->a[1] * v1                                                      \
+           - st->d->a[2] * v2                                                      \
+           - st->d->a[3] * v3                                                      \
+           - st->d->a[4] * v4;                                                     \
+        audio_data[i * st->channels + c] =                                         \
+             st->d->b[0] * v0                                                      \
+           + st->d->b[1] * v1                                                      \
+           + st->d->b[2] * v2                                                      \
+           + st->d->b[3] * v3                                                      \
+           + st->d->b[4] * v4;                                                     \
+        v4 = v3;                                                                   \
+        v3 = v2;                                                                   \
+        v2 = v1;                                                                   \
+        v1 = v0;                                                                   \
+    }                                                                              \
+    if (frames)                                                                    \
+        v[0] = v1;                                                                 \
+    v[4] = fabs(v4) < DBL_MIN ? 0.0 : v4;                                          \
+    v[3] = fabs(v3) < DBL_MIN ? 0.0 : v3;                                          \
+    v[2] = fabs(v2) < DBL_MIN ? 0.0 : v2;                                          \
+    v[1] = fabs(v1) < DBL_MIN ? 0.0 : v1;                                          \
+}                                                                                  \
+                                                                                   \
+static int ebur128_filter_channels_##type(AVFilterContext *ctx, void *arg,         \
+                                          int jobnr, int nb_jobs) {                \
+    const EBUR128ThreadData *td = arg;                                             \
+    const size_t channels = td->st->channels;                                      \
+    const size_t c_start = (channels *  jobnr     ) / nb_jobs;                     \
+    const size_t c_end   = (channels * (jobnr + 1)) / nb_jobs;                     \
+                                                                                   \
+    for (size_t c = c_start; c < c_end; ++c)                                       \
+        ebur128_filter_channel_##type(td->st,                                      \
+                                      (const type *)td->srcs[c] + td->src_index,   \
+                                      td->frames, td->stride, c);                  \
+    return 0;                                                                      \
+}                                                                                  \
+                                                                                   \
+static void ebur128_filter_##type(FFEBUR128State* st, const type** srcs,           \
+                                  size_t src_index, size_t frames,                 \
+                                  int stride) {                                    \
+    AVFilterContext *ctx = st->d->thread_ctx;                                      \
+    const int nb_jobs = ctx ? FFMIN(st->channels, ff_filter_get_nb_threads(ctx)) : 1; \
+                                                                                   \
+    if (nb_jobs > 1) {                                                             \
+        EBUR128ThreadData td = {                                                   \
+            .st        = st,                                                       \
+            .srcs      = (const void **)srcs,                                      \
+            .src_index = src_index,                                                \
+            .frames    = frames,                                                   \
+            .stride    = stride,                                                   \
+        };                                                                         \
+        ff_filter_execute(ctx, ebur128_filter_channels_##type, &td, NULL, nb_jobs); \
+    } else {                                                                       \
+        for (size_t c = 0; c < st->channels; ++c)                                  \
+            ebur128_filter_channel_##type(st, srcs[c] + src_index,                 \
+                                          frames, stride, c);                      \
     }                                                                              \
 }
 EBUR128_FILTER(double, 1.0)
@@ -456,6 +510,12 @@ int ff_ebur128_set_channel(FFEBUR128State * st,
     return 0;
 }
 
+void ff_ebur128_set_thread_context(FFEBUR128State * st,
+                                   struct AVFilterContext *ctx)
+{
+    st->d->thread_ctx = ctx;
+}
+
 static int ebur128_energy_shortterm(FFEBUR128State * st, double *out);
 #define EBUR128_ADD_FRAMES_PLANAR(type)                                                \
 static void ebur128_add_frames_planar_##type(FFEBUR128State* st, const type** srcs,    \
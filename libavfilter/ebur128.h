@@ -145,6 +145,21 @@ void ff_ebur128_destroy(FFEBUR128State ** st);
 int ff_ebur128_set_channel(FFEBUR128State * st,
                            unsigned int channel_number, int value);
 
+struct AVFilterContext;
+
+/** \brief Filter the channels in parallel.
+ *
+ *  The channels are spread over the slice threads of the given filter. This
+ *  requires that no two channels share a channel type, which is always the
+ *  case with the default channel map.
+ *
+ *  @param st library state.
+ *  @param ctx filter whose slice threads are used, or NULL to filter the
+ *             channels serially.
+ */
+void ff_ebur128_set_thread_context(FFEBUR128State * st,
+                                   struct AVFilterContext *ctx);
+
 /** \brief Add frames to be processed.
  *
  *  @param st library state.
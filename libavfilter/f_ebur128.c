@@ -71,6 +71,8 @@ struct integrator {
     double sum_kept_powers;         ///< sum of the powers (weighted sums) above absolute threshold
     int nb_kept_powers;             ///< number of sum above absolute threshold
     struct hist_entry *histogram;   ///< histogram of the powers, used to compute LRA and I
+    uint64_t *count_tree;           ///< Fenwick tree of the histogram counts
+    double *energy_tree;            ///< Fenwick tree of the histogram energies, by decreasing loudness (I only)
 };
 
 struct rect { int x, y, w, h; };
@@ -540,6 +542,68 @@ static struct hist_entry *get_histogram(void)
     return h;
 }
 
+/*
+ * The histograms are queried every 100ms for the values above the relative
+ * gate and for the LRA percentiles. Binary indexed (Fenwick) trees of the
+ * counts and energies answer these in O(log(HIST_SIZE)) instead of scanning
+ * the whole histogram for every block.
+ */
+static int alloc_hist_trees(struct integrator *integ, int energy)
+{
+    integ->count_tree = av_calloc(HIST_SIZE + 1, sizeof(*integ->count_tree));
+    if (!integ->count_tree)
+        return AVERROR(ENOMEM);
+    if (energy) {
+        integ->energy_tree = av_calloc(HIST_SIZE + 1, sizeof(*integ->energy_tree));
+        if (!integ->energy_tree)
+            return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+static void hist_add(struct integrator *integ, int pos)
+{
+    integ->histogram[pos].count++;
+    for (int i = pos + 1; i <= HIST_SIZE; i += i & -i)
+        integ->count_tree[i]++;
+    if (integ->energy_tree) {
+        for (int i = HIST_SIZE - pos; i <= HIST_SIZE; i += i & -i)
+            integ->energy_tree[i] += integ->histogram[pos].energy;
+    }
+}
+
+/* number of values in the bins below pos */
+static uint64_t hist_count_below(const struct integrator *integ, int pos)
+{
+    uint64_t n = 0;
+    for (int i = pos; i > 0; i -= i & -i)
+        n += integ->count_tree[i];
+    return n;
+}
+
+/* sum of the energies of the values in the bins from pos up */
+static double hist_energy_from(const struct integrator *integ, int pos)
+{
+    double sum = 0.0;
+    for (int i = HIST_SIZE - pos; i > 0; i -= i & -i)
+        sum += integ->energy_tree[i];
+    return sum;
+}
+
+/* first bin at which the number of values up to and including it reaches n */
+static int hist_find(const struct integrator *integ, uint64_t n)
+{
+    int pos = 0;
+
+    for (int step = 1 << av_log2(HIST_SIZE); step; step >>= 1) {
+        if (pos + step <= HIST_SIZE && integ->count_tree[pos + step] < n) {
+            pos += step;
+            n   -= integ->count_tree[pos];
+        }
+    }
+    return FFMIN(pos, HIST_SIZE - 1);
+}
+
 static av_cold int init(AVFilterContext *ctx)
 {
     EBUR128Context *ebur128 = ctx->priv;
@@ -569,6 +633,9 @@ static av_cold int init(AVFilterContext *ctx)
     ebur128->i3000.histogram = get_histogram();
     if (!ebur128->i400.histogram || !ebur128->i3000.histogram)
         return AVERROR(ENOMEM);
+    if ((ret = alloc_hist_trees(&ebur128->i400,  1)) < 0 ||
+        (ret = alloc_hist_trees(&ebur128->i3000, 0)) < 0)
+        return ret;
 
     ebur128->integrated_loudness = ABS_THRES;
     ebur128->loudness_range = 0;
@@ -612,7 +679,7 @@ static int gate_update(struct integrator *integ, double power,
 
     /* update powers histograms by incrementing current power count */
     ipower = av_clip(HIST_POS(loudness), 0, HIST_SIZE - 1);
-    integ->histogram[ipower].count++;
+    hist_add(integ, ipower);
 
     /* compute relative threshold and get its position in the histogram */
     integ->sum_kept_powers += power;
@@ -626,6 +693,99 @@ static int gate_update(struct integrator *integ, double power,
     return gate_hist_pos;
 }
 
+typedef struct ThreadData {
+    const double *samples;          ///< interleaved samples of the input frame
+    int offset;                     ///< index of the first sample to process
+    int nb_samples;                 ///< number of samples to process
+} ThreadData;
+
+/**
+ * Filter a block of samples for a range of channels, and integrate the
+ * resulting energies in the 400ms and 3s windows. The channels are
+ * independent from each other, so they can be spread over the threads.
+ */
+static int filter_channels(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    EBUR128Context *ebur128 = ctx->priv;
+    const ThreadData *td = arg;
+    const int nb_channels = ebur128->nb_channels;
+    const int ch_start = (nb_channels *  jobnr     ) / nb_jobs;
+    const int ch_end   = (nb_channels * (jobnr + 1)) / nb_jobs;
+    const double *pre_b = ebur128->pre_b, *pre_a = ebur128->pre_a;
+    const double *rlb_b = ebur128->rlb_b, *rlb_a = ebur128->rlb_a;
+
+    for (int ch = ch_start; ch < ch_end; ch++) {
+        const double *samples = td->samples + td->offset * nb_channels + ch;
+        double *x = ebur128->x + ch * 3;
+        double *y = ebur128->y + ch * 3;
+        double *z = ebur128->z + ch * 3;
+        double x0 = x[0], x1 = x[1], x2 = x[2];
+        double y0 = y[0], y1 = y[1], y2 = y[2];
+        double z0 = z[0], z1 = z[1], z2 = z[2];
+        double sum_400, sum_3000;
+        double *cache_400, *cache_3000;
+        int bin_id_400, bin_id_3000;
+
+        if (ebur128->peak_mode & PEAK_MODE_SAMPLES_PEAKS) {
+            double peak = ebur128->sample_peaks[ch];
+            for (int i = 0; i < td->nb_samples; i++)
+                peak = FFMAX(peak, fabs(samples[i * nb_channels]));
+            ebur128->sample_peaks[ch] = peak;
+        }
+
+        if (!ebur128->ch_weighting[ch]) {
+            x[0] = samples[(td->nb_samples - 1) * nb_channels];
+            continue;
+        }
+
+        sum_400     = ebur128->i400.sum[ch];
+        sum_3000    = ebur128->i3000.sum[ch];
+        cache_400   = ebur128->i400.cache[ch];
+        cache_3000  = ebur128->i3000.cache[ch];
+        bin_id_400  = ebur128->i400.cache_pos;
+        bin_id_3000 = ebur128->i3000.cache_pos;
+
+        for (int i = 0; i < td->nb_samples; i++) {
+            double bin;
+
+            /* Y[i] = X[i]*b0 + X[i-1]*b1 + X[i-2]*b2 - Y[i-1]*a1 - Y[i-2]*a2 */
+            x0 = samples[i * nb_channels];
+            y2 = y1;
+            y1 = y0;
+            y0 = x0*pre_b[0] + x1*pre_b[1] + x2*pre_b[2] - y1*pre_a[1] - y2*pre_a[2];
+            x2 = x1;
+            x1 = x0;
+            z2 = z1;
+            z1 = z0;
+            z0 = y0*rlb_b[0] + y1*rlb_b[1] + y2*rlb_b[2] - z1*rlb_a[1] - z2*rlb_a[2];
+
+            bin = z0 * z0;
+
+            /* add the new value, and limit the sum to the cache size (400ms or 3s)
+             * by removing the oldest one */
+            sum_400  = sum_400  + bin - cache_400 [bin_id_400];
+            sum_3000 = sum_3000 + bin - cache_3000[bin_id_3000];
+
+            /* override old cache entry with the new value */
+            cache_400 [bin_id_400 ] = bin;
+            cache_3000[bin_id_3000] = bin;
+
+            if (++bin_id_400 == ebur128->i400.cache_size)
+                bin_id_400 = 0;
+            if (++bin_id_3000 == ebur128->i3000.cache_size)
+                bin_id_3000 = 0;
+        }
+
+        x[0] = x0; x[1] = x1; x[2] = x2;
+        y[0] = y0; y[1] = y1; y[2] = y2;
+        z[0] = z0; z[1] = z1; z[2] = z2;
+        ebur128->i400.sum[ch]  = sum_400;
+        ebur128->i3000.sum[ch] = sum_3000;
+    }
+
+    return 0;
+}
+
 static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
 {
     int i, ch, idx_insample, ret;
@@ -657,59 +817,33 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
 #endif
 
     for (idx_insample = ebur128->idx_insample; idx_insample < nb_samples; idx_insample++) {
-        const int bin_id_400  = ebur128->i400.cache_pos;
-        const int bin_id_3000 = ebur128->i3000.cache_pos;
-
-#define MOVE_TO_NEXT_CACHED_ENTRY(time) do {                \
-    ebur128->i##time.cache_pos++;                           \
-    if (ebur128->i##time.cache_pos ==                       \
-        ebur128->i##time.cache_size) {                      \
-        ebur128->i##time.filled    = 1;                     \
-        ebur128->i##time.cache_pos = 0;                     \
-    }                                                       \
-} while (0)
-
-        MOVE_TO_NEXT_CACHED_ENTRY(400);
-        MOVE_TO_NEXT_CACHED_ENTRY(3000);
-
-        for (ch = 0; ch < nb_channels; ch++) {
-            double bin;
-
-            if (ebur128->peak_mode & PEAK_MODE_SAMPLES_PEAKS)
-                ebur128->sample_peaks[ch] = FFMAX(ebur128->sample_peaks[ch], fabs(samples[idx_insample * nb_channels + ch]));
+        const int samples_in_100ms = inlink->sample_rate / 10;
+        ThreadData td = {
+            .samples    = samples,
+            .offset     = idx_insample,
+            .nb_samples = nb_samples - idx_insample,
+        };
 
-            ebur128->x[ch * 3] = samples[idx_insample * nb_channels + ch]; // set X[i]
+        /* process all the samples up to the next 100ms boundary at once */
+        if (samples_in_100ms > ebur128->sample_count)
+            td.nb_samples = FFMIN(td.nb_samples, samples_in_100ms - ebur128->sample_count);
 
-            if (!ebur128->ch_weighting[ch])
-                continue;
+        ff_filter_execute(ctx, filter_channels, &td, NULL,
+                          FFMIN(nb_channels, ff_filter_get_nb_threads(ctx)));
 
-            /* Y[i] = X[i]*b0 + X[i-1]*b1 + X[i-2]*b2 - Y[i-1]*a1 - Y[i-2]*a2 */
-#define FILTER(Y, X, NUM, DEN) do {                                             \
-            double *dst = ebur128->Y + ch*3;                                    \
-            double *src = ebur128->X + ch*3;                                    \
-            dst[2] = dst[1];                                                    \
-            dst[1] = dst[0];                                                    \
-            dst[0] = src[0]*NUM[0] + src[1]*NUM[1] + src[2]*NUM[2]              \
-                                   - dst[1]*DEN[1] - dst[2]*DEN[2];             \
+#define MOVE_CACHE_POSITION(time, n) do {                           \
+    ebur128->i##time.cache_pos += n;                                \
+    if (ebur128->i##time.cache_pos >= ebur128->i##time.cache_size) {\
+        ebur128->i##time.filled     = 1;                            \
+        ebur128->i##time.cache_pos %= ebur128->i##time.cache_size;  \
+    }                                                               \
 } while (0)
 
-            // TODO: merge both filters in one?
-            FILTER(y, x, ebur128->pre_b, ebur128->pre_a);  // apply pre-filter
-            ebur128->x[ch * 3 + 2] = ebur128->x[ch * 3 + 1];
-            ebur128->x[ch * 3 + 1] = ebur128->x[ch * 3    ];
-            FILTER(z, y, ebur128->rlb_b, ebur128->rlb_a);  // apply RLB-filter
-
-            bin = ebur128->z[ch * 3] * ebur128->z[ch * 3];
-
-            /* add the new value, and limit the sum to the cache size (400ms or 3s)
-             * by removing the oldest one */
-            ebur128->i400.sum [ch] = ebur128->i400.sum [ch] + bin - ebur128->i400.cache [ch][bin_id_400];
-            ebur128->i3000.sum[ch] = ebur128->i3000.sum[ch] + bin - ebur128->i3000.cache[ch][bin_id_3000];
+        MOVE_CACHE_POSITION(400,  td.nb_samples);
+        MOVE_CACHE_POSITION(3000, td.nb_samples);
 
-            /* override old cache entry with the new value */
-            ebur128->i400.cache [ch][bin_id_400 ] = bin;
-            ebur128->i3000.cache[ch][bin_id_3000] = bin;
-        }
+        idx_insample          += td.nb_samples - 1;
+        ebur128->sample_count += td.nb_samples;
 
 #define FIND_PEAK(global, sp, ptype) do {                        \
     int ch;                                                      \
@@ -728,7 +862,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
         /* For integrated loudness, gating blocks are 400ms long with 75%
          * overlap (see BS.1770-2 p5), so a re-computation is needed each 100ms
          * (4800 samples at 48kHz). */
-        if (++ebur128->sample_count == inlink->sample_rate / 10) {
+        if (ebur128->sample_count == samples_in_100ms) {
             double loudness_400, loudness_3000;
             double power_400 = 1e-12, power_3000 = 1e-12;
             AVFilterLink *outlink = ctx->outputs[0];
@@ -755,18 +889,14 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
 #define I_GATE_THRES -10  // initially defined to -8 LU in the first EBU standard
 
             if (loudness_400 >= ABS_THRES) {
-                double integrated_sum = 0.0;
-                uint64_t nb_integrated = 0;
                 int gate_hist_pos = gate_update(&ebur128->i400, power_400,
                                                 loudness_400, I_GATE_THRES);
-
-                /* compute integrated loudness by summing the histogram values
+                /* compute integrated loudness from the histogram values
                  * above the relative threshold */
-                for (i = gate_hist_pos; i < HIST_SIZE; i++) {
-                    const unsigned nb_v = ebur128->i400.histogram[i].count;
-                    nb_integrated  += nb_v;
-                    integrated_sum += nb_v * ebur128->i400.histogram[i].energy;
-                }
+                uint64_t nb_integrated = ebur128->i400.nb_kept_powers -
+                                         hist_count_below(&ebur128->i400, gate_hist_pos);
+                double integrated_sum  = hist_energy_from(&ebur128->i400, gate_hist_pos);
+
                 if (nb_integrated) {
                     ebur128->integrated_loudness = LOUDNESS(integrated_sum / nb_integrated);
                     /* dual-mono correction */
@@ -784,36 +914,23 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *insamples)
             /* XXX: example code in EBU 3342 is ">=" but formula in BS.1770
              * specs is ">" */
             if (loudness_3000 >= ABS_THRES) {
-                uint64_t nb_powers = 0;
                 int gate_hist_pos = gate_update(&ebur128->i3000, power_3000,
                                                 loudness_3000, LRA_GATE_THRES);
+                uint64_t below     = hist_count_below(&ebur128->i3000, gate_hist_pos);
+                uint64_t nb_powers = ebur128->i3000.nb_kept_powers - below;
 
-                for (i = gate_hist_pos; i < HIST_SIZE; i++)
-                    nb_powers += ebur128->i3000.histogram[i].count;
                 if (nb_powers) {
-                    uint64_t n, nb_pow;
+                    uint64_t nb_pow;
 
                     /* get lower loudness to consider */
-                    n = 0;
                     nb_pow = LRA_LOWER_PRC * nb_powers * 0.01 + 0.5;
-                    for (i = gate_hist_pos; i < HIST_SIZE; i++) {
-                        n += ebur128->i3000.histogram[i].count;
-                        if (n >= nb_pow) {
-                            ebur128->lra_low = ebur128->i3000.histogram[i].loudness;
-                            break;
-                        }
-                    }
+                    i = FFMAX(hist_find(&ebur128->i3000, below + nb_pow), gate_hist_pos);
+                    ebur128->lra_low = ebur128->i3000.histogram[i].loudness;
 
                     /* get higher loudness to consider */
-                    n = nb_powers;
                     nb_pow = LRA_HIGHER_PRC * nb_powers * 0.01 + 0.5;
-                    for (i = HIST_SIZE - 1; i >= 0; i--) {
-                        n -= FFMIN(n, ebur128->i3000.histogram[i].count);
-                        if (n < nb_pow) {
-                            ebur128->lra_high = ebur128->i3000.histogram[i].loudness;
-                            break;
-                        }
-                    }
+                    i = hist_find(&ebur128->i3000, below + nb_pow);
+                    ebur128->lra_high = ebur128->i3000.histogram[i].loudness;
 
                     // XXX: show low & high on the graph?
                     ebur128->loudness_range = ebur128->lra_high - ebur128->lra_low;
@@ -1086,6 +1203,9 @@ static av_cold void uninit(AVFilterContext *ctx)
     av_freep(&ebur128->i3000.sum);
     av_freep(&ebur128->i400.histogram);
     av_freep(&ebur128->i3000.histogram);
+    av_freep(&ebur128->i400.count_tree);
+    av_freep(&ebur128->i3000.count_tree);
+    av_freep(&ebur128->i400.energy_tree);
     for (int i = 0; i < ebur128->nb_channels; i++) {
         if (ebur128->i400.cache)
             av_freep(&ebur128->i400.cache[i]);
@@ -1114,7 +1234,7 @@ const FFFilter ff_af_ebur128 = {
     .p.description = NULL_IF_CONFIG_SMALL("EBU R128 scanner."),
     .p.outputs     = NULL,
     .p.priv_class  = &ebur128_class,
-    .p.flags       = AVFILTER_FLAG_DYNAMIC_OUTPUTS,
+    .p.flags       = AVFILTER_FLAG_DYNAMIC_OUTPUTS | AVFILTER_FLAG_SLICE_THREADS,
     .priv_size     = sizeof(EBUR128Context),
     .init          = init,
     .uninit        = uninit,
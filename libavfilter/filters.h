@@ -205,6 +205,12 @@ static inline FilterLink* ff_filter_link(AVFilterLink *link)
  */
 #define FF_FILTER_FLAG_HWFRAME_AWARE (1 << 0)
 
+/**
+ * The filter accesses filters or links other than its own inputs and outputs,
+ * and must not be activated concurrently with any other filter.
+ */
+#define FF_FILTER_FLAG_GRAPH_EXCLUSIVE (1 << 1)
+
 /**
  * Find the index of a link.
  *
@@ -806,4 +812,11 @@ int ff_fmt_is_in(int fmt, const int *fmts);
 int ff_filter_execute(AVFilterContext *ctx, avfilter_action_func *func,
                       void *arg, int *ret, int nb_jobs);
 
+/**
+ * Tell if the jobs of ff_filter_execute() are started in increasing order and
+ * each one runs until it returns, so that a job may wait for the ones before
+ * it. This is not the case with a caller-provided AVFilterGraph.execute.
+ */
+int ff_filter_execute_is_ordered(AVFilterContext *ctx);
+
 #endif /* AVFILTER_FILTERS_H */
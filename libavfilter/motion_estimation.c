@@ -18,7 +18,11 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <string.h>
+
 #include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
 #include "motion_estimation.h"
 
 static const int8_t sqr1[8][2]  = {{ 0,-1}, { 0, 1}, {-1, 0}, { 1, 0}, {-1,-1}, {-1, 1}, { 1,-1}, { 1, 1}};
@@ -55,26 +59,37 @@ void ff_me_init_context(AVMotionEstContext *me_ctx, int mb_size, int search_para
     me_ctx->x_max = x_max;
     me_ctx->y_min = y_min;
     me_ctx->y_max = y_max;
+
+    for (int i = 1; i < FF_ARRAY_ELEMS(me_ctx->sad); i++)
+        me_ctx->sad[i] = av_pixelutils_get_sad_fn(i, i, 0, NULL);
 }
 
-uint64_t ff_me_cmp_sad(AVMotionEstContext *me_ctx, int x_mb, int y_mb, int x_mv, int y_mv)
+uint64_t ff_me_sad(const AVMotionEstContext *me_ctx, const uint8_t *src1,
+                   const uint8_t *src2, ptrdiff_t linesize, int size)
 {
-    const int linesize = me_ctx->linesize;
-    uint8_t *data_ref = me_ctx->data_ref;
-    uint8_t *data_cur = me_ctx->data_cur;
+    const int bits = av_log2(size);
     uint64_t sad = 0;
     int i, j;
 
-    data_ref += y_mv * linesize;
-    data_cur += y_mb * linesize;
+    if (size == 1 << bits && bits < FF_ARRAY_ELEMS(me_ctx->sad) && me_ctx->sad[bits])
+        return me_ctx->sad[bits](src1, linesize, src2, linesize);
 
-    for (j = 0; j < me_ctx->mb_size; j++)
-        for (i = 0; i < me_ctx->mb_size; i++)
-            sad += FFABS(data_ref[x_mv + i + j * linesize] - data_cur[x_mb + i + j * linesize]);
+    for (j = 0; j < size; j++)
+        for (i = 0; i < size; i++)
+            sad += FFABS(src1[i + j * linesize] - src2[i + j * linesize]);
 
     return sad;
 }
 
+uint64_t ff_me_cmp_sad(AVMotionEstContext *me_ctx, int x_mb, int y_mb, int x_mv, int y_mv)
+{
+    const int linesize = me_ctx->linesize;
+
+    return ff_me_sad(me_ctx, me_ctx->data_ref + x_mv + y_mv * linesize,
+                     me_ctx->data_cur + x_mb + y_mb * linesize,
+                     linesize, me_ctx->mb_size);
+}
+
 uint64_t ff_me_search_esa(AVMotionEstContext *me_ctx, int x_mb, int y_mb, int *mv)
 {
     int x, y;
@@ -431,3 +446,56 @@ uint64_t ff_me_search_umh(AVMotionEstContext *me_ctx, int x_mb, int y_mb, int *m
 
     return cost_min;
 }
+
+int ff_me_progress_init(AVMotionEstProgress *p, int nb_rows)
+{
+    int ret;
+
+    p->progress = av_calloc(nb_rows, sizeof(*p->progress));
+    if (!p->progress)
+        return AVERROR(ENOMEM);
+    p->nb_rows = nb_rows;
+
+    if ((ret = ff_mutex_init(&p->mutex, NULL))) {
+        av_freep(&p->progress);
+        return AVERROR(ret);
+    }
+    if ((ret = ff_cond_init(&p->cond, NULL))) {
+        ff_mutex_destroy(&p->mutex);
+        av_freep(&p->progress);
+        return AVERROR(ret);
+    }
+
+    return 0;
+}
+
+void ff_me_progress_uninit(AVMotionEstProgress *p)
+{
+    if (!p->progress)
+        return;
+
+    ff_cond_destroy(&p->cond);
+    ff_mutex_destroy(&p->mutex);
+    av_freep(&p->progress);
+}
+
+void ff_me_progress_reset(AVMotionEstProgress *p)
+{
+    memset(p->progress, 0, p->nb_rows * sizeof(*p->progress));
+}
+
+void ff_me_progress_await(AVMotionEstProgress *p, int row, int nb)
+{
+    ff_mutex_lock(&p->mutex);
+    while (p->progress[row] < nb)
+        ff_cond_wait(&p->cond, &p->mutex);
+    ff_mutex_unlock(&p->mutex);
+}
+
+void ff_me_progress_report(AVMotionEstProgress *p, int row, int nb)
+{
+    ff_mutex_lock(&p->mutex);
+    p->progress[row] = nb;
+    ff_cond_broadcast(&p->cond);
+    ff_mutex_unlock(&p->mutex);
+}
@@ -21,8 +21,12 @@
 #ifndef AVFILTER_MOTION_ESTIMATION_H
 #define AVFILTER_MOTION_ESTIMATION_H
 
+#include <stddef.h>
 #include <stdint.h>
 
+#include "libavutil/pixelutils.h"
+#include "libavutil/thread.h"
+
 #define AV_ME_METHOD_ESA        1
 #define AV_ME_METHOD_TSS        2
 #define AV_ME_METHOD_TDLS       3
@@ -59,11 +63,31 @@ typedef struct AVMotionEstContext {
 
     uint64_t (*get_cost)(struct AVMotionEstContext *me_ctx, int x_mb, int y_mb,
                          int mv_x, int mv_y);
+
+    av_pixelutils_sad_fn sad[6];    ///< SAD of (1 << n) x (1 << n) blocks, may be NULL
 } AVMotionEstContext;
 
+/**
+ * Per-row progress of a block search run over several rows concurrently.
+ * Predictive methods use the vectors of the left, top and top-right blocks,
+ * so a row may only advance while it stays behind the row above it.
+ */
+typedef struct AVMotionEstProgress {
+    int *progress;                  ///< number of blocks searched in each row
+    int nb_rows;
+    AVMutex mutex;
+    AVCond cond;
+} AVMotionEstProgress;
+
 void ff_me_init_context(AVMotionEstContext *me_ctx, int mb_size, int search_param,
                         int width, int height, int x_min, int x_max, int y_min, int y_max);
 
+/**
+ * Sum of absolute differences of two size x size blocks.
+ */
+uint64_t ff_me_sad(const AVMotionEstContext *me_ctx, const uint8_t *src1,
+                   const uint8_t *src2, ptrdiff_t linesize, int size);
+
 uint64_t ff_me_cmp_sad(AVMotionEstContext *me_ctx, int x_mb, int y_mb, int x_mv, int y_mv);
 
 uint64_t ff_me_search_esa(AVMotionEstContext *me_ctx, int x_mb, int y_mb, int *mv);
@@ -84,4 +108,17 @@ uint64_t ff_me_search_epzs(AVMotionEstContext *me_ctx, int x_mb, int y_mb, int *
 
 uint64_t ff_me_search_umh(AVMotionEstContext *me_ctx, int x_mb, int y_mb, int *mv);
 
+int ff_me_progress_init(AVMotionEstProgress *p, int nb_rows);
+
+void ff_me_progress_uninit(AVMotionEstProgress *p);
+
+void ff_me_progress_reset(AVMotionEstProgress *p);
+
+/**
+ * Wait until at least nb blocks of the given row have been searched.
+ */
+void ff_me_progress_await(AVMotionEstProgress *p, int row, int nb);
+
+void ff_me_progress_report(AVMotionEstProgress *p, int row, int nb);
+
 #endif /* AVFILTER_MOTION_ESTIMATION_H */
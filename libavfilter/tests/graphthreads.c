@@ -0,0 +1,157 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Run a graph with four independent branches with and without graph
+ * threading, and check that the output does not change.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/frame.h"
+#include "libavutil/hash.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+
+#define HASH_SIZE (2 * AV_HASH_MAX_SIZE + 4)
+
+static const char *graph_desc =
+    "testsrc2=s=176x144:r=25:d=2,format=yuv420p,split=4[a][b][c][d];"
+    "[a]avgblur=3[a1];"
+    "[b]crop=160:128,pad=176:144:8:8:blue[b1];"
+    "[c]hue=h=90:s=2[c1];"
+    "[d]drawbox=x=16:y=16:w=64:h=64:c=red,vflip[d1];"
+    "[a1][b1]hstack[top];"
+    "[c1][d1]hstack[bottom];"
+    "[top][bottom]vstack,buffersink";
+
+/* largest number of filters activated in one round */
+static int max_jobs;
+
+/* Caller-provided execute, which runs the jobs serially. */
+static int serial_execute(AVFilterContext *ctx, avfilter_action_func *func,
+                          void *arg, int *ret, int nb_jobs)
+{
+    max_jobs = FFMAX(max_jobs, nb_jobs);
+    for (int i = 0; i < nb_jobs; i++) {
+        int r = func(ctx, arg, i, nb_jobs);
+        if (ret)
+            ret[i] = r;
+    }
+    return 0;
+}
+
+static int run_graph(const char *thread_type, int nb_threads, int custom_execute,
+                     uint8_t *res)
+{
+    AVFilterGraph *graph = avfilter_graph_alloc();
+    AVFilterContext *sink = NULL;
+    AVFrame *frame = av_frame_alloc();
+    struct AVHashContext *hash = NULL;
+    uint8_t *buf = NULL;
+    int ret;
+
+    if (!graph || !frame) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    if ((ret = av_hash_alloc(&hash, "md5")) < 0)
+        goto end;
+    av_hash_init(hash);
+
+    if ((ret = av_opt_set(graph, "thread_type", thread_type, 0)) < 0)
+        goto end;
+    graph->nb_threads = nb_threads;
+    if (custom_execute)
+        graph->execute = serial_execute;
+
+    if ((ret = avfilter_graph_parse_ptr(graph, graph_desc, NULL, NULL, NULL)) < 0 ||
+        (ret = avfilter_graph_config(graph, NULL)) < 0)
+        goto end;
+    for (unsigned i = 0; i < graph->nb_filters; i++)
+        if (!strcmp(graph->filters[i]->filter->name, "buffersink"))
+            sink = graph->filters[i];
+
+    while ((ret = av_buffersink_get_frame(sink, frame)) >= 0) {
+        int size = av_image_get_buffer_size(frame->format, frame->width,
+                                            frame->height, 1);
+        if (!buf && !(buf = av_malloc(size))) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        av_image_copy_to_buffer(buf, size, (const uint8_t * const *)frame->data,
+                                frame->linesize, frame->format,
+                                frame->width, frame->height, 1);
+        av_hash_update(hash, buf, size);
+        av_frame_unref(frame);
+    }
+    if (ret == AVERROR_EOF)
+        ret = 0;
+    av_hash_final_hex(hash, res, HASH_SIZE);
+
+end:
+    av_free(buf);
+    av_hash_freep(&hash);
+    av_frame_free(&frame);
+    avfilter_graph_free(&graph);
+    return ret;
+}
+
+static int test(const char *thread_type, int nb_threads, int custom_execute,
+                const uint8_t *ref)
+{
+    uint8_t res[HASH_SIZE] = { 0 };
+    int ret;
+
+    max_jobs = 0;
+    ret = run_graph(thread_type, nb_threads, custom_execute, res);
+    printf("%s, %d threads%s: ", thread_type, nb_threads,
+           custom_execute ? ", caller execute" : "");
+    if (ret < 0) {
+        printf("%s\n", av_err2str(ret));
+        return ret;
+    }
+    printf("output %s", memcmp(res, ref, HASH_SIZE) ? "differs" : "matches");
+    if (custom_execute)
+        printf(", several filters per round %s", max_jobs > 1 ? "yes" : "no");
+    printf("\n");
+    return 0;
+}
+
+int main(void)
+{
+    uint8_t ref[HASH_SIZE] = { 0 };
+    int ret = 0;
+
+    if (run_graph("slice", 1, 0, ref) < 0) {
+        printf("running the graph failed\n");
+        return 1;
+    }
+
+    ret |= test("slice+graph", 2, 0, ref);
+    ret |= test("slice+graph", 4, 0, ref);
+    ret |= test("graph",       3, 0, ref);
+    ret |= test("graph",       4, 1, ref);
+
+    return ret < 0;
+}
@@ -41,6 +41,7 @@ typedef struct MEContext {
     AVFrame *prev, *cur, *next;
 
     int (*mv_table[3])[2][2];           ///< motion vectors of current & prev 2 frames
+    AVMotionEstProgress me_progress;    ///< per row search progress of the current direction
 } MEContext;
 
 #define OFFSET(x) offsetof(MEContext, x)
@@ -100,7 +101,8 @@ static int config_input(AVFilterLink *inlink)
 
     ff_me_init_context(&s->me_ctx, s->mb_size, s->search_param, inlink->w, inlink->h, 0, (s->b_width - 1) << s->log2_mb_size, 0, (s->b_height - 1) << s->log2_mb_size);
 
-    return 0;
+    ff_me_progress_uninit(&s->me_progress);
+    return ff_me_progress_init(&s->me_progress, s->b_height);
 }
 
 static void add_mv_data(AVMotionVector *mv, int mb_size,
@@ -116,18 +118,6 @@ static void add_mv_data(AVMotionVector *mv, int mb_size,
     mv->flags = 0;
 }
 
-#define SEARCH_MV(method)\
-    do {\
-        for (mb_y = 0; mb_y < s->b_height; mb_y++)\
-            for (mb_x = 0; mb_x < s->b_width; mb_x++) {\
-                const int x_mb = mb_x << s->log2_mb_size;\
-                const int y_mb = mb_y << s->log2_mb_size;\
-                int mv[2] = {x_mb, y_mb};\
-                ff_me_search_##method(me_ctx, x_mb, y_mb, mv);\
-                add_mv_data(((AVMotionVector *) sd->data) + mv_count++, me_ctx->mb_size, x_mb, y_mb, mv[0], mv[1], dir);\
-            }\
-    } while (0)
-
 #define ADD_PRED(preds, px, py)\
     do {\
         preds.mvs[preds.nb][0] = px;\
@@ -135,6 +125,170 @@ static void add_mv_data(AVMotionVector *mv, int mb_size,
         preds.nb++;\
     } while(0)
 
+typedef struct ThreadData {
+    AVMotionVector *mvs;
+    int dir;
+} ThreadData;
+
+/**
+ * Search the motion vectors of one row of blocks. The predictive methods use
+ * the vectors of the row above, so rows wait for each other to stay behind.
+ */
+static void search_mv_row(MEContext *s, ThreadData *td, int mb_y, int wavefront)
+{
+    AVMotionEstContext me_ctx_local = s->me_ctx;
+    AVMotionEstContext *me_ctx = &me_ctx_local;
+    const int dir  = td->dir;
+
+    for (int mb_x = 0; mb_x < s->b_width; mb_x++) {
+        const int mb_i = mb_x + mb_y * s->b_width;
+        const int x_mb = mb_x << s->log2_mb_size;
+        const int y_mb = mb_y << s->log2_mb_size;
+        int mv[2] = {x_mb, y_mb};
+
+        if (wavefront && mb_y > 0)
+            ff_me_progress_await(&s->me_progress, mb_y - 1,
+                                 FFMIN(mb_x + 2, s->b_width));
+
+        if (s->method == AV_ME_METHOD_DS)
+            ff_me_search_ds(me_ctx, x_mb, y_mb, mv);
+        else if (s->method == AV_ME_METHOD_ESA)
+            ff_me_search_esa(me_ctx, x_mb, y_mb, mv);
+        else if (s->method == AV_ME_METHOD_FSS)
+            ff_me_search_fss(me_ctx, x_mb, y_mb, mv);
+        else if (s->method == AV_ME_METHOD_NTSS)
+            ff_me_search_ntss(me_ctx, x_mb, y_mb, mv);
+        else if (s->method == AV_ME_METHOD_TDLS)
+            ff_me_search_tdls(me_ctx, x_mb, y_mb, mv);
+        else if (s->method == AV_ME_METHOD_TSS)
+            ff_me_search_tss(me_ctx, x_mb, y_mb, mv);
+        else if (s->method == AV_ME_METHOD_HEXBS)
+            ff_me_search_hexbs(me_ctx, x_mb, y_mb, mv);
+        else if (s->method == AV_ME_METHOD_UMH) {
+            AVMotionEstPredictor *preds = me_ctx->preds;
+            preds[0].nb = 0;
+
+            ADD_PRED(preds[0], 0, 0);
+
+            //left mb in current frame
+            if (mb_x > 0)
+                ADD_PRED(preds[0], s->mv_table[0][mb_i - 1][dir][0], s->mv_table[0][mb_i - 1][dir][1]);
+
+            if (mb_y > 0) {
+                //top mb in current frame
+                ADD_PRED(preds[0], s->mv_table[0][mb_i - s->b_width][dir][0], s->mv_table[0][mb_i - s->b_width][dir][1]);
+
+                //top-right mb in current frame
+                if (mb_x + 1 < s->b_width)
+                    ADD_PRED(preds[0], s->mv_table[0][mb_i - s->b_width + 1][dir][0], s->mv_table[0][mb_i - s->b_width + 1][dir][1]);
+                //top-left mb in current frame
+                else if (mb_x > 0)
+                    ADD_PRED(preds[0], s->mv_table[0][mb_i - s->b_width - 1][dir][0], s->mv_table[0][mb_i - s->b_width - 1][dir][1]);
+            }
+
+            //median predictor
+            if (preds[0].nb == 4) {
+                me_ctx->pred_x = mid_pred(preds[0].mvs[1][0], preds[0].mvs[2][0], preds[0].mvs[3][0]);
+                me_ctx->pred_y = mid_pred(preds[0].mvs[1][1], preds[0].mvs[2][1], preds[0].mvs[3][1]);
+            } else if (preds[0].nb == 3) {
+                me_ctx->pred_x = mid_pred(0, preds[0].mvs[1][0], preds[0].mvs[2][0]);
+                me_ctx->pred_y = mid_pred(0, preds[0].mvs[1][1], preds[0].mvs[2][1]);
+            } else if (preds[0].nb == 2) {
+                me_ctx->pred_x = preds[0].mvs[1][0];
+                me_ctx->pred_y = preds[0].mvs[1][1];
+            } else {
+                me_ctx->pred_x = 0;
+                me_ctx->pred_y = 0;
+            }
+
+            ff_me_search_umh(me_ctx, x_mb, y_mb, mv);
+
+            s->mv_table[0][mb_i][dir][0] = mv[0] - x_mb;
+            s->mv_table[0][mb_i][dir][1] = mv[1] - y_mb;
+        } else if (s->method == AV_ME_METHOD_EPZS) {
+            AVMotionEstPredictor *preds = me_ctx->preds;
+            preds[0].nb = 0;
+            preds[1].nb = 0;
+
+            ADD_PRED(preds[0], 0, 0);
+
+            //left mb in current frame
+            if (mb_x > 0)
+                ADD_PRED(preds[0], s->mv_table[0][mb_i - 1][dir][0], s->mv_table[0][mb_i - 1][dir][1]);
+
+            //top mb in current frame
+            if (mb_y > 0)
+                ADD_PRED(preds[0], s->mv_table[0][mb_i - s->b_width][dir][0], s->mv_table[0][mb_i - s->b_width][dir][1]);
+
+            //top-right mb in current frame
+            if (mb_y > 0 && mb_x + 1 < s->b_width)
+                ADD_PRED(preds[0], s->mv_table[0][mb_i - s->b_width + 1][dir][0], s->mv_table[0][mb_i - s->b_width + 1][dir][1]);
+
+            //median predictor
+            if (preds[0].nb == 4) {
+                me_ctx->pred_x = mid_pred(preds[0].mvs[1][0], preds[0].mvs[2][0], preds[0].mvs[3][0]);
+                me_ctx->pred_y = mid_pred(preds[0].mvs[1][1], preds[0].mvs[2][1], preds[0].mvs[3][1]);
+            } else if (preds[0].nb == 3) {
+                me_ctx->pred_x = mid_pred(0, preds[0].mvs[1][0], preds[0].mvs[2][0]);
+                me_ctx->pred_y = mid_pred(0, preds[0].mvs[1][1], preds[0].mvs[2][1]);
+            } else if (preds[0].nb == 2) {
+                me_ctx->pred_x = preds[0].mvs[1][0];
+                me_ctx->pred_y = preds[0].mvs[1][1];
+            } else {
+                me_ctx->pred_x = 0;
+                me_ctx->pred_y = 0;
+            }
+
+            //collocated mb in prev frame
+            ADD_PRED(preds[0], s->mv_table[1][mb_i][dir][0], s->mv_table[1][mb_i][dir][1]);
+
+            //accelerator motion vector of collocated block in prev frame
+            ADD_PRED(preds[1], s->mv_table[1][mb_i][dir][0] + (s->mv_table[1][mb_i][dir][0] - s->mv_table[2][mb_i][dir][0]),
+                               s->mv_table[1][mb_i][dir][1] + (s->mv_table[1][mb_i][dir][1] - s->mv_table[2][mb_i][dir][1]));
+
+            //left mb in prev frame
+            if (mb_x > 0)
+                ADD_PRED(preds[1], s->mv_table[1][mb_i - 1][dir][0], s->mv_table[1][mb_i - 1][dir][1]);
+
+            //top mb in prev frame
+            if (mb_y > 0)
+                ADD_PRED(preds[1], s->mv_table[1][mb_i - s->b_width][dir][0], s->mv_table[1][mb_i - s->b_width][dir][1]);
+
+            //right mb in prev frame
+            if (mb_x + 1 < s->b_width)
+                ADD_PRED(preds[1], s->mv_table[1][mb_i + 1][dir][0], s->mv_table[1][mb_i + 1][dir][1]);
+
+            //bottom mb in prev frame
+            if (mb_y + 1 < s->b_height)
+                ADD_PRED(preds[1], s->mv_table[1][mb_i + s->b_width][dir][0], s->mv_table[1][mb_i + s->b_width][dir][1]);
+
+            ff_me_search_epzs(me_ctx, x_mb, y_mb, mv);
+
+            s->mv_table[0][mb_i][dir][0] = mv[0] - x_mb;
+            s->mv_table[0][mb_i][dir][1] = mv[1] - y_mb;
+        }
+
+        add_mv_data(td->mvs + mb_i, s->mb_size, x_mb, y_mb, mv[0], mv[1], dir);
+
+        if (wavefront)
+            ff_me_progress_report(&s->me_progress, mb_y, mb_x + 1);
+    }
+}
+
+static int search_mv_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    MEContext *s = ctx->priv;
+    const int slice_start = (s->b_height *  jobnr     ) / nb_jobs;
+    const int slice_end   = (s->b_height * (jobnr + 1)) / nb_jobs;
+    const int wavefront = s->method == AV_ME_METHOD_EPZS ||
+                          s->method == AV_ME_METHOD_UMH;
+
+    for (int mb_y = slice_start; mb_y < slice_end; mb_y++)
+        search_mv_row(s, arg, mb_y, wavefront);
+
+    return 0;
+}
+
 static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
 {
     AVFilterContext *ctx = inlink->dst;
@@ -142,8 +296,9 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
     AVMotionEstContext *me_ctx = &s->me_ctx;
     AVFrameSideData *sd;
     AVFrame *out;
-    int mb_x, mb_y, dir;
-    int32_t mv_count = 0;
+    /* rows waiting for the row above need it to be started first */
+    int nb_jobs = ff_filter_execute_is_ordered(ctx) ? s->b_height : 1;
+    int dir;
     int ret;
 
     if (frame->pts == AV_NOPTS_VALUE) {
@@ -182,145 +337,15 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *frame)
     me_ctx->linesize = s->cur->linesize[0];
 
     for (dir = 0; dir < 2; dir++) {
-        me_ctx->data_ref = (dir ? s->next : s->prev)->data[0];
+        ThreadData td = {
+            .mvs = (AVMotionVector *) sd->data + dir * s->b_count,
+            .dir = dir,
+        };
 
-        if (s->method == AV_ME_METHOD_DS)
-            SEARCH_MV(ds);
-        else if (s->method == AV_ME_METHOD_ESA)
-            SEARCH_MV(esa);
-        else if (s->method == AV_ME_METHOD_FSS)
-            SEARCH_MV(fss);
-        else if (s->method == AV_ME_METHOD_NTSS)
-            SEARCH_MV(ntss);
-        else if (s->method == AV_ME_METHOD_TDLS)
-            SEARCH_MV(tdls);
-        else if (s->method == AV_ME_METHOD_TSS)
-            SEARCH_MV(tss);
-        else if (s->method == AV_ME_METHOD_HEXBS)
-            SEARCH_MV(hexbs);
-        else if (s->method == AV_ME_METHOD_UMH) {
-            for (mb_y = 0; mb_y < s->b_height; mb_y++)
-                for (mb_x = 0; mb_x < s->b_width; mb_x++) {
-                    const int mb_i = mb_x + mb_y * s->b_width;
-                    const int x_mb = mb_x << s->log2_mb_size;
-                    const int y_mb = mb_y << s->log2_mb_size;
-                    int mv[2] = {x_mb, y_mb};
-
-                    AVMotionEstPredictor *preds = me_ctx->preds;
-                    preds[0].nb = 0;
-
-                    ADD_PRED(preds[0], 0, 0);
-
-                    //left mb in current frame
-                    if (mb_x > 0)
-                        ADD_PRED(preds[0], s->mv_table[0][mb_i - 1][dir][0], s->mv_table[0][mb_i - 1][dir][1]);
-
-                    if (mb_y > 0) {
-                        //top mb in current frame
-                        ADD_PRED(preds[0], s->mv_table[0][mb_i - s->b_width][dir][0], s->mv_table[0][mb_i - s->b_width][dir][1]);
-
-                        //top-right mb in current frame
-                        if (mb_x + 1 < s->b_width)
-                            ADD_PRED(preds[0], s->mv_table[0][mb_i - s->b_width + 1][dir][0], s->mv_table[0][mb_i - s->b_width + 1][dir][1]);
-                        //top-left mb in current frame
-                        else if (mb_x > 0)
-                            ADD_PRED(preds[0], s->mv_table[0][mb_i - s->b_width - 1][dir][0], s->mv_table[0][mb_i - s->b_width - 1][dir][1]);
-                    }
-
-                    //median predictor
-                    if (preds[0].nb == 4) {
-                        me_ctx->pred_x = mid_pred(preds[0].mvs[1][0], preds[0].mvs[2][0], preds[0].mvs[3][0]);
-                        me_ctx->pred_y = mid_pred(preds[0].mvs[1][1], preds[0].mvs[2][1], preds[0].mvs[3][1]);
-                    } else if (preds[0].nb == 3) {
-                        me_ctx->pred_x = mid_pred(0, preds[0].mvs[1][0], preds[0].mvs[2][0]);
-                        me_ctx->pred_y = mid_pred(0, preds[0].mvs[1][1], preds[0].mvs[2][1]);
-                    } else if (preds[0].nb == 2) {
-                        me_ctx->pred_x = preds[0].mvs[1][0];
-                        me_ctx->pred_y = preds[0].mvs[1][1];
-                    } else {
-                        me_ctx->pred_x = 0;
-                        me_ctx->pred_y = 0;
-                    }
-
-                    ff_me_search_umh(me_ctx, x_mb, y_mb, mv);
-
-                    s->mv_table[0][mb_i][dir][0] = mv[0] - x_mb;
-                    s->mv_table[0][mb_i][dir][1] = mv[1] - y_mb;
-                    add_mv_data(((AVMotionVector *) sd->data) + mv_count++, me_ctx->mb_size, x_mb, y_mb, mv[0], mv[1], dir);
-                }
-
-        } else if (s->method == AV_ME_METHOD_EPZS) {
+        me_ctx->data_ref = (dir ? s->next : s->prev)->data[0];
 
-            for (mb_y = 0; mb_y < s->b_height; mb_y++)
-                for (mb_x = 0; mb_x < s->b_width; mb_x++) {
-                    const int mb_i = mb_x + mb_y * s->b_width;
-                    const int x_mb = mb_x << s->log2_mb_size;
-                    const int y_mb = mb_y << s->log2_mb_size;
-                    int mv[2] = {x_mb, y_mb};
-
-                    AVMotionEstPredictor *preds = me_ctx->preds;
-                    preds[0].nb = 0;
-                    preds[1].nb = 0;
-
-                    ADD_PRED(preds[0], 0, 0);
-
-                    //left mb in current frame
-                    if (mb_x > 0)
-                        ADD_PRED(preds[0], s->mv_table[0][mb_i - 1][dir][0], s->mv_table[0][mb_i - 1][dir][1]);
-
-                    //top mb in current frame
-                    if (mb_y > 0)
-                        ADD_PRED(preds[0], s->mv_table[0][mb_i - s->b_width][dir][0], s->mv_table[0][mb_i - s->b_width][dir][1]);
-
-                    //top-right mb in current frame
-                    if (mb_y > 0 && mb_x + 1 < s->b_width)
-                        ADD_PRED(preds[0], s->mv_table[0][mb_i - s->b_width + 1][dir][0], s->mv_table[0][mb_i - s->b_width + 1][dir][1]);
-
-                    //median predictor
-                    if (preds[0].nb == 4) {
-                        me_ctx->pred_x = mid_pred(preds[0].mvs[1][0], preds[0].mvs[2][0], preds[0].mvs[3][0]);
-                        me_ctx->pred_y = mid_pred(preds[0].mvs[1][1], preds[0].mvs[2][1], preds[0].mvs[3][1]);
-                    } else if (preds[0].nb == 3) {
-                        me_ctx->pred_x = mid_pred(0, preds[0].mvs[1][0], preds[0].mvs[2][0]);
-                        me_ctx->pred_y = mid_pred(0, preds[0].mvs[1][1], preds[0].mvs[2][1]);
-                    } else if (preds[0].nb == 2) {
-                        me_ctx->pred_x = preds[0].mvs[1][0];
-                        me_ctx->pred_y = preds[0].mvs[1][1];
-                    } else {
-                        me_ctx->pred_x = 0;
-                        me_ctx->pred_y = 0;
-                    }
-
-                    //collocated mb in prev frame
-                    ADD_PRED(preds[0], s->mv_table[1][mb_i][dir][0], s->mv_table[1][mb_i][dir][1]);
-
-                    //accelerator motion vector of collocated block in prev frame
-                    ADD_PRED(preds[1], s->mv_table[1][mb_i][dir][0] + (s->mv_table[1][mb_i][dir][0] - s->mv_table[2][mb_i][dir][0]),
-                                       s->mv_table[1][mb_i][dir][1] + (s->mv_table[1][mb_i][dir][1] - s->mv_table[2][mb_i][dir][1]));
-
-                    //left mb in prev frame
-                    if (mb_x > 0)
-                        ADD_PRED(preds[1], s->mv_table[1][mb_i - 1][dir][0], s->mv_table[1][mb_i - 1][dir][1]);
-
-                    //top mb in prev frame
-                    if (mb_y > 0)
-                        ADD_PRED(preds[1], s->mv_table[1][mb_i - s->b_width][dir][0], s->mv_table[1][mb_i - s->b_width][dir][1]);
-
-                    //right mb in prev frame
-                    if (mb_x + 1 < s->b_width)
-                        ADD_PRED(preds[1], s->mv_table[1][mb_i + 1][dir][0], s->mv_table[1][mb_i + 1][dir][1]);
-
-                    //bottom mb in prev frame
-                    if (mb_y + 1 < s->b_height)
-                        ADD_PRED(preds[1], s->mv_table[1][mb_i + s->b_width][dir][0], s->mv_table[1][mb_i + s->b_width][dir][1]);
-
-                    ff_me_search_epzs(me_ctx, x_mb, y_mb, mv);
-
-                    s->mv_table[0][mb_i][dir][0] = mv[0] - x_mb;
-                    s->mv_table[0][mb_i][dir][1] = mv[1] - y_mb;
-                    add_mv_data(((AVMotionVector *) sd->data) + mv_count++, s->mb_size, x_mb, y_mb, mv[0], mv[1], dir);
-                }
-        }
+        ff_me_progress_reset(&s->me_progress);
+        ff_filter_execute(ctx, search_mv_slice, &td, NULL, nb_jobs);
     }
 
     return ff_filter_frame(ctx->outputs[0], out);
@@ -337,6 +362,8 @@ static av_cold void uninit(AVFilterContext *ctx)
 
     for (i = 0; i < 3; i++)
         av_freep(&s->mv_table[i]);
+
+    ff_me_progress_uninit(&s->me_progress);
 }
 
 static const AVFilterPad mestimate_inputs[] = {
@@ -352,7 +379,7 @@ const FFFilter ff_vf_mestimate = {
     .p.name        = "mestimate",
     .p.description = NULL_IF_CONFIG_SMALL("Generate motion vectors."),
     .p.priv_class  = &mestimate_class,
-    .p.flags       = AVFILTER_FLAG_METADATA_ONLY,
+    .p.flags       = AVFILTER_FLAG_METADATA_ONLY | AVFILTER_FLAG_SLICE_THREADS,
     .priv_size     = sizeof(MEContext),
     .uninit        = uninit,
     FILTER_INPUTS(mestimate_inputs),
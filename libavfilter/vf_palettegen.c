@@ -77,6 +77,9 @@ typedef struct PaletteGenContext {
 
     AVFrame *prev_frame;                    // previous frame used for the diff stats_mode
     struct hist_node histogram[HIST_SIZE];  // histogram/hashtable of the colors
+    struct hist_node *job_histograms;       // per slice job histograms, merged into histogram after each frame
+    int nb_job_histograms;                  // number of slice jobs, HIST_SIZE nodes each
+    int *job_rets;                          // return values of the slice jobs
     struct color_ref **refs;                // references of all the colors used in the stream
     int nb_refs;                            // number of color references (or number of different colors)
     struct range_box boxes[256];            // define the segmentation of the colorspace (the final palette)
@@ -418,15 +421,38 @@ static int color_inc(struct hist_node *hist, uint32_t color)
     return 1;
 }
 
+/**
+ * Merge a color reference counted elsewhere into a hash table node.
+ */
+static int color_merge(struct hist_node *node, const struct color_ref *ref)
+{
+    struct color_ref *e;
+
+    for (int i = 0; i < node->nb_entries; i++) {
+        e = &node->entries[i];
+        if (e->color == ref->color) {
+            e->count += ref->count;
+            return 0;
+        }
+    }
+
+    e = av_dynarray2_add((void**)&node->entries, &node->nb_entries,
+                         sizeof(*node->entries), (const uint8_t *)ref);
+    if (!e)
+        return AVERROR(ENOMEM);
+    return 1;
+}
+
 /**
  * Update histogram when pixels differ from previous frame.
  */
 static int update_histogram_diff(struct hist_node *hist,
-                                 const AVFrame *f1, const AVFrame *f2)
+                                 const AVFrame *f1, const AVFrame *f2,
+                                 int slice_start, int slice_end)
 {
     int x, y, ret, nb_diff_colors = 0;
 
-    for (y = 0; y < f1->height; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         const uint32_t *p = (const uint32_t *)(f1->data[0] + y*f1->linesize[0]);
         const uint32_t *q = (const uint32_t *)(f2->data[0] + y*f2->linesize[0]);
 
@@ -445,11 +471,12 @@ static int update_histogram_diff(struct hist_node *hist,
 /**
  * Simple histogram of the frame.
  */
-static int update_histogram_frame(struct hist_node *hist, const AVFrame *f)
+static int update_histogram_frame(struct hist_node *hist, const AVFrame *f,
+                                  int slice_start, int slice_end)
 {
     int x, y, ret, nb_diff_colors = 0;
 
-    for (y = 0; y < f->height; y++) {
+    for (y = slice_start; y < slice_end; y++) {
         const uint32_t *p = (const uint32_t *)(f->data[0] + y*f->linesize[0]);
 
         for (x = 0; x < f->width; x++) {
@@ -462,6 +489,66 @@ static int update_histogram_frame(struct hist_node *hist, const AVFrame *f)
     return nb_diff_colors;
 }
 
+typedef struct ThreadData {
+    const AVFrame *in, *prev;
+} ThreadData;
+
+static int update_histogram_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteGenContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    struct hist_node *hist = s->job_histograms + jobnr * HIST_SIZE;
+    const int height = td->in->height;
+    const int slice_start = (height *  jobnr     ) / nb_jobs;
+    const int slice_end   = (height * (jobnr + 1)) / nb_jobs;
+
+    return td->prev ? update_histogram_diff(hist, td->prev, td->in, slice_start, slice_end)
+                    : update_histogram_frame(hist, td->in, slice_start, slice_end);
+}
+
+/**
+ * Merge the slice histograms into the main one, and reset them. Within every
+ * hash table node, the slices are merged in order so that the colors end up
+ * sorted by first occurrence, exactly as if the frame was scanned at once.
+ */
+static int merge_histograms(PaletteGenContext *s, int nb_jobs)
+{
+    int ret, nb_diff_colors = 0;
+
+    for (int i = 0; i < nb_jobs; i++)
+        if (s->job_rets[i] < 0)
+            return s->job_rets[i];
+
+    for (int j = 0; j < HIST_SIZE; j++) {
+        for (int i = 0; i < nb_jobs; i++) {
+            struct hist_node *node = &s->job_histograms[i * HIST_SIZE + j];
+
+            for (int k = 0; k < node->nb_entries; k++) {
+                ret = color_merge(&s->histogram[j], &node->entries[k]);
+                if (ret < 0)
+                    return ret;
+                nb_diff_colors += ret;
+            }
+            node->nb_entries = 0;
+        }
+    }
+    return nb_diff_colors;
+}
+
+static int update_histogram(AVFilterContext *ctx, const AVFrame *in)
+{
+    PaletteGenContext *s = ctx->priv;
+    const int nb_jobs = FFMIN(in->height, s->nb_job_histograms);
+    ThreadData td = { .in = in, .prev = s->prev_frame };
+
+    if (nb_jobs <= 1)
+        return s->prev_frame ? update_histogram_diff(s->histogram, s->prev_frame, in, 0, in->height)
+                             : update_histogram_frame(s->histogram, in, 0, in->height);
+
+    ff_filter_execute(ctx, update_histogram_slice, &td, s->job_rets, nb_jobs);
+    return merge_histograms(s, nb_jobs);
+}
+
 /**
  * Update the histogram for each passing frame. No frame will be pushed here.
  */
@@ -474,8 +561,7 @@ static int filter_frame(AVFilterLink *inlink, AVFrame *in)
     if (in->color_trc != AVCOL_TRC_UNSPECIFIED && in->color_trc != AVCOL_TRC_IEC61966_2_1)
         av_log(ctx, AV_LOG_WARNING, "The input frame is not in sRGB, colors may be off\n");
 
-    ret = s->prev_frame ? update_histogram_diff(s->histogram, s->prev_frame, in)
-                        : update_histogram_frame(s->histogram, in);
+    ret = update_histogram(ctx, in);
     if (ret > 0)
         s->nb_refs += ret;
 
@@ -523,6 +609,33 @@ static int request_frame(AVFilterLink *outlink)
     return r;
 }
 
+static void free_job_histograms(PaletteGenContext *s)
+{
+    for (int i = 0; i < s->nb_job_histograms * HIST_SIZE; i++)
+        av_freep(&s->job_histograms[i].entries);
+    av_freep(&s->job_histograms);
+    av_freep(&s->job_rets);
+    s->nb_job_histograms = 0;
+}
+
+static int config_input(AVFilterLink *inlink)
+{
+    AVFilterContext *ctx = inlink->dst;
+    PaletteGenContext *s = ctx->priv;
+    const int nb_threads = ff_filter_get_nb_threads(ctx);
+
+    free_job_histograms(s);
+    if (nb_threads <= 1)
+        return 0;
+
+    s->job_histograms = av_calloc(nb_threads, HIST_SIZE * sizeof(*s->job_histograms));
+    s->job_rets       = av_calloc(nb_threads, sizeof(*s->job_rets));
+    if (!s->job_histograms || !s->job_rets)
+        return AVERROR(ENOMEM);
+    s->nb_job_histograms = nb_threads;
+    return 0;
+}
+
 /**
  * The output is one simple 16x16 squared-pixels palette.
  */
@@ -554,6 +667,7 @@ static av_cold void uninit(AVFilterContext *ctx)
         av_freep(&s->histogram[i].entries);
     av_freep(&s->refs);
     av_frame_free(&s->prev_frame);
+    free_job_histograms(s);
 }
 
 static const AVFilterPad palettegen_inputs[] = {
@@ -561,6 +675,7 @@ static const AVFilterPad palettegen_inputs[] = {
         .name         = "default",
         .type         = AVMEDIA_TYPE_VIDEO,
         .filter_frame = filter_frame,
+        .config_props = config_input,
     },
 };
 
@@ -577,6 +692,7 @@ const FFFilter ff_vf_palettegen = {
     .p.name        = "palettegen",
     .p.description = NULL_IF_CONFIG_SMALL("Find the optimal palette for a given stream."),
     .p.priv_class  = &palettegen_class,
+    .p.flags       = AVFILTER_FLAG_SLICE_THREADS,
     .priv_size     = sizeof(PaletteGenContext),
     .init          = init,
     .uninit        = uninit,
@@ -82,13 +82,16 @@ struct cache_node {
 
 struct PaletteUseContext;
 
-typedef int (*set_frame_func)(struct PaletteUseContext *s, AVFrame *out, AVFrame *in,
+typedef int (*set_frame_func)(struct PaletteUseContext *s, struct cache_node *cache,
+                              AVFrame *out, AVFrame *in,
                               int x_start, int y_start, int width, int height);
 
 typedef struct PaletteUseContext {
     const AVClass *class;
     FFFrameSync fs;
-    struct cache_node cache[CACHE_SIZE];    /* lookup cache */
+    struct cache_node *cache;               /* lookup caches, CACHE_SIZE entries per slice job */
+    int nb_caches;
+    int *job_rets;
     struct color_node map[AVPALETTE_COUNT]; /* 3D-Tree (KD-Tree with K=3) for reverse colormap */
     uint32_t palette[AVPALETTE_COUNT];
     int transparency_index; /* index in the palette of transparency. -1 if there is no transparency in the palette. */
@@ -239,11 +242,12 @@ struct stack_node {
  * Check if the requested color is in the cache already. If not, find it in the
  * color tree and cache it.
  */
-static av_always_inline int color_get(PaletteUseContext *s, uint32_t color)
+static av_always_inline int color_get(PaletteUseContext *s, struct cache_node *cache,
+                                      uint32_t color)
 {
     struct color_info clrinfo;
     const uint32_t hash = ff_lowbias32(color) & (CACHE_SIZE - 1);
-    struct cache_node *node = &s->cache[hash];
+    struct cache_node *node = &cache[hash];
     struct cached_color *e;
 
     // first, check for transparency
@@ -268,11 +272,11 @@ static av_always_inline int color_get(PaletteUseContext *s, uint32_t color)
     return e->pal_entry;
 }
 
-static av_always_inline int get_dst_color_err(PaletteUseContext *s,
+static av_always_inline int get_dst_color_err(PaletteUseContext *s, struct cache_node *cache,
                                               uint32_t c, int *er, int *eg, int *eb)
 {
     uint32_t dstc;
-    const int dstx = color_get(s, c);
+    const int dstx = color_get(s, cache, c);
     if (dstx < 0)
         return dstx;
     dstc = s->palette[dstx];
@@ -289,7 +293,8 @@ static av_always_inline int get_dst_color_err(PaletteUseContext *s,
     return dstx;
 }
 
-static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFrame *in,
+static av_always_inline int set_frame(PaletteUseContext *s, struct cache_node *cache,
+                                      AVFrame *out, AVFrame *in,
                                       int x_start, int y_start, int w, int h,
                                       enum dithering_mode dither)
 {
@@ -315,7 +320,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
                 const uint8_t g = av_clip_uint8(g8 + d);
                 const uint8_t b = av_clip_uint8(b8 + d);
                 const uint32_t color_new = (unsigned)(a8) << 24 | r << 16 | g << 8 | b;
-                const int color = color_get(s, color_new);
+                const int color = color_get(s, cache, color_new);
 
                 if (color < 0)
                     return color;
@@ -323,7 +328,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_HECKBERT) {
                 const int right = x < w - 1, down = y < h - 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
 
                 if (color < 0)
                     return color;
@@ -335,7 +340,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_FLOYD_STEINBERG) {
                 const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
 
                 if (color < 0)
                     return color;
@@ -349,7 +354,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
             } else if (dither == DITHERING_SIERRA2) {
                 const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
                 const int right2 = x < w - 2,                    left2 = x > x_start + 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
 
                 if (color < 0)
                     return color;
@@ -368,7 +373,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
 
             } else if (dither == DITHERING_SIERRA2_4A) {
                 const int right = x < w - 1, down = y < h - 1, left = x > x_start;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
 
                 if (color < 0)
                     return color;
@@ -381,7 +386,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
             } else if (dither == DITHERING_SIERRA3) {
                 const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
                 const int right2 = x < w - 2, down2 = y < h - 2, left2 = x > x_start + 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
 
                 if (color < 0)
                     return color;
@@ -407,7 +412,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
             } else if (dither == DITHERING_BURKES) {
                 const int right  = x < w - 1, down  = y < h - 1, left  = x > x_start;
                 const int right2 = x < w - 2,                    left2 = x > x_start + 1;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
 
                 if (color < 0)
                     return color;
@@ -427,7 +432,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
             } else if (dither == DITHERING_ATKINSON) {
                 const int right  = x < w - 1, down  = y < h - 1, left = x > x_start;
                 const int right2 = x < w - 2, down2 = y < h - 2;
-                const int color = get_dst_color_err(s, src[x], &er, &eg, &eb);
+                const int color = get_dst_color_err(s, cache, src[x], &er, &eg, &eb);
 
                 if (color < 0)
                     return color;
@@ -444,7 +449,7 @@ static av_always_inline int set_frame(PaletteUseContext *s, AVFrame *out, AVFram
                 }
 
             } else {
-                const int color = color_get(s, src[x]);
+                const int color = color_get(s, cache, src[x]);
 
                 if (color < 0)
                     return color;
@@ -767,6 +772,27 @@ static void set_processing_window(enum diff_mode diff_mode,
     *hp = height;
 }
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    int x, y, w, h;
+} ThreadData;
+
+/**
+ * Map one band of rows of the processing window. Only used for the dithering
+ * modes without error diffusion, where every pixel is independent. Each job
+ * has its own color cache so that no lookup state is shared between threads.
+ */
+static int set_frame_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    PaletteUseContext *s = ctx->priv;
+    const ThreadData *td = arg;
+    const int slice_start = td->y + (td->h *  jobnr     ) / nb_jobs;
+    const int slice_end   = td->y + (td->h * (jobnr + 1)) / nb_jobs;
+
+    return s->set_frame(s, s->cache + jobnr * CACHE_SIZE, td->out, td->in,
+                        td->x, slice_start, td->w, slice_end - slice_start);
+}
+
 static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
 {
     int x, y, w, h, ret;
@@ -795,7 +821,17 @@ static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
     ff_dlog(ctx, "%dx%d rect: (%d;%d) -> (%d,%d) [area:%dx%d]\n",
             w, h, x, y, x+w, y+h, in->width, in->height);
 
-    ret = s->set_frame(s, out, in, x, y, w, h);
+    if (s->nb_caches > 1) {
+        ThreadData td = { .in = in, .out = out, .x = x, .y = y, .w = w, .h = h };
+        const int nb_jobs = FFMIN(h, s->nb_caches);
+
+        ff_filter_execute(ctx, set_frame_slice, &td, s->job_rets, nb_jobs);
+        ret = 0;
+        for (int i = 0; i < nb_jobs && ret >= 0; i++)
+            ret = s->job_rets[i];
+    } else {
+        ret = s->set_frame(s, s->cache, out, in, x, y, w, h);
+    }
     if (ret < 0) {
         av_frame_free(&out);
         *outf = NULL;
@@ -806,11 +842,28 @@ static int apply_palette(AVFilterLink *inlink, AVFrame *in, AVFrame **outf)
     return 0;
 }
 
+static void free_caches(PaletteUseContext *s)
+{
+    for (int i = 0; i < s->nb_caches * CACHE_SIZE; i++)
+        av_freep(&s->cache[i].entries);
+    av_freep(&s->cache);
+    av_freep(&s->job_rets);
+    s->nb_caches = 0;
+}
+
 static int config_output(AVFilterLink *outlink)
 {
     int ret;
     AVFilterContext *ctx = outlink->src;
     PaletteUseContext *s = ctx->priv;
+    const int sliced = s->dither == DITHERING_NONE || s->dither == DITHERING_BAYER;
+
+    free_caches(s);
+    s->nb_caches = sliced ? ff_filter_get_nb_threads(ctx) : 1;
+    s->cache     = av_calloc(s->nb_caches, CACHE_SIZE * sizeof(*s->cache));
+    s->job_rets  = av_calloc(s->nb_caches, sizeof(*s->job_rets));
+    if (!s->cache || !s->job_rets)
+        return AVERROR(ENOMEM);
 
     ret = ff_framesync_init_dualinput(&s->fs, ctx);
     if (ret < 0)
@@ -854,9 +907,10 @@ static void load_palette(PaletteUseContext *s, const AVFrame *palette_frame)
     if (s->new) {
         memset(s->palette, 0, sizeof(s->palette));
         memset(s->map, 0, sizeof(s->map));
-        for (i = 0; i < CACHE_SIZE; i++)
+        for (i = 0; i < s->nb_caches * CACHE_SIZE; i++) {
             av_freep(&s->cache[i].entries);
-        memset(s->cache, 0, sizeof(s->cache));
+            s->cache[i].nb_entries = 0;
+        }
     }
 
     i = 0;
@@ -904,10 +958,11 @@ static int load_apply_palette(FFFrameSync *fs)
 }
 
 #define DEFINE_SET_FRAME(name, value)                                           \
-static int set_frame_##name(PaletteUseContext *s, AVFrame *out, AVFrame *in,    \
+static int set_frame_##name(PaletteUseContext *s, struct cache_node *cache,     \
+                            AVFrame *out, AVFrame *in,                          \
                             int x_start, int y_start, int w, int h)             \
 {                                                                               \
-    return set_frame(s, out, in, x_start, y_start, w, h, value);                \
+    return set_frame(s, cache, out, in, x_start, y_start, w, h, value);         \
 }
 
 DEFINE_SET_FRAME(none,            DITHERING_NONE)
@@ -972,8 +1027,7 @@ static av_cold void uninit(AVFilterContext *ctx)
     PaletteUseContext *s = ctx->priv;
 
     ff_framesync_uninit(&s->fs);
-    for (int i = 0; i < CACHE_SIZE; i++)
-        av_freep(&s->cache[i].entries);
+    free_caches(s);
     av_frame_free(&s->last_in);
     av_frame_free(&s->last_out);
 }
@@ -1001,6 +1055,7 @@ const FFFilter ff_vf_paletteuse = {
     .p.name        = "paletteuse",
     .p.description = NULL_IF_CONFIG_SMALL("Use a palette to downsample an input video stream."),
     .p.priv_class  = &paletteuse_class,
+    .p.flags       = AVFILTER_FLAG_SLICE_THREADS,
     .priv_size     = sizeof(PaletteUseContext),
     .init          = init,
     .uninit        = uninit,
@@ -190,6 +190,8 @@ void avformat_free_context(AVFormatContext *s)
     av_dict_free(&si->id3v2_meta);
     av_packet_free(&si->pkt);
     av_packet_free(&si->parse_pkt);
+    for (int i = 0; i < FF_ARRAY_ELEMS(si->packet_pools); i++)
+        av_buffer_pool_uninit(&si->packet_pools[i]);
     avpriv_packet_list_free(&si->packet_buffer);
     av_freep(&s->streams);
     av_freep(&s->stream_groups);
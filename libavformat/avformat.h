@@ -1474,6 +1474,7 @@ typedef struct AVFormatContext {
 #define AVFMT_FLAG_SHORTEST   0x100000 ///< Stop muxing when the shortest stream stops.
 #endif
 #define AVFMT_FLAG_AUTO_BSF   0x200000 ///< Add bitstream filters as requested by the muxer
+#define AVFMT_FLAG_PACKET_POOL 0x400000 ///< Allocate demuxed packet payloads from reusable buffer pools, where supported
 
     /**
      * Maximum number of bytes read from input in order to determine stream
@@ -115,6 +115,14 @@ URLContext *ffio_geturlcontext(AVIOContext *s)
         return NULL;
 }
 
+int ffio_map(AVIOContext *s, int64_t pos, int size,
+             AVBufferRef **buf, uint8_t **data)
+{
+    URLContext *h = ffio_geturlcontext(s);
+
+    return h && !s->write_flag ? ffurl_map(h, pos, size, buf, data) : 0;
+}
+
 static int url_alloc_for_protocol(URLContext **puc, const URLProtocol *up,
                                   const char *filename, int flags,
                                   const AVIOInterruptCB *int_cb)
@@ -844,6 +852,14 @@ int ffurl_get_short_seek(void *urlcontext)
     return h->prot->url_get_short_seek(h);
 }
 
+int ffurl_map(URLContext *h, int64_t pos, int size,
+              AVBufferRef **buf, uint8_t **data)
+{
+    if (!h || !h->prot || !h->prot->url_map)
+        return 0;
+    return h->prot->url_map(h, pos, size, buf, data);
+}
+
 int ffurl_shutdown(URLContext *h, int flags)
 {
     if (!h || !h->prot || !h->prot->url_shutdown)
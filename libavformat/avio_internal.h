@@ -21,6 +21,7 @@
 
 #include "avio.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/log.h"
 
 extern const AVClass ff_avio_class;
@@ -222,6 +223,17 @@ int ffio_open_dyn_packet_buf(AVIOContext **s, int max_packet_size);
  */
 struct URLContext *ffio_geturlcontext(AVIOContext *s);
 
+/**
+ * Map size bytes of the resource read through the AVIOContext at position pos
+ * in memory, followed by zeroed padding, if the underlying protocol supports
+ * and was asked for it (e.g. the mmap option of the file protocol).
+ *
+ * @return 1 if *buf and *data were set, 0 if the range is not mapped, or a
+ *         negative error code
+ */
+int ffio_map(AVIOContext *s, int64_t pos, int size,
+             AVBufferRef **buf, uint8_t **data);
+
 /**
  * Create and initialize a AVIOContext for accessing the
  * resource referenced by the URLContext h.
@@ -208,7 +208,16 @@ void avio_write(AVIOContext *s, const unsigned char *buf, int size)
         return;
     }
     do {
-        int len = FFMIN(s->buf_end - s->buf_ptr, size);
+        int len;
+
+        if (size > s->buffer_size && !s->update_checksum && !s->max_packet_size &&
+            s->buf_ptr == s->buffer && s->buf_ptr_max == s->buffer) {
+            // bypass the empty buffer and write data directly from buf
+            writeout(s, buf, size);
+            return;
+        }
+
+        len = FFMIN(s->buf_end - s->buf_ptr, size);
         memcpy(s->buf_ptr, buf, len);
         s->buf_ptr += len;
 
@@ -991,7 +1000,8 @@ void ffio_write_lines(AVIOContext *s, const unsigned char *buf, int size,
 int ffio_copy_url_options(AVIOContext* pb, AVDictionary** avio_opts)
 {
     const char *opts[] = {
-        "headers", "user_agent", "cookies", "http_proxy", "referer", "rw_timeout", "icy", NULL };
+        "headers", "user_agent", "cookies", "http_proxy", "referer", "rw_timeout", "icy",
+        "connection_pool", "pool_max_idle", "pool_idle_timeout", NULL };
     const char **opt = opts;
     uint8_t *buf = NULL;
     int ret = 0;
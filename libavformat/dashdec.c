@@ -30,6 +30,7 @@
 #include "avio_internal.h"
 #include "dash.h"
 #include "demux.h"
+#include "segprefetch.h"
 #include "url.h"
 
 #define INITIAL_BUFFER_SIZE 32768
@@ -80,6 +81,9 @@ struct representation {
     char *url_template;
     FFIOContext pb;
     AVIOContext *input;
+    SegmentPrefetch *prefetch;
+    int prefetch_threads;
+    int input_prefetched;
     AVFormatContext *parent;
     AVFormatContext *ctx;
     int stream_index;
@@ -154,6 +158,10 @@ typedef struct DASHContext {
     AVDictionary *avio_opts;
     int max_url_size;
     char *cenc_decryption_key;
+    int prefetch_segments;
+    int prefetch_threads;
+    int prefetch_threads_used;
+    int64_t prefetch_max_size;
 
     /* Flags for init section*/
     int is_init_section_common_video;
@@ -356,6 +364,7 @@ static void free_representation(struct representation *pls)
     free_fragment(&pls->init_section);
     av_freep(&pls->init_sec_buf);
     av_freep(&pls->pb.pub.buffer);
+    ff_segprefetch_free(&pls->prefetch);
     ff_format_io_close(pls->parent, &pls->input);
     if (pls->ctx) {
         pls->ctx->pb = NULL;
@@ -1674,7 +1683,10 @@ static int read_from_url(struct representation *pls, struct fragment *seg,
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, pls->cur_seg_size - pls->cur_seg_offset);
 
-    ret = avio_read(pls->input, buf, buf_size);
+    if (pls->input_prefetched)
+        ret = ff_segprefetch_read(pls->prefetch, buf, buf_size);
+    else
+        ret = avio_read(pls->input, buf, buf_size);
     if (ret > 0)
         pls->cur_seg_offset += ret;
 
@@ -1713,6 +1725,101 @@ cleanup:
     return ret;
 }
 
+/* Queue the fragments following the current one for prefetching and take the
+ * current one from the prefetched ones, if it is there. */
+static int open_prefetched_input(DASHContext *c, struct representation *pls)
+{
+    char *tmpfilename, *url;
+    int64_t seq_no;
+    int ret;
+
+    /* live manifests are refreshed as fragments are opened, and single
+     * fragment representations are read with seeking */
+    if (c->is_live || pls->n_fragments == 1)
+        return AVERROR(ENOSYS);
+
+    if (!pls->prefetch) {
+        int nb_reps = c->n_videos + c->n_audios + c->n_subtitles, nb_threads;
+
+        /* the threads of the demuxer are shared by its representations */
+        nb_threads = FFMAX(c->prefetch_threads / FFMAX(nb_reps, 1), 1);
+        nb_threads = FFMIN3(nb_threads, c->prefetch_segments,
+                            c->prefetch_threads - c->prefetch_threads_used);
+        if (nb_threads <= 0)
+            return AVERROR(ENOSYS);
+
+        ret = ff_segprefetch_alloc(&pls->prefetch, pls->parent, c->prefetch_segments,
+                                   nb_threads, c->prefetch_max_size);
+        if (ret < 0) {
+            av_log(pls->parent, AV_LOG_WARNING,
+                   "Failed to set up fragment prefetching: %s\n", av_err2str(ret));
+            c->prefetch_segments = 0;
+            return ret;
+        }
+        pls->prefetch_threads     = nb_threads;
+        c->prefetch_threads_used += nb_threads;
+    }
+
+    tmpfilename = av_mallocz(c->max_url_size);
+    url         = av_mallocz(c->max_url_size);
+    if (!tmpfilename || !url) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    seq_no = ff_segprefetch_seek(pls->prefetch, pls->cur_seq_no);
+    for (;; seq_no++) {
+        AVDictionary *opts = NULL;
+
+        av_dict_copy(&opts, c->avio_opts, 0);
+        av_dict_set(&opts, "multiple_requests", "1", 0);
+        if (pls->n_fragments) {
+            struct fragment *seg;
+
+            if (seq_no >= pls->n_fragments)
+                break;
+            seg = pls->fragments[seq_no];
+            ff_make_absolute_url(url, c->max_url_size, c->base_url, seg->url);
+            if (seg->size >= 0) {
+                av_dict_set_int(&opts, "offset", seg->url_offset, 0);
+                av_dict_set_int(&opts, "end_offset", seg->url_offset + seg->size, 0);
+            }
+        } else if (pls->url_template && seq_no <= pls->last_seq_no) {
+            ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, seq_no, 0,
+                                     get_segment_start_time_based_on_timeline(pls, seq_no));
+            ff_make_absolute_url(url, c->max_url_size, c->base_url, tmpfilename);
+        } else {
+            av_dict_free(&opts);
+            break;
+        }
+
+        ret = ishttp(url) ? ff_segprefetch_add(pls->prefetch, seq_no, url, opts) : AVERROR(ENOSYS);
+        av_dict_free(&opts);
+        if (ret < 0)
+            break;
+    }
+
+    ret = ff_segprefetch_open(pls->prefetch, pls->cur_seq_no, &c->avio_opts);
+    if (ret < 0) {
+        if (ret != AVERROR(ENOENT) && ret != AVERROR_EXIT)
+            av_log(pls->parent, AV_LOG_WARNING,
+                   "Prefetching fragment %"PRId64" failed: %s\n",
+                   pls->cur_seq_no, av_err2str(ret));
+        goto end;
+    }
+
+    av_log(pls->parent, AV_LOG_VERBOSE, "DASH prefetched fragment %"PRId64"\n",
+           pls->cur_seq_no);
+    pls->input_prefetched = 1;
+    pls->cur_seg_offset   = 0;
+    pls->cur_seg_size     = pls->cur_seg->size;
+
+end:
+    av_free(tmpfilename);
+    av_free(url);
+    return ret;
+}
+
 static int update_init_section(struct representation *pls)
 {
     static const int max_init_section_size = 1024 * 1024;
@@ -1762,7 +1869,7 @@ static int update_init_section(struct representation *pls)
 static int64_t seek_data(void *opaque, int64_t offset, int whence)
 {
     struct representation *v = opaque;
-    if (v->n_fragments && !v->init_sec_data_len) {
+    if (v->n_fragments && !v->init_sec_data_len && v->input) {
         return avio_seek(v->input, offset, whence);
     }
 
@@ -1776,7 +1883,7 @@ static int read_data(void *opaque, uint8_t *buf, int buf_size)
     DASHContext *c = v->parent->priv_data;
 
 restart:
-    if (!v->input) {
+    if (!v->input && !v->input_prefetched) {
         free_fragment(&v->cur_seg);
         v->cur_seg = get_current_fragment(v);
         if (!v->cur_seg) {
@@ -1789,7 +1896,10 @@ restart:
         if (ret)
             goto end;
 
-        ret = open_input(c, v, v->cur_seg);
+        if (c->prefetch_segments > 0 && open_prefetched_input(c, v) >= 0)
+            ret = 0;
+        else
+            ret = open_input(c, v, v->cur_seg);
         if (ret < 0) {
             if (ff_check_interrupt(c->interrupt_callback)) {
                 ret = AVERROR_EXIT;
@@ -2130,6 +2240,7 @@ static int dash_read_header(AVFormatContext *s)
 
 static void recheck_discard_flags(AVFormatContext *s, struct representation **p, int n)
 {
+    DASHContext *c = s->priv_data;
     int i, j;
 
     for (i = 0; i < n; i++) {
@@ -2148,6 +2259,10 @@ static void recheck_discard_flags(AVFormatContext *s, struct representation **p,
         } else if (!needed && pls->ctx) {
             close_demux_for_component(pls);
             ff_format_io_close(pls->parent, &pls->input);
+            ff_segprefetch_free(&pls->prefetch);
+            c->prefetch_threads_used -= pls->prefetch_threads;
+            pls->prefetch_threads     = 0;
+            pls->input_prefetched = 0;
             av_log(s, AV_LOG_INFO, "No longer receiving stream_index %d\n", pls->stream_index);
         }
     }
@@ -2210,6 +2325,7 @@ static int dash_read_packet(AVFormatContext *s, AVPacket *pkt)
             cur->init_sec_buf_read_offset = 0;
             cur->is_restart_needed = 0;
             ff_format_io_close(cur->parent, &cur->input);
+            cur->input_prefetched = 0;
             ret = reopen_demux_for_component(s, cur);
         }
     }
@@ -2248,6 +2364,8 @@ static int dash_seek(AVFormatContext *s, struct representation *pls, int64_t see
     }
 
     ff_format_io_close(pls->parent, &pls->input);
+    ff_segprefetch_flush(pls->prefetch);
+    pls->input_prefetched = 0;
 
     // find the nearest fragment
     if (pls->n_timelines > 0 && pls->fragment_timescale > 0) {
@@ -2346,6 +2464,12 @@ static const AVOption dash_options[] = {
         {.str = "aac,m4a,m4s,m4v,mov,mp4,webm,ts"},
         INT_MIN, INT_MAX, FLAGS},
     { "cenc_decryption_key", "Media decryption key (hex)", OFFSET(cenc_decryption_key), AV_OPT_TYPE_STRING, {.str = NULL}, INT_MIN, INT_MAX, .flags = FLAGS },
+    { "prefetch_segments", "Number of HTTP fragments to download ahead in the background, 0 to disable",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, FLAGS },
+    { "prefetch_threads", "Maximum number of concurrent prefetch downloads of all representations",
+        OFFSET(prefetch_threads), AV_OPT_TYPE_INT, {.i64 = 4}, 1, 64, FLAGS },
+    { "prefetch_max_size", "Maximum amount of prefetched data held in memory",
+        OFFSET(prefetch_max_size), AV_OPT_TYPE_INT64, {.i64 = 64 << 20}, 0, INT64_MAX, FLAGS },
     {NULL}
 };
 
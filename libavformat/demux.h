@@ -330,6 +330,38 @@ int ff_generate_avci_extradata(AVStream *st);
  */
 int ff_get_extradata(void *logctx, AVCodecParameters *par, AVIOContext *pb, int size);
 
+/**
+ * Allocate a buffer of at least size bytes for demuxed data. If
+ * AVFMT_FLAG_PACKET_POOL is set, the buffer is taken from a pool of
+ * buffers of the next power-of-two size, so that its memory is reused
+ * once all references to it are dropped. Buffers larger than any regular
+ * packet are allocated normally. The buffer is not zeroed.
+ */
+AVBufferRef *ff_demux_buffer_alloc(AVFormatContext *s, size_t size);
+
+/**
+ * Like av_new_packet(), but allocate the payload with
+ * ff_demux_buffer_alloc().
+ */
+int ff_demux_new_packet(AVFormatContext *s, AVPacket *pkt, int size);
+
+/**
+ * If the next size bytes of pb can be mapped in memory, see ffio_map(), skip
+ * over them and return a reference to them instead of reading them. The data
+ * is read-only and followed by AV_INPUT_BUFFER_PADDING_SIZE zero bytes.
+ *
+ * @return 1 if *buf and *data were set, 0 if the data is not mapped and has
+ *         to be read, or a negative error code
+ */
+int ff_demux_map(AVIOContext *pb, int size, AVBufferRef **buf, uint8_t **data);
+
+/**
+ * Like av_get_packet(), but reference the payload in place if it is mapped
+ * in memory, see ff_demux_map(), or else allocate it with
+ * ff_demux_buffer_alloc().
+ */
+int ff_demux_get_packet(AVFormatContext *s, AVIOContext *pb, AVPacket *pkt, int size);
+
 /**
  * Find stream index based on format-specific stream ID
  * @return stream index, or < 0 on error
@@ -22,6 +22,8 @@
 #include "libavutil/mem.h"
 
 #include "libavutil/avassert.h"
+#include "libavutil/buffer.h"
+#include "libavutil/intmath.h"
 #include "libavcodec/bytestream.h"
 #include "libavcodec/packet_internal.h"
 #include "avformat.h"
@@ -351,6 +353,127 @@ int ff_get_extradata(void *logctx, AVCodecParameters *par, AVIOContext *pb, int
     return ret;
 }
 
+/* larger reads may come from damaged files, leave those to av_get_packet(),
+ * which limits them to the remaining input size and grows them in chunks */
+#define MAX_POOLED_PACKET_SIZE 5000000
+
+AVBufferRef *ff_demux_buffer_alloc(AVFormatContext *s, size_t size)
+{
+    FFFormatContext *const si = ffformatcontext(s);
+    AVBufferPool **pool;
+    int idx;
+
+    // buffers are kept in the pools once allocated, so only pool those of
+    // the sizes regular packets have
+    if (!(s->flags & AVFMT_FLAG_PACKET_POOL) || !size ||
+        size > MAX_POOLED_PACKET_SIZE + AV_INPUT_BUFFER_PADDING_SIZE)
+        return av_buffer_alloc(size);
+
+    idx  = size > 1 ? av_log2(size - 1) + 1 : 0;
+    av_assert1(idx < FF_ARRAY_ELEMS(si->packet_pools));
+    pool = &si->packet_pools[idx];
+    if (!*pool) {
+        *pool = av_buffer_pool_init(1 << idx, NULL);
+        if (!*pool)
+            return NULL;
+    }
+
+    return av_buffer_pool_get(*pool);
+}
+
+int ff_demux_new_packet(AVFormatContext *s, AVPacket *pkt, int size)
+{
+    AVBufferRef *buf;
+
+    if (!(s->flags & AVFMT_FLAG_PACKET_POOL))
+        return av_new_packet(pkt, size);
+
+    if ((unsigned)size >= INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE)
+        return AVERROR(EINVAL);
+
+    buf = ff_demux_buffer_alloc(s, size + AV_INPUT_BUFFER_PADDING_SIZE);
+    if (!buf)
+        return AVERROR(ENOMEM);
+    memset(buf->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    pkt->buf  = buf;
+    pkt->data = buf->data;
+    pkt->size = size;
+
+    return 0;
+}
+
+/* Mapping costs a few system calls and page faults per packet. With the file
+ * protocol, it only gets faster than copying from about 256 KiB on. */
+#define MIN_MAPPED_SIZE (256 * 1024)
+
+int ff_demux_map(AVIOContext *pb, int size, AVBufferRef **buf, uint8_t **data)
+{
+    int64_t pos, ret;
+
+    if (size < MIN_MAPPED_SIZE)
+        return 0;
+
+    pos = avio_tell(pb);
+    if (pos < 0)
+        return 0;
+
+    ret = ffio_map(pb, pos, size, buf, data);
+    if (ret <= 0)
+        return ret;
+
+    ret = avio_skip(pb, size);
+    if (ret < 0) {
+        av_buffer_unref(buf);
+        return ret;
+    }
+
+    return 1;
+}
+
+int ff_demux_get_packet(AVFormatContext *s, AVIOContext *pb, AVPacket *pkt, int size)
+{
+    int64_t pos = avio_tell(pb);
+    AVBufferRef *buf;
+    uint8_t *data;
+    int ret;
+
+    ret = ff_demux_map(pb, size, &buf, &data);
+    if (ret < 0)
+        return ret;
+    if (ret) {
+        av_packet_unref(pkt);
+        pkt->buf  = buf;
+        pkt->data = data;
+        pkt->size = size;
+        pkt->pos  = pos;
+        return size;
+    }
+
+    if (!(s->flags & AVFMT_FLAG_PACKET_POOL) ||
+        size <= 0 || size > MAX_POOLED_PACKET_SIZE)
+        return av_get_packet(pb, pkt, size);
+
+    av_packet_unref(pkt);
+    pkt->pos = avio_tell(pb);
+
+    ret = ff_demux_new_packet(s, pkt, size);
+    if (ret < 0)
+        return ret;
+
+    ret = avio_read(pb, pkt->data, size);
+    if (ret <= 0) {
+        av_packet_unref(pkt);
+        return ret;
+    }
+    if (ret < size) {
+        av_shrink_packet(pkt, ret);
+        pkt->flags |= AV_PKT_FLAG_CORRUPT;
+    }
+
+    return ret;
+}
+
 int ff_find_stream_index(const AVFormatContext *s, int id)
 {
     for (unsigned i = 0; i < s->nb_streams; i++)
@@ -19,13 +19,20 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+/* Needed for MAP_ANONYMOUS with glibc */
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _DARWIN_C_SOURCE // needed for MAP_ANON
+
 #include "config_components.h"
 
 #include "libavutil/avstring.h"
+#include "libavutil/buffer.h"
 #include "libavutil/file_open.h"
 #include "libavutil/internal.h"
 #include "libavutil/mem.h"
 #include "libavutil/opt.h"
+#include "libavcodec/defs.h"
 #include "avio.h"
 #if HAVE_DIRENT_H
 #include <dirent.h>
@@ -38,7 +45,12 @@
 #include <unistd.h>
 #endif
 #include <sys/stat.h>
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
+#include <stdint.h>
 #include <stdlib.h>
+#include "file_aio.h"
 #include "os_support.h"
 #include "url.h"
 
@@ -96,6 +108,14 @@ typedef struct FileContext {
     int blocksize;
     int follow;
     int seekable;
+    int aio;
+    int aio_depth;
+    int aio_block_size;
+    int direct;
+    FileAIO *async;
+    int mmap;
+    size_t page_size;
+    int64_t map_file_size;
 #if HAVE_DIRENT_H
     DIR *dir;
 #endif
@@ -106,6 +126,11 @@ static const AVOption file_options[] = {
     { "blocksize", "set I/O operation maximum block size", offsetof(FileContext, blocksize), AV_OPT_TYPE_INT, { .i64 = INT_MAX }, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM },
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { "seekable", "Sets if the file is seekable", offsetof(FileContext, seekable), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "aio", "Read ahead or write behind with worker threads", offsetof(FileContext, aio), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "aio_depth", "Number of asynchronous requests in flight", offsetof(FileContext, aio_depth), AV_OPT_TYPE_INT, { .i64 = 4 }, 1, 64, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "aio_block_size", "Size of asynchronous requests", offsetof(FileContext, aio_block_size), AV_OPT_TYPE_INT, { .i64 = 1 << 20 }, 4096, 64 << 20, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "direct", "Bypass the page cache (O_DIRECT) with asynchronous I/O", offsetof(FileContext, direct), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+    { "mmap", "Map the file in memory so that demuxers can return packets without copying", offsetof(FileContext, mmap), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { NULL }
 };
 
@@ -141,6 +166,8 @@ static int file_read(URLContext *h, unsigned char *buf, int size)
     FileContext *c = h->priv_data;
     int ret;
     size = FFMIN(size, c->blocksize);
+    if (c->async)
+        return ff_file_aio_read(c->async, buf, size);
     ret = read(c->fd, buf, size);
     if (ret == 0 && c->follow)
         return AVERROR(EAGAIN);
@@ -154,6 +181,8 @@ static int file_write(URLContext *h, const unsigned char *buf, int size)
     FileContext *c = h->priv_data;
     int ret;
     size = FFMIN(size, c->blocksize);
+    if (c->async)
+        return ff_file_aio_write(c->async, buf, size);
     ret = write(c->fd, buf, size);
     return (ret == -1) ? AVERROR(errno) : ret;
 }
@@ -221,7 +250,13 @@ static int fd_dup(URLContext *h, int oldfd)
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
-    int ret = close(c->fd);
+    int err = ff_file_aio_uninit(&c->async);
+    int ret;
+
+    // mappings handed out stay valid after the descriptor is closed
+    ret = close(c->fd);
+    if (err < 0)
+        return err;
     return (ret == -1) ? AVERROR(errno) : 0;
 }
 
@@ -231,6 +266,27 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
     FileContext *c = h->priv_data;
     int64_t ret;
 
+    if (c->async) {
+        struct stat st;
+
+        // the file size is only up to date with no write in flight
+        if (whence == AVSEEK_SIZE || whence == SEEK_END) {
+            ret = ff_file_aio_flush(c->async);
+            if (ret < 0)
+                return ret;
+            if (fstat(c->fd, &st) < 0)
+                return AVERROR(errno);
+            if (whence == AVSEEK_SIZE)
+                return st.st_size;
+            pos += st.st_size;
+        } else if (whence == SEEK_CUR)
+            pos += ff_file_aio_tell(c->async);
+        else if (whence != SEEK_SET)
+            return AVERROR(EINVAL);
+
+        return ff_file_aio_seek(c->async, pos);
+    }
+
     if (whence == AVSEEK_SIZE) {
         struct stat st;
         ret = fstat(c->fd, &st);
@@ -244,6 +300,88 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
 
 #if CONFIG_FILE_PROTOCOL
 
+#if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#if HAVE_MMAP && HAVE_PREAD && defined(MAP_ANONYMOUS) && defined(MAP_FIXED)
+#define HAVE_FILE_MAP 1
+#else
+#define HAVE_FILE_MAP 0
+#endif
+
+#if HAVE_FILE_MAP
+static void file_unmap(void *opaque, uint8_t *data)
+{
+    munmap(data, (size_t)(uintptr_t)opaque);
+}
+
+/*
+ * The range is mapped from the file up to the last page boundary before its
+ * end. The rest of it is copied into anonymous memory, where the padding
+ * after it is zero, instead of holding the following bytes of the file.
+ */
+static int file_map(URLContext *h, int64_t pos, int size,
+                    AVBufferRef **buf, uint8_t **data)
+{
+    FileContext *c = h->priv_data;
+    int64_t start, end, tail;
+    uint8_t *map;
+    ssize_t ret;
+    size_t len;
+
+    if (!c->page_size || pos < 0 || size <= 0)
+        return 0;
+
+    start = pos - pos % c->page_size;
+    end   = pos + size;
+    tail  = end - end % c->page_size;
+    len   = tail - start +
+            FFALIGN(end - tail + AV_INPUT_BUFFER_PADDING_SIZE, c->page_size);
+
+    if (tail == start)
+        return 0;
+
+    /* mapping pages past the end of the file would fault on access, its size
+     * is only checked again for ranges past the last known end */
+    if (end > c->map_file_size) {
+        struct stat st;
+        if (fstat(c->fd, &st) < 0)
+            return 0;
+        c->map_file_size = st.st_size;
+        if (end > c->map_file_size)
+            return 0;
+    }
+
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED)
+        return 0;
+
+    if (mmap(map, tail - start, PROT_READ, MAP_PRIVATE | MAP_FIXED,
+             c->fd, start) == MAP_FAILED)
+        goto fail;
+
+    do {
+        ret = pread(c->fd, map + (tail - start), end - tail, tail);
+    } while (ret < 0 && errno == EINTR);
+    if (ret != end - tail)
+        goto fail;
+
+    *buf = av_buffer_create(map, len, file_unmap, (void*)(uintptr_t)len,
+                            AV_BUFFER_FLAG_READONLY);
+    if (!*buf) {
+        munmap(map, len);
+        return AVERROR(ENOMEM);
+    }
+    *data = map + (pos - start);
+
+    return 1;
+fail:
+    munmap(map, len);
+    return 0;
+}
+#endif
+
 static int file_delete(URLContext *h)
 {
 #if HAVE_UNISTD_H
@@ -284,7 +422,7 @@ static int file_open(URLContext *h, const char *filename, int flags)
 {
     FileContext *c = h->priv_data;
     int access;
-    int fd;
+    int fd, is_reg;
     struct stat st;
 
     av_strstart(filename, "file:", &filename);
@@ -308,7 +446,12 @@ static int file_open(URLContext *h, const char *filename, int flags)
         return AVERROR(errno);
     c->fd = fd;
 
-    h->is_streamed = !fstat(fd, &st) && S_ISFIFO(st.st_mode);
+    // mapping and asynchronous I/O are only set up for regular files
+    is_reg = 0;
+    if (!fstat(fd, &st)) {
+        h->is_streamed = S_ISFIFO(st.st_mode);
+        is_reg = S_ISREG(st.st_mode);
+    }
 
     /* Buffer writes more than the default 32k to improve throughput especially
      * with networked file systems */
@@ -318,6 +461,32 @@ static int file_open(URLContext *h, const char *filename, int flags)
     if (c->seekable >= 0)
         h->is_streamed = !c->seekable;
 
+    if (c->mmap && !(flags & AVIO_FLAG_WRITE) && !c->follow) {
+#if HAVE_FILE_MAP
+        if (is_reg)
+            c->page_size = sysconf(_SC_PAGESIZE);
+        else
+            av_log(h, AV_LOG_VERBOSE, "Only regular files can be mapped\n");
+#else
+        av_log(h, AV_LOG_WARNING, "Mapping files is not supported on this system\n");
+#endif
+    }
+
+    if (c->aio) {
+        if (!is_reg || c->follow ||
+            (flags & AVIO_FLAG_READ_WRITE) == AVIO_FLAG_READ_WRITE) {
+            av_log(h, AV_LOG_VERBOSE, "Asynchronous I/O only works for reading "
+                   "or writing regular files, using blocking I/O\n");
+        } else {
+            int ret = ff_file_aio_init(&c->async, h, fd, !!(flags & AVIO_FLAG_WRITE),
+                                       c->aio_depth, c->aio_block_size, c->direct);
+            if (ret < 0) {
+                close(fd);
+                return ret;
+            }
+        }
+    }
+
     return 0;
 }
 
@@ -413,6 +582,9 @@ const URLProtocol ff_file_protocol = {
     .url_seek            = file_seek,
     .url_close           = file_close,
     .url_get_file_handle = file_get_handle,
+#if HAVE_FILE_MAP
+    .url_map             = file_map,
+#endif
     .url_check           = file_check,
     .url_delete          = file_delete,
     .url_move            = file_move,
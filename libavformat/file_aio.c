@@ -0,0 +1,603 @@
+/*
+ * Asynchronous read-ahead and write-behind for the file protocol
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/* for O_DIRECT */
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "libavutil/error.h"
+#include "libavutil/fifo.h"
+#include "libavutil/log.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+
+#include "file_aio.h"
+
+#define HAVE_AIO_THREADS (HAVE_THREADS && HAVE_PREAD)
+
+/* O_DIRECT needs buffers, offsets and sizes aligned to the logical block size
+ * of the device; the page size covers all common ones. */
+#define AIO_ALIGN 4096
+
+enum RequestState {
+    REQ_IDLE,
+    REQ_PENDING,
+    REQ_DONE,
+};
+
+typedef struct Request {
+    uint8_t        *buf;
+    int64_t         offset;
+    int             size;
+    int             write;
+
+    enum RequestState state;
+    // number of bytes transferred or an AVERROR code, valid once done
+    int             result;
+} Request;
+
+struct FileAIO {
+    void           *logctx;
+    int             fd;
+    int             write;
+    int             direct;
+
+    uint8_t        *pool;
+    Request        *reqs;
+    int             nb_reqs;
+    int             block_size;
+
+    int64_t         pos;
+
+    /* reading: the requests in use form a ring starting at first, covering
+     * the file from reqs[first].offset up to next_offset */
+    int             first;
+    int             nb_used;
+    int64_t         next_offset;
+    int             eof;
+
+    /* writing: reqs[cur] is being filled with fill bytes, the others are
+     * idle or in flight; error is the first failure of a write */
+    int             cur;
+    int             fill;
+    int             error;
+
+#if HAVE_AIO_THREADS
+    // set once the lock and conditions are initialized
+    int             threads_ready;
+    pthread_t      *workers;
+    int             nb_workers;
+    AVFifo         *queue;
+    int             quit;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond_work;
+    pthread_cond_t  cond_done;
+#endif
+};
+
+#if HAVE_PREAD
+/**
+ * Transfer the remainder of a request synchronously, starting done bytes in.
+ * Only stops short at the end of file.
+ */
+static int transfer_all(int fd, const Request *req, int done)
+{
+    while (done < req->size) {
+        ssize_t ret = req->write ?
+            pwrite(fd, req->buf + done, req->size - done, req->offset + done) :
+            pread (fd, req->buf + done, req->size - done, req->offset + done);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return AVERROR(errno);
+        }
+        if (!ret)
+            break;
+        done += ret;
+    }
+    return done;
+}
+#endif
+
+#if HAVE_AIO_THREADS
+static void *worker(void *arg)
+{
+    FileAIO *a = arg;
+
+    pthread_mutex_lock(&a->lock);
+    while (1) {
+        Request *req;
+        int ret;
+
+        while (!a->quit && !av_fifo_can_read(a->queue))
+            pthread_cond_wait(&a->cond_work, &a->lock);
+        if (a->quit)
+            break;
+
+        av_fifo_read(a->queue, &req, 1);
+        pthread_mutex_unlock(&a->lock);
+
+        ret = transfer_all(a->fd, req, 0);
+
+        pthread_mutex_lock(&a->lock);
+        req->result = ret;
+        req->state  = REQ_DONE;
+        pthread_cond_broadcast(&a->cond_done);
+    }
+    pthread_mutex_unlock(&a->lock);
+
+    return NULL;
+}
+
+static int threads_init(FileAIO *a)
+{
+    int ret;
+
+    a->queue = av_fifo_alloc2(a->nb_reqs, sizeof(Request*), 0);
+    a->workers = av_calloc(a->nb_reqs, sizeof(*a->workers));
+    if (!a->queue || !a->workers)
+        return AVERROR(ENOMEM);
+
+    ret = pthread_mutex_init(&a->lock, NULL);
+    if (ret)
+        return AVERROR(ret);
+    ret = pthread_cond_init(&a->cond_work, NULL);
+    if (ret) {
+        pthread_mutex_destroy(&a->lock);
+        return AVERROR(ret);
+    }
+    ret = pthread_cond_init(&a->cond_done, NULL);
+    if (ret) {
+        pthread_cond_destroy(&a->cond_work);
+        pthread_mutex_destroy(&a->lock);
+        return AVERROR(ret);
+    }
+    a->threads_ready = 1;
+
+    // one worker per request, so that all of them can be in flight at once
+    for (; a->nb_workers < a->nb_reqs; a->nb_workers++) {
+        ret = pthread_create(&a->workers[a->nb_workers], NULL, worker, a);
+        if (ret)
+            return AVERROR(ret);
+    }
+
+    return 0;
+}
+
+static void threads_uninit(FileAIO *a)
+{
+    pthread_mutex_lock(&a->lock);
+    a->quit = 1;
+    pthread_cond_broadcast(&a->cond_work);
+    pthread_mutex_unlock(&a->lock);
+
+    for (int i = 0; i < a->nb_workers; i++)
+        pthread_join(a->workers[i], NULL);
+
+    pthread_cond_destroy(&a->cond_done);
+    pthread_cond_destroy(&a->cond_work);
+    pthread_mutex_destroy(&a->lock);
+}
+
+static int threads_submit(FileAIO *a, Request *req)
+{
+    pthread_mutex_lock(&a->lock);
+    // the queue has room for all requests
+    av_fifo_write(a->queue, &req, 1);
+    pthread_cond_signal(&a->cond_work);
+    pthread_mutex_unlock(&a->lock);
+
+    return 0;
+}
+
+static int threads_wait(FileAIO *a, Request *req)
+{
+    pthread_mutex_lock(&a->lock);
+    while (req->state != REQ_DONE)
+        pthread_cond_wait(&a->cond_done, &a->lock);
+    pthread_mutex_unlock(&a->lock);
+
+    return 0;
+}
+#endif
+
+/**
+ * A request that could not be submitted or waited for is marked done with the
+ * error as its result, so that it is never waited for again.
+ */
+static void request_fail(Request *req, int err)
+{
+    req->result = err;
+    req->state  = REQ_DONE;
+}
+
+static int request_submit(FileAIO *a, Request *req)
+{
+    int ret;
+
+    req->state = REQ_PENDING;
+
+#if HAVE_AIO_THREADS
+    ret = threads_submit(a, req);
+#else
+    ret = AVERROR(ENOSYS);
+#endif
+    if (ret < 0)
+        request_fail(req, ret);
+
+    return ret;
+}
+
+static int request_wait(FileAIO *a, Request *req)
+{
+    int ret;
+
+    if (req->state != REQ_PENDING)
+        return 0;
+
+#if HAVE_AIO_THREADS
+    ret = threads_wait(a, req);
+#else
+    ret = AVERROR(ENOSYS);
+#endif
+    if (ret < 0)
+        request_fail(req, ret);
+
+    return ret;
+}
+
+static Request *read_req(FileAIO *a, int idx)
+{
+    return &a->reqs[(a->first + idx) % a->nb_reqs];
+}
+
+static void read_release(FileAIO *a)
+{
+    read_req(a, 0)->state = REQ_IDLE;
+    a->first = (a->first + 1) % a->nb_reqs;
+    a->nb_used--;
+}
+
+/**
+ * Wait for the read-ahead in flight and restart it at the current position.
+ */
+static void read_reset(FileAIO *a)
+{
+    while (a->nb_used) {
+        request_wait(a, read_req(a, 0));
+        read_release(a);
+    }
+    a->next_offset = a->pos - a->pos % AIO_ALIGN;
+    a->eof         = 0;
+}
+
+static int read_ahead(FileAIO *a)
+{
+    while (a->nb_used < a->nb_reqs && !a->eof) {
+        Request *req = read_req(a, a->nb_used);
+        int ret;
+
+        req->offset = a->next_offset;
+        req->size   = a->block_size;
+        req->write  = 0;
+
+        ret = request_submit(a, req);
+        if (ret < 0)
+            return ret;
+
+        a->next_offset += a->block_size;
+        a->nb_used++;
+    }
+
+    return 0;
+}
+
+int ff_file_aio_read(FileAIO *a, uint8_t *buf, int size)
+{
+    while (1) {
+        Request *req;
+        int64_t end;
+        int ret;
+
+        ret = read_ahead(a);
+        if (ret < 0)
+            return ret;
+
+        if (!a->nb_used) {
+            // start over on the next call, in case the file has grown
+            read_reset(a);
+            return AVERROR_EOF;
+        }
+
+        req = read_req(a, 0);
+        ret = request_wait(a, req);
+        if (ret < 0)
+            return ret;
+        if (req->result < 0) {
+            ret = req->result;
+            read_release(a);
+            read_reset(a);
+            return ret;
+        }
+        if (req->result < req->size)
+            a->eof = 1;
+
+        // requests following a short one may start past the end of file
+        end = req->offset + req->result;
+        if (a->pos >= req->offset && a->pos < end) {
+            int n = FFMIN(size, end - a->pos);
+
+            memcpy(buf, req->buf + (a->pos - req->offset), n);
+            a->pos += n;
+            if (a->pos == end)
+                read_release(a);
+            return n;
+        }
+
+        read_release(a);
+    }
+}
+
+static int write_wait(FileAIO *a, Request *req)
+{
+    int ret;
+
+    if (req->state == REQ_IDLE)
+        return 0;
+
+    ret = request_wait(a, req);
+    req->state = REQ_IDLE;
+    if (ret >= 0 && req->result < req->size)
+        ret = req->result < 0 ? req->result : AVERROR(EIO);
+    if (ret < 0 && !a->error) {
+        av_log(a->logctx, AV_LOG_ERROR, "Error writing %d bytes at %"PRId64": %s\n",
+               req->size, req->offset, av_err2str(ret));
+        a->error = ret;
+    }
+
+    return ret;
+}
+
+static int write_submit(FileAIO *a)
+{
+    Request *req = &a->reqs[a->cur];
+
+    if (!a->fill)
+        return 0;
+
+    req->size  = a->fill;
+    req->write = 1;
+
+#ifdef O_DIRECT
+    if (a->direct && (req->offset % AIO_ALIGN || req->size % AIO_ALIGN)) {
+        int flags;
+
+        // e.g. the tail of the file, or a header rewritten after seeking
+        av_log(a->logctx, AV_LOG_DEBUG, "Unaligned write, disabling O_DIRECT\n");
+        for (int i = 0; i < a->nb_reqs; i++)
+            if (i != a->cur)
+                write_wait(a, &a->reqs[i]);
+
+        flags = fcntl(a->fd, F_GETFL);
+        if (flags < 0 || fcntl(a->fd, F_SETFL, flags & ~O_DIRECT) < 0)
+            return AVERROR(errno);
+        a->direct = 0;
+    }
+#endif
+
+    a->fill = 0;
+    a->cur  = (a->cur + 1) % a->nb_reqs;
+
+    return request_submit(a, req);
+}
+
+int ff_file_aio_write(FileAIO *a, const uint8_t *buf, int size)
+{
+    Request *req = &a->reqs[a->cur];
+    int n, ret;
+
+    if (a->error)
+        return a->error;
+
+    if (!a->fill) {
+        // the buffer may still be in flight from the previous round
+        ret = write_wait(a, req);
+        if (ret < 0)
+            return ret;
+        req->offset = a->pos;
+    }
+
+    n = FFMIN(size, a->block_size - a->fill);
+    memcpy(req->buf + a->fill, buf, n);
+    a->fill += n;
+    a->pos  += n;
+
+    if (a->fill == a->block_size) {
+        ret = write_submit(a);
+        if (ret < 0)
+            return ret;
+    }
+
+    return n;
+}
+
+int ff_file_aio_flush(FileAIO *a)
+{
+    int ret;
+
+    if (!a->write)
+        return 0;
+
+    ret = write_submit(a);
+    if (ret < 0 && !a->error)
+        a->error = ret;
+
+    for (int i = 0; i < a->nb_reqs; i++)
+        write_wait(a, &a->reqs[i]);
+
+    return a->error;
+}
+
+int64_t ff_file_aio_seek(FileAIO *a, int64_t pos)
+{
+    if (pos < 0)
+        return AVERROR(EINVAL);
+
+    if (a->write) {
+        int ret = ff_file_aio_flush(a);
+        if (ret < 0)
+            return ret;
+        a->pos = pos;
+        return pos;
+    }
+
+    // keep the read-ahead for short seeks into it
+    if (a->nb_used && pos >= read_req(a, 0)->offset && pos < a->next_offset) {
+        a->pos = pos;
+        return pos;
+    }
+
+    a->pos = pos;
+    read_reset(a);
+
+    return pos;
+}
+
+int64_t ff_file_aio_tell(FileAIO *a)
+{
+    return a->pos;
+}
+
+static void aio_free(FileAIO **pa)
+{
+    FileAIO *a = *pa;
+
+#if HAVE_AIO_THREADS
+    if (a->threads_ready)
+        threads_uninit(a);
+    av_fifo_freep2(&a->queue);
+    av_freep(&a->workers);
+#endif
+
+    av_freep(&a->reqs);
+    av_freep(&a->pool);
+    av_freep(pa);
+}
+
+int ff_file_aio_uninit(FileAIO **pa)
+{
+    FileAIO *a = *pa;
+    int ret;
+
+    if (!a)
+        return 0;
+
+    ret = ff_file_aio_flush(a);
+    if (!a->write)
+        read_reset(a);
+
+    aio_free(pa);
+
+    return ret;
+}
+
+int ff_file_aio_init(FileAIO **pa, void *logctx, int fd, int write,
+                     int nb_requests, int block_size, int direct)
+{
+    FileAIO *a;
+    uint8_t *buf;
+    int ret;
+
+    if (block_size <= 0 || block_size > INT_MAX - AIO_ALIGN ||
+        nb_requests <= 0 || nb_requests > INT_MAX / (block_size + AIO_ALIGN))
+        return AVERROR(EINVAL);
+
+    a = av_mallocz(sizeof(*a));
+    if (!a)
+        return AVERROR(ENOMEM);
+
+    a->logctx     = logctx;
+    a->fd         = fd;
+    a->write      = write;
+    a->nb_reqs    = nb_requests;
+    a->block_size = FFALIGN(block_size, AIO_ALIGN);
+
+    a->reqs = av_calloc(a->nb_reqs, sizeof(*a->reqs));
+    a->pool = av_malloc((size_t)a->nb_reqs * a->block_size + AIO_ALIGN - 1);
+    if (!a->reqs || !a->pool) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    buf = (uint8_t*)FFALIGN((uintptr_t)a->pool, AIO_ALIGN);
+    for (int i = 0; i < a->nb_reqs; i++)
+        a->reqs[i].buf = buf + (size_t)i * a->block_size;
+
+#if HAVE_AIO_THREADS
+    ret = threads_init(a);
+    if (ret < 0) {
+        av_log(logctx, AV_LOG_ERROR, "Could not start I/O threads: %s\n",
+               av_err2str(ret));
+        goto fail;
+    }
+#else
+    av_log(logctx, AV_LOG_ERROR, "Asynchronous I/O is not supported on this system\n");
+    ret = AVERROR(ENOSYS);
+    goto fail;
+#endif
+
+    if (direct) {
+#ifdef O_DIRECT
+        int flags = fcntl(fd, F_GETFL);
+
+        // not all file systems support it, e.g. tmpfs
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_DIRECT) < 0)
+            av_log(logctx, AV_LOG_WARNING, "Could not enable O_DIRECT: %s\n",
+                   av_err2str(AVERROR(errno)));
+        else
+            a->direct = 1;
+#else
+        av_log(logctx, AV_LOG_WARNING, "O_DIRECT is not supported on this system\n");
+#endif
+    }
+
+    av_log(logctx, AV_LOG_VERBOSE, "Asynchronous %s using worker threads, "
+           "%d requests of %d bytes%s\n", write ? "write-behind" : "read-ahead",
+           a->nb_reqs, a->block_size, a->direct ? ", O_DIRECT" : "");
+
+    *pa = a;
+    return 0;
+fail:
+    aio_free(&a);
+    return ret;
+}
@@ -0,0 +1,66 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_FILE_AIO_H
+#define AVFORMAT_FILE_AIO_H
+
+#include <stdint.h>
+
+/**
+ * Asynchronous I/O on a regular file: reads are served from up to
+ * nb_requests blocks read ahead of the current position, writes are gathered
+ * into such blocks and written out behind the caller. The blocks are
+ * transferred with pread()/pwrite() by one worker thread each. The file
+ * position is kept here, the file descriptor position is not used.
+ */
+typedef struct FileAIO FileAIO;
+
+/**
+ * @param write      the file is written rather than read
+ * @param block_size size of each request, rounded up to the page size
+ * @param direct     bypass the page cache with O_DIRECT where supported
+ */
+int ff_file_aio_init(FileAIO **pa, void *logctx, int fd, int write,
+                     int nb_requests, int block_size, int direct);
+
+/**
+ * Write out pending data and free the context; the file descriptor is left
+ * open.
+ *
+ * @return the first error of any write, if one failed
+ */
+int ff_file_aio_uninit(FileAIO **pa);
+
+int ff_file_aio_read(FileAIO *a, uint8_t *buf, int size);
+int ff_file_aio_write(FileAIO *a, const uint8_t *buf, int size);
+
+/**
+ * Wait for all pending writes to complete.
+ */
+int ff_file_aio_flush(FileAIO *a);
+
+/**
+ * Move to the absolute position pos, keeping the read-ahead data if pos falls
+ * into it.
+ *
+ * @return pos or a negative error code
+ */
+int64_t ff_file_aio_seek(FileAIO *a, int64_t pos);
+int64_t ff_file_aio_tell(FileAIO *a);
+
+#endif /* AVFORMAT_FILE_AIO_H */
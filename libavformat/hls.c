@@ -47,6 +47,7 @@
 #include "url.h"
 
 #include "hls_sample_encryption.h"
+#include "segprefetch.h"
 
 #define INITIAL_BUFFER_SIZE 32768
 
@@ -107,6 +108,9 @@ struct playlist {
     int input_read_done;
     AVIOContext *input_next;
     int input_next_requested;
+    SegmentPrefetch *prefetch;
+    int prefetch_threads;
+    int input_prefetched;
     AVFormatContext *parent;
     int index;
     AVFormatContext *ctx;
@@ -229,6 +233,10 @@ typedef struct HLSContext {
     int http_multiple;
     int http_seekable;
     int seg_max_retry;
+    int prefetch_segments;
+    int prefetch_threads;
+    int prefetch_threads_used;
+    int64_t prefetch_max_size;
     AVIOContext *playlist_pb;
     HLSCryptoContext  crypto_ctx;
 } HLSContext;
@@ -277,6 +285,7 @@ static void free_playlist_list(HLSContext *c)
         av_freep(&pls->init_sec_buf);
         av_packet_free(&pls->pkt);
         av_freep(&pls->pb.pub.buffer);
+        ff_segprefetch_free(&pls->prefetch);
         ff_format_io_close(c->ctx, &pls->input);
         pls->input_read_done = 0;
         ff_format_io_close(c->ctx, &pls->input_next);
@@ -645,14 +654,12 @@ static int open_url_keepalive(AVFormatContext *s, AVIOContext **pb,
 #endif
 }
 
-static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
-                    AVDictionary **opts, AVDictionary *opts2, int *is_http_out)
+static int check_url(AVFormatContext *s, const char *url, int *is_http)
 {
     HLSContext *c = s->priv_data;
-    AVDictionary *tmp = NULL;
     const char *proto_name = NULL;
-    int ret;
-    int is_http = 0;
+
+    *is_http = 0;
 
     if (av_strstart(url, "crypto", NULL)) {
         if (url[6] == '+' || url[6] == ':')
@@ -678,7 +685,7 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
             return AVERROR_INVALIDDATA;
         }
     } else if (av_strstart(proto_name, "http", NULL)) {
-        is_http = 1;
+        *is_http = 1;
     } else if (av_strstart(proto_name, "data", NULL)) {
         ;
     } else
@@ -693,6 +700,21 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
     else if (strcmp(proto_name, "file") || !strncmp(url, "file,", 5))
         return AVERROR_INVALIDDATA;
 
+    return 0;
+}
+
+static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
+                    AVDictionary **opts, AVDictionary *opts2, int *is_http_out)
+{
+    HLSContext *c = s->priv_data;
+    AVDictionary *tmp = NULL;
+    int ret;
+    int is_http;
+
+    ret = check_url(s, url, &is_http);
+    if (ret < 0)
+        return ret;
+
     av_dict_copy(&tmp, *opts, 0);
     av_dict_copy(&tmp, opts2, 0);
 
@@ -1121,7 +1143,10 @@ static int read_from_url(struct playlist *pls, struct segment *seg,
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, seg->size - pls->cur_seg_offset);
 
-    ret = avio_read(pls->input, buf, buf_size);
+    if (pls->input_prefetched)
+        ret = ff_segprefetch_read(pls->prefetch, buf, buf_size);
+    else
+        ret = avio_read(pls->input, buf, buf_size);
     if (ret > 0)
         pls->cur_seg_offset += ret;
 
@@ -1412,6 +1437,81 @@ cleanup:
     return ret;
 }
 
+/* Queue the segments following the current one for prefetching and take the
+ * current one from the prefetched ones, if it is there. */
+static int open_prefetched_input(HLSContext *c, struct playlist *pls)
+{
+    int64_t seq_no;
+    int ret, is_http;
+
+    if (!pls->prefetch) {
+        int nb_threads;
+
+        /* the threads of the demuxer are shared by its playlists, those that
+         * are not needed anymore give theirs back */
+        nb_threads = FFMAX(c->prefetch_threads / c->n_playlists, 1);
+        nb_threads = FFMIN3(nb_threads, c->prefetch_segments,
+                            c->prefetch_threads - c->prefetch_threads_used);
+        if (nb_threads <= 0)
+            return AVERROR(ENOSYS);
+
+        ret = ff_segprefetch_alloc(&pls->prefetch, pls->parent, c->prefetch_segments,
+                                   nb_threads, c->prefetch_max_size);
+        if (ret < 0) {
+            av_log(pls->parent, AV_LOG_WARNING,
+                   "Failed to set up segment prefetching: %s\n", av_err2str(ret));
+            c->prefetch_segments = 0;
+            return ret;
+        }
+        pls->prefetch_threads     = nb_threads;
+        c->prefetch_threads_used += nb_threads;
+    }
+
+    seq_no = ff_segprefetch_seek(pls->prefetch, pls->cur_seq_no);
+    for (; seq_no < pls->start_seq_no + pls->n_segments; seq_no++) {
+        struct segment *seg = pls->segments[seq_no - pls->start_seq_no];
+        AVDictionary *opts = NULL;
+
+        /* encrypted segments are left to open_input(), which fetches the key,
+         * and so are byte ranges of other resources than HTTP ones, which
+         * need seeking */
+        if (seg->key_type != KEY_NONE || check_url(pls->parent, seg->url, &is_http) < 0 ||
+            (!is_http && seg->size >= 0))
+            break;
+
+        av_dict_copy(&opts, c->avio_opts, 0);
+        if (is_http && c->http_persistent)
+            av_dict_set(&opts, "multiple_requests", "1", 0);
+        if (seg->size >= 0) {
+            av_dict_set_int(&opts, "offset", seg->url_offset, 0);
+            av_dict_set_int(&opts, "end_offset", seg->url_offset + seg->size, 0);
+        }
+        ret = ff_segprefetch_add(pls->prefetch, seq_no, seg->url, opts);
+        av_dict_free(&opts);
+        if (ret < 0)
+            break;
+    }
+
+    ret = ff_segprefetch_open(pls->prefetch, pls->cur_seq_no, &c->avio_opts);
+    if (ret < 0) {
+        if (ret != AVERROR(ENOENT) && ret != AVERROR_EXIT)
+            av_log(pls->parent, AV_LOG_WARNING,
+                   "Prefetching segment %"PRId64" of playlist %d failed: %s\n",
+                   pls->cur_seq_no, pls->index, av_err2str(ret));
+        return ret;
+    }
+
+    av_log(pls->parent, AV_LOG_VERBOSE, "HLS prefetched segment %"PRId64", playlist %d\n",
+           pls->cur_seq_no, pls->index);
+
+    /* a connection kept alive for a previous segment is not needed anymore */
+    ff_format_io_close(pls->parent, &pls->input);
+    pls->input_prefetched = 1;
+    pls->cur_seg_offset   = 0;
+
+    return 0;
+}
+
 static int update_init_section(struct playlist *pls, struct segment *seg)
 {
     static const int max_init_section_size = 1024*1024;
@@ -1536,7 +1636,7 @@ restart:
     if (!v->needed)
         return AVERROR_EOF;
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    if (!v->input_prefetched && (!v->input || (c->http_persistent && v->input_read_done))) {
         int64_t reload_interval;
 
         /* Check that the playlist is still needed before opening a new
@@ -1607,7 +1707,9 @@ reload:
         if (ret)
             return ret;
 
-        if (c->http_multiple == 1 && v->input_next_requested) {
+        if (c->prefetch_segments > 0 && open_prefetched_input(c, v) >= 0) {
+            ret = 0;
+        } else if (c->http_multiple == 1 && v->input_next_requested) {
             FFSWAP(AVIOContext *, v->input, v->input_next);
             v->cur_seg_offset = 0;
             v->input_next_requested = 0;
@@ -1679,7 +1781,9 @@ reload:
 
         return ret;
     }
-    if (c->http_persistent &&
+    if (v->input_prefetched) {
+        v->input_prefetched = 0;
+    } else if (c->http_persistent &&
         seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         v->input_read_done = 1;
     } else {
@@ -1985,6 +2089,10 @@ static int hls_read_header(AVFormatContext *s)
     c->ctx                = s;
     c->interrupt_callback = &s->interrupt_callback;
 
+    /* prefetching overlaps more requests than http_multiple */
+    if (c->prefetch_segments > 0)
+        c->http_multiple = 0;
+
     c->first_packet = 1;
     c->first_timestamp = AV_NOPTS_VALUE;
     c->cur_timestamp = AV_NOPTS_VALUE;
@@ -2134,6 +2242,8 @@ static int hls_read_header(AVFormatContext *s)
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next = NULL;
             pls->input_next_requested = 0;
+            ff_segprefetch_flush(pls->prefetch);
+            pls->input_prefetched = 0;
             pls->cur_seg_offset = 0;
             pls->cur_init_section = NULL;
             /* Reset EOF flag */
@@ -2296,6 +2406,10 @@ static int recheck_discard_flags(AVFormatContext *s, int first)
             pls->input_read_done = 0;
             ff_format_io_close(pls->parent, &pls->input_next);
             pls->input_next_requested = 0;
+            ff_segprefetch_free(&pls->prefetch);
+            c->prefetch_threads_used -= pls->prefetch_threads;
+            pls->prefetch_threads     = 0;
+            pls->input_prefetched = 0;
             pls->needed = 0;
             changed = 1;
             av_log(s, AV_LOG_INFO, "No longer receiving playlist %d\n", i);
@@ -2552,6 +2666,8 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         pls->input_read_done = 0;
         ff_format_io_close(pls->parent, &pls->input_next);
         pls->input_next_requested = 0;
+        ff_segprefetch_flush(pls->prefetch);
+        pls->input_prefetched = 0;
         av_packet_unref(pls->pkt);
         pb->eof_reached = 0;
         /* Clear any buffered data */
@@ -2646,6 +2762,12 @@ static const AVOption hls_options[] = {
         OFFSET(seg_format_opts), AV_OPT_TYPE_DICT, {.str = NULL}, 0, 0, FLAGS},
     {"seg_max_retry", "Maximum number of times to reload a segment on error.",
      OFFSET(seg_max_retry), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, FLAGS},
+    {"prefetch_segments", "Number of segments to download ahead in the background, 0 to disable",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, 64, FLAGS},
+    {"prefetch_threads", "Maximum number of concurrent prefetch downloads of all playlists",
+        OFFSET(prefetch_threads), AV_OPT_TYPE_INT, {.i64 = 4}, 1, 64, FLAGS},
+    {"prefetch_max_size", "Maximum amount of prefetched data held in memory",
+        OFFSET(prefetch_max_size), AV_OPT_TYPE_INT64, {.i64 = 64 << 20}, 0, INT64_MAX, FLAGS},
     {NULL}
 };
 
@@ -40,6 +40,7 @@
 #include "avformat.h"
 #include "http.h"
 #include "httpauth.h"
+#include "httppool.h"
 #include "internal.h"
 #include "network.h"
 #include "os_support.h"
@@ -69,6 +70,8 @@ typedef enum {
 typedef struct HTTPContext {
     const AVClass *class;
     URLContext *hd;
+    /* Set if hd was opened through the connection pool */
+    HTTPPoolConn *pool_conn;
     unsigned char buffer[BUFFER_SIZE], *buf_ptr, *buf_end;
     int line_count;
     int http_code;
@@ -76,6 +79,8 @@ typedef struct HTTPContext {
     uint64_t chunksize;
     int chunkend;
     uint64_t off, end_off, filesize;
+    /* Offset after the body of the reply if known, otherwise UINT64_MAX. */
+    uint64_t body_end;
     char *uri;
     char *location;
     HTTPAuthState auth_state;
@@ -143,6 +148,12 @@ typedef struct HTTPContext {
     unsigned int retry_after;
     int reconnect_max_retries;
     int reconnect_delay_total_max;
+    int connection_pool;
+    int pool_max_idle;
+    int pool_idle_timeout;
+    int64_t pool_opened;
+    int64_t pool_reused;
+    int64_t pool_dropped;
 } HTTPContext;
 
 #define OFFSET(x) offsetof(HTTPContext, x)
@@ -188,6 +199,12 @@ static const AVOption options[] = {
     { "resource", "The resource requested by a client", OFFSET(resource), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, E },
     { "reply_code", "The http status code to return to a client", OFFSET(reply_code), AV_OPT_TYPE_INT, { .i64 = 200}, INT_MIN, 599, E},
     { "short_seek_size", "Threshold to favor readahead over seek.", OFFSET(short_seek_size), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, D },
+    { "connection_pool", "reuse idle connections of other HTTP contexts to the same server", OFFSET(connection_pool), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, D | E },
+    { "pool_max_idle", "max idle connections kept per server", OFFSET(pool_max_idle), AV_OPT_TYPE_INT, { .i64 = 6 }, 0, 64, D | E },
+    { "pool_idle_timeout", "time in seconds after which idle connections are closed", OFFSET(pool_idle_timeout), AV_OPT_TYPE_INT, { .i64 = 15 }, 0, INT_MAX, D | E },
+    { "pool_opened", "export the number of connections opened with the pool enabled", OFFSET(pool_opened), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "pool_reused", "export the number of connections reused from the pool", OFFSET(pool_reused), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "pool_dropped", "export the number of idle connections closed by the pool", OFFSET(pool_dropped), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { NULL }
 };
 
@@ -196,6 +213,55 @@ static int http_connect(URLContext *h, const char *path, const char *local_path,
                         const char *proxyauth);
 static int http_read_header(URLContext *h);
 static int http_shutdown(URLContext *h, int flags);
+static int http_finish_reply(URLContext *h);
+
+static void http_close_cnx(HTTPContext *s)
+{
+    if (s->pool_conn) {
+        ff_http_pool_close(&s->pool_conn);
+        s->hd = NULL;
+    } else {
+        ffurl_closep(&s->hd);
+    }
+}
+
+static int http_open_lower(URLContext *h, const char *url,
+                           AVDictionary **options, int reuse, int *reused)
+{
+    HTTPContext *s = h->priv_data;
+    HTTPPoolStats stats;
+    int ret;
+
+    *reused = 0;
+    if (!s->connection_pool)
+        return ffurl_open_whitelist(&s->hd, url, AVIO_FLAG_READ_WRITE,
+                                    &h->interrupt_callback, options,
+                                    h->protocol_whitelist, h->protocol_blacklist, h);
+
+    ret = ff_http_pool_open(&s->pool_conn, url, AVIO_FLAG_READ_WRITE,
+                            &h->interrupt_callback, options,
+                            h->protocol_whitelist, h->protocol_blacklist, h,
+                            reuse, reused);
+    if (ret < 0)
+        return ret;
+    s->hd = s->pool_conn->hd;
+
+    ff_http_pool_get_stats(&stats);
+    s->pool_opened  = stats.nb_opened;
+    s->pool_reused  = stats.nb_reused;
+    s->pool_dropped = stats.nb_dropped;
+    if (*reused)
+        av_log(h, AV_LOG_DEBUG, "Reusing pooled connection to %s\n", url);
+    return 0;
+}
+
+/* Errors a request on an idle connection gets if the server closed it. */
+static int is_stale_cnx_error(int err)
+{
+    return err == AVERROR_EOF          || err == AVERROR(EIO)   ||
+           err == AVERROR(ECONNRESET)  || err == AVERROR(EPIPE) ||
+           err == AVERROR(ECONNABORTED);
+}
 
 void ff_http_init_auth_state(URLContext *dest, const URLContext *src)
 {
@@ -216,8 +282,10 @@ static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
     char auth[1024], proxyauth[1024] = "";
     char path1[MAX_URL_SIZE], sanitized_path[MAX_URL_SIZE + 1];
     char buf[1024], urlbuf[MAX_URL_SIZE];
-    int port, use_proxy, err = 0;
+    int port, use_proxy, err = 0, reused = 0;
+    AVDictionary *retry_options = NULL;
     HTTPContext *s = h->priv_data;
+    uint64_t off = s->off;
 
     av_url_split(proto, sizeof(proto), auth, sizeof(auth),
                  hostname, sizeof(hostname), &port,
@@ -273,15 +341,29 @@ static int http_open_cnx_internal(URLContext *h, AVDictionary **options)
     ff_url_join(buf, sizeof(buf), lower_proto, NULL, hostname, port, NULL);
 
     if (!s->hd) {
-        err = ffurl_open_whitelist(&s->hd, buf, AVIO_FLAG_READ_WRITE,
-                                   &h->interrupt_callback, options,
-                                   h->protocol_whitelist, h->protocol_blacklist, h);
+        if (s->connection_pool && options &&
+            (err = av_dict_copy(&retry_options, *options, 0)) < 0)
+            goto end;
+        err = http_open_lower(h, buf, options, 1, &reused);
     }
 
 end:
     freeenv_utf8(env_http_proxy);
-    return err < 0 ? err : http_connect(
-        h, path, local_path, hoststr, auth, proxyauth);
+    if (err < 0)
+        goto fail;
+    err = http_connect(h, path, local_path, hoststr, auth, proxyauth);
+    if (reused && is_stale_cnx_error(err)) {
+        /* the server closed the idle connection in the meantime */
+        av_log(h, AV_LOG_DEBUG, "Pooled connection failed, opening a new one\n");
+        http_close_cnx(s);
+        s->off = off;
+        err = http_open_lower(h, buf, &retry_options, 0, &reused);
+        if (err >= 0)
+            err = http_connect(h, path, local_path, hoststr, auth, proxyauth);
+    }
+fail:
+    av_dict_free(&retry_options);
+    return err;
 }
 
 static int http_should_reconnect(HTTPContext *s, int err)
@@ -416,7 +498,7 @@ redo:
         /* restore the offset (http_connect resets it) */
         s->off = off;
 
-        ffurl_closep(&s->hd);
+        http_close_cnx(s);
         goto redo;
     }
 
@@ -424,7 +506,7 @@ redo:
     if (s->http_code == 401) {
         if ((cur_auth_type == HTTP_AUTH_NONE || s->auth_state.stale) &&
             s->auth_state.auth_type != HTTP_AUTH_NONE && auth_attempts < 4) {
-            ffurl_closep(&s->hd);
+            http_close_cnx(s);
             goto redo;
         } else
             goto fail;
@@ -432,7 +514,7 @@ redo:
     if (s->http_code == 407) {
         if ((cur_proxy_auth_type == HTTP_AUTH_NONE || s->proxy_auth_state.stale) &&
             s->proxy_auth_state.auth_type != HTTP_AUTH_NONE && auth_attempts < 4) {
-            ffurl_closep(&s->hd);
+            http_close_cnx(s);
             goto redo;
         } else
             goto fail;
@@ -441,7 +523,7 @@ redo:
          s->http_code == 303 || s->http_code == 307 || s->http_code == 308) &&
         s->new_location) {
         /* url moved, get next */
-        ffurl_closep(&s->hd);
+        http_close_cnx(s);
         if (redirects++ >= MAX_REDIRECTS)
             return AVERROR(EIO);
 
@@ -467,7 +549,7 @@ redo:
 
 fail:
     if (s->hd)
-        ffurl_closep(&s->hd);
+        http_close_cnx(s);
     if (ret < 0)
         return ret;
     return ff_http_averror(s->http_code, AVERROR(EIO));
@@ -510,6 +592,9 @@ int ff_http_do_new_request2(URLContext *h, const char *uri, AVDictionary **opts)
             return ret;
     }
 
+    if (s->connection_pool && s->pool_conn && (ret = http_finish_reply(h)) < 0)
+        return ret;
+
     if (s->willclose)
         return AVERROR_EOF;
 
@@ -1207,9 +1292,11 @@ static int process_line(URLContext *h, char *line, int line_count, int *parsed_h
         if (!av_strcasecmp(tag, "Location")) {
             if ((ret = parse_location(s, p)) < 0)
                 return ret;
-        } else if (!av_strcasecmp(tag, "Content-Length") &&
-                   s->filesize == UINT64_MAX) {
-            s->filesize = strtoull(p, NULL, 10);
+        } else if (!av_strcasecmp(tag, "Content-Length")) {
+            /* turned into the end offset once all headers are read */
+            s->body_end = strtoull(p, NULL, 10);
+            if (s->filesize == UINT64_MAX)
+                s->filesize = s->body_end;
         } else if (!av_strcasecmp(tag, "Content-Range")) {
             parse_content_range(h, p);
         } else if (!av_strcasecmp(tag, "Accept-Ranges") &&
@@ -1379,6 +1466,7 @@ static int http_read_header(URLContext *h)
     av_freep(&s->new_location);
     s->expires = 0;
     s->chunksize = UINT64_MAX;
+    s->body_end  = UINT64_MAX;
     s->filesize_from_content_range = UINT64_MAX;
 
     for (;;) {
@@ -1412,6 +1500,9 @@ static int http_read_header(URLContext *h)
     if (s->filesize_from_content_range != UINT64_MAX)
         s->filesize = s->filesize_from_content_range;
 
+    if (s->body_end != UINT64_MAX)
+        s->body_end += s->off;
+
     if (s->seekable == -1 && s->is_mediagateway && s->filesize == 2000000000)
         h->is_streamed = 1; /* we can in fact _not_ seek */
 
@@ -1532,7 +1623,8 @@ static int http_connect(URLContext *h, const char *path, const char *local_path,
         av_bprintf(&request, "Expect: 100-continue\r\n");
 
     if (!has_header(s->headers, "\r\nConnection: "))
-        av_bprintf(&request, "Connection: %s\r\n", s->multiple_requests ? "keep-alive" : "close");
+        av_bprintf(&request, "Connection: %s\r\n",
+                   s->multiple_requests || s->connection_pool ? "keep-alive" : "close");
 
     if (!has_header(s->headers, "\r\nHost: "))
         av_bprintf(&request, "Host: %s\r\n", hoststr);
@@ -1637,14 +1729,14 @@ static int http_buf_read(URLContext *h, uint8_t *buf, int size)
                    "Chunked encoding data size: %"PRIu64"\n",
                     s->chunksize);
 
-            if (!s->chunksize && s->multiple_requests) {
+            if (!s->chunksize && (s->multiple_requests || s->connection_pool)) {
                 http_get_line(s, line, sizeof(line)); // read empty chunk
                 s->chunkend = 1;
                 return 0;
             }
             else if (!s->chunksize) {
                 av_log(h, AV_LOG_DEBUG, "Last chunk received, closing conn\n");
-                ffurl_closep(&s->hd);
+                http_close_cnx(s);
                 return 0;
             }
             else if (s->chunksize == UINT64_MAX) {
@@ -1915,8 +2007,9 @@ static int http_shutdown(URLContext *h, int flags)
         ((flags & AVIO_FLAG_READ) && s->chunked_post && s->listen)) {
         ret = ffurl_write(s->hd, footer, sizeof(footer) - 1);
         ret = ret > 0 ? 0 : ret;
-        /* flush the receive buffer when it is write only mode */
-        if (!(flags & AVIO_FLAG_READ)) {
+        /* flush the receive buffer when it is write only mode, unless the
+         * reply is read to reuse the connection */
+        if (!(flags & AVIO_FLAG_READ) && !s->pool_conn) {
             char buf[1024];
             int read_ret;
             s->hd->flags |= AVIO_FLAG_NONBLOCK;
@@ -1933,6 +2026,39 @@ static int http_shutdown(URLContext *h, int flags)
     return ret;
 }
 
+/* Read what is left of the reply to the last request, for the connection to
+ * be reused for a new one. */
+static int http_finish_reply(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+    uint64_t drained = 0;
+    uint8_t buf[1024];
+    int ret;
+
+    if (s->end_chunked_post && !s->end_header &&
+        (ret = http_read_header(h)) < 0)
+        return ret;
+    if (!s->end_header)
+        return AVERROR(EINVAL);
+    if (s->chunksize == UINT64_MAX &&
+        (s->body_end == UINT64_MAX || s->body_end - s->off > sizeof(buf) * 64))
+        return AVERROR(EINVAL);
+
+    while ((ret = http_buf_read(h, buf, sizeof(buf))) > 0) {
+        drained += ret;
+        if (drained > sizeof(buf) * 64)
+            return AVERROR(EINVAL);
+    }
+    if (ret < 0 && ret != AVERROR_EOF)
+        return ret;
+
+    if (s->willclose || s->buf_ptr != s->buf_end)
+        return AVERROR(EINVAL);
+    if (s->chunksize != UINT64_MAX)
+        return s->chunkend ? 0 : AVERROR(EINVAL);
+    return s->off == s->body_end ? 0 : AVERROR(EINVAL);
+}
+
 static int http_close(URLContext *h)
 {
     int ret = 0;
@@ -1947,8 +2073,16 @@ static int http_close(URLContext *h)
         /* Close the write direction by sending the end of chunked encoding. */
         ret = http_shutdown(h, h->flags);
 
+    /* waiting for the reply is only worth it to pool the connection */
+    if (s->connection_pool && s->pool_conn && ret >= 0 && http_finish_reply(h) >= 0) {
+        ff_http_pool_release(&s->pool_conn, s->pool_max_idle,
+                             s->pool_idle_timeout * 1000000LL);
+        s->hd = NULL;
+    }
     if (s->hd)
-        ffurl_closep(&s->hd);
+        http_close_cnx(s);
+    if (s->connection_pool)
+        ff_http_pool_reap();
     av_dict_free(&s->chained_options);
     av_dict_free(&s->cookie_dict);
     av_dict_free(&s->redirect_cache);
@@ -1961,6 +2095,7 @@ static int64_t http_seek_internal(URLContext *h, int64_t off, int whence, int fo
 {
     HTTPContext *s = h->priv_data;
     URLContext *old_hd = s->hd;
+    HTTPPoolConn *old_conn = s->pool_conn;
     uint64_t old_off = s->off;
     uint8_t old_buf[BUFFER_SIZE];
     int old_buf_size, ret;
@@ -2008,7 +2143,8 @@ static int64_t http_seek_internal(URLContext *h, int64_t off, int whence, int fo
     /* we save the old context in case the seek fails */
     old_buf_size = s->buf_end - s->buf_ptr;
     memcpy(old_buf, s->buf_ptr, old_buf_size);
-    s->hd = NULL;
+    s->hd        = NULL;
+    s->pool_conn = NULL;
 
     /* if it fails, continue on old connection */
     if ((ret = http_open_cnx(h, &options)) < 0) {
@@ -2016,12 +2152,16 @@ static int64_t http_seek_internal(URLContext *h, int64_t off, int whence, int fo
         memcpy(s->buffer, old_buf, old_buf_size);
         s->buf_ptr = s->buffer;
         s->buf_end = s->buffer + old_buf_size;
-        s->hd      = old_hd;
-        s->off     = old_off;
+        s->hd        = old_hd;
+        s->pool_conn = old_conn;
+        s->off       = old_off;
         return ret;
     }
     av_dict_free(&options);
-    ffurl_close(old_hd);
+    if (old_conn)
+        ff_http_pool_close(&old_conn);
+    else
+        ffurl_close(old_hd);
     return off;
 }
 
@@ -2099,7 +2239,7 @@ static int http_proxy_close(URLContext *h)
 {
     HTTPContext *s = h->priv_data;
     if (s->hd)
-        ffurl_closep(&s->hd);
+        http_close_cnx(s);
     return 0;
 }
 
@@ -2173,7 +2313,7 @@ redo:
     if (s->http_code == 407 &&
         (cur_auth_type == HTTP_AUTH_NONE || s->proxy_auth_state.stale) &&
         s->proxy_auth_state.auth_type != HTTP_AUTH_NONE && auth_attempts < 2) {
-        ffurl_closep(&s->hd);
+        http_close_cnx(s);
         goto redo;
     }
 
@@ -0,0 +1,393 @@
+/*
+ * HTTP connection pool
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/bprint.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "httppool.h"
+#include "url.h"
+
+/* Idle connections kept at most for all servers together, the ones idle for
+ * the longest time are closed first. */
+#define MAX_IDLE_TOTAL 64
+
+static AVMutex pool_mutex = AV_MUTEX_INITIALIZER;
+/* Idle connections, the most recently released first */
+static HTTPPoolConn *pool;
+static int nb_idle;
+static HTTPPoolStats pool_stats;
+
+static int pool_interrupt_cb(void *opaque)
+{
+    HTTPPoolConn *conn = opaque;
+    return ff_check_interrupt(&conn->int_cb);
+}
+
+static const AVClass *find_protocol_class(const char *name)
+{
+    const URLProtocol **protocols = ffurl_get_protocols(NULL, NULL);
+    const AVClass *class = NULL;
+
+    if (!protocols)
+        return NULL;
+    for (int i = 0; protocols[i]; i++) {
+        if (!strcmp(protocols[i]->name, name)) {
+            class = protocols[i]->priv_data_class;
+            break;
+        }
+    }
+    av_freep(&protocols);
+    return class;
+}
+
+static int has_option(const AVClass *class, const char *name)
+{
+    return class && av_opt_find(&class, name, NULL, 0, AV_OPT_SEARCH_FAKE_OBJ);
+}
+
+/* Whether name is an option the connection is opened with: an option of the
+ * URLContext itself, of the lower protocol or of the tcp protocol below it. */
+static int is_lower_option(const AVClass *const classes[2], const char *name)
+{
+    return !strcmp(name, "rw_timeout")         ||
+           !strcmp(name, "protocol_whitelist") ||
+           !strcmp(name, "protocol_blacklist") ||
+           has_option(classes[0], name) || has_option(classes[1], name);
+}
+
+/**
+ * Identify the connections to url that can be used interchangeably: the URL
+ * followed by the protocol lists and the options they are opened with.
+ */
+static char *pool_key(const char *url, const AVClass *const classes[2],
+                      const AVDictionary *options,
+                      const char *whitelist, const char *blacklist)
+{
+    const AVDictionaryEntry *e = NULL;
+    AVBPrint bp;
+    char *key;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&bp, "%s\n%s\n%s", url, whitelist ? whitelist : "",
+               blacklist ? blacklist : "");
+    while ((e = av_dict_iterate(options, e))) {
+        if (is_lower_option(classes, e->key))
+            av_bprintf(&bp, "\n%s=%s", e->key, e->value);
+    }
+    if (av_bprint_finalize(&bp, &key) < 0)
+        return NULL;
+    return key;
+}
+
+/* Remove the options that opening the connection would have used. */
+static int consume_options(const AVClass *const classes[2], AVDictionary **options)
+{
+    const AVDictionaryEntry *e = NULL;
+    AVDictionary *left = NULL;
+    int ret;
+
+    if (!options)
+        return 0;
+    while ((e = av_dict_iterate(*options, e))) {
+        if (!is_lower_option(classes, e->key) &&
+            (ret = av_dict_set(&left, e->key, e->value, 0)) < 0) {
+            av_dict_free(&left);
+            return ret;
+        }
+    }
+    av_dict_free(options);
+    *options = left;
+    return 0;
+}
+
+static void conn_free(HTTPPoolConn **pconn)
+{
+    HTTPPoolConn *conn = *pconn;
+
+    if (!conn)
+        return;
+    ffurl_closep(&conn->hd);
+    av_freep(&conn->key);
+    av_freep(pconn);
+}
+
+/* Unlink the idle connections for which drop() is true, to be closed by the
+ * caller outside of the lock. */
+static HTTPPoolConn *pool_unlink(int (*drop)(const HTTPPoolConn *conn, const void *opaque),
+                                 const void *opaque)
+{
+    HTTPPoolConn *dropped = NULL, **p = &pool;
+
+    while (*p) {
+        HTTPPoolConn *conn = *p;
+        if (drop(conn, opaque)) {
+            *p = conn->next;
+            conn->next = dropped;
+            dropped = conn;
+            nb_idle--;
+            pool_stats.nb_dropped++;
+        } else {
+            p = &conn->next;
+        }
+    }
+    return dropped;
+}
+
+/* Check that the server did not close an idle connection, nor sent anything
+ * on it. */
+static int conn_is_alive(HTTPPoolConn *conn)
+{
+    uint8_t byte;
+    int ret;
+
+    conn->hd->flags |= AVIO_FLAG_NONBLOCK;
+    ret = ffurl_read(conn->hd, &byte, 1);
+    conn->hd->flags &= ~AVIO_FLAG_NONBLOCK;
+    return ret == AVERROR(EAGAIN);
+}
+
+static int is_expired(const HTTPPoolConn *conn, const void *opaque)
+{
+    return conn->expiry <= *(const int64_t *)opaque;
+}
+
+static int is_any(const HTTPPoolConn *conn, const void *opaque)
+{
+    return 1;
+}
+
+/* Unlink the least recently released idle connections past MAX_IDLE_TOTAL
+ * and prepend them to dropped; must be called with the lock held. */
+static HTTPPoolConn *pool_trim(HTTPPoolConn *dropped)
+{
+    HTTPPoolConn **last;
+
+    while (nb_idle > MAX_IDLE_TOTAL) {
+        for (last = &pool; (*last)->next; last = &(*last)->next);
+        (*last)->next = dropped;
+        dropped       = *last;
+        *last         = NULL;
+        nb_idle--;
+        pool_stats.nb_dropped++;
+    }
+    return dropped;
+}
+
+static void close_list(HTTPPoolConn *conn)
+{
+    while (conn) {
+        HTTPPoolConn *next = conn->next;
+        conn_free(&conn);
+        conn = next;
+    }
+}
+
+int ff_http_pool_open(HTTPPoolConn **pconn, const char *url, int flags,
+                      const AVIOInterruptCB *int_cb, AVDictionary **options,
+                      const char *whitelist, const char *blacklist,
+                      URLContext *parent, int reuse, int *reused)
+{
+    const AVClass *classes[2];
+    AVIOInterruptCB pool_cb;
+    HTTPPoolConn *conn;
+    char proto[16];
+    char *key;
+    int ret;
+
+    *reused = 0;
+    av_strlcpy(proto, url, FFMIN(sizeof(proto), strcspn(url, ":") + 1));
+    classes[0] = find_protocol_class(proto);
+    classes[1] = strcmp(proto, "tcp") ? find_protocol_class("tcp") : NULL;
+
+    key = pool_key(url, classes, options ? *options : NULL, whitelist, blacklist);
+    if (!key)
+        return AVERROR(ENOMEM);
+
+    while (reuse) {
+        HTTPPoolConn *expired, **p;
+        int64_t now = av_gettime_relative();
+
+        ff_mutex_lock(&pool_mutex);
+        expired = pool_unlink(is_expired, &now);
+        for (p = &pool; *p && strcmp((*p)->key, key); p = &(*p)->next);
+        conn = *p;
+        if (conn) {
+            *p = conn->next;
+            nb_idle--;
+        }
+        ff_mutex_unlock(&pool_mutex);
+        close_list(expired);
+
+        if (!conn)
+            break;
+        conn->next   = NULL;
+        conn->int_cb = int_cb ? *int_cb : (AVIOInterruptCB){ 0 };
+        if (conn_is_alive(conn)) {
+            ff_mutex_lock(&pool_mutex);
+            pool_stats.nb_reused++;
+            ff_mutex_unlock(&pool_mutex);
+            av_free(key);
+            if ((ret = consume_options(classes, options)) < 0) {
+                conn_free(&conn);
+                return ret;
+            }
+            *pconn  = conn;
+            *reused = 1;
+            return 0;
+        }
+        ff_mutex_lock(&pool_mutex);
+        pool_stats.nb_dropped++;
+        ff_mutex_unlock(&pool_mutex);
+        conn_free(&conn);
+    }
+
+    conn = av_mallocz(sizeof(*conn));
+    if (!conn) {
+        av_free(key);
+        return AVERROR(ENOMEM);
+    }
+    conn->key = key;
+    if (int_cb)
+        conn->int_cb = *int_cb;
+    pool_cb = (AVIOInterruptCB){ pool_interrupt_cb, conn };
+
+    ret = ffurl_open_whitelist(&conn->hd, url, flags, &pool_cb, options,
+                               whitelist, blacklist, parent);
+    if (ret < 0) {
+        conn_free(&conn);
+        return ret;
+    }
+
+    ff_mutex_lock(&pool_mutex);
+    pool_stats.nb_opened++;
+    ff_mutex_unlock(&pool_mutex);
+    *pconn = conn;
+    return 0;
+}
+
+void ff_http_pool_release(HTTPPoolConn **pconn, int max_idle, int64_t idle_timeout)
+{
+    HTTPPoolConn *conn = *pconn, *dropped = NULL, *p;
+    int64_t now = av_gettime_relative();
+    int nb_same = 0;
+
+    if (!conn)
+        return;
+    *pconn = NULL;
+
+    if (max_idle <= 0 || idle_timeout <= 0) {
+        conn_free(&conn);
+        return;
+    }
+
+    conn->int_cb = (AVIOInterruptCB){ 0 };
+    conn->expiry = now + idle_timeout;
+
+    ff_mutex_lock(&pool_mutex);
+    dropped = pool_unlink(is_expired, &now);
+    for (p = pool; p; p = p->next)
+        nb_same += !strcmp(p->key, conn->key);
+    if (nb_same >= max_idle) {
+        pool_stats.nb_dropped++;
+        conn->next = dropped;
+        dropped    = conn;
+    } else {
+        conn->next = pool;
+        pool       = conn;
+        nb_idle++;
+        dropped = pool_trim(dropped);
+    }
+    ff_mutex_unlock(&pool_mutex);
+
+    close_list(dropped);
+}
+
+void ff_http_pool_close(HTTPPoolConn **pconn)
+{
+    conn_free(pconn);
+}
+
+void ff_http_pool_reap(void)
+{
+    HTTPPoolConn *idle, *alive = NULL, **tail = &alive, *dropped = NULL, **p;
+    int64_t now = av_gettime_relative();
+    int nb_alive = 0, nb_dead = 0;
+
+    /* Probing a connection reads from it, possibly through TLS, so take all
+     * of them out of the pool rather than doing it with the lock held. They
+     * can't be reused by other contexts meanwhile. */
+    ff_mutex_lock(&pool_mutex);
+    idle    = pool;
+    pool    = NULL;
+    nb_idle = 0;
+    ff_mutex_unlock(&pool_mutex);
+
+    while (idle) {
+        HTTPPoolConn *conn = idle;
+
+        idle = conn->next;
+        if (is_expired(conn, &now) || !conn_is_alive(conn)) {
+            conn->next = dropped;
+            dropped    = conn;
+            nb_dead++;
+        } else {
+            conn->next = NULL;
+            *tail      = conn;
+            tail       = &conn->next;
+            nb_alive++;
+        }
+    }
+
+    /* Connections released meanwhile are the most recent ones. The limit per
+     * server is enforced again by the next release. */
+    ff_mutex_lock(&pool_mutex);
+    for (p = &pool; *p; p = &(*p)->next);
+    *p       = alive;
+    nb_idle += nb_alive;
+    pool_stats.nb_dropped += nb_dead;
+    dropped = pool_trim(dropped);
+    ff_mutex_unlock(&pool_mutex);
+
+    close_list(dropped);
+}
+
+void ff_http_pool_flush(void)
+{
+    HTTPPoolConn *dropped;
+
+    ff_mutex_lock(&pool_mutex);
+    dropped = pool_unlink(is_any, NULL);
+    ff_mutex_unlock(&pool_mutex);
+
+    close_list(dropped);
+}
+
+void ff_http_pool_get_stats(HTTPPoolStats *stats)
+{
+    ff_mutex_lock(&pool_mutex);
+    *stats = pool_stats;
+    ff_mutex_unlock(&pool_mutex);
+}
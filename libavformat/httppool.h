@@ -0,0 +1,103 @@
+/*
+ * HTTP connection pool
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_HTTPPOOL_H
+#define AVFORMAT_HTTPPOOL_H
+
+#include <stdint.h>
+
+#include "libavutil/dict.h"
+
+#include "avio.h"
+#include "url.h"
+
+/**
+ * Connection of the lower protocol (tcp or tls) of a HTTP context, which can
+ * be handed over to the process-wide pool of idle connections when the
+ * context is done with it and taken from there by any other context
+ * connecting to the same server with the same settings.
+ */
+typedef struct HTTPPoolConn {
+    URLContext *hd;
+    /**
+     * Interrupt callback of the current user of the connection. hd and the
+     * contexts it opened itself call it through a callback of their own, as
+     * they outlive the HTTP context that opened them.
+     */
+    AVIOInterruptCB int_cb;
+    char *key;
+    int64_t expiry;
+    struct HTTPPoolConn *next;
+} HTTPPoolConn;
+
+typedef struct HTTPPoolStats {
+    int64_t nb_opened;  ///< connections opened while pooling was enabled
+    int64_t nb_reused;  ///< connections taken from the pool
+    int64_t nb_dropped; ///< idle connections closed, expired or over a limit
+} HTTPPoolStats;
+
+/**
+ * Take an idle connection to url from the pool, or open a new one as with
+ * ffurl_open_whitelist() if there is none.
+ *
+ * Idle connections are only reused if they were opened with the same
+ * options, as far as they are options of the lower protocol, and if they
+ * are still open and have no pending data.
+ *
+ * @param reuse  whether a connection can be taken from the pool
+ * @param reused set to 1 if the connection was taken from the pool, else 0
+ */
+int ff_http_pool_open(HTTPPoolConn **pconn, const char *url, int flags,
+                      const AVIOInterruptCB *int_cb, AVDictionary **options,
+                      const char *whitelist, const char *blacklist,
+                      URLContext *parent, int reuse, int *reused);
+
+/**
+ * Hand a connection that is ready for a new request over to the pool.
+ *
+ * @param max_idle     maximum number of idle connections to keep for the
+ *                     same server and settings, the connection is closed if
+ *                     it would exceed it
+ * @param idle_timeout time in microseconds after which the connection is
+ *                     closed if it was not reused
+ */
+void ff_http_pool_release(HTTPPoolConn **pconn, int max_idle, int64_t idle_timeout);
+
+/**
+ * Close a connection without handing it over to the pool.
+ */
+void ff_http_pool_close(HTTPPoolConn **pconn);
+
+/**
+ * Close the idle connections that expired or were closed by the server.
+ *
+ * The connections are checked without holding the pool lock, so they are
+ * not available to other contexts meanwhile.
+ */
+void ff_http_pool_reap(void);
+
+/**
+ * Close all idle connections.
+ */
+void ff_http_pool_flush(void);
+
+void ff_http_pool_get_stats(HTTPPoolStats *stats);
+
+#endif /* AVFORMAT_HTTPPOOL_H */
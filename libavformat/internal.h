@@ -122,6 +122,13 @@ typedef struct FFFormatContext {
     AVDictionary *id3v2_meta;
 
     int missing_streams;
+
+    /**
+     * Pools for demuxed packet payloads if AVFMT_FLAG_PACKET_POOL is set,
+     * pool i holding buffers of 1 << i bytes; large enough for
+     * MAX_POOLED_PACKET_SIZE in demux_utils.c.
+     */
+    struct AVBufferPool *packet_pools[24];
 } FFFormatContext;
 
 static av_always_inline FFFormatContext *ffformatcontext(AVFormatContext *s)
@@ -605,6 +612,13 @@ int ff_copy_whiteblacklists(AVFormatContext *dst, const AVFormatContext *src);
  */
 int ff_format_io_close(AVFormatContext *s, AVIOContext **pb);
 
+/**
+ * Check whether AVFormatContext.io_open was left to the default callback,
+ * which opens URLs with ffio_open_whitelist() and the interrupt callback and
+ * protocol white- and blacklists of s.
+ */
+int ff_format_io_open_is_default(const AVFormatContext *s);
+
 /**
  * Utility function to check if the file uses http or https protocol
  *
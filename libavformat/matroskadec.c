@@ -1084,14 +1084,37 @@ static int ebml_read_ascii(AVIOContext *pb, int size,
  * Read the next element as binary data.
  * 0 is success, < 0 or NEEDS_CHECKING is failure.
  */
-static int ebml_read_binary(AVIOContext *pb, int length,
-                            int64_t pos, EbmlBin *bin)
+static int ebml_read_binary(AVFormatContext *s, AVIOContext *pb, int length,
+                            int64_t pos, EbmlBin *bin, int map)
 {
+    AVBufferRef *buf;
+    uint8_t *data;
     int ret;
 
-    ret = av_buffer_realloc(&bin->buf, length + AV_INPUT_BUFFER_PADDING_SIZE);
-    if (ret < 0)
-        return ret;
+    if (map) {
+        ret = ff_demux_map(pb, length, &buf, &data);
+        if (ret < 0)
+            return ret;
+        if (ret) {
+            av_buffer_unref(&bin->buf);
+            bin->buf  = buf;
+            bin->data = data;
+            bin->size = length;
+            bin->pos  = pos;
+            return 0;
+        }
+    }
+
+    if (s->flags & AVFMT_FLAG_PACKET_POOL) {
+        av_buffer_unref(&bin->buf);
+        bin->buf = ff_demux_buffer_alloc(s, length + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!bin->buf)
+            return AVERROR(ENOMEM);
+    } else {
+        ret = av_buffer_realloc(&bin->buf, length + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (ret < 0)
+            return ret;
+    }
     memset(bin->buf->data + length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
 
     bin->data = bin->buf->data;
@@ -1486,7 +1509,10 @@ static int ebml_parse(MatroskaDemuxContext *matroska,
         res = ebml_read_ascii(pb, length, syntax->def.s, data);
         break;
     case EBML_BIN:
-        res = ebml_read_binary(pb, length, pos_alt, data);
+        // block payloads end up in packets, which may reference the file
+        // mapped in memory
+        res = ebml_read_binary(matroska->ctx, pb, length, pos_alt, data,
+                               id == MATROSKA_ID_BLOCK || id == MATROSKA_ID_SIMPLEBLOCK);
         break;
     case EBML_LEVEL1:
     case EBML_NEST:
@@ -10977,7 +10977,7 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
         }
 #endif
         else
-            ret = av_get_packet(sc->pb, pkt, sample->size);
+            ret = ff_demux_get_packet(s, sc->pb, pkt, sample->size);
         if (ret < 0) {
             if (should_retry(sc->pb, ret)) {
                 mov_current_sample_dec(sc);
@@ -11019,6 +11019,13 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
     if (st->discard == AVDISCARD_ALL)
         goto retry;
 
+    // the payload may be read-only, e.g. mapped from the file
+    if (mov->aax_mode || mov->decryption_key) {
+        ret = av_packet_make_writable(pkt);
+        if (ret < 0)
+            return ret;
+    }
+
     if (mov->aax_mode)
         aax_filter(pkt->data, pkt->size, mov);
 
@@ -0,0 +1,597 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+#include "config_components.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/error.h"
+#include "libavutil/fifo.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+#include "libavcodec/packet_internal.h"
+
+#include "avio_internal.h"
+#include "http.h"
+#include "internal.h"
+#include "segprefetch.h"
+#include "url.h"
+
+#if HAVE_THREADS
+
+#define CHUNK_SIZE 65536
+
+enum RequestState {
+    REQUEST_QUEUED,
+    REQUEST_ACTIVE,
+    REQUEST_DONE,
+};
+
+typedef struct PrefetchRequest {
+    int64_t id;
+    char *url;
+    AVDictionary *options;
+
+    enum RequestState state;
+    /* set when the request is dropped while a worker fetches it, the worker
+     * then frees it */
+    atomic_int cancel;
+    int opened;
+    /* error that ended the download, AVERROR_EOF if it completed */
+    int error;
+    /* cookies of the response, to be used for the following requests */
+    char *cookies;
+
+    PacketList chunks;
+    int64_t size;
+    int chunk_pos;
+} PrefetchRequest;
+
+typedef struct PrefetchWorker {
+    SegmentPrefetch *sp;
+    pthread_t thread;
+    AVIOInterruptCB interrupt_callback;
+    PrefetchRequest *req;
+    AVPacket *pkt;
+    /* connection kept alive between requests to the same server */
+    AVIOContext *pb;
+    char *pb_url;
+} PrefetchWorker;
+
+struct SegmentPrefetch {
+    AVFormatContext *s;
+
+    PrefetchWorker *workers;
+    int nb_workers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t  cond_worker;
+    pthread_cond_t  cond_reader;
+    atomic_int abort;
+
+    /* queued requests, oldest first */
+    AVFifo *queue;
+    int64_t buffered;
+    int64_t max_size;
+    AVPacket *pkt;
+};
+
+static void request_free(SegmentPrefetch *sp, PrefetchRequest **preq)
+{
+    PrefetchRequest *req = *preq;
+
+    sp->buffered -= req->size;
+    avpriv_packet_list_free(&req->chunks);
+    av_dict_free(&req->options);
+    av_freep(&req->cookies);
+    av_freep(&req->url);
+    av_freep(preq);
+}
+
+/* called with the lock held */
+static void request_drop(SegmentPrefetch *sp)
+{
+    PrefetchRequest *req;
+
+    if (av_fifo_read(sp->queue, &req, 1) < 0)
+        return;
+
+    if (req->state == REQUEST_ACTIVE)
+        atomic_store(&req->cancel, 1);
+    else
+        request_free(sp, &req);
+    pthread_cond_broadcast(&sp->cond_worker);
+}
+
+static int is_first(SegmentPrefetch *sp, const PrefetchRequest *req)
+{
+    PrefetchRequest *first;
+    return av_fifo_peek(sp->queue, &first, 1, 0) >= 0 && first == req;
+}
+
+static PrefetchRequest *next_queued(SegmentPrefetch *sp)
+{
+    for (size_t i = 0; i < av_fifo_can_read(sp->queue); i++) {
+        PrefetchRequest *req;
+        av_fifo_peek(sp->queue, &req, 1, i);
+        if (req->state == REQUEST_QUEUED)
+            return req;
+    }
+    return NULL;
+}
+
+/* The interrupt callback of the demuxer is only called by the thread reading
+ * from it, see reader_wait(). */
+static int worker_check_interrupt(void *arg)
+{
+    PrefetchWorker *w = arg;
+
+    return atomic_load(&w->sp->abort) ||
+           (w->req && atomic_load(&w->req->cancel));
+}
+
+/* called with the lock held */
+static int reader_wait(SegmentPrefetch *sp)
+{
+    int64_t t = av_gettime() + 100000;
+    struct timespec tv = { .tv_sec  =  t / 1000000,
+                           .tv_nsec = (t % 1000000) * 1000 };
+
+    if (ff_check_interrupt(&sp->s->interrupt_callback))
+        return AVERROR_EXIT;
+    pthread_cond_timedwait(&sp->cond_reader, &sp->lock, &tv);
+    return 0;
+}
+
+#if CONFIG_HTTP_PROTOCOL
+static int same_server(const char *url1, const char *url2)
+{
+    char proto1[10], proto2[10], host1[1024], host2[1024];
+    int port1, port2;
+
+    av_url_split(proto1, sizeof(proto1), NULL, 0, host1, sizeof(host1),
+                 &port1, NULL, 0, url1);
+    av_url_split(proto2, sizeof(proto2), NULL, 0, host2, sizeof(host2),
+                 &port2, NULL, 0, url2);
+    return av_strstart(proto1, "http", NULL) && !strcmp(proto1, proto2) &&
+           !strcmp(host1, host2) && port1 == port2;
+}
+#endif
+
+static int worker_open(PrefetchWorker *w, PrefetchRequest *req)
+{
+    AVFormatContext *s = w->sp->s;
+    AVDictionary *opts = NULL;
+    int ret = AVERROR(EINVAL);
+
+#if CONFIG_HTTP_PROTOCOL
+    if (w->pb && ffio_geturlcontext(w->pb) && same_server(w->pb_url, req->url)) {
+        av_dict_copy(&opts, req->options, 0);
+        w->pb->eof_reached = 0;
+        ret = ff_http_do_new_request2(ffio_geturlcontext(w->pb), req->url, &opts);
+        av_dict_free(&opts);
+    }
+#endif
+    if (ret < 0) {
+        ff_format_io_close(s, &w->pb);
+
+        av_dict_copy(&opts, req->options, 0);
+        /* the default callback is bypassed to be able to drop requests
+         * while they are being opened */
+        if (ff_format_io_open_is_default(s))
+            ret = ffio_open_whitelist(&w->pb, req->url, AVIO_FLAG_READ,
+                                      &w->interrupt_callback, &opts,
+                                      s->protocol_whitelist, s->protocol_blacklist);
+        else
+            ret = s->io_open(s, &w->pb, req->url, AVIO_FLAG_READ, &opts);
+        av_dict_free(&opts);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (!(s->flags & AVFMT_FLAG_CUSTOM_IO))
+        av_opt_get(w->pb, "cookies", AV_OPT_SEARCH_CHILDREN, (uint8_t**)&req->cookies);
+
+    av_free(w->pb_url);
+    w->pb_url = av_strdup(req->url);
+    if (!w->pb_url) {
+        ff_format_io_close(s, &w->pb);
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+static void worker_fetch(PrefetchWorker *w, PrefetchRequest *req)
+{
+    SegmentPrefetch *sp = w->sp;
+    int ret;
+
+    av_log(sp->s, AV_LOG_VERBOSE, "Prefetching url '%s'\n", req->url);
+
+    ret = worker_open(w, req);
+
+    pthread_mutex_lock(&sp->lock);
+    req->opened = ret >= 0;
+    pthread_cond_broadcast(&sp->cond_reader);
+
+    while (ret >= 0) {
+        /* the first request is always fetched, it is the one being read */
+        while (sp->buffered >= sp->max_size && !is_first(sp, req) &&
+               !atomic_load(&req->cancel) && !atomic_load(&sp->abort))
+            pthread_cond_wait(&sp->cond_worker, &sp->lock);
+        if (atomic_load(&req->cancel) || atomic_load(&sp->abort)) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+        pthread_mutex_unlock(&sp->lock);
+
+        ret = av_get_packet(w->pb, w->pkt, CHUNK_SIZE);
+
+        pthread_mutex_lock(&sp->lock);
+        if (ret > 0) {
+            int size = w->pkt->size;
+
+            ret = avpriv_packet_list_put(&req->chunks, w->pkt, NULL, 0);
+            if (ret < 0) {
+                av_packet_unref(w->pkt);
+                break;
+            }
+            req->size    += size;
+            sp->buffered += size;
+            pthread_cond_broadcast(&sp->cond_reader);
+        } else if (!ret) {
+            ret = AVERROR_EOF;
+        }
+    }
+    req->error = ret;
+    pthread_mutex_unlock(&sp->lock);
+
+    /* only a response read to its end leaves the connection reusable */
+    if (ret != AVERROR_EOF)
+        ff_format_io_close(sp->s, &w->pb);
+}
+
+static void *worker_thread(void *arg)
+{
+    PrefetchWorker *w = arg;
+    SegmentPrefetch *sp = w->sp;
+
+    pthread_mutex_lock(&sp->lock);
+    while (!atomic_load(&sp->abort)) {
+        PrefetchRequest *req = next_queued(sp);
+
+        if (!req) {
+            pthread_cond_wait(&sp->cond_worker, &sp->lock);
+            continue;
+        }
+
+        req->state = REQUEST_ACTIVE;
+        w->req     = req;
+        pthread_mutex_unlock(&sp->lock);
+
+        worker_fetch(w, req);
+
+        pthread_mutex_lock(&sp->lock);
+        w->req = NULL;
+        if (atomic_load(&req->cancel)) {
+            request_free(sp, &req);
+            pthread_cond_broadcast(&sp->cond_worker);
+        } else {
+            req->state = REQUEST_DONE;
+        }
+        pthread_cond_broadcast(&sp->cond_reader);
+    }
+    pthread_mutex_unlock(&sp->lock);
+
+    ff_format_io_close(sp->s, &w->pb);
+    av_freep(&w->pb_url);
+
+    return NULL;
+}
+
+int ff_segprefetch_alloc(SegmentPrefetch **psp, AVFormatContext *s,
+                         int nb_segments, int nb_threads, int64_t max_size)
+{
+    SegmentPrefetch *sp;
+    int ret;
+
+    sp = av_mallocz(sizeof(*sp));
+    if (!sp)
+        return AVERROR(ENOMEM);
+
+    sp->s          = s;
+    sp->max_size   = max_size;
+    sp->nb_workers = FFMIN(nb_threads, nb_segments);
+    atomic_init(&sp->abort, 0);
+
+    sp->queue   = av_fifo_alloc2(nb_segments, sizeof(PrefetchRequest*), 0);
+    sp->pkt     = av_packet_alloc();
+    sp->workers = av_calloc(sp->nb_workers, sizeof(*sp->workers));
+    if (!sp->queue || !sp->pkt || !sp->workers) {
+        ret = AVERROR(ENOMEM);
+        goto fail_alloc;
+    }
+    for (int i = 0; i < sp->nb_workers; i++) {
+        PrefetchWorker *w = &sp->workers[i];
+
+        w->sp  = sp;
+        w->pkt = av_packet_alloc();
+        if (!w->pkt) {
+            ret = AVERROR(ENOMEM);
+            goto fail_alloc;
+        }
+        w->interrupt_callback.callback = worker_check_interrupt;
+        w->interrupt_callback.opaque   = w;
+    }
+
+    ret = pthread_mutex_init(&sp->lock, NULL);
+    if (ret) {
+        ret = AVERROR(ret);
+        goto fail_alloc;
+    }
+    ret = pthread_cond_init(&sp->cond_worker, NULL);
+    if (ret) {
+        ret = AVERROR(ret);
+        goto fail_mutex;
+    }
+    ret = pthread_cond_init(&sp->cond_reader, NULL);
+    if (ret) {
+        ret = AVERROR(ret);
+        goto fail_cond_worker;
+    }
+
+    for (int i = 0; i < sp->nb_workers; i++) {
+        ret = pthread_create(&sp->workers[i].thread, NULL, worker_thread,
+                             &sp->workers[i]);
+        if (ret) {
+            sp->nb_workers = i;
+            *psp = sp;
+            ff_segprefetch_free(psp);
+            return AVERROR(ret);
+        }
+    }
+
+    *psp = sp;
+    return 0;
+
+fail_cond_worker:
+    pthread_cond_destroy(&sp->cond_worker);
+fail_mutex:
+    pthread_mutex_destroy(&sp->lock);
+fail_alloc:
+    if (sp->workers) {
+        for (int i = 0; i < sp->nb_workers; i++)
+            av_packet_free(&sp->workers[i].pkt);
+    }
+    av_freep(&sp->workers);
+    av_packet_free(&sp->pkt);
+    av_fifo_freep2(&sp->queue);
+    av_free(sp);
+    return ret;
+}
+
+void ff_segprefetch_free(SegmentPrefetch **psp)
+{
+    SegmentPrefetch *sp = *psp;
+
+    if (!sp)
+        return;
+
+    pthread_mutex_lock(&sp->lock);
+    atomic_store(&sp->abort, 1);
+    while (av_fifo_can_read(sp->queue))
+        request_drop(sp);
+    pthread_cond_broadcast(&sp->cond_worker);
+    pthread_mutex_unlock(&sp->lock);
+
+    for (int i = 0; i < sp->nb_workers; i++)
+        pthread_join(sp->workers[i].thread, NULL);
+    for (int i = 0; i < sp->nb_workers; i++)
+        av_packet_free(&sp->workers[i].pkt);
+
+    pthread_cond_destroy(&sp->cond_reader);
+    pthread_cond_destroy(&sp->cond_worker);
+    pthread_mutex_destroy(&sp->lock);
+
+    av_freep(&sp->workers);
+    av_packet_free(&sp->pkt);
+    av_fifo_freep2(&sp->queue);
+    av_freep(psp);
+}
+
+int ff_segprefetch_add(SegmentPrefetch *sp, int64_t id, const char *url,
+                       const AVDictionary *options)
+{
+    PrefetchRequest *req;
+    int ret;
+
+    pthread_mutex_lock(&sp->lock);
+    ret = av_fifo_can_write(sp->queue) ? 0 : AVERROR(EAGAIN);
+    pthread_mutex_unlock(&sp->lock);
+    if (ret < 0)
+        return ret;
+
+    req = av_mallocz(sizeof(*req));
+    if (!req)
+        return AVERROR(ENOMEM);
+    req->id    = id;
+    req->state = REQUEST_QUEUED;
+    atomic_init(&req->cancel, 0);
+    req->url   = av_strdup(url);
+    if (!req->url || av_dict_copy(&req->options, options, 0) < 0) {
+        av_dict_free(&req->options);
+        av_freep(&req->url);
+        av_free(req);
+        return AVERROR(ENOMEM);
+    }
+
+    pthread_mutex_lock(&sp->lock);
+    av_fifo_write(sp->queue, &req, 1);
+    pthread_cond_signal(&sp->cond_worker);
+    pthread_mutex_unlock(&sp->lock);
+
+    return 0;
+}
+
+int64_t ff_segprefetch_seek(SegmentPrefetch *sp, int64_t id)
+{
+    PrefetchRequest *req;
+    size_t nb_queued;
+
+    pthread_mutex_lock(&sp->lock);
+    while (av_fifo_peek(sp->queue, &req, 1, 0) >= 0 && req->id < id)
+        request_drop(sp);
+    if (av_fifo_peek(sp->queue, &req, 1, 0) >= 0 && req->id != id) {
+        while (av_fifo_can_read(sp->queue))
+            request_drop(sp);
+    }
+
+    nb_queued = av_fifo_can_read(sp->queue);
+    if (nb_queued) {
+        av_fifo_peek(sp->queue, &req, 1, nb_queued - 1);
+        id = req->id + 1;
+    }
+    pthread_mutex_unlock(&sp->lock);
+
+    return id;
+}
+
+void ff_segprefetch_flush(SegmentPrefetch *sp)
+{
+    if (!sp)
+        return;
+
+    pthread_mutex_lock(&sp->lock);
+    while (av_fifo_can_read(sp->queue))
+        request_drop(sp);
+    pthread_mutex_unlock(&sp->lock);
+}
+
+int ff_segprefetch_open(SegmentPrefetch *sp, int64_t id, AVDictionary **options)
+{
+    PrefetchRequest *req;
+    int ret = 0;
+
+    pthread_mutex_lock(&sp->lock);
+    if (av_fifo_peek(sp->queue, &req, 1, 0) < 0 || req->id != id) {
+        ret = AVERROR(ENOENT);
+        goto end;
+    }
+
+    while (!req->opened && req->state != REQUEST_DONE && ret >= 0)
+        ret = reader_wait(sp);
+    if (ret < 0)
+        goto end;
+    if (!req->opened) {
+        ret = req->error;
+        goto end;
+    }
+
+    if (req->cookies)
+        ret = av_dict_set(options, "cookies", req->cookies, 0);
+
+end:
+    pthread_mutex_unlock(&sp->lock);
+    return ret;
+}
+
+int ff_segprefetch_read(SegmentPrefetch *sp, uint8_t *buf, int size)
+{
+    PrefetchRequest *req;
+    int ret = 0;
+
+    pthread_mutex_lock(&sp->lock);
+    if (av_fifo_peek(sp->queue, &req, 1, 0) < 0) {
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+
+    while (!req->chunks.head && req->state != REQUEST_DONE && ret >= 0)
+        ret = reader_wait(sp);
+    if (ret < 0)
+        goto end;
+
+    while (ret < size && req->chunks.head) {
+        const AVPacket *chunk = &req->chunks.head->pkt;
+        int len = FFMIN(size - ret, chunk->size - req->chunk_pos);
+
+        memcpy(buf + ret, chunk->data + req->chunk_pos, len);
+        req->chunk_pos += len;
+        ret            += len;
+
+        if (req->chunk_pos == chunk->size) {
+            req->size    -= chunk->size;
+            sp->buffered -= chunk->size;
+            req->chunk_pos = 0;
+            avpriv_packet_list_get(&req->chunks, sp->pkt);
+            av_packet_unref(sp->pkt);
+            pthread_cond_broadcast(&sp->cond_worker);
+        }
+    }
+    if (!ret)
+        ret = req->error;
+
+end:
+    pthread_mutex_unlock(&sp->lock);
+    return ret;
+}
+
+#else
+
+int ff_segprefetch_alloc(SegmentPrefetch **psp, AVFormatContext *s,
+                         int nb_segments, int nb_threads, int64_t max_size)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_segprefetch_free(SegmentPrefetch **psp)
+{
+}
+
+int ff_segprefetch_add(SegmentPrefetch *sp, int64_t id, const char *url,
+                       const AVDictionary *options)
+{
+    return AVERROR(ENOSYS);
+}
+
+int64_t ff_segprefetch_seek(SegmentPrefetch *sp, int64_t id)
+{
+    return id;
+}
+
+void ff_segprefetch_flush(SegmentPrefetch *sp)
+{
+}
+
+int ff_segprefetch_open(SegmentPrefetch *sp, int64_t id, AVDictionary **options)
+{
+    return AVERROR(ENOENT);
+}
+
+int ff_segprefetch_read(SegmentPrefetch *sp, uint8_t *buf, int size)
+{
+    return AVERROR(ENOSYS);
+}
+
+#endif /* HAVE_THREADS */
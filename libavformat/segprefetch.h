@@ -0,0 +1,93 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_SEGPREFETCH_H
+#define AVFORMAT_SEGPREFETCH_H
+
+#include <stdint.h>
+
+#include "libavutil/dict.h"
+
+#include "avformat.h"
+
+/**
+ * Background download of the next segments of a HLS playlist or DASH
+ * representation. Requests are queued in playlist order, identified by their
+ * sequence number, and fetched by a pool of worker threads. Their data is kept
+ * in memory until it is read, at most max_size bytes of it for the requests
+ * after the first one.
+ *
+ * The URLs are opened with the io_open() callback of the demuxer, which is
+ * then called from the worker threads and must be thread-safe. If it is the
+ * default one, they are opened with the protocol white- and blacklists of the
+ * demuxer instead, so that dropped requests can be interrupted. The interrupt
+ * callback of the demuxer is only called from the functions below, which
+ * return AVERROR_EXIT when it interrupts them.
+ */
+typedef struct SegmentPrefetch SegmentPrefetch;
+
+/**
+ * @param nb_segments maximum number of queued requests
+ * @param nb_threads  maximum number of worker threads, at most nb_segments of
+ *                    them are started
+ */
+int ff_segprefetch_alloc(SegmentPrefetch **psp, AVFormatContext *s,
+                         int nb_segments, int nb_threads, int64_t max_size);
+
+void ff_segprefetch_free(SegmentPrefetch **psp);
+
+/**
+ * Queue a request for url after the last queued one.
+ *
+ * @param options protocol options, as for avio_open2()
+ * @return 0, or AVERROR(EAGAIN) if nb_segments requests are queued already
+ */
+int ff_segprefetch_add(SegmentPrefetch *sp, int64_t id, const char *url,
+                       const AVDictionary *options);
+
+/**
+ * Drop the requests queued before the one for id, or all of them if the
+ * first remaining one is not for id.
+ *
+ * @return id of the next request to queue
+ */
+int64_t ff_segprefetch_seek(SegmentPrefetch *sp, int64_t id);
+
+/**
+ * Drop all queued requests. sp may be NULL.
+ */
+void ff_segprefetch_flush(SegmentPrefetch *sp);
+
+/**
+ * Wait until the first queued request is opened.
+ *
+ * @param options set to the cookies of the response, if it has any
+ * @return 0 if it is for id and its data can be read, AVERROR(ENOENT) if it
+ *         is not for id, or the error from opening it
+ */
+int ff_segprefetch_open(SegmentPrefetch *sp, int64_t id, AVDictionary **options);
+
+/**
+ * Read data of the first queued request, waiting for it as needed.
+ *
+ * @return number of bytes read, AVERROR_EOF at the end of the segment or the
+ *         error that ended its download
+ */
+int ff_segprefetch_read(SegmentPrefetch *sp, uint8_t *buf, int size);
+
+#endif /* AVFORMAT_SEGPREFETCH_H */
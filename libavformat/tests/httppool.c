@@ -0,0 +1,262 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/dict.h"
+#include "libavutil/log.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "libavformat/http.h"
+#include "libavformat/httppool.h"
+#include "libavformat/network.h"
+#include "libavformat/url.h"
+
+#define MAX_CLIENTS 8
+
+/* Keep-alive HTTP/1.1 server answering every request with its path. It
+ * closes the connection after answering a request for /drop, as a server
+ * closing an idle connection would. */
+typedef struct Server {
+    int          listen_fd;
+    int          port;
+    atomic_int   stop;
+    atomic_int   nb_accepted;
+    pthread_t    thread;
+} Server;
+
+typedef struct Client {
+    int  fd;
+    int  len;
+    char buf[4096];
+} Client;
+
+static int handle_request(Client *c)
+{
+    char path[256], reply[512];
+    char *end = strstr(c->buf, "\r\n\r\n");
+    int len, drop;
+
+    if (!end)
+        return 0;
+    if (sscanf(c->buf, "GET %255s ", path) != 1)
+        return -1;
+    drop = !strcmp(path, "/drop");
+    len = snprintf(reply, sizeof(reply),
+                   "HTTP/1.1 200 OK\r\n"
+                   "Content-Type: text/plain\r\n"
+                   "Content-Length: %zu\r\n"
+                   "Connection: keep-alive\r\n"
+                   "\r\n%s", strlen(path), path);
+    if (send(c->fd, reply, len, 0) != len)
+        return -1;
+    end += 4;
+    c->len -= end - c->buf;
+    memmove(c->buf, end, c->len + 1);
+    return drop ? -1 : 0;
+}
+
+static void *server_thread(void *arg)
+{
+    Server *s = arg;
+    Client clients[MAX_CLIENTS];
+    int nb_clients = 0;
+
+    while (!atomic_load(&s->stop)) {
+        struct pollfd fds[MAX_CLIENTS + 1];
+
+        fds[0] = (struct pollfd){ .fd = s->listen_fd, .events = POLLIN };
+        for (int i = 0; i < nb_clients; i++)
+            fds[i + 1] = (struct pollfd){ .fd = clients[i].fd, .events = POLLIN };
+        if (poll(fds, nb_clients + 1, 20) <= 0)
+            continue;
+
+        for (int i = nb_clients - 1; i >= 0; i--) {
+            Client *c = &clients[i];
+            int ret;
+
+            if (!(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            ret = recv(c->fd, c->buf + c->len, sizeof(c->buf) - 1 - c->len, 0);
+            if (ret > 0) {
+                c->len += ret;
+                c->buf[c->len] = 0;
+                ret = handle_request(c);
+            } else {
+                ret = -1;
+            }
+            if (ret < 0) {
+                closesocket(c->fd);
+                *c = clients[--nb_clients];
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(s->listen_fd, NULL, NULL);
+            if (fd < 0)
+                continue;
+            if (nb_clients == MAX_CLIENTS) {
+                closesocket(fd);
+                continue;
+            }
+            clients[nb_clients].fd  = fd;
+            clients[nb_clients].len = 0;
+            nb_clients++;
+            atomic_fetch_add(&s->nb_accepted, 1);
+        }
+    }
+
+    for (int i = 0; i < nb_clients; i++)
+        closesocket(clients[i].fd);
+    return NULL;
+}
+
+static int server_start(Server *s)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET };
+    socklen_t addrlen = sizeof(addr);
+
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    s->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (s->listen_fd < 0)
+        return -1;
+    if (bind(s->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(s->listen_fd, MAX_CLIENTS) ||
+        getsockname(s->listen_fd, (struct sockaddr *)&addr, &addrlen)) {
+        closesocket(s->listen_fd);
+        return -1;
+    }
+    s->port = ntohs(addr.sin_port);
+    atomic_init(&s->stop, 0);
+    atomic_init(&s->nb_accepted, 0);
+    if (pthread_create(&s->thread, NULL, server_thread, s)) {
+        closesocket(s->listen_fd);
+        return -1;
+    }
+    return 0;
+}
+
+static void server_stop(Server *s)
+{
+    atomic_store(&s->stop, 1);
+    pthread_join(s->thread, NULL);
+    closesocket(s->listen_fd);
+}
+
+static char url_buf[64];
+
+static const char *url(const Server *s, const char *path)
+{
+    snprintf(url_buf, sizeof(url_buf), "http://127.0.0.1:%d%s", s->port, path);
+    return url_buf;
+}
+
+static void read_reply(URLContext *h)
+{
+    char buf[256];
+    int len = 0, ret;
+
+    while ((ret = ffurl_read(h, buf + len, sizeof(buf) - 1 - len)) > 0)
+        len += ret;
+    buf[len] = 0;
+    printf("reply: %s\n", buf);
+}
+
+static URLContext *open_url(const Server *s, const char *path)
+{
+    URLContext *h = NULL;
+    AVDictionary *opts = NULL;
+    int ret;
+
+    av_dict_set(&opts, "connection_pool", "1", 0);
+    ret = ffurl_open_whitelist(&h, url(s, path), AVIO_FLAG_READ, NULL, &opts,
+                               NULL, NULL, NULL);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        printf("opening %s failed\n", path);
+        return NULL;
+    }
+    read_reply(h);
+    return h;
+}
+
+static void print_stats(const Server *s, const char *step)
+{
+    HTTPPoolStats stats;
+
+    ff_http_pool_get_stats(&stats);
+    printf("%s: opened %"PRId64" reused %"PRId64" dropped %"PRId64
+           ", server connections %d\n", step, stats.nb_opened,
+           stats.nb_reused, stats.nb_dropped, atomic_load(&s->nb_accepted));
+}
+
+int main(void)
+{
+    Server s = { 0 };
+    URLContext *h;
+    int ret;
+
+    av_log_set_level(AV_LOG_ERROR);
+    ff_network_init();
+    if (server_start(&s) < 0) {
+        printf("could not start the server\n");
+        return 1;
+    }
+
+    /* a connection released by one context is taken by the next one */
+    if (!(h = open_url(&s, "/first")))
+        return 1;
+    ffurl_closep(&h);
+    print_stats(&s, "first context");
+    if (!(h = open_url(&s, "/second")))
+        return 1;
+    print_stats(&s, "second context");
+
+    /* a new request on the same context keeps the connection */
+    ret = ff_http_do_new_request2(h, url(&s, "/third"), NULL);
+    if (ret < 0) {
+        printf("new request failed\n");
+        return 1;
+    }
+    read_reply(h);
+    ffurl_closep(&h);
+    print_stats(&s, "new request");
+
+    /* the connection the server closed is reaped instead of being kept */
+    if (!(h = open_url(&s, "/drop")))
+        return 1;
+    av_usleep(100000);
+    ffurl_closep(&h);
+    print_stats(&s, "server closed");
+
+    if (!(h = open_url(&s, "/last")))
+        return 1;
+    ffurl_closep(&h);
+    print_stats(&s, "last context");
+
+    ff_http_pool_flush();
+    print_stats(&s, "flushed");
+
+    server_stop(&s);
+    ff_network_close();
+    return 0;
+}
@@ -0,0 +1,320 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/dict.h"
+#include "libavutil/file.h"
+#include "libavutil/hash.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+
+#include "libavformat/avformat.h"
+#include "libavformat/network.h"
+
+#define MAX_CONNECTIONS 32
+
+/* Keep-alive HTTP/1.1 server for the files of a directory, with a thread
+ * per connection, so that a client that stops reading does not hold up the
+ * others. */
+typedef struct Server {
+    const char  *dir;
+    int          listen_fd;
+    int          port;
+    atomic_int   stop;
+    atomic_int   nb_connections;
+    atomic_int   nb_requests;
+    pthread_t    threads[MAX_CONNECTIONS];
+    int          fds[MAX_CONNECTIONS];
+    int          nb_threads;
+    pthread_t    thread;
+} Server;
+
+typedef struct Connection {
+    Server *s;
+    int     fd;
+} Connection;
+
+static int send_all(int fd, const void *data, size_t size)
+{
+    const uint8_t *buf = data;
+
+    while (size) {
+        int ret = send(fd, buf, FFMIN(size, 65536), 0);
+        if (ret <= 0)
+            return -1;
+        buf  += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+static int serve_request(Server *s, int fd, const char *req)
+{
+    char path[256], file[1024], header[256];
+    const char *range = strstr(req, "\r\nRange: bytes=");
+    uint8_t *data = NULL;
+    size_t size = 0, start = 0;
+    int len, ret;
+
+    if (sscanf(req, "GET %255s ", path) != 1)
+        return -1;
+    atomic_fetch_add(&s->nb_requests, 1);
+
+    snprintf(file, sizeof(file), "%s%s", s->dir, path);
+    if (strstr(path, "..") || av_file_map(file, &data, &size, 0, NULL) < 0) {
+        len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n");
+        return send_all(fd, header, len);
+    }
+    if (range)
+        start = FFMIN(strtoull(range + 15, NULL, 10), size);
+    if (start)
+        len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 206 Partial Content\r\n"
+                       "Content-Range: bytes %zu-%zu/%zu\r\n"
+                       "Content-Length: %zu\r\n\r\n",
+                       start, size - 1, size, size - start);
+    else
+        len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n\r\n", size);
+    ret = send_all(fd, header, len);
+    if (!ret)
+        ret = send_all(fd, data + start, size - start);
+    av_file_unmap(data, size);
+    return ret;
+}
+
+static void *connection_thread(void *arg)
+{
+    Connection *c = arg;
+    Server *s = c->s;
+    char buf[4096];
+    int len = 0;
+
+    while (!atomic_load(&s->stop)) {
+        struct pollfd pfd = { .fd = c->fd, .events = POLLIN };
+        char *end;
+        int ret;
+
+        if (poll(&pfd, 1, 20) <= 0)
+            continue;
+        ret = recv(c->fd, buf + len, sizeof(buf) - 1 - len, 0);
+        if (ret <= 0)
+            break;
+        len += ret;
+        buf[len] = 0;
+        while ((end = strstr(buf, "\r\n\r\n"))) {
+            end += 4;
+            if (serve_request(s, c->fd, buf) < 0)
+                goto end;
+            len -= end - buf;
+            memmove(buf, end, len + 1);
+        }
+        if (len == sizeof(buf) - 1)
+            break;
+    }
+end:
+    shutdown(c->fd, SHUT_RDWR);
+    av_free(c);
+    return NULL;
+}
+
+static void *server_thread(void *arg)
+{
+    Server *s = arg;
+
+    while (!atomic_load(&s->stop)) {
+        struct pollfd pfd = { .fd = s->listen_fd, .events = POLLIN };
+        Connection *c;
+        int fd;
+
+        if (poll(&pfd, 1, 20) <= 0)
+            continue;
+        fd = accept(s->listen_fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+        if (s->nb_threads == MAX_CONNECTIONS || !(c = av_malloc(sizeof(*c)))) {
+            closesocket(fd);
+            continue;
+        }
+        c->s  = s;
+        c->fd = fd;
+        if (pthread_create(&s->threads[s->nb_threads], NULL, connection_thread, c)) {
+            closesocket(fd);
+            av_free(c);
+            continue;
+        }
+        s->fds[s->nb_threads++] = fd;
+        atomic_fetch_add(&s->nb_connections, 1);
+    }
+
+    for (int i = 0; i < s->nb_threads; i++) {
+        pthread_join(s->threads[i], NULL);
+        closesocket(s->fds[i]);
+    }
+    return NULL;
+}
+
+static int server_start(Server *s, const char *dir)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET };
+    socklen_t addrlen = sizeof(addr);
+
+    s->dir = dir;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    s->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (s->listen_fd < 0)
+        return -1;
+    if (bind(s->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(s->listen_fd, MAX_CONNECTIONS) ||
+        getsockname(s->listen_fd, (struct sockaddr *)&addr, &addrlen)) {
+        closesocket(s->listen_fd);
+        return -1;
+    }
+    s->port = ntohs(addr.sin_port);
+    atomic_init(&s->stop, 0);
+    atomic_init(&s->nb_connections, 0);
+    atomic_init(&s->nb_requests, 0);
+    if (pthread_create(&s->thread, NULL, server_thread, s)) {
+        closesocket(s->listen_fd);
+        return -1;
+    }
+    return 0;
+}
+
+static void server_stop(Server *s)
+{
+    atomic_store(&s->stop, 1);
+    pthread_join(s->thread, NULL);
+    closesocket(s->listen_fd);
+}
+
+/* Fragments read from the prefetched ones and requested directly. */
+static atomic_int nb_prefetched, nb_direct;
+
+static void log_callback(void *avcl, int level, const char *fmt, va_list vl)
+{
+    if (av_strstart(fmt, "DASH prefetched fragment", NULL))
+        atomic_fetch_add(&nb_prefetched, 1);
+    else if (av_strstart(fmt, "DASH request for url", NULL))
+        atomic_fetch_add(&nb_direct, 1);
+    else if (level <= AV_LOG_ERROR)
+        av_log_default_callback(avcl, level, fmt, vl);
+}
+
+/**
+ * Demux url and compute a hash of all packets.
+ *
+ * @param discard index of a stream to discard after opening, or -1
+ * @param res     set to the hash as a hex string
+ */
+static int demux(const char *name, const char *url, const char *opts_str,
+                 int discard, uint8_t res[2 * AV_HASH_MAX_SIZE + 4])
+{
+    AVFormatContext *s = NULL;
+    AVDictionary *opts = NULL;
+    AVPacket *pkt = av_packet_alloc();
+    struct AVHashContext *hash = NULL;
+    int nb_packets = 0, ret;
+
+    if (!pkt || (ret = av_hash_alloc(&hash, "md5")) < 0) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    av_hash_init(hash);
+
+    av_dict_parse_string(&opts, opts_str, "=", ":", 0);
+    ret = avformat_open_input(&s, url, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        goto end;
+    if (discard >= 0)
+        s->streams[discard]->discard = AVDISCARD_ALL;
+    atomic_store(&nb_prefetched, 0);
+    atomic_store(&nb_direct, 0);
+
+    while ((ret = av_read_frame(s, pkt)) >= 0) {
+        av_hash_update(hash, (const uint8_t *)&pkt->stream_index, sizeof(pkt->stream_index));
+        av_hash_update(hash, (const uint8_t *)&pkt->pts, sizeof(pkt->pts));
+        av_hash_update(hash, pkt->data, pkt->size);
+        nb_packets++;
+        av_packet_unref(pkt);
+    }
+    if (ret == AVERROR_EOF)
+        ret = 0;
+
+    av_hash_final_hex(hash, res, 2 * AV_HASH_MAX_SIZE + 4);
+    printf("%s: %d packets\n", name, nb_packets);
+    printf("%s: fragments prefetched %s, requested directly %d\n", name,
+           atomic_load(&nb_prefetched) ? "some" : "none", atomic_load(&nb_direct));
+end:
+    if (ret < 0)
+        printf("%s: %s\n", name, av_err2str(ret));
+    avformat_close_input(&s);
+    av_packet_free(&pkt);
+    av_hash_freep(&hash);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    Server s = { 0 };
+    uint8_t serial[2 * AV_HASH_MAX_SIZE + 4] = { 0 }, res[2 * AV_HASH_MAX_SIZE + 4] = { 0 };
+    char url[1024];
+    int nb_requests, nb_connections, ret = 0;
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <directory> <manifest>\n", argv[0]);
+        return 1;
+    }
+
+    av_log_set_callback(log_callback);
+    ff_network_init();
+    if (server_start(&s, argv[1]) < 0) {
+        printf("could not start the server\n");
+        return 1;
+    }
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/%s", s.port, argv[2]);
+
+    ret |= demux("serial", url, "", -1, serial);
+
+    /* the workers keep their connection for the following fragments */
+    atomic_store(&s.nb_requests, 0);
+    atomic_store(&s.nb_connections, 0);
+    ret |= demux("prefetch", url,
+                 "prefetch_segments=3:prefetch_threads=2:prefetch_max_size=4096", -1, res);
+    nb_requests    = atomic_load(&s.nb_requests);
+    nb_connections = atomic_load(&s.nb_connections);
+    printf("prefetch: packets match %s, connections reused %s\n",
+           memcmp(res, serial, sizeof(res)) ? "no" : "yes",
+           nb_connections < nb_requests ? "yes" : "no");
+
+    /* the thread of the first stream is taken when opening, and is left to
+     * the second one once the first is discarded */
+    ret |= demux("discard", url, "prefetch_segments=2:prefetch_threads=1", 0, res);
+
+    server_stop(&s);
+    ff_network_close();
+    return ret < 0;
+}
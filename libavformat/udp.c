@@ -26,12 +26,12 @@
 
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE     /* Needed for using struct ip_mreq with recent glibc */
+#define _GNU_SOURCE     /* Needed for recvmmsg() and sendmmsg() */
 
 #include "avformat.h"
 #include "libavutil/avassert.h"
 #include "libavutil/mem.h"
 #include "libavutil/parseutils.h"
-#include "libavutil/fifo.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/opt.h"
 #include "libavutil/log.h"
@@ -65,6 +65,7 @@
 #endif
 
 #if HAVE_PTHREAD_CANCEL
+#include <stdatomic.h>
 #include "libavutil/thread.h"
 #endif
 
@@ -77,6 +78,13 @@
 #define UDP_RX_BUF_SIZE 393216
 #define UDP_MAX_PKT_SIZE 65536
 #define UDP_HEADER_SIZE 8
+#define UDP_BATCH_SIZE 32
+
+#if HAVE_SENDMMSG
+#define UDP_TX_BATCH_SIZE UDP_BATCH_SIZE
+#else
+#define UDP_TX_BATCH_SIZE 1
+#endif
 
 typedef struct UDPContext {
     const AVClass *class;
@@ -96,17 +104,26 @@ typedef struct UDPContext {
 
     /* Circular Buffer variables for use in UDP receive code */
     int circular_buffer_size;
-    AVFifo *fifo;
-    int circular_buffer_error;
+    uint8_t *fifo;
+    size_t fifo_size;
     int64_t bitrate; /* number of bits to send per second */
     int64_t burst_bits;
-    int close_req;
 #if HAVE_PTHREAD_CANCEL
+    atomic_size_t fifo_wpos;
+    atomic_size_t fifo_rpos;
+    atomic_int waiting;
+    atomic_int circular_buffer_error;
+    atomic_int close_req;
+    atomic_int_least64_t nb_fifo_overruns;
+    atomic_int_least64_t nb_socket_drops;
+    uint8_t *rx_buf;
     pthread_t circular_buffer_thread;
     pthread_mutex_t mutex;
     pthread_cond_t cond;
     int thread_started;
 #endif
+    int64_t fifo_overruns;
+    int64_t socket_drops;
     uint8_t tmp[UDP_MAX_PKT_SIZE+4];
     int remaining_in_dg;
     char *localaddr;
@@ -139,6 +156,8 @@ static const AVOption options[] = {
     { "timeout",        "set raise error timeout, in microseconds (only in read mode)",OFFSET(timeout),         AV_OPT_TYPE_INT,  {.i64 = 0}, 0, INT_MAX, D },
     { "sources",        "Source list",                                     OFFSET(sources),        AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
     { "block",          "Block list",                                      OFFSET(block),          AV_OPT_TYPE_STRING, { .str = NULL },               .flags = D|E },
+    { "fifo_overruns",  "export the number of datagrams dropped because the circular buffer was full", OFFSET(fifo_overruns), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "socket_drops",   "export the number of datagrams dropped because the socket buffer was full", OFFSET(socket_drops), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { NULL }
 };
 
@@ -479,69 +498,264 @@ static int udp_get_file_handle(URLContext *h)
 }
 
 #if HAVE_PTHREAD_CANCEL
+/* The circular buffer is a single-producer single-consumer ring of
+ * datagrams, each stored as a 32-bit length followed by the payload. Only the
+ * producer advances fifo_wpos and only the consumer fifo_rpos; one byte is
+ * always left free to tell a full ring from an empty one. */
+static size_t fifo_used(const UDPContext *s, size_t rpos, size_t wpos)
+{
+    return wpos >= rpos ? wpos - rpos : s->fifo_size - rpos + wpos;
+}
+
+static size_t fifo_space(const UDPContext *s, size_t rpos, size_t wpos)
+{
+    return s->fifo_size - 1 - fifo_used(s, rpos, wpos);
+}
+
+static size_t fifo_put(UDPContext *s, size_t pos, const uint8_t *src, size_t len)
+{
+    size_t n = FFMIN(len, s->fifo_size - pos);
+
+    memcpy(s->fifo + pos, src, n);
+    memcpy(s->fifo, src + n, len - n);
+    pos += len;
+    return pos >= s->fifo_size ? pos - s->fifo_size : pos;
+}
+
+static size_t fifo_get(UDPContext *s, size_t pos, uint8_t *dst, size_t len)
+{
+    size_t n = FFMIN(len, s->fifo_size - pos);
+
+    memcpy(dst, s->fifo + pos, n);
+    memcpy(dst + n, s->fifo, len - n);
+    pos += len;
+    return pos >= s->fifo_size ? pos - s->fifo_size : pos;
+}
+
+static size_t fifo_skip(const UDPContext *s, size_t pos, size_t len)
+{
+    pos += len;
+    return pos >= s->fifo_size ? pos - s->fifo_size : pos;
+}
+
+/* The mutex and condition variable are only used to sleep: a thread finding
+ * the ring empty sets waiting and checks again under the mutex, the other one
+ * signals after advancing its position only if it sees waiting set. */
+static void fifo_wake(UDPContext *s)
+{
+    if (atomic_load(&s->waiting)) {
+        pthread_mutex_lock(&s->mutex);
+        pthread_cond_signal(&s->cond);
+        pthread_mutex_unlock(&s->mutex);
+    }
+}
+
+#if HAVE_RECVMMSG
+typedef union UDPControl {
+    struct cmsghdr hdr;
+    char buf[CMSG_SPACE(sizeof(uint32_t))];
+} UDPControl;
+
+static void udp_update_socket_drops(UDPContext *s, struct msghdr *msg)
+{
+#ifdef SO_RXQ_OVFL
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+            uint32_t drops;
+            memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+            atomic_store_explicit(&s->nb_socket_drops, drops, memory_order_relaxed);
+        }
+    }
+#endif
+}
+#endif
+
+/* Append a datagram to the ring, return 1 if it was dropped */
+static int circular_buffer_put(URLContext *h, size_t rpos, size_t *wpos,
+                               const uint8_t *data, int len,
+                               struct sockaddr_storage *addr, int *overrun)
+{
+    UDPContext *s = h->priv_data;
+    uint8_t hdr[4];
+
+    if (ff_ip_check_source_lists(addr, &s->filters))
+        return 1;
+
+    if (fifo_space(s, rpos, *wpos) < len + 4) {
+        /* No Space left */
+        atomic_fetch_add_explicit(&s->nb_fifo_overruns, 1, memory_order_relaxed);
+        if (s->overrun_nonfatal) {
+            /* Only warn once per run of dropped datagrams */
+            if (!*overrun)
+                av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
+                        "Surviving due to overrun_nonfatal option\n");
+            *overrun = 1;
+            return 1;
+        } else {
+            av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
+                    "To avoid, increase fifo_size URL option. "
+                    "To survive in such case, use overrun_nonfatal option\n");
+            return AVERROR(EIO);
+        }
+    }
+    *overrun = 0;
+
+    AV_WL32(hdr, len);
+    *wpos = fifo_put(s, *wpos, hdr, 4);
+    *wpos = fifo_put(s, *wpos, data, len);
+    return 0;
+}
+
 static void *circular_buffer_task_rx( void *_URLContext)
 {
     URLContext *h = _URLContext;
     UDPContext *s = h->priv_data;
-    int old_cancelstate;
+    size_t wpos = atomic_load_explicit(&s->fifo_wpos, memory_order_relaxed);
+    int old_cancelstate, overrun = 0;
+#if HAVE_RECVMMSG
+    struct mmsghdr msgs[UDP_BATCH_SIZE];
+    struct iovec iov[UDP_BATCH_SIZE];
+    struct sockaddr_storage addrs[UDP_BATCH_SIZE];
+    UDPControl control[UDP_BATCH_SIZE];
+
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < UDP_BATCH_SIZE; i++) {
+        iov[i].iov_base = s->rx_buf + i * UDP_MAX_PKT_SIZE;
+        iov[i].iov_len  = UDP_MAX_PKT_SIZE;
+        msgs[i].msg_hdr.msg_name   = &addrs[i];
+        msgs[i].msg_hdr.msg_iov    = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+#else
+    struct sockaddr_storage addr;
+#endif
 
     ff_thread_setname("udp-rx");
 
     pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
-    pthread_mutex_lock(&s->mutex);
     if (ff_socket_nonblock(s->udp_fd, 0) < 0) {
         av_log(h, AV_LOG_ERROR, "Failed to set blocking mode");
-        s->circular_buffer_error = AVERROR(EIO);
+        atomic_store(&s->circular_buffer_error, AVERROR(EIO));
         goto end;
     }
     while(1) {
-        int len;
-        struct sockaddr_storage addr;
+        size_t rpos;
+        int nb, ret = 0;
+#if HAVE_RECVMMSG
+        for (int i = 0; i < UDP_BATCH_SIZE; i++) {
+            msgs[i].msg_hdr.msg_namelen    = sizeof(addrs[i]);
+            msgs[i].msg_hdr.msg_control    = &control[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+        }
+#else
         socklen_t addr_len = sizeof(addr);
+#endif
 
-        pthread_mutex_unlock(&s->mutex);
         /* Blocking operations are always cancellation points;
            see "General Information" / "Thread Cancelation Overview"
            in Single Unix. */
         pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_cancelstate);
-        len = recvfrom(s->udp_fd, s->tmp+4, sizeof(s->tmp)-4, 0, (struct sockaddr *)&addr, &addr_len);
+#if HAVE_RECVMMSG
+        /* Wait for one datagram, then take those already queued as well */
+        nb = recvmmsg(s->udp_fd, msgs, UDP_BATCH_SIZE, MSG_WAITFORONE, NULL);
+#else
+        nb = recvfrom(s->udp_fd, s->tmp, sizeof(s->tmp), 0, (struct sockaddr *)&addr, &addr_len);
+#endif
         pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
-        pthread_mutex_lock(&s->mutex);
-        if (len < 0) {
+        if (nb < 0) {
             if (ff_neterrno() != AVERROR(EAGAIN) && ff_neterrno() != AVERROR(EINTR)) {
-                s->circular_buffer_error = ff_neterrno();
+                atomic_store(&s->circular_buffer_error, ff_neterrno());
                 goto end;
             }
             continue;
         }
-        if (ff_ip_check_source_lists(&addr, &s->filters))
-            continue;
-        AV_WL32(s->tmp, len);
 
-        if (av_fifo_can_write(s->fifo) < len + 4) {
-            /* No Space left */
-            if (s->overrun_nonfatal) {
-                av_log(h, AV_LOG_WARNING, "Circular buffer overrun. "
-                        "Surviving due to overrun_nonfatal option\n");
-                continue;
-            } else {
-                av_log(h, AV_LOG_ERROR, "Circular buffer overrun. "
-                        "To avoid, increase fifo_size URL option. "
-                        "To survive in such case, use overrun_nonfatal option\n");
-                s->circular_buffer_error = AVERROR(EIO);
-                goto end;
-            }
+        rpos = atomic_load_explicit(&s->fifo_rpos, memory_order_acquire);
+#if HAVE_RECVMMSG
+        for (int i = 0; i < nb && ret >= 0; i++) {
+            udp_update_socket_drops(s, &msgs[i].msg_hdr);
+            ret = circular_buffer_put(h, rpos, &wpos, iov[i].iov_base,
+                                      msgs[i].msg_len, &addrs[i], &overrun);
         }
-        av_fifo_write(s->fifo, s->tmp, len + 4);
-        pthread_cond_signal(&s->cond);
+#else
+        ret = circular_buffer_put(h, rpos, &wpos, s->tmp, nb, &addr, &overrun);
+#endif
+        /* Publish the whole batch at once */
+        atomic_store(&s->fifo_wpos, wpos);
+        if (ret < 0) {
+            atomic_store(&s->circular_buffer_error, ret);
+            goto end;
+        }
+        fifo_wake(s);
     }
 
 end:
+    pthread_mutex_lock(&s->mutex);
     pthread_cond_signal(&s->cond);
     pthread_mutex_unlock(&s->mutex);
     return NULL;
 }
 
+/* Wait until the ring is not empty or closing is requested, return the write
+ * position or the read one if the ring is empty. */
+static size_t circular_buffer_wait_tx(UDPContext *s, size_t rpos)
+{
+    size_t wpos = atomic_load_explicit(&s->fifo_wpos, memory_order_acquire);
+
+    if (wpos != rpos || atomic_load(&s->close_req))
+        return wpos;
+
+    pthread_mutex_lock(&s->mutex);
+    atomic_store(&s->waiting, 1);
+    while ((wpos = atomic_load(&s->fifo_wpos)) == rpos && !atomic_load(&s->close_req))
+        pthread_cond_wait(&s->cond, &s->mutex);
+    atomic_store(&s->waiting, 0);
+    pthread_mutex_unlock(&s->mutex);
+
+    return wpos;
+}
+
+typedef struct UDPTxBatch {
+#if HAVE_SENDMMSG
+    struct mmsghdr msgs[UDP_BATCH_SIZE];
+#else
+    const uint8_t *data;
+    int len;
+#endif
+} UDPTxBatch;
+
+static int udp_send_batch(UDPContext *s, UDPTxBatch *batch, int nb)
+{
+    int sent = 0;
+
+    while (sent < nb) {
+        int ret;
+#if HAVE_SENDMMSG
+        ret = sendmmsg(s->udp_fd, batch->msgs + sent, nb - sent, 0);
+#else
+        if (!s->is_connected) {
+            ret = sendto (s->udp_fd, batch->data, batch->len, 0,
+                        (struct sockaddr *) &s->dest_addr,
+                        s->dest_addr_len);
+        } else
+            ret = send(s->udp_fd, batch->data, batch->len, 0);
+        if (ret >= 0) {
+            batch->data += ret;
+            batch->len  -= ret;
+            ret = !batch->len;
+        }
+#endif
+        if (ret >= 0) {
+            sent += ret;
+        } else {
+            ret = ff_neterrno();
+            if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR))
+                return ret;
+        }
+    }
+    return 0;
+}
+
 static void *circular_buffer_task_tx( void *_URLContext)
 {
     URLContext *h = _URLContext;
@@ -551,91 +765,102 @@ static void *circular_buffer_task_tx( void *_URLContext)
     int64_t sent_bits = 0;
     int64_t burst_interval = s->bitrate ? (s->burst_bits * 1000000 / s->bitrate) : 0;
     int64_t max_delay = s->bitrate ?  ((int64_t)h->max_packet_size * 8 * 1000000 / s->bitrate + 1) : 0;
+    size_t rpos = atomic_load_explicit(&s->fifo_rpos, memory_order_relaxed);
+    UDPTxBatch batch;
+#if HAVE_SENDMMSG
+    struct iovec iov[UDP_BATCH_SIZE][2];
+
+    memset(&batch, 0, sizeof(batch));
+    for (int i = 0; i < UDP_BATCH_SIZE; i++) {
+        if (!s->is_connected) {
+            batch.msgs[i].msg_hdr.msg_name    = &s->dest_addr;
+            batch.msgs[i].msg_hdr.msg_namelen = s->dest_addr_len;
+        }
+        batch.msgs[i].msg_hdr.msg_iov = iov[i];
+    }
+#endif
 
     ff_thread_setname("udp-tx");
 
-    pthread_mutex_lock(&s->mutex);
-
     if (ff_socket_nonblock(s->udp_fd, 0) < 0) {
         av_log(h, AV_LOG_ERROR, "Failed to set blocking mode");
-        s->circular_buffer_error = AVERROR(EIO);
-        goto end;
+        atomic_store(&s->circular_buffer_error, AVERROR(EIO));
+        return NULL;
     }
 
     for(;;) {
-        int len;
-        const uint8_t *p;
-        uint8_t tmp[4];
-        int64_t timestamp;
+        size_t wpos = circular_buffer_wait_tx(s, rpos);
+        size_t pos = rpos;
+        int nb = 0, ret;
 
-        len = av_fifo_can_read(s->fifo);
-
-        while (len<4) {
-            if (s->close_req)
-                goto end;
-            pthread_cond_wait(&s->cond, &s->mutex);
-            len = av_fifo_can_read(s->fifo);
-        }
-
-        av_fifo_read(s->fifo, tmp, 4);
-        len = AV_RL32(tmp);
-
-        av_assert0(len >= 0);
-        av_assert0(len <= sizeof(s->tmp));
-
-        av_fifo_read(s->fifo, s->tmp, len);
-
-        pthread_mutex_unlock(&s->mutex);
+        if (wpos == rpos)
+            break;
 
-        if (s->bitrate) {
-            timestamp = av_gettime_relative();
-            if (timestamp < target_timestamp) {
-                int64_t delay = target_timestamp - timestamp;
-                if (delay > max_delay) {
-                    delay = max_delay;
-                    start_timestamp = timestamp + delay;
-                    sent_bits = 0;
-                }
-                av_usleep(delay);
-            } else {
-                if (timestamp - burst_interval > target_timestamp) {
-                    start_timestamp = timestamp - burst_interval;
-                    sent_bits = 0;
+        /* Gather the datagrams that are due now, their payload is sent from
+         * the ring and it is released only once they are sent. */
+        while (nb < UDP_TX_BATCH_SIZE && pos != wpos) {
+            int64_t timestamp;
+            uint8_t tmp[4];
+            size_t data_pos;
+            int len;
+
+            data_pos = fifo_get(s, pos, tmp, 4);
+            len = AV_RL32(tmp);
+
+            av_assert0(len >= 0);
+            av_assert0(len <= UDP_MAX_PKT_SIZE);
+
+            if (s->bitrate) {
+                timestamp = av_gettime_relative();
+                if (timestamp < target_timestamp) {
+                    int64_t delay = target_timestamp - timestamp;
+                    if (nb)
+                        break;
+                    if (delay > max_delay) {
+                        delay = max_delay;
+                        start_timestamp = timestamp + delay;
+                        sent_bits = 0;
+                    }
+                    av_usleep(delay);
+                } else {
+                    if (timestamp - burst_interval > target_timestamp) {
+                        start_timestamp = timestamp - burst_interval;
+                        sent_bits = 0;
+                    }
                 }
+                sent_bits += len * 8;
+                target_timestamp = start_timestamp + sent_bits * 1000000 / s->bitrate;
             }
-            sent_bits += len * 8;
-            target_timestamp = start_timestamp + sent_bits * 1000000 / s->bitrate;
-        }
 
-        p = s->tmp;
-        while (len) {
-            int ret;
-            av_assert0(len > 0);
-            if (!s->is_connected) {
-                ret = sendto (s->udp_fd, p, len, 0,
-                            (struct sockaddr *) &s->dest_addr,
-                            s->dest_addr_len);
-            } else
-                ret = send(s->udp_fd, p, len, 0);
-            if (ret >= 0) {
-                len -= ret;
-                p   += ret;
-            } else {
-                ret = ff_neterrno();
-                if (ret != AVERROR(EAGAIN) && ret != AVERROR(EINTR)) {
-                    pthread_mutex_lock(&s->mutex);
-                    s->circular_buffer_error = ret;
-                    pthread_mutex_unlock(&s->mutex);
-                    return NULL;
-                }
+#if HAVE_SENDMMSG
+            {
+                struct msghdr *msg = &batch.msgs[nb].msg_hdr;
+                size_t n = FFMIN(len, s->fifo_size - data_pos);
+
+                msg->msg_iov[0].iov_base = s->fifo + data_pos;
+                msg->msg_iov[0].iov_len  = n;
+                msg->msg_iov[1].iov_base = s->fifo;
+                msg->msg_iov[1].iov_len  = len - n;
+                msg->msg_iovlen = 1 + (len > n);
             }
+            pos = fifo_skip(s, data_pos, len);
+#else
+            pos = fifo_get(s, data_pos, s->tmp, len);
+            batch.data = s->tmp;
+            batch.len  = len;
+#endif
+            nb++;
         }
 
-        pthread_mutex_lock(&s->mutex);
+        ret = udp_send_batch(s, &batch, nb);
+        if (ret < 0) {
+            atomic_store(&s->circular_buffer_error, ret);
+            return NULL;
+        }
+        rpos = pos;
+        atomic_store_explicit(&s->fifo_rpos, rpos, memory_order_release);
     }
 
-end:
-    pthread_mutex_unlock(&s->mutex);
     return NULL;
 }
 
@@ -904,9 +1129,25 @@ static int udp_open(URLContext *h, const char *uri, int flags)
             ff_log_net_error(h, AV_LOG_WARNING, "getsockopt(SO_RCVBUF)");
         } else {
             av_log(h, AV_LOG_DEBUG, "end receive buffer size reported is %d\n", tmp);
+#ifdef SO_RCVBUFFORCE
+            /* Try to exceed the system limit, this needs CAP_NET_ADMIN */
+            if (tmp < s->buffer_size) {
+                tmp = s->buffer_size;
+                if (!setsockopt(udp_fd, SOL_SOCKET, SO_RCVBUFFORCE, &tmp, sizeof(tmp)))
+                    getsockopt(udp_fd, SOL_SOCKET, SO_RCVBUF, &tmp, &len);
+                else
+                    tmp = 0;
+            }
+#endif
             if(tmp < s->buffer_size)
                 av_log(h, AV_LOG_WARNING, "attempted to set receive buffer to size %d but it only ended up set as %d\n", s->buffer_size, tmp);
         }
+#if HAVE_RECVMMSG && defined(SO_RXQ_OVFL)
+        /* have the number of datagrams dropped by the socket reported */
+        tmp = 1;
+        if (setsockopt(udp_fd, SOL_SOCKET, SO_RXQ_OVFL, &tmp, sizeof(tmp)) < 0)
+            ff_log_net_error(h, AV_LOG_DEBUG, "setsockopt(SO_RXQ_OVFL)");
+#endif
 
         /* make the socket non-blocking */
         ff_socket_nonblock(udp_fd, 1);
@@ -935,11 +1176,23 @@ static int udp_open(URLContext *h, const char *uri, int flags)
 
     if ((!is_output && s->circular_buffer_size) || (is_output && s->bitrate && s->circular_buffer_size)) {
         /* start the task going */
-        s->fifo = av_fifo_alloc2(s->circular_buffer_size, 1, 0);
+        s->fifo_size = s->circular_buffer_size + 1;
+        s->fifo = av_malloc(s->fifo_size);
         if (!s->fifo) {
             ret = AVERROR(ENOMEM);
             goto fail;
         }
+#if HAVE_RECVMMSG
+        /* Large enough for a batch of datagrams of any size, the pages are
+         * only touched as far as the datagrams actually received need. */
+        if (!is_output) {
+            s->rx_buf = av_malloc(UDP_BATCH_SIZE * UDP_MAX_PKT_SIZE);
+            if (!s->rx_buf) {
+                ret = AVERROR(ENOMEM);
+                goto fail;
+            }
+        }
+#endif
         ret = pthread_mutex_init(&s->mutex, NULL);
         if (ret != 0) {
             av_log(h, AV_LOG_ERROR, "pthread_mutex_init failed : %s\n", strerror(ret));
@@ -972,7 +1225,10 @@ static int udp_open(URLContext *h, const char *uri, int flags)
  fail:
     if (udp_fd >= 0)
         closesocket(udp_fd);
-    av_fifo_freep2(&s->fifo);
+    av_freep(&s->fifo);
+#if HAVE_PTHREAD_CANCEL
+    av_freep(&s->rx_buf);
+#endif
     ff_ip_reset_filters(&s->filters);
     return ret;
 }
@@ -997,29 +1253,32 @@ static int udp_read(URLContext *h, uint8_t *buf, int size)
     int avail, nonblock = h->flags & AVIO_FLAG_NONBLOCK;
 
     if (s->fifo) {
-        pthread_mutex_lock(&s->mutex);
         do {
-            avail = av_fifo_can_read(s->fifo);
-            if (avail) { // >=size) {
+            size_t rpos = atomic_load_explicit(&s->fifo_rpos, memory_order_relaxed);
+            size_t wpos = atomic_load_explicit(&s->fifo_wpos, memory_order_acquire);
+            int err;
+
+            s->fifo_overruns = atomic_load_explicit(&s->nb_fifo_overruns, memory_order_relaxed);
+            s->socket_drops  = atomic_load_explicit(&s->nb_socket_drops,  memory_order_relaxed);
+
+            if (wpos != rpos) {
                 uint8_t tmp[4];
+                int len;
 
-                av_fifo_read(s->fifo, tmp, 4);
-                avail = AV_RL32(tmp);
+                rpos = fifo_get(s, rpos, tmp, 4);
+                len = avail = AV_RL32(tmp);
                 if(avail > size){
                     av_log(h, AV_LOG_WARNING, "Part of datagram lost due to insufficient buffer size\n");
                     avail = size;
                 }
 
-                av_fifo_read(s->fifo, buf, avail);
-                av_fifo_drain2(s->fifo, AV_RL32(tmp) - avail);
-                pthread_mutex_unlock(&s->mutex);
+                rpos = fifo_get(s, rpos, buf, avail);
+                rpos = fifo_skip(s, rpos, len - avail);
+                atomic_store_explicit(&s->fifo_rpos, rpos, memory_order_release);
                 return avail;
-            } else if(s->circular_buffer_error){
-                int err = s->circular_buffer_error;
-                pthread_mutex_unlock(&s->mutex);
+            } else if ((err = atomic_load(&s->circular_buffer_error))) {
                 return err;
             } else if(nonblock) {
-                pthread_mutex_unlock(&s->mutex);
                 return AVERROR(EAGAIN);
             } else {
                 /* FIXME: using the monotonic clock would be better,
@@ -1027,11 +1286,15 @@ static int udp_read(URLContext *h, uint8_t *buf, int size)
                 int64_t t = av_gettime() + 100000;
                 struct timespec tv = { .tv_sec  =  t / 1000000,
                                        .tv_nsec = (t % 1000000) * 1000 };
-                int err = pthread_cond_timedwait(&s->cond, &s->mutex, &tv);
-                if (err) {
-                    pthread_mutex_unlock(&s->mutex);
+                pthread_mutex_lock(&s->mutex);
+                atomic_store(&s->waiting, 1);
+                if (atomic_load(&s->fifo_wpos) == rpos &&
+                    !atomic_load(&s->circular_buffer_error))
+                    err = pthread_cond_timedwait(&s->cond, &s->mutex, &tv);
+                atomic_store(&s->waiting, 0);
+                pthread_mutex_unlock(&s->mutex);
+                if (err)
                     return AVERROR(err == ETIMEDOUT ? EAGAIN : err);
-                }
                 nonblock = 1;
             }
         } while(1);
@@ -1058,30 +1321,27 @@ static int udp_write(URLContext *h, const uint8_t *buf, int size)
 
 #if HAVE_PTHREAD_CANCEL
     if (s->fifo) {
+        size_t rpos = atomic_load_explicit(&s->fifo_rpos, memory_order_acquire);
+        size_t wpos = atomic_load_explicit(&s->fifo_wpos, memory_order_relaxed);
         uint8_t tmp[4];
-
-        pthread_mutex_lock(&s->mutex);
+        int err;
 
         /*
           Return error if last tx failed.
           Here we can't know on which packet error was, but it needs to know that error exists.
         */
-        if (s->circular_buffer_error<0) {
-            int err = s->circular_buffer_error;
-            pthread_mutex_unlock(&s->mutex);
+        if ((err = atomic_load(&s->circular_buffer_error)) < 0)
             return err;
-        }
 
-        if (av_fifo_can_write(s->fifo) < size + 4) {
+        if (fifo_space(s, rpos, wpos) < size + 4) {
             /* What about a partial packet tx ? */
-            pthread_mutex_unlock(&s->mutex);
             return AVERROR(ENOMEM);
         }
         AV_WL32(tmp, size);
-        av_fifo_write(s->fifo, tmp, 4); /* size of packet */
-        av_fifo_write(s->fifo, buf, size); /* the data */
-        pthread_cond_signal(&s->cond);
-        pthread_mutex_unlock(&s->mutex);
+        wpos = fifo_put(s, wpos, tmp, 4); /* size of packet */
+        wpos = fifo_put(s, wpos, buf, size); /* the data */
+        atomic_store(&s->fifo_wpos, wpos);
+        fifo_wake(s);
         return size;
     }
 #endif
@@ -1108,8 +1368,8 @@ static int udp_close(URLContext *h)
 #if HAVE_PTHREAD_CANCEL
     // Request close once writing is finished
     if (s->thread_started && !(h->flags & AVIO_FLAG_READ)) {
+        atomic_store(&s->close_req, 1);
         pthread_mutex_lock(&s->mutex);
-        s->close_req = 1;
         pthread_cond_signal(&s->cond);
         pthread_mutex_unlock(&s->mutex);
     }
@@ -1139,9 +1399,10 @@ static int udp_close(URLContext *h)
         pthread_mutex_destroy(&s->mutex);
         pthread_cond_destroy(&s->cond);
     }
+    av_freep(&s->rx_buf);
 #endif
     closesocket(s->udp_fd);
-    av_fifo_freep2(&s->fifo);
+    av_freep(&s->fifo);
     ff_ip_reset_filters(&s->filters);
     return 0;
 }
@@ -26,6 +26,7 @@
 
 #include "avio.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/dict.h"
 #include "libavutil/log.h"
 
@@ -83,6 +84,17 @@ typedef struct URLProtocol {
     int (*url_get_multi_file_handle)(URLContext *h, int **handles,
                                      int *numhandles);
     int (*url_get_short_seek)(URLContext *h);
+    /**
+     * Map size bytes of the resource at pos in memory, followed by
+     * AV_INPUT_BUFFER_PADDING_SIZE zero bytes. *buf is a new read-only
+     * reference to the mapping, which may outlive the context, and *data
+     * points to the requested bytes in it.
+     *
+     * @return 1 on success, 0 if the range cannot be mapped, or a negative
+     *         error code
+     */
+    int (*url_map)(URLContext *h, int64_t pos, int size,
+                   AVBufferRef **buf, uint8_t **data);
     int (*url_shutdown)(URLContext *h, int flags);
     const AVClass *priv_data_class;
     int priv_data_size;
@@ -263,6 +275,15 @@ int ffurl_get_multi_file_handle(URLContext *h, int **handles, int *numhandles);
  */
 int ffurl_get_short_seek(void *urlcontext);
 
+/**
+ * Map a range of the resource in memory, see URLProtocol.url_map.
+ *
+ * @return 1 if *buf and *data were set, 0 if the range is not mapped, or a
+ *         negative error code
+ */
+int ffurl_map(URLContext *h, int64_t pos, int size,
+              AVBufferRef **buf, uint8_t **data);
+
 /**
  * Signal the URLContext that we are done reading or writing the stream.
  *
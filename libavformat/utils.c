@@ -22,6 +22,7 @@
 #include <stdint.h>
 
 #include "config.h"
+#include "config_components.h"
 
 #include "libavutil/avstring.h"
 #include "libavutil/bprint.h"
@@ -33,6 +34,7 @@
 
 #include "avformat.h"
 #include "avio_internal.h"
+#include "httppool.h"
 #include "internal.h"
 #if CONFIG_NETWORK
 #include "network.h"
@@ -563,6 +565,9 @@ int avformat_network_init(void)
 int avformat_network_deinit(void)
 {
 #if CONFIG_NETWORK
+#if CONFIG_HTTP_PROTOCOL || CONFIG_HTTPS_PROTOCOL
+    ff_http_pool_flush();
+#endif
     ff_network_close();
     ff_tls_deinit();
 #endif
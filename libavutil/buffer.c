@@ -16,10 +16,20 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+/* Needed for MAP_ANONYMOUS and madvise() with glibc */
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+
 #include <stdatomic.h>
 #include <stdint.h>
 #include <string.h>
 
+#include "config.h"
+
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
 #include "avassert.h"
 #include "buffer_internal.h"
 #include "common.h"
@@ -276,12 +286,172 @@ AVBufferPool *av_buffer_pool_init2(size_t size, void *opaque,
     pool->pool_free = pool_free;
 
     atomic_init(&pool->refcount, 1);
+    atomic_init(&pool->free_list, 0);
 
     return pool;
 }
 
+#define HUGE_PAGE_SIZE (2 << 20)
+
+static atomic_size_t huge_page_threshold = 0;
+
+void av_buffer_pool_set_huge_page_threshold(size_t min_size)
+{
+    atomic_store_explicit(&huge_page_threshold, min_size, memory_order_relaxed);
+}
+
+/*
+ * A block of memory that pool buffers are carved out of. Every buffer holds a
+ * reference to it, as does the allocator while it is being filled.
+ */
+typedef struct BufferSlab {
+    uint8_t    *data;
+    size_t      size;
+    int         mapped;
+    atomic_uint refcount;
+} BufferSlab;
+
+typedef struct SlabAllocator {
+    size_t      buf_size;
+    size_t      slab_size;
+    int         zero;
+
+    BufferSlab *cur;
+    size_t      offset;
+} SlabAllocator;
+
+static void slab_unref(BufferSlab *slab)
+{
+    if (atomic_fetch_sub_explicit(&slab->refcount, 1, memory_order_acq_rel) > 1)
+        return;
+
+#if HAVE_MMAP
+    if (slab->mapped)
+        munmap(slab->data, slab->size);
+    else
+#endif
+        av_free(slab->data);
+    av_free(slab);
+}
+
+static BufferSlab *slab_alloc(size_t size, int zero)
+{
+    BufferSlab *slab = av_mallocz(sizeof(*slab));
+    if (!slab)
+        return NULL;
+
+    slab->size = size;
+    atomic_init(&slab->refcount, 1);
+
+#if HAVE_MMAP && defined(MAP_ANONYMOUS)
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_SHIFT)
+    /* explicitly reserved huge pages, if the system has any left */
+    slab->data = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                      21 << MAP_HUGE_SHIFT, -1, 0);
+    if (slab->data != MAP_FAILED) {
+        slab->mapped = 1;
+        return slab;
+    }
+#endif
+    {
+        /* transparent huge pages, which need huge page aligned memory */
+        size_t   len = size + HUGE_PAGE_SIZE;
+        uint8_t *map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map != MAP_FAILED) {
+            uint8_t *data = (uint8_t *)FFALIGN((uintptr_t)map, HUGE_PAGE_SIZE);
+
+            if (data > map)
+                munmap(map, data - map);
+            if (data + size < map + len)
+                munmap(data + size, map + len - (data + size));
+#ifdef MADV_HUGEPAGE
+            madvise(data, size, MADV_HUGEPAGE);
+#endif
+            slab->data   = data;
+            slab->mapped = 1;
+            return slab;
+        }
+    }
+#endif
+
+    slab->data = zero ? av_mallocz(size) : av_malloc(size);
+    if (!slab->data)
+        av_freep(&slab);
+
+    return slab;
+}
+
+static void slab_buffer_free(void *opaque, uint8_t *data)
+{
+    slab_unref(opaque);
+}
+
+/* called with the pool mutex held */
+static AVBufferRef *slab_pool_alloc(void *opaque, size_t size)
+{
+    SlabAllocator *sa = opaque;
+    AVBufferRef *ret;
+
+    if (!sa->cur || sa->offset + sa->buf_size > sa->cur->size) {
+        if (sa->cur)
+            slab_unref(sa->cur);
+        sa->cur    = slab_alloc(sa->slab_size, sa->zero);
+        sa->offset = 0;
+        if (!sa->cur)
+            return NULL;
+    }
+
+    ret = av_buffer_create(sa->cur->data + sa->offset, size,
+                           slab_buffer_free, sa->cur, 0);
+    if (!ret)
+        return NULL;
+
+    atomic_fetch_add_explicit(&sa->cur->refcount, 1, memory_order_relaxed);
+    sa->offset += sa->buf_size;
+
+    return ret;
+}
+
+static void slab_pool_free(void *opaque)
+{
+    SlabAllocator *sa = opaque;
+
+    if (sa->cur)
+        slab_unref(sa->cur);
+    av_free(sa);
+}
+
+static SlabAllocator *slab_allocator_alloc(size_t size, int zero)
+{
+    SlabAllocator *sa;
+    size_t buf_size = FFALIGN(size, 64);
+
+    if (!size || buf_size < size || buf_size > SIZE_MAX / 8 - HUGE_PAGE_SIZE)
+        return NULL;
+
+    sa = av_mallocz(sizeof(*sa));
+    if (!sa)
+        return NULL;
+
+    sa->buf_size = buf_size;
+    sa->zero     = zero;
+
+    /* use the smallest slab that leaves at most 1/8 of it unused */
+    for (int n = 1; n <= 8; n++) {
+        sa->slab_size = FFALIGN(n * buf_size, HUGE_PAGE_SIZE);
+        if (sa->slab_size % buf_size <= sa->slab_size / 8)
+            break;
+    }
+
+    return sa;
+}
+
 AVBufferPool *av_buffer_pool_init(size_t size, AVBufferRef* (*alloc)(size_t size))
 {
+    size_t threshold = atomic_load_explicit(&huge_page_threshold,
+                                            memory_order_relaxed);
     AVBufferPool *pool = av_mallocz(sizeof(*pool));
     if (!pool)
         return NULL;
@@ -294,20 +464,97 @@ AVBufferPool *av_buffer_pool_init(size_t size, AVBufferRef* (*alloc)(size_t size
     pool->size     = size;
     pool->alloc    = alloc ? alloc : av_buffer_alloc;
 
+    if (threshold && size >= threshold &&
+        (pool->alloc == av_buffer_alloc || pool->alloc == av_buffer_allocz)) {
+        /* if this fails, the pool just uses the plain allocator */
+        pool->opaque = slab_allocator_alloc(size, pool->alloc == av_buffer_allocz);
+        if (pool->opaque) {
+            pool->alloc2    = slab_pool_alloc;
+            pool->pool_free = slab_pool_free;
+        }
+    }
+
     atomic_init(&pool->refcount, 1);
+    atomic_init(&pool->free_list, 0);
 
     return pool;
 }
 
+static BufferPoolEntry *pool_entry(AVBufferPool *pool, unsigned idx)
+{
+    unsigned chunk = av_log2(idx / POOL_CHUNK0_SIZE + 1);
+
+    return &pool->chunks[chunk][idx - POOL_CHUNK0_SIZE * ((1 << chunk) - 1)];
+}
+
+/* new value of the free list head with the given top entry */
+static uintptr_t free_list_head(uintptr_t old, unsigned idx1)
+{
+    return ((old & ~(uintptr_t)POOL_IDX_MASK) + POOL_IDX_MASK + 1) | idx1;
+}
+
+static void pool_push(AVBufferPool *pool, BufferPoolEntry *buf)
+{
+    uintptr_t head;
+
+    if (buf->idx == POOL_IDX_MASK) {
+        ff_mutex_lock(&pool->mutex);
+        buf->overflow_next = pool->overflow;
+        pool->overflow     = buf;
+        ff_mutex_unlock(&pool->mutex);
+        return;
+    }
+
+    head = atomic_load_explicit(&pool->free_list, memory_order_relaxed);
+
+    do {
+        atomic_store_explicit(&buf->next, head & POOL_IDX_MASK, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->free_list, &head,
+                                                    free_list_head(head, buf->idx + 1),
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+static BufferPoolEntry *pool_pop(AVBufferPool *pool)
+{
+    uintptr_t head = atomic_load_explicit(&pool->free_list, memory_order_acquire);
+    BufferPoolEntry *buf;
+    unsigned next;
+
+    do {
+        if (!(head & POOL_IDX_MASK))
+            return NULL;
+
+        /* entries are never freed before the pool itself, so this is safe
+         * even if buf is popped by another thread meanwhile; the counter in
+         * the head then makes the exchange below fail */
+        buf  = pool_entry(pool, (head & POOL_IDX_MASK) - 1);
+        next = atomic_load_explicit(&buf->next, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->free_list, &head,
+                                                    free_list_head(head, next),
+                                                    memory_order_acquire,
+                                                    memory_order_acquire));
+
+    return buf;
+}
+
 static void buffer_pool_flush(AVBufferPool *pool)
 {
-    while (pool->pool) {
-        BufferPoolEntry *buf = pool->pool;
-        pool->pool = buf->next;
+    BufferPoolEntry *buf;
 
+    while ((buf = pool_pop(pool))) {
+        buf->free(buf->opaque, buf->data);
+        buf->data = NULL;
+    }
+
+    ff_mutex_lock(&pool->mutex);
+    while (pool->overflow) {
+        buf = pool->overflow;
+        pool->overflow = buf->overflow_next;
         buf->free(buf->opaque, buf->data);
         av_freep(&buf);
     }
+    ff_mutex_unlock(&pool->mutex);
 }
 
 /*
@@ -322,6 +569,9 @@ static void buffer_pool_free(AVBufferPool *pool)
     if (pool->pool_free)
         pool->pool_free(pool->opaque);
 
+    for (int i = 0; i < FF_ARRAY_ELEMS(pool->chunks); i++)
+        av_freep(&pool->chunks[i]);
+
     av_freep(&pool);
 }
 
@@ -334,9 +584,7 @@ void av_buffer_pool_uninit(AVBufferPool **ppool)
     pool   = *ppool;
     *ppool = NULL;
 
-    ff_mutex_lock(&pool->mutex);
     buffer_pool_flush(pool);
-    ff_mutex_unlock(&pool->mutex);
 
     if (atomic_fetch_sub_explicit(&pool->refcount, 1, memory_order_acq_rel) == 1)
         buffer_pool_free(pool);
@@ -347,39 +595,57 @@ static void pool_release_buffer(void *opaque, uint8_t *data)
     BufferPoolEntry *buf = opaque;
     AVBufferPool *pool = buf->pool;
 
-    ff_mutex_lock(&pool->mutex);
-    buf->next = pool->pool;
-    pool->pool = buf;
-    ff_mutex_unlock(&pool->mutex);
+    pool_push(pool, buf);
 
     if (atomic_fetch_sub_explicit(&pool->refcount, 1, memory_order_acq_rel) == 1)
         buffer_pool_free(pool);
 }
 
 /* allocate a new buffer and override its free() callback so that
- * it is returned to the pool on free */
+ * it is returned to the pool on free; must be called with the pool mutex
+ * held */
 static AVBufferRef *pool_alloc_buffer(AVBufferPool *pool)
 {
     BufferPoolEntry *buf;
     AVBufferRef     *ret;
+    unsigned idx = pool->nb_entries, chunk;
 
     av_assert0(pool->alloc || pool->alloc2);
 
+    if (idx < POOL_IDX_MASK) {
+        chunk = av_log2(idx / POOL_CHUNK0_SIZE + 1);
+        if (!pool->chunks[chunk]) {
+            pool->chunks[chunk] = av_calloc(POOL_CHUNK0_SIZE << chunk,
+                                            sizeof(*pool->chunks[chunk]));
+            if (!pool->chunks[chunk])
+                return NULL;
+        }
+        buf = pool_entry(pool, idx);
+    } else {
+        buf = av_mallocz(sizeof(*buf));
+        if (!buf)
+            return NULL;
+    }
+
     ret = pool->alloc2 ? pool->alloc2(pool->opaque, pool->size) :
                          pool->alloc(pool->size);
-    if (!ret)
-        return NULL;
-
-    buf = av_mallocz(sizeof(*buf));
-    if (!buf) {
-        av_buffer_unref(&ret);
+    if (!ret) {
+        if (idx >= POOL_IDX_MASK)
+            av_free(buf);
         return NULL;
     }
 
+    if (idx < POOL_IDX_MASK)
+        pool->nb_entries++;
+    else
+        idx = POOL_IDX_MASK;
+
     buf->data   = ret->buffer->data;
     buf->opaque = ret->buffer->opaque;
     buf->free   = ret->buffer->free;
     buf->pool   = pool;
+    buf->idx    = idx;
+    atomic_init(&buf->next, 0);
 
     ret->buffer->opaque = buf;
     ret->buffer->free   = pool_release_buffer;
@@ -389,24 +655,29 @@ static AVBufferRef *pool_alloc_buffer(AVBufferPool *pool)
 
 AVBufferRef *av_buffer_pool_get(AVBufferPool *pool)
 {
-    AVBufferRef *ret;
+    AVBufferRef *ret = NULL;
     BufferPoolEntry *buf;
 
-    ff_mutex_lock(&pool->mutex);
-    buf = pool->pool;
+    buf = pool_pop(pool);
+    if (!buf) {
+        ff_mutex_lock(&pool->mutex);
+        buf = pool->overflow;
+        if (buf)
+            pool->overflow = buf->overflow_next;
+        else
+            ret = pool_alloc_buffer(pool);
+        ff_mutex_unlock(&pool->mutex);
+    }
+
     if (buf) {
         memset(&buf->buffer, 0, sizeof(buf->buffer));
         ret = buffer_create(&buf->buffer, buf->data, pool->size,
                             pool_release_buffer, buf, 0);
-        if (ret) {
-            pool->pool = buf->next;
-            buf->next = NULL;
+        if (ret)
             buf->buffer.flags_internal |= BUFFER_FLAG_NO_FREE;
-        }
-    } else {
-        ret = pool_alloc_buffer(pool);
+        else
+            pool_push(pool, buf);
     }
-    ff_mutex_unlock(&pool->mutex);
 
     if (ret)
         atomic_fetch_add_explicit(&pool->refcount, 1, memory_order_relaxed);
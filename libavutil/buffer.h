@@ -265,6 +265,25 @@ typedef struct AVBufferPool AVBufferPool;
  */
 AVBufferPool *av_buffer_pool_init(size_t size, AVBufferRef* (*alloc)(size_t size));
 
+/**
+ * Back the buffers of pools created afterwards with av_buffer_pool_init() from
+ * huge pages where the system supports them, if the buffers are at least
+ * min_size bytes large and the pool uses the default allocator,
+ * av_buffer_alloc() or av_buffer_allocz().
+ *
+ * Such pools carve their buffers out of larger slabs mapped in huge pages, so
+ * that processing large frames causes fewer TLB misses. Explicitly reserved
+ * huge pages are used if available, transparent huge pages otherwise. The
+ * memory of a slab is only returned to the system once all the buffers in it
+ * are freed.
+ *
+ * By default, i.e. with min_size 0, huge pages are not used.
+ *
+ * @note This is a global setting affecting all pools created afterwards in
+ *       the process, it is meant to be set by the application at startup.
+ */
+void av_buffer_pool_set_huge_page_threshold(size_t min_size);
+
 /**
  * Allocate and initialize a buffer pool with a more complex allocator.
  *
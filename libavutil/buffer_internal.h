@@ -76,7 +76,16 @@ typedef struct BufferPoolEntry {
     void (*free)(void *opaque, uint8_t *data);
 
     AVBufferPool *pool;
-    struct BufferPoolEntry *next;
+
+    /*
+     * Index of this entry in the pool, and the index+1 of the next entry in
+     * the free list (0 for none), see AVBufferPool.free_list. Entries past
+     * the index space have POOL_IDX_MASK as index and are linked through
+     * overflow_next instead.
+     */
+    unsigned idx;
+    atomic_uint next;
+    struct BufferPoolEntry *overflow_next;
 
     /*
      * An AVBuffer structure to (re)use as AVBuffer for subsequent uses
@@ -85,9 +94,51 @@ typedef struct BufferPoolEntry {
     AVBuffer buffer;
 } BufferPoolEntry;
 
+/*
+ * The free list head is a pointer-sized word, so that updating it does not
+ * need a 64-bit compare-and-swap (and libatomic) on 32-bit targets. Pool
+ * entries are referred to by an index in its low bits, leaving the rest for
+ * the ABA counter: 16 and 48 bits on 64-bit targets, 10 and 22 bits
+ * otherwise. Further entries use the mutex-protected overflow list.
+ */
+#if UINTPTR_MAX > UINT32_MAX
+#define POOL_IDX_BITS    16
+#else
+#define POOL_IDX_BITS    10
+#endif
+#define POOL_IDX_MASK    ((1 << POOL_IDX_BITS) - 1)
+#define POOL_CHUNK0_SIZE 8
+#define POOL_NB_CHUNKS   14
+
 struct AVBufferPool {
+    /*
+     * Serializes the alloc callbacks and the creation of new entries; getting
+     * and releasing pooled buffers does not need it.
+     */
     AVMutex mutex;
-    BufferPoolEntry *pool;
+
+    /*
+     * Entries are stored in chunks of growing size, chunk i holding
+     * POOL_CHUNK0_SIZE << i entries, so that they never move once created.
+     */
+    BufferPoolEntry *chunks[POOL_NB_CHUNKS];
+    unsigned      nb_entries;
+
+    /*
+     * Lock-free stack of the unused entries. The low POOL_IDX_BITS hold the
+     * index+1 of the top entry (0 when empty), the rest is a counter
+     * incremented on every update so that a stale head does not compare equal
+     * unless the counter wrapped around meanwhile.
+     * Entries are only freed with the pool, as a thread losing a race may
+     * still read one, so their number is that of the buffers in use at once.
+     */
+    atomic_uintptr_t free_list;
+
+    /*
+     * Unused entries created once all POOL_IDX_MASK indices were taken, i.e.
+     * with that many buffers in use at once; protected by mutex.
+     */
+    BufferPoolEntry *overflow;
 
     /*
      * This is used to track when the pool is to be freed.
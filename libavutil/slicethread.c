@@ -20,6 +20,7 @@
 #include "cpu.h"
 #include "internal.h"
 #include "slicethread.h"
+#include "threadpool.h"
 #include "mem.h"
 #include "thread.h"
 #include "avassert.h"
@@ -36,6 +37,19 @@ typedef struct WorkerContext {
     int             done;
 } WorkerContext;
 
+typedef struct ThreadPool {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    pthread_t       *threads;
+    int             nb_threads;
+    AVSliceThread   *tasks;         ///< contexts waiting for helpers, protected by mutex
+    int             finished;
+    atomic_int      refcount;
+} ThreadPool;
+
+static AVMutex     pool_lock = AV_MUTEX_INITIALIZER;
+static ThreadPool *global_pool;
+
 struct AVSliceThread {
     WorkerContext   *workers;
     int             nb_threads;
@@ -52,6 +66,13 @@ struct AVSliceThread {
     void            *priv;
     void            (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads);
     void            (*main_func)(void *priv);
+
+    /* shared pool mode, all protected by pool->mutex */
+    ThreadPool      *pool;
+    AVSliceThread   *next_task;
+    int             queued;
+    int             nb_participants;
+    int             nb_running;
 };
 
 static int run_jobs(AVSliceThread *ctx)
@@ -95,17 +116,228 @@ static void *attribute_align_arg thread_worker(void *v)
     }
 }
 
+static void run_pooled_jobs(AVSliceThread *ctx, int threadnr)
+{
+    unsigned nb_jobs = ctx->nb_jobs;
+    unsigned jobnr;
+
+    while ((jobnr = atomic_fetch_add_explicit(&ctx->current_job, 1, memory_order_acq_rel)) < nb_jobs)
+        ctx->worker_func(ctx->priv, jobnr, threadnr, nb_jobs, ctx->nb_active_threads);
+}
+
+static void pool_remove_task(ThreadPool *pool, AVSliceThread *ctx)
+{
+    AVSliceThread **p = &pool->tasks;
+
+    while (*p != ctx)
+        p = &(*p)->next_task;
+    *p = ctx->next_task;
+    ctx->next_task = NULL;
+    ctx->queued    = 0;
+}
+
+static void *attribute_align_arg pool_worker(void *v)
+{
+    ThreadPool *pool = v;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->finished) {
+        AVSliceThread *ctx = pool->tasks;
+        int threadnr;
+
+        if (!ctx) {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+            continue;
+        }
+
+        /* all jobs already claimed, nothing left to steal */
+        if (atomic_load_explicit(&ctx->current_job, memory_order_relaxed) >= ctx->nb_jobs) {
+            pool_remove_task(pool, ctx);
+            continue;
+        }
+
+        threadnr = ctx->nb_participants++;
+        ctx->nb_running++;
+        if (ctx->nb_participants == ctx->nb_active_threads)
+            pool_remove_task(pool, ctx);
+        pthread_mutex_unlock(&pool->mutex);
+
+        run_pooled_jobs(ctx, threadnr);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (!--ctx->nb_running)
+            pthread_cond_signal(&ctx->done_cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+static void pool_free(ThreadPool **ppool)
+{
+    ThreadPool *pool = *ppool;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->finished = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->nb_threads; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->mutex);
+    av_freep(&pool->threads);
+    av_freep(ppool);
+}
+
+static void pool_unref(ThreadPool **ppool)
+{
+    if (!*ppool)
+        return;
+
+    if (atomic_fetch_sub_explicit(&(*ppool)->refcount, 1, memory_order_acq_rel) == 1)
+        pool_free(ppool);
+    *ppool = NULL;
+}
+
+static int pool_alloc(ThreadPool **ppool, int nb_threads)
+{
+    ThreadPool *pool;
+    int ret;
+
+    pool = av_mallocz(sizeof(*pool));
+    if (!pool)
+        return AVERROR(ENOMEM);
+
+    pool->threads = av_calloc(nb_threads, sizeof(*pool->threads));
+    if (!pool->threads) {
+        av_free(pool);
+        return AVERROR(ENOMEM);
+    }
+
+    ret = pthread_mutex_init(&pool->mutex, NULL);
+    if (ret) {
+        av_free(pool->threads);
+        av_free(pool);
+        return AVERROR(ret);
+    }
+    ret = pthread_cond_init(&pool->cond, NULL);
+    if (ret) {
+        pthread_mutex_destroy(&pool->mutex);
+        av_free(pool->threads);
+        av_free(pool);
+        return AVERROR(ret);
+    }
+    atomic_init(&pool->refcount, 1);
+
+    for (; pool->nb_threads < nb_threads; pool->nb_threads++) {
+        ret = pthread_create(&pool->threads[pool->nb_threads], NULL, pool_worker, pool);
+        if (ret) {
+            pool_free(&pool);
+            return AVERROR(ret);
+        }
+    }
+
+    *ppool = pool;
+    return 0;
+}
+
+static void pool_execute(AVSliceThread *ctx)
+{
+    ThreadPool *pool = ctx->pool;
+    int nb_helpers   = ctx->nb_active_threads - 1;
+
+    atomic_store_explicit(&ctx->current_job, 0, memory_order_relaxed);
+
+    /* the calling thread always takes part, so execution can never stall
+     * waiting for a pool worker, even when called from inside one */
+    if (nb_helpers) {
+        AVSliceThread **p = &pool->tasks;
+
+        pthread_mutex_lock(&pool->mutex);
+        ctx->nb_participants = 1;
+        ctx->nb_running      = 1;
+        while (*p)
+            p = &(*p)->next_task;
+        *p          = ctx;
+        ctx->queued = 1;
+        for (int i = 0; i < FFMIN(nb_helpers, pool->nb_threads); i++)
+            pthread_cond_signal(&pool->cond);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    run_pooled_jobs(ctx, 0);
+
+    if (nb_helpers) {
+        pthread_mutex_lock(&pool->mutex);
+        if (ctx->queued)
+            pool_remove_task(pool, ctx);
+        ctx->nb_running--;
+        while (ctx->nb_running)
+            pthread_cond_wait(&ctx->done_cond, &pool->mutex);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+int av_thread_pool_set_global(int nb_threads)
+{
+    ThreadPool *pool = NULL;
+    int ret;
+
+    if (nb_threads < 0)
+        return AVERROR(EINVAL);
+    if (!nb_threads)
+        nb_threads = av_cpu_count();
+
+    ret = pool_alloc(&pool, nb_threads);
+    if (ret < 0)
+        return ret;
+
+    ff_mutex_lock(&pool_lock);
+    FFSWAP(ThreadPool*, pool, global_pool);
+    ff_mutex_unlock(&pool_lock);
+
+    pool_unref(&pool);
+
+    return nb_threads;
+}
+
+void av_thread_pool_free_global(void)
+{
+    ThreadPool *pool;
+
+    ff_mutex_lock(&pool_lock);
+    pool        = global_pool;
+    global_pool = NULL;
+    ff_mutex_unlock(&pool_lock);
+
+    pool_unref(&pool);
+}
+
 int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
                               void (*worker_func)(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads),
                               void (*main_func)(void *priv),
                               int nb_threads)
 {
     AVSliceThread *ctx;
+    ThreadPool *pool = NULL;
     int nb_workers, i;
     int ret;
 
     av_assert0(nb_threads >= 0);
-    if (!nb_threads) {
+
+    /* main_func may block on the workers, so such contexts keep their own */
+    if (!main_func) {
+        ff_mutex_lock(&pool_lock);
+        if ((pool = global_pool))
+            atomic_fetch_add_explicit(&pool->refcount, 1, memory_order_relaxed);
+        ff_mutex_unlock(&pool_lock);
+    }
+
+    if (!nb_threads && pool) {
+        nb_threads = FFMIN(pool->nb_threads + 1, MAX_AUTO_THREADS);
+    } else if (!nb_threads) {
         int nb_cpus = av_cpu_count();
         if (nb_cpus > 1)
             nb_threads = FFMIN(nb_cpus + 1, MAX_AUTO_THREADS);
@@ -116,16 +348,21 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
     nb_workers = nb_threads;
     if (!main_func)
         nb_workers--;
+    if (pool)
+        nb_workers = 0;
 
     *pctx = ctx = av_mallocz(sizeof(*ctx));
-    if (!ctx)
+    if (!ctx) {
+        pool_unref(&pool);
         return AVERROR(ENOMEM);
+    }
 
     if (nb_workers && !(ctx->workers = av_calloc(nb_workers, sizeof(*ctx->workers)))) {
         av_freep(pctx);
         return AVERROR(ENOMEM);
     }
 
+    ctx->pool        = pool;
     ctx->priv        = priv;
     ctx->worker_func = worker_func;
     ctx->main_func   = main_func;
@@ -138,6 +375,7 @@ int avpriv_slicethread_create(AVSliceThread **pctx, void *priv,
     atomic_init(&ctx->current_job, 0);
     ret = pthread_mutex_init(&ctx->done_mutex, NULL);
     if (ret) {
+        pool_unref(&ctx->pool);
         av_freep(&ctx->workers);
         av_freep(pctx);
         return AVERROR(ret);
@@ -194,6 +432,12 @@ void avpriv_slicethread_execute(AVSliceThread *ctx, int nb_jobs, int execute_mai
     av_assert0(nb_jobs > 0);
     ctx->nb_jobs           = nb_jobs;
     ctx->nb_active_threads = FFMIN(nb_jobs, ctx->nb_threads);
+
+    if (ctx->pool) {
+        pool_execute(ctx);
+        return;
+    }
+
     atomic_store_explicit(&ctx->first_job, 0, memory_order_relaxed);
     atomic_store_explicit(&ctx->current_job, ctx->nb_active_threads, memory_order_relaxed);
     nb_workers             = ctx->nb_active_threads;
@@ -234,6 +478,8 @@ void avpriv_slicethread_free(AVSliceThread **pctx)
     nb_workers = ctx->nb_threads;
     if (!ctx->main_func)
         nb_workers--;
+    if (ctx->pool)
+        nb_workers = 0;
 
     ctx->finished = 1;
     for (i = 0; i < nb_workers; i++) {
@@ -251,6 +497,7 @@ void avpriv_slicethread_free(AVSliceThread **pctx)
         pthread_mutex_destroy(&w->mutex);
     }
 
+    pool_unref(&ctx->pool);
     pthread_cond_destroy(&ctx->done_cond);
     pthread_mutex_destroy(&ctx->done_mutex);
     av_freep(&ctx->workers);
@@ -278,4 +525,13 @@ void avpriv_slicethread_free(AVSliceThread **pctx)
     av_assert0(!pctx || !*pctx);
 }
 
+int av_thread_pool_set_global(int nb_threads)
+{
+    return AVERROR(ENOSYS);
+}
+
+void av_thread_pool_free_global(void)
+{
+}
+
 #endif /* HAVE_PTHREADS || HAVE_W32THREADS || HAVE_OS32THREADS */
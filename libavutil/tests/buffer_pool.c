@@ -0,0 +1,286 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/buffer.h"
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#define MAX_THREADS 64
+#define MAX_HELD    4
+#define BUF_SIZE    64
+
+typedef struct TestContext {
+    AVBufferPool *pool;
+    int           nb_allocs;
+    int           iterations;
+    atomic_int    errors;
+} TestContext;
+
+typedef struct ThreadContext {
+    TestContext *t;
+    pthread_t    thread;
+    int          id;
+} ThreadContext;
+
+static AVBufferRef *test_alloc(void *opaque, size_t size)
+{
+    TestContext *t = opaque;
+
+    // called with the pool lock held
+    t->nb_allocs++;
+
+    return av_buffer_alloc(size);
+}
+
+static void *worker(void *arg)
+{
+    ThreadContext *tc = arg;
+    TestContext    *t = tc->t;
+    AVBufferRef *held[MAX_HELD] = { NULL };
+
+    for (int i = 0; i < t->iterations; i++) {
+        // keep a varying number of buffers to shuffle the free list order
+        int idx = (i * 7 + tc->id) % MAX_HELD;
+
+        if (held[idx]) {
+            // another thread owning the same buffer would have overwritten it
+            for (int j = 0; j < BUF_SIZE; j++)
+                if (held[idx]->data[j] != (uint8_t)(tc->id + i)) {
+                    atomic_fetch_add(&t->errors, 1);
+                    break;
+                }
+            av_buffer_unref(&held[idx]);
+        }
+
+        held[idx] = av_buffer_pool_get(t->pool);
+        if (!held[idx]) {
+            atomic_fetch_add(&t->errors, 1);
+            break;
+        }
+        // retag all held buffers with the current iteration
+        for (int j = 0; j < MAX_HELD; j++)
+            if (held[j])
+                memset(held[j]->data, tc->id + i + 1, BUF_SIZE);
+    }
+
+    for (int j = 0; j < MAX_HELD; j++)
+        av_buffer_unref(&held[j]);
+
+    return NULL;
+}
+
+static int run_threads(TestContext *t, int nb_threads)
+{
+    ThreadContext tc[MAX_THREADS];
+    int started;
+
+    for (started = 0; started < nb_threads; started++) {
+        tc[started].t  = t;
+        tc[started].id = started;
+        if (pthread_create(&tc[started].thread, NULL, worker, &tc[started]))
+            break;
+    }
+    for (int i = 0; i < started; i++)
+        pthread_join(tc[i].thread, NULL);
+
+    return started == nb_threads ? 0 : -1;
+}
+
+static int test_single(void)
+{
+    TestContext t = { 0 };
+    AVBufferRef *bufs[16];
+    uint8_t *data[16];
+    int reused = 0;
+
+    t.pool = av_buffer_pool_init2(BUF_SIZE, &t, test_alloc, NULL);
+    if (!t.pool)
+        return 1;
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(bufs); i++) {
+        bufs[i] = av_buffer_pool_get(t.pool);
+        if (!bufs[i])
+            return 1;
+        data[i] = bufs[i]->data;
+    }
+    for (int i = 0; i < FF_ARRAY_ELEMS(bufs); i++)
+        av_buffer_unref(&bufs[i]);
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(bufs); i++) {
+        bufs[i] = av_buffer_pool_get(t.pool);
+        if (!bufs[i])
+            return 1;
+        for (int j = 0; j < FF_ARRAY_ELEMS(data); j++)
+            reused += bufs[i]->data == data[j];
+    }
+
+    // uninit with buffers still in use, they are freed on release
+    av_buffer_pool_uninit(&t.pool);
+    for (int i = 0; i < FF_ARRAY_ELEMS(bufs); i++)
+        av_buffer_unref(&bufs[i]);
+
+    printf("single: allocs %d reused %d\n", t.nb_allocs, reused);
+
+    return 0;
+}
+
+static int test_overflow(void)
+{
+    // more buffers in use at once than there are lock-free pool indices
+    const int nb_bufs = 70000;
+    TestContext t = { 0 };
+    AVBufferRef **bufs;
+    int failed = 0;
+
+    bufs = av_calloc(nb_bufs, sizeof(*bufs));
+    t.pool = av_buffer_pool_init2(16, &t, test_alloc, NULL);
+    if (!bufs || !t.pool)
+        return 1;
+
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < nb_bufs; i++)
+            failed += !(bufs[i] = av_buffer_pool_get(t.pool));
+        for (int i = 0; i < nb_bufs; i++)
+            av_buffer_unref(&bufs[i]);
+    }
+
+    av_buffer_pool_uninit(&t.pool);
+    av_freep(&bufs);
+
+    printf("overflow: allocs %d failed %d\n", t.nb_allocs, failed);
+
+    return 0;
+}
+
+static int test_huge_pages(void)
+{
+    AVBufferPool *pool;
+    AVBufferRef *bufs[32] = { NULL };
+    size_t size = 300000;
+    int zeroed = 1, aligned = 1, intact = 1;
+
+    av_buffer_pool_set_huge_page_threshold(size);
+    pool = av_buffer_pool_init(size, av_buffer_allocz);
+    av_buffer_pool_set_huge_page_threshold(0);
+    if (!pool)
+        return 1;
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(bufs); i++) {
+        bufs[i] = av_buffer_pool_get(pool);
+        if (!bufs[i])
+            return 1;
+        for (size_t j = 0; j < size; j++)
+            zeroed &= !bufs[i]->data[j];
+        aligned &= !((uintptr_t)bufs[i]->data & 63);
+        memset(bufs[i]->data, i, size);
+    }
+    // buffers carved out of the same slab must not overlap
+    for (int i = 0; i < FF_ARRAY_ELEMS(bufs); i++)
+        for (size_t j = 0; j < size; j++)
+            intact &= bufs[i]->data[j] == i;
+
+    av_buffer_pool_uninit(&pool);
+    for (int i = 0; i < FF_ARRAY_ELEMS(bufs); i++)
+        av_buffer_unref(&bufs[i]);
+
+    printf("huge pages: zeroed %d aligned %d intact %d\n", zeroed, aligned, intact);
+
+    return 0;
+}
+
+static int test_threads(int nb_threads)
+{
+    TestContext t = { .iterations = 20000 };
+    int ret;
+
+    atomic_init(&t.errors, 0);
+
+    t.pool = av_buffer_pool_init2(BUF_SIZE, &t, test_alloc, NULL);
+    if (!t.pool)
+        return 1;
+
+    ret = run_threads(&t, nb_threads);
+    av_buffer_pool_uninit(&t.pool);
+    if (ret < 0)
+        return 1;
+
+    printf("threads %d: errors %d, allocs %s\n", nb_threads,
+           atomic_load(&t.errors),
+           t.nb_allocs <= nb_threads * MAX_HELD ? "bounded" : "unbounded");
+
+    return 0;
+}
+
+static int bench(int max_threads)
+{
+    for (int nb_threads = 1; nb_threads <= max_threads; nb_threads *= 2) {
+        TestContext t = { .iterations = 1000000 };
+        int64_t start, elapsed;
+        int ret;
+
+        atomic_init(&t.errors, 0);
+
+        t.pool = av_buffer_pool_init2(BUF_SIZE, &t, test_alloc, NULL);
+        if (!t.pool)
+            return 1;
+
+        start   = av_gettime_relative();
+        ret     = run_threads(&t, nb_threads);
+        elapsed = av_gettime_relative() - start;
+        av_buffer_pool_uninit(&t.pool);
+        if (ret < 0)
+            return 1;
+
+        printf("threads %2d: %8.1f ns per get/release, %.2f M/s total%s\n",
+               nb_threads, elapsed * 1000.0 / t.iterations,
+               (double)t.iterations * nb_threads / elapsed,
+               atomic_load(&t.errors) ? " ERRORS" : "");
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && !strcmp(argv[1], "-b")) {
+        int max_threads = argc >= 3 ? atoi(argv[2]) : 8;
+        return bench(av_clip(max_threads, 1, MAX_THREADS));
+    }
+
+    if (test_single())
+        return 1;
+
+    if (test_overflow())
+        return 1;
+
+    if (test_huge_pages())
+        return 1;
+
+    for (int nb_threads = 1; nb_threads <= 8; nb_threads *= 2)
+        if (test_threads(nb_threads))
+            return 1;
+
+    return 0;
+}
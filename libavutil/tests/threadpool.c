@@ -0,0 +1,197 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "libavutil/slicethread.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadpool.h"
+
+#define MAX_JOBS   1024
+#define MAX_INNER  4
+
+typedef struct Jobs {
+    AVSliceThread *thread;
+    atomic_int     runs[MAX_JOBS];
+    atomic_int     nb_on_caller;
+    pthread_t      caller;
+
+    /* jobs blocking until released */
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    int             nb_started;
+    int             released;
+
+    /* contexts executed from inside the jobs, one per thread */
+    struct Jobs    *inner;
+} Jobs;
+
+static void count_job(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
+{
+    Jobs *j = priv;
+
+    atomic_fetch_add(&j->runs[jobnr], 1);
+    if (pthread_equal(pthread_self(), j->caller))
+        atomic_fetch_add(&j->nb_on_caller, 1);
+}
+
+static void blocking_job(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
+{
+    Jobs *j = priv;
+
+    atomic_fetch_add(&j->runs[jobnr], 1);
+    pthread_mutex_lock(&j->mutex);
+    j->nb_started++;
+    pthread_cond_broadcast(&j->cond);
+    while (!j->released)
+        pthread_cond_wait(&j->cond, &j->mutex);
+    pthread_mutex_unlock(&j->mutex);
+}
+
+static void nested_job(void *priv, int jobnr, int threadnr, int nb_jobs, int nb_threads)
+{
+    Jobs *j = priv;
+    Jobs *inner = &j->inner[threadnr];
+
+    atomic_fetch_add(&j->runs[jobnr], 1);
+    inner->caller = pthread_self();
+    avpriv_slicethread_execute(inner->thread, 8, 0);
+}
+
+static int jobs_init(Jobs *j, void (*func)(void *, int, int, int, int), int nb_threads)
+{
+    for (int i = 0; i < MAX_JOBS; i++)
+        atomic_init(&j->runs[i], 0);
+    atomic_init(&j->nb_on_caller, 0);
+    j->caller = pthread_self();
+    return avpriv_slicethread_create(&j->thread, j, func, NULL, nb_threads);
+}
+
+/* number of jobs among the first nb_jobs that ran other than nb_runs times */
+static int jobs_check(Jobs *j, int nb_jobs, int nb_runs)
+{
+    int nb_wrong = 0;
+
+    for (int i = 0; i < MAX_JOBS; i++)
+        nb_wrong += atomic_load(&j->runs[i]) != (i < nb_jobs ? nb_runs : 0);
+    return nb_wrong;
+}
+
+static void test_run(const char *name, Jobs *j, int nb_jobs, int nb_runs)
+{
+    for (int i = 0; i < MAX_JOBS; i++)
+        atomic_store(&j->runs[i], 0);
+    for (int i = 0; i < nb_runs; i++)
+        avpriv_slicethread_execute(j->thread, nb_jobs, 0);
+    printf("%s: jobs not run once: %d\n", name, jobs_check(j, nb_jobs, nb_runs));
+}
+
+static void *execute_thread(void *arg)
+{
+    Jobs *j = arg;
+
+    avpriv_slicethread_execute(j->thread, 2, 0);
+    return NULL;
+}
+
+/* The only pool worker is held by the jobs of another context, so all the
+ * jobs must run on the calling thread. */
+static void test_busy_pool(void)
+{
+    Jobs busy = { 0 }, j = { 0 };
+    pthread_t thread;
+    int ret;
+
+    pthread_mutex_init(&busy.mutex, NULL);
+    pthread_cond_init(&busy.cond, NULL);
+    jobs_init(&busy, blocking_job, 2);
+    ret = jobs_init(&j, count_job, 2);
+
+    pthread_create(&thread, NULL, execute_thread, &busy);
+    pthread_mutex_lock(&busy.mutex);
+    while (busy.nb_started < 2)
+        pthread_cond_wait(&busy.cond, &busy.mutex);
+    pthread_mutex_unlock(&busy.mutex);
+
+    avpriv_slicethread_execute(j.thread, 16, 0);
+    printf("busy pool: threads %d, jobs not run once %d, on the calling thread %d\n",
+           ret, jobs_check(&j, 16, 1), atomic_load(&j.nb_on_caller));
+
+    pthread_mutex_lock(&busy.mutex);
+    busy.released = 1;
+    pthread_cond_broadcast(&busy.cond);
+    pthread_mutex_unlock(&busy.mutex);
+    pthread_join(thread, NULL);
+
+    avpriv_slicethread_free(&j.thread);
+    avpriv_slicethread_free(&busy.thread);
+    pthread_cond_destroy(&busy.cond);
+    pthread_mutex_destroy(&busy.mutex);
+}
+
+/* Jobs running on the pool workers execute jobs of other contexts. */
+static void test_nested(void)
+{
+    Jobs outer = { 0 }, inner[MAX_INNER] = { 0 };
+    int nb_inner = 0, nb_threads;
+
+    nb_threads = jobs_init(&outer, nested_job, MAX_INNER);
+    outer.inner = inner;
+    for (int i = 0; i < nb_threads; i++)
+        jobs_init(&inner[i], count_job, 3);
+
+    avpriv_slicethread_execute(outer.thread, 32, 0);
+    for (int i = 0; i < nb_threads; i++) {
+        for (int k = 0; k < 8; k++)
+            nb_inner += atomic_load(&inner[i].runs[k]);
+        avpriv_slicethread_free(&inner[i].thread);
+    }
+    /* each outer job ran all 8 jobs of the inner context of its thread */
+    printf("nested: outer jobs not run once %d, inner jobs run %d\n",
+           jobs_check(&outer, 32, 1), nb_inner);
+    avpriv_slicethread_free(&outer.thread);
+}
+
+int main(void)
+{
+    Jobs auto_threads = { 0 }, old_pool = { 0 };
+    int ret;
+
+    ret = av_thread_pool_set_global(3);
+    printf("pool: %d workers\n", ret);
+
+    ret = jobs_init(&auto_threads, count_job, 0);
+    printf("automatic: %d threads\n", ret);
+    test_run("automatic", &auto_threads, MAX_JOBS, 10);
+    avpriv_slicethread_free(&auto_threads.thread);
+
+    jobs_init(&old_pool, count_job, 8);
+    test_run("more threads than workers", &old_pool, 100, 10);
+
+    av_thread_pool_set_global(1);
+    test_busy_pool();
+    test_nested();
+
+    /* a replaced or freed pool lives as long as the contexts using it */
+    av_thread_pool_free_global();
+    test_run("after free", &old_pool, 100, 20);
+    avpriv_slicethread_free(&old_pool.thread);
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVUTIL_THREADPOOL_H
+#define AVUTIL_THREADPOOL_H
+
+/**
+ * @file
+ * @ingroup lavu_thread_pool
+ * Process-wide shared worker pool.
+ */
+
+/**
+ * @defgroup lavu_thread_pool Shared thread pool
+ * @ingroup lavu_misc
+ *
+ * By default every slice threaded context (codec slice threading, filtergraph
+ * threading, swscale threading) spawns its own worker threads. Once a global
+ * pool is installed, contexts created afterwards instead run their jobs on the
+ * pool's workers, so the number of worker threads stays the same no matter
+ * how many codecs, filtergraphs and scalers are instantiated.
+ *
+ * The thread calling the execute function always takes part in the work, and
+ * idle pool workers join whichever context has unclaimed jobs. At most the
+ * pool's workers plus the threads calling execute run jobs at once. The
+ * number of jobs is unaffected. The thread count of contexts created with 0
+ * (automatic) threads is derived from the pool size instead of the number of
+ * CPUs.
+ *
+ * Only slice threading goes through the pool. Frame threading, the codecs
+ * whose slice threading has a main function blocking on the workers (vp9),
+ * and threads created by external libraries keep their own threads.
+ *
+ * @{
+ */
+
+/**
+ * Install a global pool of worker threads.
+ *
+ * Contexts created before this call keep using the threads they already
+ * own. A previously installed pool is released and its threads exit once
+ * the last context using it is freed.
+ *
+ * @param nb_threads number of worker threads, 0 for one per CPU
+ * @return number of worker threads or a negative AVERROR code on failure
+ */
+int av_thread_pool_set_global(int nb_threads);
+
+/**
+ * Uninstall the global pool. Contexts created afterwards spawn their own
+ * threads again, those still attached keep the pool alive until freed.
+ */
+void av_thread_pool_free_global(void);
+
+/**
+ * @}
+ */
+
+#endif /* AVUTIL_THREADPOOL_H */
@@ -264,6 +264,17 @@ fate-ffmpeg-loopback-decoding: CMD = transcode \
     "-map 0:v:0 -c:v mpeg2video -f null - -flags +bitexact -idct simple -threads $$threads -dec 0:0 -filter_complex '[0:v][dec:0]hstack[stack]' -map '[stack]' -c:v ffv1" ""
 FATE_FFMPEG-$(call ENCDEC2, MPEG2VIDEO, FFV1, NUT, HSTACK_FILTER PIPE_PROTOCOL FRAMECRC_MUXER) += fate-ffmpeg-loopback-decoding
 
+# Test the latency-bounded mode: MPEG-2 with B-frames must decode as usual, and
+# the audio packet durations change mid-stream, changing the queue limits.
+fate-ffmpeg-sched-latency: tests/data/vsynth1.yuv
+fate-ffmpeg-sched-latency: CMD = transcode \
+    "rawvideo -s 352x288 -pix_fmt yuv420p" $(TARGET_PATH)/tests/data/vsynth1.yuv nut \
+    "-map 0:v -map 1:a -c:v mpeg2video -bf 2 -qscale 10 -c:a pcm_s16le -t 2" \
+    "-c:v rawvideo -c:a pcm_s16le" "" \
+    "-f lavfi -i sine=d=2:samples_per_frame=256+3840*(1-ceil(trunc(n/20)/1000))" \
+    "-sched_latency 100ms"
+FATE_FFMPEG-$(call ENCDEC2, MPEG2VIDEO, PCM_S16LE, NUT, SINE_FILTER LAVFI_INDEV FRAMECRC_MUXER) += fate-ffmpeg-sched-latency
+
 # test matching by stream disposition
 fate-ffmpeg-spec-disposition: CMD = framecrc -i $(TARGET_SAMPLES)/mpegts/pmtchange.ts -map '0:disp:visual_impaired+descriptions:1' -c copy
 FATE_SAMPLES_FFMPEG-$(call FRAMECRC, MPEGTS,,) += fate-ffmpeg-spec-disposition
@@ -164,6 +164,16 @@ FATE_FILTER-$(call FILTERFRAMECRC, MINTERPOLATE TESTSRC2) += fate-filter-minterp
 fate-filter-minterpolate-up: CMD = framecrc -lavfi testsrc2=r=2:d=10,minterpolate=fps=10 -t 1
 fate-filter-minterpolate-down: CMD = framecrc -lavfi testsrc2=r=2:d=10,minterpolate=fps=1 -t 1
 
+# the predictive motion search runs the block rows as a wavefront on threads
+FATE_FILTER-$(call FILTERFRAMECRC, MINTERPOLATE TESTSRC2) += fate-filter-minterpolate-up-threads
+fate-filter-minterpolate-up-threads: CMD = framecrc -filter_threads 4 -lavfi testsrc2=r=2:d=10,minterpolate=fps=10 -t 1
+fate-filter-minterpolate-up-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-minterpolate-up
+
+FATE_FILTER-$(call FILTERFRAMECRC, MESTIMATE CODECVIEW TESTSRC2) += fate-filter-mestimate-umh fate-filter-mestimate-umh-threads
+fate-filter-mestimate-umh: CMD = framecrc -lavfi testsrc2=r=5:d=2,mestimate=umh,codecview=mvt=fp+bp -t 1
+fate-filter-mestimate-umh-threads: CMD = framecrc -filter_threads 4 -lavfi testsrc2=r=5:d=2,mestimate=umh,codecview=mvt=fp+bp -t 1
+fate-filter-mestimate-umh-threads: REF = $(SRC_PATH)/tests/ref/fate/filter-mestimate-umh
+
 FATE_FILTER_VSYNTH_PGMYUV-$(CONFIG_BOXBLUR_FILTER) += fate-filter-boxblur
 fate-filter-boxblur: CMD = framecrc -c:v pgmyuv -i $(SRC) -vf boxblur=2:1
 
@@ -799,6 +809,13 @@ FATE_FILTER-$(call ALLYES, TESTSRC2_FILTER SPLIT_FILTER AVGBLUR_FILTER        \
                            METADATA_FILTER WRAPPED_AVFRAME_ENCODER NULL_MUXER \
                            PIPE_PROTOCOL) += $(FATE_FILTER_REFCMP_METADATA-yes)
 
+FATE_FILTER-$(call ALLYES, TESTSRC2_FILTER FORMAT_FILTER SPLIT_FILTER      \
+                           AVGBLUR_FILTER CROP_FILTER PAD_FILTER HUE_FILTER   \
+                           DRAWBOX_FILTER VFLIP_FILTER HSTACK_FILTER          \
+                           VSTACK_FILTER) += fate-filter-graph-threads
+fate-filter-graph-threads: libavfilter/tests/graphthreads$(EXESUF)
+fate-filter-graph-threads: CMD = run libavfilter/tests/graphthreads$(EXESUF)
+
 FATE_SAMPLES_FFPROBE += $(FATE_METADATA_FILTER-yes)
 FATE_SAMPLES_FFMPEG += $(FATE_FILTER_SAMPLES-yes)
 FATE_FFMPEG += $(FATE_FILTER-yes)
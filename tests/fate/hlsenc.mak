@@ -41,6 +41,13 @@ fate-hls-live-endlist: CMD = md5 -i $(SRC) -af hdcd=process_stereo=false -t 20 -
 fate-hls-live-endlist: CMP = oneline
 fate-hls-live-endlist: REF = e189ce781d9c87882f58e3929455167b
 
+FATE_HLSENC-$(call ALLYES, HLS_DEMUXER MPEGTS_MUXER MPEGTS_DEMUXER AEVALSRC_FILTER ARESAMPLE_FILTER LAVFI_INDEV MP2FIXED_ENCODER) += fate-hls-prefetch
+fate-hls-prefetch: tests/data/live_endlist.m3u8
+fate-hls-prefetch: SRC = $(TARGET_PATH)/tests/data/live_endlist.m3u8
+fate-hls-prefetch: CMD = md5 -prefetch_segments 3 -prefetch_threads 2 -prefetch_max_size 32768 -i $(SRC) -af hdcd=process_stereo=false -t 20 -f s24le
+fate-hls-prefetch: CMP = oneline
+fate-hls-prefetch: REF = e189ce781d9c87882f58e3929455167b
+
 tests/data/hls_segment_size.m3u8: TAG = GEN
 tests/data/hls_segment_size.m3u8: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
 	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
@@ -6,6 +6,26 @@ FATE_LIBAVFORMAT-$(CONFIG_NETWORK) += fate-noproxy
 fate-noproxy: libavformat/tests/noproxy$(EXESUF)
 fate-noproxy: CMD = run libavformat/tests/noproxy$(EXESUF)
 
+FATE_HTTPPOOL-$(HAVE_THREADS) += fate-httppool
+FATE_LIBAVFORMAT-$(CONFIG_HTTP_PROTOCOL) += $(FATE_HTTPPOOL-yes)
+fate-httppool: libavformat/tests/httppool$(EXESUF)
+fate-httppool: CMD = run libavformat/tests/httppool$(EXESUF)
+
+tests/data/dash_prefetch.mpd: TAG = GEN
+tests/data/dash_prefetch.mpd: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i "aevalsrc=sin(2*PI*440*t):d=6" -f lavfi -i "aevalsrc=sin(2*PI*660*t):d=6" \
+        -map 0 -map 1 -codec:a mp2fixed -f dash -seg_duration 1 \
+        -init_seg_name 'dash_prefetch-init-$$RepresentationID$$.m4s' \
+        -media_seg_name 'dash_prefetch-chunk-$$RepresentationID$$-$$Number%05d$$.m4s' \
+        $(TARGET_PATH)/tests/data/dash_prefetch.mpd 2>/dev/null
+
+# prefetching DASH fragments from a local HTTP server
+FATE_SEGPREFETCH-$(call ALLYES, DASH_MUXER DASH_DEMUXER MOV_DEMUXER AEVALSRC_FILTER ARESAMPLE_FILTER LAVFI_INDEV MP2FIXED_ENCODER HTTP_PROTOCOL FFMPEG) += fate-segprefetch
+FATE_LIBAVFORMAT-$(HAVE_THREADS) += $(FATE_SEGPREFETCH-yes)
+fate-segprefetch: tests/data/dash_prefetch.mpd libavformat/tests/segprefetch$(EXESUF)
+fate-segprefetch: CMD = run libavformat/tests/segprefetch$(EXESUF) $(TARGET_PATH)/tests/data dash_prefetch.mpd
+
 FATE_LIBAVFORMAT-$(CONFIG_FFRTMPCRYPT_PROTOCOL) += fate-rtmpdh
 fate-rtmpdh: libavformat/tests/rtmpdh$(EXESUF)
 fate-rtmpdh: CMD = run libavformat/tests/rtmpdh$(EXESUF)
@@ -241,6 +241,24 @@ fate-vsynth%-mjpeg-trell:             ENCOPTS = -qscale 9 -pix_fmt yuvj420p -tre
 fate-vsynth%-mjpeg-huffman:           ENCOPTS = -qscale 9 -pix_fmt yuvj420p -huffman optimal
 fate-vsynth%-mjpeg-trell-huffman:     ENCOPTS = -qscale 9 -pix_fmt yuvj420p -trellis 1 -huffman optimal
 
+# decoding with threads, with and without restart intervals; the encoder
+# writes a restart marker after every macroblock row when using slices
+FATE_MJPEG_THREADS-$(call TRANSCODE, MJPEG, AVI, RAWVIDEO_DEMUXER SCALE_FILTER) += fate-mjpeg-frame-threads \
+                                                                   fate-mjpeg-rst-frame-threads \
+                                                                   fate-mjpeg-rst-slice-threads
+$(FATE_MJPEG_THREADS-yes): tests/data/vsynth1.yuv
+fate-mjpeg-frame-threads:     CMD = transcode "rawvideo -s 352x288 -pix_fmt yuv420p" tests/data/vsynth1.yuv \
+                                    avi "-vf scale -c mjpeg -qscale 9 -pix_fmt yuvj420p" "" "" "" \
+                                    "-threads 3 -thread_type frame+slice"
+fate-mjpeg-rst-frame-threads: CMD = transcode "rawvideo -s 352x288 -pix_fmt yuv420p" tests/data/vsynth1.yuv \
+                                    avi "-vf scale -c mjpeg -qscale 9 -pix_fmt yuvj420p -threads 2 -slices 2" "" "" "" \
+                                    "-threads 3 -thread_type frame+slice"
+fate-mjpeg-rst-slice-threads: CMD = transcode "rawvideo -s 352x288 -pix_fmt yuv420p" tests/data/vsynth1.yuv \
+                                    avi "-vf scale -c mjpeg -qscale 9 -pix_fmt yuvj420p -threads 2 -slices 2" "" "" "" \
+                                    "-threads 3 -thread_type slice"
+FATE_FFMPEG += $(FATE_MJPEG_THREADS-yes)
+fate-mjpeg-threads: $(FATE_MJPEG_THREADS-yes)
+
 FATE_VCODEC-$(call ENCDEC, MPEG1VIDEO, MPEG1VIDEO MPEGVIDEO) += mpeg1 mpeg1b
 fate-vsynth%-mpeg1:              FMT     = mpeg1video
 fate-vsynth%-mpeg1:              CODEC   = mpeg1video
@@ -256,7 +274,9 @@ FATE_MPEG2 := mpeg2                                                     \
              mpeg2-ilace                                                \
              mpeg2-ivlc-qprd                                            \
              mpeg2-thread                                               \
-             mpeg2-thread-ivlc
+             mpeg2-thread-ivlc                                          \
+             mpeg2-frame-thread                                         \
+             mpeg2-frame-thread-ivlc
 
 FATE_VCODEC-$(call ENCDEC, MPEG2VIDEO, MPEG2VIDEO MPEGVIDEO) += $(FATE_MPEG2)
 
@@ -285,6 +305,14 @@ fate-vsynth%-mpeg2-thread:       ENCOPTS = -qscale 10 -bf 2 -flags +ildct+ilme \
                                            -threads 2 -slices 2
 fate-vsynth%-mpeg2-thread-ivlc:  ENCOPTS = -qscale 10 -bf 2 -flags +ildct+ilme \
                                            -intra_vlc 1 -threads 2 -slices 2
+fate-vsynth%-mpeg2-frame-thread: ENCOPTS = -qscale 10 -bf 2 -flags +ildct+ilme \
+                                           -threads 2 -slices 2
+fate-vsynth%-mpeg2-frame-thread-ivlc: ENCOPTS = -qscale 10 -bf 2 -flags +ildct+ilme \
+                                           -intra_vlc 1 -threads 2 -slices 2
+
+# frame threading is opt-in for the MPEG-1/2 decoders
+fate-vsynth%-mpeg2-frame-thread fate-vsynth%-mpeg2-frame-thread-ivlc: THREADS     = 2
+fate-vsynth%-mpeg2-frame-thread fate-vsynth%-mpeg2-frame-thread-ivlc: THREAD_TYPE = frame
 
 FATE_MPEG4_MP4 = mpeg4
 FATE_MPEG4_AVI = mpeg4-rc                                               \
@@ -0,0 +1,125 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Measure the throughput of the file protocol through AVIOContext, with
+ * blocking I/O and with asynchronous I/O. A scratch file is written
+ * and read back in the same way as a muxer and a demuxer would. Unless
+ * O_DIRECT is used, the reads are likely to be served from the page cache.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/dict.h"
+#include "libavutil/error.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+
+#include "libavformat/avio.h"
+
+#define CHUNK_SIZE 65536
+
+typedef struct Config {
+    const char *name;
+    const char *aio;
+    int         direct;
+} Config;
+
+static const Config configs[] = {
+    { "blocking",         "0", 0 },
+    { "threads",          "1", 0 },
+    { "threads+direct",   "1", 1 },
+};
+
+static int run(const char *filename, const Config *cfg, int64_t size,
+               uint8_t *buf, double *write_rate, double *read_rate)
+{
+    AVIOContext *pb = NULL;
+    AVDictionary *opts = NULL;
+    int64_t start, done = 0;
+    int ret;
+
+    av_dict_set(&opts, "aio", cfg->aio, 0);
+    av_dict_set_int(&opts, "direct", cfg->direct, 0);
+
+    start = av_gettime_relative();
+    ret = avio_open2(&pb, filename, AVIO_FLAG_WRITE, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+    for (int64_t pos = 0; pos < size; pos += CHUNK_SIZE)
+        avio_write(pb, buf, FFMIN(CHUNK_SIZE, size - pos));
+    ret = avio_closep(&pb);
+    if (ret < 0)
+        return ret;
+    *write_rate = size / 1e3 / (av_gettime_relative() - start);
+
+    av_dict_set(&opts, "aio", cfg->aio, 0);
+    av_dict_set_int(&opts, "direct", cfg->direct, 0);
+
+    start = av_gettime_relative();
+    ret = avio_open2(&pb, filename, AVIO_FLAG_READ, NULL, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+    while ((ret = avio_read(pb, buf, CHUNK_SIZE)) > 0)
+        done += ret;
+    avio_closep(&pb);
+    if (done != size)
+        return ret < 0 && ret != AVERROR_EOF ? ret : AVERROR(EIO);
+    *read_rate = size / 1e3 / (av_gettime_relative() - start);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int64_t size = 1024;
+    uint8_t *buf;
+
+    if (argc < 2 || argc > 3 || (argc == 3 && (size = strtoll(argv[2], NULL, 0)) <= 0)) {
+        fprintf(stderr, "Usage: %s <scratch file> [size in MB]\n", argv[0]);
+        return 1;
+    }
+    size *= 1000000;
+
+    buf = av_malloc(CHUNK_SIZE);
+    if (!buf)
+        return 1;
+    for (int i = 0; i < CHUNK_SIZE; i++)
+        buf[i] = i * 7;
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(configs); i++) {
+        double write_rate, read_rate;
+        int ret = run(argv[1], &configs[i], size, buf, &write_rate, &read_rate);
+
+        if (ret < 0)
+            printf("%-16s failed: %s\n", configs[i].name, av_err2str(ret));
+        else
+            printf("%-16s write %6.2f GB/s, read %6.2f GB/s\n",
+                   configs[i].name, write_rate, read_rate);
+    }
+
+    remove(argv[1]);
+    av_free(buf);
+
+    return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Measure the effect of backing frame pools with huge pages on a
+ * decode+scale-like workload: motion compensation style 8-tap vertical
+ * filtering of blocks scattered over several reference frames, followed by a
+ * vertical downscale with swscale. Run it under e.g.
+ *     perf stat -e dTLB-loads,dTLB-load-misses tools/frame_pool_bench
+ * to see the TLB misses.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/buffer.h"
+#include "libavutil/common.h"
+#include "libavutil/time.h"
+
+#include "libswscale/swscale.h"
+
+#define NB_REFS   4
+#define BLOCK     64
+#define MAX_MV    256
+#define NB_TAPS   8
+
+typedef struct Plane {
+    AVBufferRef *buf;
+    uint8_t     *data;
+} Plane;
+
+static const int taps[NB_TAPS] = { -1, 4, -11, 40, 40, -11, 4, -1 };
+
+static void mc_block(uint8_t *dst, const uint8_t *src, ptrdiff_t stride)
+{
+    for (int y = 0; y < BLOCK; y++) {
+        for (int x = 0; x < BLOCK; x++) {
+            int sum = 32;
+            for (int k = 0; k < NB_TAPS; k++)
+                sum += taps[k] * src[(y + k) * stride + x];
+            dst[y * stride + x] = av_clip_uint8(sum >> 6);
+        }
+    }
+}
+
+static long read_huge_pages_kb(void)
+{
+    char line[256];
+    long kb = -1;
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1)
+            break;
+    fclose(f);
+
+    return kb;
+}
+
+static int run(int width, int height, int nb_frames, size_t threshold)
+{
+    /* MC reads up to MAX_MV + NB_TAPS rows and columns outside the frame */
+    const int border   = MAX_MV + NB_TAPS;
+    const ptrdiff_t stride = FFALIGN(width + 2 * border, 64);
+    const size_t size  = stride * (height + 2 * border);
+    Plane refs[NB_REFS] = { { 0 } }, cur = { 0 }, scaled = { 0 };
+    AVBufferPool *pool, *scaled_pool;
+    struct SwsContext *sws;
+    unsigned seed = 1;
+    int64_t start, mc_time = 0, scale_time = 0;
+    long huge_kb;
+    int ret = 0;
+
+    av_buffer_pool_set_huge_page_threshold(threshold);
+    pool        = av_buffer_pool_init(size, NULL);
+    scaled_pool = av_buffer_pool_init(stride * (height / 2), NULL);
+    av_buffer_pool_set_huge_page_threshold(0);
+
+    sws = sws_getContext(width, height, AV_PIX_FMT_GRAY8,
+                         width, height / 2, AV_PIX_FMT_GRAY8,
+                         SWS_BICUBIC, NULL, NULL, NULL);
+    if (!pool || !scaled_pool || !sws) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    for (int i = 0; i < NB_REFS; i++) {
+        refs[i].buf = av_buffer_pool_get(pool);
+        if (!refs[i].buf) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        refs[i].data = refs[i].buf->data + border * stride + border;
+        for (size_t j = 0; j < size; j++)
+            refs[i].buf->data[j] = j * (i + 1);
+    }
+
+    for (int n = 0; n < nb_frames; n++) {
+        cur.buf    = av_buffer_pool_get(pool);
+        scaled.buf = av_buffer_pool_get(scaled_pool);
+        if (!cur.buf || !scaled.buf) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        cur.data = cur.buf->data + border * stride + border;
+
+        start = av_gettime_relative();
+        for (int y = 0; y + BLOCK <= height; y += BLOCK) {
+            for (int x = 0; x + BLOCK <= width; x += BLOCK) {
+                const Plane *ref = &refs[(seed >> 16) % NB_REFS];
+                int mvx, mvy;
+
+                seed = seed * 1664525 + 1013904223;
+                mvx  = (int)(seed >>  8 & 511) - MAX_MV;
+                mvy  = (int)(seed >> 20 & 511) - MAX_MV;
+
+                mc_block(cur.data + y * stride + x,
+                         ref->data + (y + mvy - NB_TAPS / 2) * stride + x + mvx,
+                         stride);
+            }
+        }
+        mc_time += av_gettime_relative() - start;
+
+        start = av_gettime_relative();
+        sws_scale(sws, (const uint8_t * const[]){ cur.data }, (const int[]){ stride },
+                  0, height, (uint8_t * const[]){ scaled.buf->data }, (const int[]){ stride });
+        scale_time += av_gettime_relative() - start;
+
+        /* the new frame replaces the oldest reference */
+        av_buffer_unref(&refs[n % NB_REFS].buf);
+        refs[n % NB_REFS] = cur;
+        cur.buf = NULL;
+        av_buffer_unref(&scaled.buf);
+    }
+
+    huge_kb = read_huge_pages_kb();
+    printf("%-9s mc %8.2f ms/frame, scale %8.2f ms/frame",
+           threshold ? "hugepages" : "default",
+           mc_time / 1000.0 / nb_frames, scale_time / 1000.0 / nb_frames);
+    if (huge_kb >= 0)
+        printf(", AnonHugePages %ld kB", huge_kb);
+    printf("\n");
+
+end:
+    for (int i = 0; i < NB_REFS; i++)
+        av_buffer_unref(&refs[i].buf);
+    av_buffer_unref(&cur.buf);
+    av_buffer_unref(&scaled.buf);
+    av_buffer_pool_uninit(&pool);
+    av_buffer_pool_uninit(&scaled_pool);
+    sws_freeContext(sws);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int width = 3840, height = 2160, nb_frames = 30;
+    int ret;
+
+    if (argc > 1 && sscanf(argv[1], "%dx%d", &width, &height) != 2 ||
+        argc > 2 && (nb_frames = atoi(argv[2])) <= 0 ||
+        argc > 3 || width < BLOCK || height < BLOCK) {
+        fprintf(stderr, "Usage: %s [WIDTHxHEIGHT [number of frames]]\n", argv[0]);
+        return 1;
+    }
+
+    for (int huge = 0; huge < 2; huge++) {
+        ret = run(width, height, nb_frames, huge);
+        if (ret < 0) {
+            fprintf(stderr, "Benchmark failed: %s\n", av_err2str(ret));
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+#!/bin/sh
+#
+# This file is part of FFmpeg.
+#
+# FFmpeg is free software; you can redistribute it and/or
+# modify it under the terms of the GNU Lesser General Public
+# License as published by the Free Software Foundation; either
+# version 2.1 of the License, or (at your option) any later version.
+#
+# FFmpeg is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with FFmpeg; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+# Measure the throughput of streamcopy remuxing (-c copy) with ffmpeg.
+
+set -e
+
+LC_ALL=C
+export LC_ALL
+
+show_help(){
+    cat <<EOF
+Usage: ./remux_bench.sh <ffmpeg> [<input.mp4> [<input.ts>]]
+
+Remux MP4 to Matroska and MPEG-TS to MP4 with -c copy, and print the rate
+in MB/s of input data. Without inputs, high bitrate test files are generated.
+Put the work directory on a tmpfs (TMPDIR) to leave the disks out.
+EOF
+    exit 1
+}
+
+test -n "$1" || show_help
+
+FFMPEG=$1
+WORKDIR=$(mktemp -d "${TMPDIR:-/tmp}/remux_bench.XXXXXX")
+trap 'rm -rf "$WORKDIR"' EXIT
+
+MP4=${2:-$WORKDIR/in.mp4}
+TS=${3:-$WORKDIR/in.ts}
+
+if [ -z "$2" ]; then
+    echo "Generating $MP4"
+    "$FFMPEG" -v error -f lavfi -i testsrc2=s=1920x1080:r=60:d=20 \
+              -f lavfi -i sine=d=20 -c:v mpeg4 -q:v 1 -c:a aac "$MP4"
+fi
+if [ -z "$3" ]; then
+    echo "Generating $TS"
+    "$FFMPEG" -v error -i "$MP4" -c copy -bsf:v dump_extra "$TS"
+fi
+
+# remux <input> <output> [<runs>]
+remux(){
+    best=
+    for run in $(seq ${3:-5}); do
+        rtime=$("$FFMPEG" -nostdin -nostats -benchmark -y -i "$1" -c copy "$2" 2>&1 |
+                sed -n 's/.*rtime=\([0-9.]*\)s.*/\1/p')
+        best=$(awk -v a="$best" -v b="$rtime" 'BEGIN { print (a == "" || b < a) ? b : a }')
+    done
+    size=$(wc -c < "$1")
+    echo "$size $best" | awk -v n="$(basename "$1") -> $(basename "$2")" \
+        '{ printf "%-24s %8.1f MB in %6.3f s: %8.1f MB/s\n", n, $1 / 1e6, $2, $1 / 1e6 / $2 }'
+}
+
+remux "$MP4" "$WORKDIR/out.mkv"
+remux "$TS"  "$WORKDIR/out.mp4"
@@ -0,0 +1,237 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Measure the cost of handing items between two threads through the fftools
+ * ThreadQueue, in the default locked mode and in the single-producer/
+ * single-consumer mode, with and without batching. Batched runs move the items
+ * with tq_send_batch()/tq_receive_batch().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libavutil/error.h"
+#include "libavutil/frame.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "libavcodec/packet.h"
+
+#include "fftools/thread_queue.h"
+
+typedef struct BenchContext {
+    ThreadQueue         *tq;
+    enum ThreadQueueType type;
+    unsigned             nb_streams;
+    int64_t              nb_items;
+    size_t               batch;
+    int                  errors;
+} BenchContext;
+
+static void items_free(enum ThreadQueueType type, void ***pitems, size_t nb)
+{
+    for (size_t i = 0; *pitems && i < nb; i++) {
+        if (type == THREAD_QUEUE_FRAMES)
+            av_frame_free((AVFrame**)&(*pitems)[i]);
+        else
+            av_packet_free((AVPacket**)&(*pitems)[i]);
+    }
+    av_freep(pitems);
+}
+
+static void **items_alloc(enum ThreadQueueType type, size_t nb)
+{
+    void **items = av_calloc(nb, sizeof(*items));
+
+    for (size_t i = 0; items && i < nb; i++) {
+        items[i] = type == THREAD_QUEUE_FRAMES ? (void*)av_frame_alloc() :
+                                                 (void*)av_packet_alloc();
+        if (!items[i])
+            items_free(type, &items, nb);
+    }
+
+    return items;
+}
+
+static void *receiver(void *arg)
+{
+    BenchContext *b = arg;
+    size_t nb = FFMAX(b->batch, 1);
+    void **items;
+    int *stream_idx;
+    int64_t expected = 0;
+
+    items      = items_alloc(b->type, nb);
+    stream_idx = av_calloc(nb, sizeof(*stream_idx));
+    if (!items || !stream_idx) {
+        b->errors++;
+        goto end;
+    }
+
+    while (1) {
+        int ret;
+
+        ret = b->batch > 1 ? tq_receive_batch(b->tq, stream_idx, items, nb) :
+                             tq_receive(b->tq, stream_idx, items[0]);
+        if (ret == AVERROR_EOF && stream_idx[0] < 0)
+            break;
+        if (ret < 0)
+            continue;
+
+        for (int i = 0; i < FFMAX(ret, 1); i++) {
+            int64_t pts = b->type == THREAD_QUEUE_FRAMES ?
+                          ((AVFrame*)items[i])->pts : ((AVPacket*)items[i])->pts;
+
+            if (pts != expected || stream_idx[i] != expected % b->nb_streams)
+                b->errors++;
+            expected++;
+
+            b->type == THREAD_QUEUE_FRAMES ? av_frame_unref(items[i]) :
+                                             av_packet_unref(items[i]);
+        }
+    }
+
+    if (expected != b->nb_items)
+        b->errors++;
+
+end:
+    items_free(b->type, &items, nb);
+    av_freep(&stream_idx);
+
+    return NULL;
+}
+
+static int run(enum ThreadQueueType type, int spsc, unsigned nb_streams,
+               size_t queue_size, size_t batch, int64_t nb_items)
+{
+    BenchContext b = { .type = type, .nb_streams = nb_streams,
+                       .nb_items = nb_items, .batch = batch };
+    size_t nb = FFMAX(batch, 1);
+    void **items = NULL;
+    unsigned *stream_idx = NULL;
+    pthread_t thread;
+    int64_t start, elapsed;
+    int ret;
+
+    b.tq = tq_alloc(nb_streams, queue_size, type);
+    if (!b.tq)
+        return AVERROR(ENOMEM);
+
+    tq_set_batch(b.tq, batch, 1000);
+
+    if (spsc) {
+        ret = tq_set_spsc(b.tq);
+        if (ret < 0)
+            goto end;
+    }
+
+    items      = items_alloc(type, nb);
+    stream_idx = av_calloc(nb, sizeof(*stream_idx));
+    if (!items || !stream_idx) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    start = av_gettime_relative();
+
+    ret = pthread_create(&thread, NULL, receiver, &b);
+    if (ret) {
+        ret = AVERROR(ret);
+        goto end;
+    }
+
+    for (int64_t i = 0; i < nb_items;) {
+        size_t n = FFMIN(nb, nb_items - i);
+
+        for (size_t j = 0; j < n; j++) {
+            if (type == THREAD_QUEUE_FRAMES)
+                ((AVFrame*)items[j])->pts  = i + j;
+            else
+                ((AVPacket*)items[j])->pts = i + j;
+            stream_idx[j] = (i + j) % nb_streams;
+        }
+
+        if (batch > 1) {
+            ret = tq_send_batch(b.tq, stream_idx, items, n);
+            if (ret < (int)n) {
+                ret = ret < 0 ? ret : AVERROR_BUG;
+                break;
+            }
+        } else {
+            ret = tq_send(b.tq, stream_idx[0], items[0]);
+            if (ret < 0)
+                break;
+        }
+        i += n;
+    }
+    for (unsigned i = 0; i < nb_streams; i++)
+        tq_send_finish(b.tq, i);
+
+    pthread_join(thread, NULL);
+
+    elapsed = av_gettime_relative() - start;
+
+    printf("%-7s %-6s streams=%-3u queue=%-4zu batch=%-4zu %10.1f ns/item%s\n",
+           type == THREAD_QUEUE_FRAMES ? "frames" : "packets",
+           spsc ? "spsc" : "locked", nb_streams, queue_size, batch,
+           elapsed * 1000.0 / nb_items, b.errors ? " ERRORS" : "");
+    if (b.errors)
+        ret = AVERROR_BUG;
+
+end:
+    items_free(type, &items, nb);
+    av_freep(&stream_idx);
+    tq_free(&b.tq);
+    return ret < 0 ? ret : 0;
+}
+
+int main(int argc, char **argv)
+{
+    static const size_t queue_sizes[] = { 1, 8, 64 };
+    int64_t nb_items = 1000000;
+    int ret = 0;
+
+    if (argc > 2 || (argc == 2 && (nb_items = strtoll(argv[1], NULL, 0)) <= 0)) {
+        fprintf(stderr, "Usage: %s [number of items]\n", argv[0]);
+        return 1;
+    }
+
+    for (int type = 0; type < 2; type++)
+        for (int q = 0; q < FF_ARRAY_ELEMS(queue_sizes); q++)
+            for (int spsc = 0; spsc < 4; spsc++) {
+                enum ThreadQueueType t = type ? THREAD_QUEUE_FRAMES : THREAD_QUEUE_PACKETS;
+                size_t batch = spsc & 2 ? queue_sizes[q] : 0;
+                int err;
+
+                if (batch == 1)
+                    continue;
+
+                err = run(t, spsc & 1, 1, queue_sizes[q], batch, nb_items);
+                if (err >= 0)
+                    err = run(t, spsc & 1, 4, queue_sizes[q], batch, nb_items);
+                if (err < 0) {
+                    fprintf(stderr, "Benchmark failed: %s\n", av_err2str(err));
+                    ret = 1;
+                }
+            }
+
+    return ret;
+}